@@ -3,6 +3,13 @@
 #include "fts_fuzzy_match.h"
 #include "plugin/search.h"
 #include "plugin/utilities.h"
+#include "plugin/tracing.h"
+#include "plugin/metrics.h"
+#include "plugin/mappedFile.h"
+#include "plugin/endpointHealth.h"
+#include "plugin/connectionPool.h"
+#include "plugin/localServer.h"
+#include "plugin/settings.h"
 #include <string>
 #include <algorithm>
 #include <sstream>
@@ -30,6 +37,96 @@
 
 using namespace std;
 
+// Largest cover image fetched from the backend for a thumbnail
+static const size_t MAX_COVER_BYTES = 8 * 1024 * 1024;
+
+CAMP::~CAMP()
+{
+    logDebug("Unloading");
+    setConnectivityListener(nullptr);
+    // Ask everything to wind down first, then abort what is on the network so nothing below
+    // waits for a transfer, then wait for the threads. Nothing may run once the module is gone.
+    backgroundTasks.requestStop();
+    stopTransfers();
+    // Its handlers read the intro slab and the thumbnail pack
+    getLocalServer().stop();
+    introCache.stop();
+    thumbnailCache.stop();
+    folderCache.stop();
+    streamUrlCache.stop();
+    searchWorker.stop();
+    backgroundTasks.stop();
+    // Last, as downloads finishing above still record into them
+    integrityIndex.stop();
+    metadataIndex.stop();
+    stopMetricsDumper();
+    stopTraceDumper();
+    logDebug("Unloaded");
+}
+
+HRESULT VDJ_API CAMP::OnLoad()
+{
+    logDebug("OnLoad called");
+    // Loaded again after an earlier instance stopped them
+    resumeTransfers();
+    startTraceDumper();
+    startMetricsDumper();
+    // Intro snippets of browsed tracks live next to the cached tracks
+    std::string cacheDir = getCacheDir();
+    if (!cacheDir.empty()) {
+        cacheLocks.open(joinPath(cacheDir, ".cache_lock"));
+        manifestJournal.open(cacheDir, &cacheLocks);
+        deferredPosts.open(cacheDir, &cacheLocks);
+        // The intro slab and thumbnail pack are written in place, so only one process can use them
+        if (!cacheLocks.tryLock(hashString(".intro_slab"))) {
+            logDebug("Another VirtualDJ is using the intro and thumbnail caches; going without them");
+            cacheDir.clear();
+        }
+    }
+#ifdef VDJ_WIN
+    std::string slabPath = cacheDir.empty() ? "" : cacheDir + "\\.intro_slab";
+#else
+    std::string slabPath = cacheDir.empty() ? "" : cacheDir + "/.intro_slab";
+#endif
+    introCache.configure(slabPath, [this](const std::string& url, uint64_t offset, uint64_t length, TransferPriority priority,
+                                          const IntroCache::RangeSink& sink, IntroCache::RangeInfo& info) {
+        return httpGetRange(url, offset, length, priority, sink, info);
+    });
+#ifdef VDJ_WIN
+    std::string thumbnailPath = cacheDir.empty() ? "" : cacheDir + "\\.thumbnails";
+#else
+    std::string thumbnailPath = cacheDir.empty() ? "" : cacheDir + "/.thumbnails";
+#endif
+    thumbnailCache.configure(thumbnailPath, [this](const std::string& url, std::string& image) {
+        IntroCache::RangeInfo info;
+        bool complete = httpGetRange(url, 0, 0, TransferPriority::Background, [&image](const char* data, size_t size) {
+            // Covers are small; anything bigger isn't worth a thumbnail
+            if (image.size() + size > MAX_COVER_BYTES) {
+                image.clear();
+                return false;
+            }
+            image.append(data, size);
+            return true;
+        }, info);
+        return complete && !image.empty();
+    });
+    streamUrlCache.configure([this](const std::string& url, std::string& finalUrl, int64_t& expiresAt) {
+        return resolveFinalUrl(url, finalUrl, expiresAt);
+    });
+    // Listings on disk stand in for the backend while it is unreachable
+    folderCache.setOfflineCheck(isHostOffline);
+    // A catalog refreshed in the background is searched right away, not on the next load
+    folderCache.setUpdateListener([this](const std::string& url, const std::shared_ptr<const FolderListing>& listing) {
+        if (url == getApiBaseUrl() + "/api/tracks") {
+            publishCatalog(listing, getLoadedCatalog());
+        }
+    });
+    setConnectivityListener([this](const std::string& host, bool offline) { onConnectivityChanged(host, offline); });
+    // Get the catalog, folder list and connections ready before the first browse
+    startWarmUp();
+    return S_OK;
+}
+
 HRESULT VDJ_API CAMP::OnGetPluginInfo(TVdjPluginInfo8* infos)
 {
     logDebug("OnGetPluginInfo called");
@@ -45,35 +142,46 @@ HRESULT VDJ_API CAMP::OnGetPluginInfo(TVdjPluginInfo8* infos)
 
 HRESULT VDJ_API CAMP::OnSearch(const char* search, IVdjTracksList* tracksList)
 {
+    TRACE_SPAN("OnSearch");
     return ::search(this, search, tracksList);
 }
 
 HRESULT VDJ_API CAMP::OnSearchCancel()
 {
+    TRACE_SPAN("OnSearchCancel");
     logDebug("OnSearchCancel called");
     // Internet::closeDownloads();
+    {
+        // Any server search still in flight must not touch the cancelled list
+        std::lock_guard<std::mutex> lock(searchMutex);
+        searchGeneration++;
+    }
     logDebug("OnSearchCancel completed");
     return S_OK;
 }
 
 HRESULT VDJ_API CAMP::GetStreamUrl(const char* uniqueId, IVdjString& url, IVdjString& errorMessage)
 {
+    TRACE_SPAN("GetStreamUrl");
     return ::getStreamUrl(this, uniqueId, url, errorMessage);
 }
 
 HRESULT VDJ_API CAMP::GetFolderList(IVdjSubfoldersList* subfoldersList)
 {
+    TRACE_SPAN("GetFolderList");
     // return ::getFolderList(this, subfoldersList);
     return S_OK;
 }
 
 HRESULT VDJ_API CAMP::GetFolder(const char* folderUniqueId, IVdjTracksList* tracksList)
 {
+    TRACE_SPAN("GetFolder");
     return ::getFolder(this, folderUniqueId, tracksList);
 }
 
 HRESULT VDJ_API CAMP::GetContextMenu(const char* uniqueId, IVdjContextMenu* contextMenu)
 {
+    TRACE_SPAN("GetContextMenu");
     string id = uniqueId ? uniqueId : "(null)";
     logDebug("GetContextMenu called with uniqueId: '" + id + "'");
 
@@ -89,6 +197,7 @@ HRESULT VDJ_API CAMP::GetContextMenu(const char* uniqueId, IVdjContextMenu* cont
 
 HRESULT VDJ_API CAMP::OnContextMenu(const char* uniqueId, size_t menuIndex)
 {
+    TRACE_SPAN("OnContextMenu");
     string id = uniqueId ? uniqueId : "(null)";
     logDebug("OnContextMenu called with uniqueId: '" + id + "', menuIndex: " + to_string(menuIndex));
     
@@ -7,22 +7,32 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
+#include <unordered_set>
+#include <unordered_map>
+#include <chrono>
 
 #include "vdjOnlineSource.h"
+#include "plugin/trackInfo.h"
+#include "plugin/searchCache.h"
+#include "plugin/folderCache.h"
+#include "plugin/streamUrlCache.h"
+#include "plugin/introCache.h"
+#include "plugin/metadataIndex.h"
+#include "plugin/thumbnailCache.h"
+#include "plugin/integrityIndex.h"
+#include "plugin/lockFile.h"
+#include "plugin/manifestJournal.h"
+#include "plugin/deferredPosts.h"
+#include "plugin/backgroundTasks.h"
+#include "plugin/internet.h"
 #include "plugin/search.h"
 #include "plugin/streamUrl.h"
 #include "plugin/getFolderList.h"
 #include "plugin/getFolder.h"
 
-// Simple structure to hold track information
-struct TrackInfo {
-    std::string uniqueId;
-    std::string name;
-    std::string directory;
-    std::string url;
-    int size;
-};
-
 // Forward declare the search function so we can friend it.
 HRESULT search(class CAMP* plugin, const char* searchTerm, class IVdjTracksList* tracks);
 HRESULT getStreamUrl(class CAMP* plugin, const char* uniqueId, class IVdjString& url, class IVdjString& errorMessage);
@@ -37,7 +47,13 @@ public:
     friend HRESULT getStreamUrl(CAMP* plugin, const char* uniqueId, IVdjString& url, IVdjString& errorMessage);
     friend HRESULT getFolderList(CAMP* plugin, IVdjSubfoldersList* subfoldersList);
     friend HRESULT getFolder(CAMP* plugin, const char* folderUniqueId, IVdjTracksList* tracksList);
+    // bench/micro measures the private helpers directly
+    friend class CAMPBenchAccess;
+
+    // VirtualDJ deletes the plugin through Release() when unloading it
+    ~CAMP() override;
 
+    HRESULT VDJ_API OnLoad() override;
     HRESULT VDJ_API OnGetPluginInfo(TVdjPluginInfo8* infos) override;
     
     // Login methods
@@ -57,18 +73,45 @@ public:
 
 private:
     // Caching
-    void ensureTracksAreCached();
+    std::shared_ptr<const FolderListing> ensureTracksAreCached();
+    std::shared_ptr<const FolderListing> getLoadedCatalog();
+    void publishCatalog(const std::shared_ptr<const FolderListing>& listing, const std::shared_ptr<const FolderListing>& replacing);
     void downloadTrackToCache(const char* uniqueId);
     void deleteTrackFromCache(const char* uniqueId);
     bool isTrackCached(const char* uniqueId);
-    std::string getCacheDir();
+    const std::string& getCacheDir();
+    std::string getCacheFileNameForTrack(const char* uniqueId);
     std::string getCachePathForTrack(const char* uniqueId);
+    std::vector<std::string> listCachedFiles();
+    std::vector<std::string> scanCacheDir(std::vector<std::string>* partFiles = nullptr);
+    void buildCacheManifest();
+    void removeOrphanedPartFilesLocked(const std::vector<std::string>& partFiles);
+    void addToCacheManifest(const std::string& fileName);
+    void removeFromCacheManifest(const std::string& fileName);
+    void refreshCacheManifest();
+    void dropDamagedCacheFile(const std::string& fileName);
+
+    // Warm-up of catalog, folder list, connections and cache manifest
+    void startWarmUp();
+
+    // Offline mode, entered and left as the backend becomes unreachable and reachable again
+    void onConnectivityChanged(const std::string& host, bool offline);
+    void startReconnectProbe();
+    void sendPlayCount(const std::string& uniqueId);
     std::string getEncodedLocalPathForTrack(const char* uniqueId);
+    std::string getFileUrlForCacheFile(const std::string& fileName);
+    bool findCachedTrack(const TrackInfo& track, std::string& localUrl);
+    std::string getCoverUrlForTrack(const TrackInfo& track, bool cached);
 
     // HTTP and JSON parsing functions
     std::string httpGet(const std::string& url);
-    void httpPost(const std::string& url, const std::string& postData);
-    bool downloadFile(const std::string& url, const std::string& filePath);
+    HttpResponse httpGetConditional(const std::string& url, const std::string& etag);
+    HttpResponse httpGetAllPages(const std::string& url, const std::string& arrayKey, const std::string& etag);
+    bool httpPost(const std::string& url, const std::string& postData);
+    bool downloadFile(const std::string& url, const std::string& filePath, std::string& sha256);
+    bool resolveFinalUrl(const std::string& url, std::string& finalUrl, int64_t& expiresAt);
+    bool httpGetRange(const std::string& url, uint64_t offset, uint64_t length, TransferPriority priority,
+                      const IntroCache::RangeSink& sink, IntroCache::RangeInfo& info);
     std::vector<TrackInfo> parseTracksFromJson(const std::string& jsonString);
     std::string urlEncode(const std::string& value);
     
@@ -78,9 +121,72 @@ private:
     int getStoredSearchResultLimit();
     void storeSearchResultLimit(int limit);
     
-    std::vector<TrackInfo> cachedTracks;
-    bool tracksCached = false;
+    // Full track catalog, shared so readers can keep using a snapshot while it is refreshed
+    std::shared_ptr<const FolderListing> catalog;
+    std::mutex catalogMutex;     // guards the catalog pointer
+    std::mutex catalogLoadMutex; // held while loading, so concurrent callers wait instead of refetching
+
+    // AMP cache folder, found and created on first use, and its file:// URL
+    std::once_flag cacheDirOnce;
+    std::string cacheDirPath;
+    std::string cacheDirUrl;
+
+    // File names in the AMP cache folder, once buildCacheManifest has run, with their file:// URLs
+    std::mutex manifestMutex;
+    std::unordered_map<std::string, std::string> cacheManifest;
+    bool manifestReady = false;
+    std::chrono::steady_clock::time_point manifestCheckedAt; // last look at other processes' changes
+    bool manifestRefreshing = false;                          // a thread is reading their changes
+    std::unordered_set<std::string> downloadsInFlight;        // file names, guarded by manifestMutex
+
+    // Coordination with other VirtualDJ processes using the same cache folder
+    LockFile cacheLocks;
+    ManifestJournal manifestJournal;
+
+    std::atomic<bool> warmUpStarted{false};
+    std::atomic<bool> reconnectProbeRunning{false};
     int searchResultLimit = 50; // Default to 50 results
+
+    // Guards the search state below; background server searches emit results while holding it
+    std::mutex searchMutex;
+    unsigned int searchGeneration = 0; // bumped by every new search and by OnSearchCancel
+
+    // Incremental search: results of the previous query, refined locally while the user keeps typing
+    std::string lastSearchQuery;
+    std::vector<TrackInfo> lastSearchResults;
+    int lastSearchLimit = 0;
+    bool lastSearchComplete = false; // true when the backend returned fewer results than the limit
+
+    // Parsed search results of recent queries
+    SearchResultCache searchCache;
+
+    // The server half of searches, one at a time
+    SearchWorker searchWorker;
+
+    // Folder listings and the fields list, served stale-while-revalidate
+    FolderCache folderCache;
+
+    // Where stream URLs end up after the backend's redirects
+    StreamUrlCache streamUrlCache;
+
+    // First seconds of the tracks being browsed, for instant cue of uncached tracks
+    IntroCache introCache;
+
+    // Tags of the cached files, for the length, BPM, key, year and genre columns
+    MetadataIndex metadataIndex;
+
+    // Cover thumbnails for the browser, served by the local server
+    ThumbnailCache thumbnailCache;
+
+    // SHA-256 of the cached files, to catch damaged ones before they are played
+    IntegrityIndex integrityIndex;
+
+    // Play counts made while offline, sent once the backend is back
+    DeferredPosts deferredPosts;
+
+    // Server searches, downloads, warm-up and the other work the callbacks leave running,
+    // joined before the plugin goes away
+    BackgroundTasks backgroundTasks;
 };
 
 #endif
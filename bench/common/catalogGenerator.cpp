@@ -0,0 +1,153 @@
+#include "catalogGenerator.h"
+#include <random>
+#include <cctype>
+
+namespace {
+
+const char* const kArtists[] = {
+    "Drake", "Bad Bunny", "Beyoncé", "Calvin Harris", "Dua Lipa", "Kendrick Lamar", "Rihanna",
+    "The Weeknd", "Daddy Yankee", "J Balvin", "Ñengo Flow", "Rosalía", "David Guetta", "Tiësto",
+    "Burna Boy", "Wizkid", "Davido", "Tems", "Sean Paul", "Shaggy", "Vybz Kartel", "Marshmello",
+    "Skrillex", "Fred again..", "Peggy Gou", "Black Coffee", "Karol G", "Anitta", "Ozuna",
+    "Post Malone", "Doja Cat", "SZA", "Future", "Travis Scott", "21 Savage", "Metro Boomin",
+    "Lil Baby", "Megan Thee Stallion", "Cardi B", "Nicki Minaj", "Usher", "Chris Brown",
+    "Bruno Mars", "Ed Sheeran", "Harry Styles", "Taylor Swift", "Ariana Grande", "Sia",
+    "Avicii", "Kygo", "Zedd", "Diplo", "Major Lazer", "DJ Snake", "Martin Garrix", "Alesso",
+    "Café Tacvba", "Motörhead", "Sigur Rós", "Øneheart",
+};
+
+const char* const kTitleWords[] = {
+    "Love", "Night", "Fire", "Dance", "Heart", "Money", "Summer", "Party", "Baby", "Girl",
+    "Tonight", "Forever", "Dreams", "Body", "Feel", "Crazy", "Gold", "Wild", "Rain", "Sun",
+    "Lights", "City", "Paradise", "Fever", "Rhythm", "Soul", "Hold", "Move", "Energy", "Freedom",
+    "Corazón", "Noche", "Fuego", "Bailar", "Mañana", "Señorita", "Vida", "Amor", "Calor", "Playa",
+    "Higher", "Closer", "Faded", "Alone", "Runaway", "Diamonds", "Thunder", "Wave", "Electric", "Neon",
+};
+
+const char* const kVersions[] = {
+    "", "", "", " (Extended Mix)", " (Radio Edit)", " (Intro)", " (Clean)", " (Dirty)",
+    " (Acapella)", " (Instrumental)", " (Quick Hit)", " (Remix)", " (Club Mix)", " (Transition)",
+};
+
+const char* const kPrefixes[] = {
+    "", "", "", "", "(Clean) ", "(Dirty) ", "[128 BPM] ", "(2019) ", "(Intro) ",
+};
+
+const std::vector<std::string> kGenres = {
+    "Afrobeats", "Amapiano", "Bachata", "Dancehall", "Deep House", "Disco", "Drum & Bass",
+    "EDM", "Hip Hop", "House", "Latin", "Moombahton", "Old School", "Pop", "R&B",
+    "Reggae", "Reggaeton", "Soca", "Tech House", "Trap",
+};
+
+template <typename T, size_t N>
+const T& pick(const T (&items)[N], std::mt19937& rng) {
+    return items[rng() % N];
+}
+
+void appendJsonString(std::string& out, const std::string& value) {
+    out += '"';
+    for (char c : value) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    out += '"';
+}
+
+std::string urlEncodePath(const std::string& value) {
+    static const char* hex = "0123456789ABCDEF";
+    std::string encoded;
+    for (unsigned char c : value) {
+        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || c == '/') {
+            encoded += (char)c;
+        } else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 15];
+        }
+    }
+    return encoded;
+}
+
+} // namespace
+
+const std::vector<std::string>& generatedGenres() {
+    return kGenres;
+}
+
+std::vector<GeneratedTrack> generateCatalog(size_t count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<GeneratedTrack> catalog;
+    catalog.reserve(count);
+
+    for (size_t i = 0; i < count; i++) {
+        std::string artist = pick(kArtists, rng);
+        if (rng() % 5 == 0) {
+            artist += std::string(" ft. ") + pick(kArtists, rng);
+        }
+
+        std::string title = pick(kTitleWords, rng);
+        for (int words = rng() % 3; words > 0; words--) {
+            title += std::string(" ") + pick(kTitleWords, rng);
+        }
+
+        GeneratedTrack track;
+        track.genre = kGenres[rng() % kGenres.size()];
+        track.fileName = std::string(pick(kPrefixes, rng)) + artist + " - " + title + pick(kVersions, rng) +
+                         (rng() % 20 == 0 ? ".mp4" : ".mp3");
+        // Keep uniqueIds unique even when the generated names collide
+        track.cleanPath = track.genre + "/" + std::to_string(i) + "/" + track.fileName;
+        catalog.push_back(std::move(track));
+    }
+    return catalog;
+}
+
+std::vector<std::string> generateKeystrokeTrace(const std::vector<GeneratedTrack>& catalog, size_t traceCount, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::vector<std::string> keystrokes;
+    if (catalog.empty()) return keystrokes;
+
+    for (size_t i = 0; i < traceCount; i++) {
+        // Type "<artist> <first title word>" the way someone looking for a track would
+        const std::string& fileName = catalog[rng() % catalog.size()].fileName;
+        size_t dash = fileName.find(" - ");
+        if (dash == std::string::npos) continue;
+
+        std::string artist = fileName.substr(0, dash);
+        if (!artist.empty() && (artist[0] == '(' || artist[0] == '[')) {
+            artist = artist.substr(artist.find(' ') + 1);
+        }
+        size_t titleEnd = fileName.find_first_of(" .(", dash + 3);
+        std::string typed = artist + " " + fileName.substr(dash + 3, titleEnd - dash - 3);
+
+        for (size_t len = 1; len <= typed.size(); len++) {
+            // Don't stop in the middle of a UTF-8 sequence
+            if (len < typed.size() && ((unsigned char)typed[len] & 0xC0) == 0x80) continue;
+            keystrokes.push_back(typed.substr(0, len));
+        }
+    }
+    return keystrokes;
+}
+
+std::string trackToJson(const GeneratedTrack& track, const std::string& tracksBaseUrl) {
+    std::string json = "{\"fileName\":";
+    appendJsonString(json, track.fileName);
+    json += ",\"cleanPath\":";
+    appendJsonString(json, track.cleanPath);
+    json += ",\"fullUrl\":";
+    appendJsonString(json, tracksBaseUrl + "/audio/" + urlEncodePath(track.cleanPath));
+    json += ",\"field\":";
+    appendJsonString(json, track.genre);
+    json += '}';
+    return json;
+}
+
+std::string catalogToJson(const std::vector<GeneratedTrack>& catalog, const std::string& tracksBaseUrl) {
+    std::string json = "{\"results\":[";
+    json.reserve(catalog.size() * 200);
+    for (size_t i = 0; i < catalog.size(); i++) {
+        if (i > 0) json += ',';
+        json += trackToJson(catalog[i], tracksBaseUrl);
+    }
+    json += "],\"total\":" + std::to_string(catalog.size()) + "}";
+    return json;
+}
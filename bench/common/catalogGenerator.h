@@ -0,0 +1,31 @@
+#ifndef AMP_BENCH_CATALOGGENERATOR_H
+#define AMP_BENCH_CATALOGGENERATOR_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// One track as the backend describes it
+struct GeneratedTrack {
+    std::string fileName;  // "(Clean) Artist - Title (Extended Mix).mp3"
+    std::string cleanPath; // "<genre>/<fileName>", the plugin's uniqueId
+    std::string genre;     // folder (field) the track belongs to
+};
+
+// Deterministic catalog of DJ-pool style file names
+std::vector<GeneratedTrack> generateCatalog(size_t count, uint32_t seed = 1);
+
+// Genres used by generateCatalog, i.e. the folder list
+const std::vector<std::string>& generatedGenres();
+
+// Successive search box contents while typing "<artist> <title word>" for traceCount random tracks, one entry per keystroke
+std::vector<std::string> generateKeystrokeTrace(const std::vector<GeneratedTrack>& catalog, size_t traceCount, uint32_t seed = 1);
+
+// One track as an /api/tracks result object
+std::string trackToJson(const GeneratedTrack& track, const std::string& tracksBaseUrl);
+
+// The catalog as an /api/tracks style JSON body ({"results":[...],"total":N})
+std::string catalogToJson(const std::vector<GeneratedTrack>& catalog, const std::string& tracksBaseUrl);
+
+#endif // AMP_BENCH_CATALOGGENERATOR_H
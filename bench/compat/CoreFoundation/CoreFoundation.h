@@ -0,0 +1,12 @@
+// Stand-in for the one Apple header vdjPlugin8.h needs, so the plugin's
+// POSIX/libcurl code paths can be compiled headless on Linux.
+#ifndef AMP_BENCH_COREFOUNDATION_H
+#define AMP_BENCH_COREFOUNDATION_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void* CFBundleRef;
+
+#endif
@@ -0,0 +1,10 @@
+// Stand-in for <MacTypes.h>, see CoreFoundation/CoreFoundation.h
+#ifndef AMP_BENCH_MACTYPES_H
+#define AMP_BENCH_MACTYPES_H
+
+#include <stdint.h>
+
+typedef int32_t SInt32;
+typedef uint32_t UInt32;
+
+#endif
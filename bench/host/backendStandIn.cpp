@@ -0,0 +1,459 @@
+#include "backendStandIn.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <sstream>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace {
+
+std::string urlDecode(const std::string& value, bool plusIsSpace) {
+    std::string decoded;
+    for (size_t i = 0; i < value.size(); i++) {
+        if (value[i] == '%' && i + 2 < value.size() && isxdigit((unsigned char)value[i + 1]) && isxdigit((unsigned char)value[i + 2])) {
+            decoded += (char)std::stoi(value.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        } else if (value[i] == '+' && plusIsSpace) {
+            decoded += ' ';
+        } else {
+            decoded += value[i];
+        }
+    }
+    return decoded;
+}
+
+std::string toLower(std::string value) {
+    for (char& c : value) c = (char)tolower((unsigned char)c);
+    return value;
+}
+
+// Value of "key":"..." inside one JSON object, or empty
+std::string jsonStringField(const std::string& object, const std::string& key) {
+    size_t pos = object.find("\"" + key + "\"");
+    if (pos == std::string::npos) return "";
+    pos = object.find('"', object.find(':', pos) + 1);
+    if (pos == std::string::npos) return "";
+    std::string value;
+    for (pos++; pos < object.size() && object[pos] != '"'; pos++) {
+        if (object[pos] == '\\' && pos + 1 < object.size()) pos++;
+        value += object[pos];
+    }
+    return value;
+}
+
+// gzip member of data, as Content-Encoding: gzip expects
+std::string gzipCompress(const std::string& data) {
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) return "";
+    std::string compressed(deflateBound(&stream, data.size()), '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = (uInt)data.size();
+    stream.next_out = (Bytef*)&compressed[0];
+    stream.avail_out = (uInt)compressed.size();
+    int result = deflate(&stream, Z_FINISH);
+    compressed.resize(stream.total_out);
+    deflateEnd(&stream);
+    return result == Z_STREAM_END ? compressed : "";
+}
+
+const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 206: return "Partial Content";
+        case 304: return "Not Modified";
+        case 404: return "Not Found";
+        case 416: return "Range Not Satisfiable";
+        default: return "Error";
+    }
+}
+
+} // namespace
+
+BackendStandIn::BackendStandIn() {}
+
+BackendStandIn::~BackendStandIn() {
+    stop();
+}
+
+bool BackendStandIn::start(int port) {
+    // A client hanging up mid-response must not kill the benchmark
+    signal(SIGPIPE, SIG_IGN);
+
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) return false;
+    int yes = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons((uint16_t)port);
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 128) != 0) {
+        close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+
+    socklen_t length = sizeof(address);
+    getsockname(listenFd, (sockaddr*)&address, &length);
+    listenPort = ntohs(address.sin_port);
+
+    running = true;
+    acceptThread = std::thread(&BackendStandIn::acceptLoop, this);
+    return true;
+}
+
+void BackendStandIn::stop() {
+    if (!running.exchange(false)) return;
+
+    shutdown(listenFd, SHUT_RDWR);
+    close(listenFd);
+    listenFd = -1;
+    if (acceptThread.joinable()) acceptThread.join();
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        for (int fd : connections) shutdown(fd, SHUT_RDWR);
+        threads.swap(connectionThreads);
+    }
+    for (auto& thread : threads) thread.join();
+}
+
+std::string BackendStandIn::baseUrl() const {
+    return "http://127.0.0.1:" + std::to_string(listenPort);
+}
+
+void BackendStandIn::setCatalog(const std::vector<GeneratedTrack>& catalog) {
+    std::lock_guard<std::mutex> lock(catalogMutex);
+    tracks = catalog;
+    trackJson.clear();
+    trackNamesLower.clear();
+    tracksByGenre.clear();
+    trackJson.reserve(catalog.size());
+    trackNamesLower.reserve(catalog.size());
+
+    for (size_t i = 0; i < catalog.size(); i++) {
+        trackJson.push_back(trackToJson(catalog[i], baseUrl()));
+        trackNamesLower.push_back(toLower(catalog[i].fileName));
+        tracksByGenre[catalog[i].genre].push_back(i);
+    }
+    catalogVersion++;
+}
+
+std::vector<GeneratedTrack> BackendStandIn::getCatalog() {
+    std::lock_guard<std::mutex> lock(catalogMutex);
+    return tracks;
+}
+
+bool BackendStandIn::loadFixtures(const std::string& directory) {
+    std::ifstream tracksFile(directory + "/tracks.json", std::ios::binary);
+    if (!tracksFile) return false;
+    std::stringstream buffer;
+    buffer << tracksFile.rdbuf();
+    std::string json = buffer.str();
+
+    // Recorded catalogs only need fileName and cleanPath; the folder is the first path segment
+    std::vector<GeneratedTrack> catalog;
+    size_t pos = json.find('[');
+    while (pos != std::string::npos) {
+        size_t objStart = json.find('{', pos);
+        if (objStart == std::string::npos) break;
+        size_t objEnd = json.find('}', objStart);
+        if (objEnd == std::string::npos) break;
+        std::string object = json.substr(objStart, objEnd - objStart + 1);
+        pos = objEnd + 1;
+
+        GeneratedTrack track;
+        track.fileName = jsonStringField(object, "fileName");
+        track.cleanPath = jsonStringField(object, "cleanPath");
+        track.genre = jsonStringField(object, "field");
+        if (track.genre.empty()) track.genre = track.cleanPath.substr(0, track.cleanPath.find('/'));
+        if (!track.fileName.empty() && !track.cleanPath.empty()) catalog.push_back(track);
+    }
+    if (catalog.empty()) return false;
+    setCatalog(catalog);
+
+    std::ifstream audioFile(directory + "/audio.mp3", std::ios::binary);
+    if (audioFile) {
+        std::stringstream audio;
+        audio << audioFile.rdbuf();
+        std::lock_guard<std::mutex> lock(catalogMutex);
+        audioFixture = audio.str();
+    }
+    return true;
+}
+
+void BackendStandIn::acceptLoop() {
+    while (running) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) {
+            if (!running) break;
+            continue;
+        }
+        int yes = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        std::lock_guard<std::mutex> lock(connectionsMutex);
+        connections.insert(fd);
+        connectionThreads.emplace_back(&BackendStandIn::serveConnection, this, fd);
+    }
+}
+
+void BackendStandIn::serveConnection(int fd) {
+    std::string buffer;
+    char chunk[16384];
+    bool keepAlive = true;
+
+    while (keepAlive && running) {
+        // Read one request head
+        size_t headerEnd;
+        while ((headerEnd = buffer.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) goto done;
+            buffer.append(chunk, received);
+        }
+
+        Request request;
+        {
+            std::istringstream head(buffer.substr(0, headerEnd));
+            std::string line, target, version;
+            std::getline(head, line);
+            std::istringstream requestLine(line);
+            requestLine >> request.method >> target >> version;
+
+            while (std::getline(head, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                size_t colon = line.find(':');
+                if (colon == std::string::npos) continue;
+                std::string value = line.substr(colon + 1);
+                value.erase(0, value.find_first_not_of(' '));
+                request.headers[toLower(line.substr(0, colon))] = value;
+            }
+
+            size_t question = target.find('?');
+            request.path = urlDecode(target.substr(0, question), false);
+            if (question != std::string::npos) {
+                std::istringstream query(target.substr(question + 1));
+                std::string pair;
+                while (std::getline(query, pair, '&')) {
+                    size_t equals = pair.find('=');
+                    request.query[urlDecode(pair.substr(0, equals), true)] =
+                        equals == std::string::npos ? "" : urlDecode(pair.substr(equals + 1), true);
+                }
+            }
+            keepAlive = version == "HTTP/1.1" && toLower(request.headers["connection"]) != "close";
+        }
+        buffer.erase(0, headerEnd + 4);
+
+        size_t contentLength = request.headers.count("content-length") ? std::stoul(request.headers["content-length"]) : 0;
+        while (buffer.size() < contentLength) {
+            ssize_t received = recv(fd, chunk, sizeof(chunk), 0);
+            if (received <= 0) goto done;
+            buffer.append(chunk, received);
+        }
+        request.body = buffer.substr(0, contentLength);
+        buffer.erase(0, contentLength);
+
+        size_t requestNumber = ++requests;
+        Response response = route(request);
+
+        if (latencyMs > 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(latencyMs.load()));
+        }
+        int every = stallEvery;
+        if (every > 0 && requestNumber % every == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(stallMs.load()));
+        }
+
+        bool compress = gzip && response.status == 200 && response.contentType == "application/json" &&
+                        response.body.size() >= 1024 &&
+                        toLower(request.headers["accept-encoding"]).find("gzip") != std::string::npos;
+        if (compress) {
+            response.body = gzipBody(response);
+        }
+
+        std::string head = "HTTP/1.1 " + std::to_string(response.status) + " " + statusText(response.status) + "\r\n";
+        head += "Content-Type: " + response.contentType + "\r\n";
+        if (compress) head += "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n";
+        if (!response.etag.empty()) head += "ETag: " + response.etag + "\r\n";
+        if (response.contentType == "audio/mpeg") head += "Accept-Ranges: bytes\r\n";
+        if (!response.contentRange.empty()) head += "Content-Range: " + response.contentRange + "\r\n";
+        head += "Content-Length: " + std::to_string(response.status == 304 ? 0 : response.body.size()) + "\r\n";
+        head += keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+
+        bool sendBody = response.status != 304 && request.method != "HEAD";
+        if (!sendAll(fd, head, false) || (sendBody && !sendAll(fd, response.body, true))) break;
+    }
+
+done:
+    std::lock_guard<std::mutex> lock(connectionsMutex);
+    connections.erase(fd);
+    close(fd);
+}
+
+std::string BackendStandIn::gzipBody(const Response& response) {
+    // Compressed once per ETag, so repeated pages cost what a CDN-cached response would
+    if (response.etag.empty()) return gzipCompress(response.body);
+    {
+        std::lock_guard<std::mutex> lock(gzipMutex);
+        auto cached = gzipCache.find(response.etag);
+        if (cached != gzipCache.end()) return cached->second;
+    }
+    std::string compressed = gzipCompress(response.body);
+    std::lock_guard<std::mutex> lock(gzipMutex);
+    if (gzipCache.size() >= 4096) gzipCache.clear();
+    gzipCache[response.etag] = compressed;
+    return compressed;
+}
+
+bool BackendStandIn::sendAll(int fd, const std::string& data, bool throttle) {
+    const size_t chunkSize = 16384;
+    for (size_t offset = 0; offset < data.size(); ) {
+        size_t length = std::min(chunkSize, data.size() - offset);
+        ssize_t sent = send(fd, data.data() + offset, length, 0);
+        if (sent <= 0) return false;
+        offset += sent;
+        bytesSent += sent;
+
+        int rate = bandwidthKBps;
+        if (throttle && rate > 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds((long long)sent * 1000000 / ((long long)rate * 1024)));
+        }
+    }
+    return true;
+}
+
+BackendStandIn::Response BackendStandIn::route(const Request& request) {
+    Response response;
+    std::lock_guard<std::mutex> lock(catalogMutex);
+
+    if (request.method == "POST") {
+        response.body = "{\"ok\":true}";
+        return response;
+    }
+
+    if (request.path.compare(0, 7, "/audio/") == 0) {
+        response.contentType = "audio/mpeg";
+        size_t size = audioFixture.empty() ? audioBytes.load() : audioFixture.size();
+        // Only the requested bytes, as intros and resolves ask for a few KB of a track
+        size_t first = 0, last = size - 1;
+        auto range = request.headers.find("range");
+        if (range != request.headers.end() && range->second.compare(0, 6, "bytes=") == 0 && range->second.find(',') == std::string::npos) {
+            std::string spec = range->second.substr(6);
+            size_t dash = spec.find('-');
+            if (dash == 0) {
+                size_t suffix = strtoul(spec.c_str() + 1, nullptr, 10);
+                first = suffix >= size ? 0 : size - suffix;
+            } else if (dash != std::string::npos) {
+                first = strtoul(spec.c_str(), nullptr, 10);
+                if (dash + 1 < spec.size()) last = std::min(last, (size_t)strtoul(spec.c_str() + dash + 1, nullptr, 10));
+            }
+            if (size == 0 || first > last || first >= size) {
+                response.status = 416;
+                response.contentRange = "bytes */" + std::to_string(size);
+                return response;
+            }
+            response.status = 206;
+            response.contentRange = "bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(size);
+        }
+        response.body = audioFixture.empty() ? std::string(last - first + 1, '\0') : audioFixture.substr(first, last - first + 1);
+        return response;
+    }
+
+    if (request.path == "/api/tracks") {
+        std::vector<size_t> indices;
+        auto search = request.query.find("search");
+        if (search != request.query.end() && !search->second.empty()) {
+            // Every word of the search has to appear in the file name
+            std::vector<std::string> words;
+            std::istringstream split(toLower(search->second));
+            for (std::string word; split >> word; ) words.push_back(word);
+            for (size_t i = 0; i < trackNamesLower.size(); i++) {
+                bool matches = true;
+                for (const auto& word : words) {
+                    if (trackNamesLower[i].find(word) == std::string::npos) { matches = false; break; }
+                }
+                if (matches) indices.push_back(i);
+            }
+        } else {
+            indices.resize(tracks.size());
+            for (size_t i = 0; i < indices.size(); i++) indices[i] = i;
+        }
+        return jsonPage(indices, "results", request);
+    }
+
+    if (request.path == "/api/fields-db") {
+        response.body = "{\"fields\":[";
+        bool first = true;
+        for (const auto& genre : tracksByGenre) {
+            if (!first) response.body += ',';
+            first = false;
+            response.body += "{\"name\":\"" + genre.first + "\",\"pathCount\":" + std::to_string(genre.second.size()) + "}";
+        }
+        response.body += "]}";
+        response.etag = "\"fields-" + std::to_string(catalogVersion) + "\"";
+        auto ifNoneMatch = request.headers.find("if-none-match");
+        if (ifNoneMatch != request.headers.end() && ifNoneMatch->second == response.etag) response.status = 304;
+        return response;
+    }
+
+    const std::string fieldsPrefix = "/api/fields/";
+    const std::string tracksSuffix = "/tracks";
+    if (request.path.compare(0, fieldsPrefix.size(), fieldsPrefix) == 0 && request.path.size() > fieldsPrefix.size() + tracksSuffix.size() &&
+        request.path.compare(request.path.size() - tracksSuffix.size(), tracksSuffix.size(), tracksSuffix) == 0) {
+        std::string genre = request.path.substr(fieldsPrefix.size(), request.path.size() - fieldsPrefix.size() - tracksSuffix.size());
+        auto found = tracksByGenre.find(genre);
+        return jsonPage(found == tracksByGenre.end() ? std::vector<size_t>() : found->second, "tracks", request);
+    }
+
+    if (request.path == "/") {
+        response.contentType = "text/plain";
+        response.body = "ok";
+        return response;
+    }
+
+    response.status = 404;
+    response.body = "{\"error\":\"not found\"}";
+    return response;
+}
+
+BackendStandIn::Response BackendStandIn::jsonPage(const std::vector<size_t>& indices, const std::string& key, const Request& request) {
+    size_t offset = 0, limit = indices.size();
+    auto found = request.query.find("offset");
+    if (found != request.query.end()) offset = std::min(indices.size(), (size_t)std::stoul(found->second));
+    found = request.query.find("limit");
+    if (found != request.query.end()) limit = std::stoul(found->second);
+    size_t end = std::min(indices.size(), offset + limit);
+
+    Response response;
+    response.body.reserve((end - offset) * 200 + 64);
+    response.body = "{\"" + key + "\":[";
+    for (size_t i = offset; i < end; i++) {
+        if (i > offset) response.body += ',';
+        response.body += trackJson[indices[i]];
+    }
+    response.body += "],\"total\":" + std::to_string(indices.size()) + "}";
+
+    std::string identity = request.path;
+    for (const auto& parameter : request.query) identity += "&" + parameter.first + "=" + parameter.second;
+    response.etag = "\"" + std::to_string(catalogVersion) + "-" + std::to_string(std::hash<std::string>()(identity)) + "\"";
+
+    auto ifNoneMatch = request.headers.find("if-none-match");
+    if (ifNoneMatch != request.headers.end() && ifNoneMatch->second == response.etag) {
+        response.status = 304;
+    }
+    return response;
+}
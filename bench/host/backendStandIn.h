@@ -0,0 +1,98 @@
+#ifndef AMP_BENCH_BACKENDSTANDIN_H
+#define AMP_BENCH_BACKENDSTANDIN_H
+
+// Local HTTP/1.1 server that answers the AMP backend endpoints the plugin uses:
+//   GET  /api/tracks[?search=&limit=&offset=]   {"results":[...],"total":N}
+//   GET  /api/fields-db                         {"fields":[{"name":..,"pathCount":..}]}
+//   GET  /api/fields/{name}/tracks[?limit=&offset=]  {"tracks":[...],"total":N}
+//   POST /api/fields/most-played/tracks
+//   GET|HEAD /audio/{cleanPath}                 honours a single Range (206/416)
+// JSON bodies carry an ETag and honour If-None-Match, and are gzipped for clients that accept it
+// unless gzip is turned off. Latency, bandwidth and stalls are
+// adjustable while running so benchmarks can model slow, distant or flaky backends.
+
+#include "catalogGenerator.h"
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+class BackendStandIn
+{
+public:
+    BackendStandIn();
+    ~BackendStandIn();
+
+    // Listen on 127.0.0.1:port (0 picks a free port)
+    bool start(int port = 0);
+    void stop();
+
+    int port() const { return listenPort; }
+    std::string baseUrl() const;
+
+    // Serve this catalog, replacing the previous one
+    void setCatalog(const std::vector<GeneratedTrack>& catalog);
+    // Load recorded responses: tracks.json (an /api/tracks body) and optionally audio.mp3.
+    // The catalog and folders are derived from tracks.json.
+    bool loadFixtures(const std::string& directory);
+    std::vector<GeneratedTrack> getCatalog();
+
+    std::atomic<int> latencyMs{0};      // added before every response
+    std::atomic<int> bandwidthKBps{0};  // 0 = unlimited
+    std::atomic<size_t> audioBytes{2 * 1024 * 1024}; // synthetic audio size when there is no fixture
+    std::atomic<int> stallEvery{0};     // every Nth request is held back an extra stallMs (0 = never)
+    std::atomic<int> stallMs{0};
+    std::atomic<bool> gzip{true};       // Content-Encoding: gzip for JSON bodies of 1 KB and more
+
+    std::atomic<size_t> requests{0};
+    std::atomic<size_t> bytesSent{0};
+
+private:
+    struct Request {
+        std::string method;
+        std::string path;
+        std::map<std::string, std::string> query;
+        std::map<std::string, std::string> headers; // lowercased names
+        std::string body;
+    };
+    struct Response {
+        int status = 200;
+        std::string contentType = "application/json";
+        std::string body;
+        std::string etag;
+        std::string contentRange; // set for 206 and 416
+    };
+
+    void acceptLoop();
+    void serveConnection(int fd);
+    Response route(const Request& request);
+    Response jsonPage(const std::vector<size_t>& indices, const std::string& key, const Request& request);
+    bool sendAll(int fd, const std::string& data, bool throttle);
+    std::string gzipBody(const Response& response);
+
+    int listenFd = -1;
+    int listenPort = 0;
+    std::atomic<bool> running{false};
+    std::thread acceptThread;
+
+    std::mutex connectionsMutex;
+    std::set<int> connections;
+    std::vector<std::thread> connectionThreads;
+
+    std::mutex gzipMutex;
+    std::map<std::string, std::string> gzipCache; // compressed bodies by ETag
+
+    // Catalog, pre-rendered as one JSON object per track
+    std::mutex catalogMutex;
+    std::vector<GeneratedTrack> tracks;
+    std::vector<std::string> trackJson;
+    std::vector<std::string> trackNamesLower;
+    std::map<std::string, std::vector<size_t>> tracksByGenre;
+    std::string audioFixture;
+    unsigned catalogVersion = 0;
+};
+
+#endif // AMP_BENCH_BACKENDSTANDIN_H
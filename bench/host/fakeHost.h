@@ -0,0 +1,73 @@
+#ifndef AMP_BENCH_FAKEHOST_H
+#define AMP_BENCH_FAKEHOST_H
+
+// Minimal stand-ins for the objects VirtualDJ hands to an online source plugin
+
+#include "vdjOnlineSource.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+class FakeCallbacks : public IVdjCallbacks8
+{
+public:
+    std::atomic<int> commands{0};
+
+    HRESULT SendCommand(const char* command) override { commands++; return S_OK; }
+    HRESULT GetInfo(const char* command, double* result) override { return E_NOTIMPL; }
+    HRESULT GetStringInfo(const char* command, void* result, int size) override { return E_NOTIMPL; }
+    HRESULT DeclareParameter(void* parameter, int type, int id, const char* name, const char* shortName, float defaultvalue) override { return S_OK; }
+    HRESULT GetSongBuffer(int pos, int nb, short** buffer) override { return E_NOTIMPL; }
+};
+
+// Counts tracks and lets the caller wait for finish() after an asynchronous OnSearch
+class FakeTracksList : public IVdjTracksList
+{
+public:
+    void VDJ_API add(const char* uniqueId, const char* title, const char* artist, const char* remix, const char* genre,
+                     const char* label, const char* comment, const char* coverUrl, const char* streamUrl,
+                     float length, float bpm, int key, int year, bool isKaraoke, bool isVideo) override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (count++ == 0) firstAdd = std::chrono::steady_clock::now();
+    }
+
+    void VDJ_API finish() override
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+        finishedAt = std::chrono::steady_clock::now();
+        finishedCondition.notify_all();
+    }
+
+    bool waitFinished(int timeoutMs)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return finishedCondition.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return finished; });
+    }
+
+    std::mutex mutex;
+    std::condition_variable finishedCondition;
+    size_t count = 0;
+    bool finished = false;
+    std::chrono::steady_clock::time_point firstAdd;
+    std::chrono::steady_clock::time_point finishedAt;
+};
+
+class FakeSubfoldersList : public IVdjSubfoldersList
+{
+public:
+    size_t count = 0;
+    void VDJ_API add(const char* folderUniqueId, const char* folderName) override { count++; }
+};
+
+class FakeString : public IVdjString
+{
+public:
+    std::string value;
+    void VDJ_API operator=(const char* text) override { value = text ? text : ""; }
+};
+
+#endif // AMP_BENCH_FAKEHOST_H
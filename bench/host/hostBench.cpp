@@ -0,0 +1,263 @@
+// Drives the plugin the way VirtualDJ does, against a local backend stand-in,
+// and reports per-callback latency percentiles at several catalog sizes.
+//
+//   amp_host_bench [--sizes 1000,10000,50000] [--traces 20] [--iterations 100]
+//                  [--latency-ms 0] [--bandwidth-kbps 0] [--keystroke-ms 150]
+//                  [--stall-every 0] [--stall-ms 0] [--hedge 1] [--gzip 1]
+//                  [--warmup-ms 3000] [--fixtures DIR] [--json FILE]
+//
+// --stall-every N holds every Nth backend response back an extra --stall-ms, to see
+// the plugin's adaptive timeouts and hedged requests at work (--hedge 0 turns hedging off).
+// --gzip 0 makes the stand-in send JSON uncompressed; compare bytes served and timings
+// with a --bandwidth-kbps limit to see what compression saves.
+
+#include "fakeHost.h"
+#include "backendStandIn.h"
+#include "catalogGenerator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<size_t> sizes = {1000, 10000, 50000};
+    size_t traces = 20;       // keystroke traces replayed per catalog
+    size_t iterations = 100;  // calls per non-search callback
+    int latencyMs = 0;
+    int bandwidthKBps = 0;
+    int stallEvery = 0;       // every Nth backend request stalls for stallMs
+    int stallMs = 0;
+    bool hedge = true;        // .camp_http_hedge for the plugin
+    bool gzip = true;         // stand-in compresses JSON for clients that accept gzip
+    int keystrokeMs = 150;    // time between keystrokes; unfinished searches are cancelled
+    int warmupMs = 3000;      // time given to the plugin's load-time warm-up
+    std::string fixtures;
+    std::string jsonPath;
+};
+
+struct Result {
+    size_t catalogSize;
+    std::string callback;
+    std::vector<double> samples; // milliseconds
+    size_t cancelled = 0;
+};
+
+static double msSince(Clock::time_point start, Clock::time_point end = Clock::now()) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+static double percentile(std::vector<double> samples, double q) {
+    if (samples.empty()) return 0;
+    std::sort(samples.begin(), samples.end());
+    size_t rank = (size_t)std::ceil(q * samples.size());
+    return samples[std::min(samples.size() - 1, rank > 0 ? rank - 1 : 0)];
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) {
+            fprintf(stderr, "Missing value for %s\n", arg.c_str());
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--sizes") {
+            options.sizes.clear();
+            size_t start = 0;
+            while (start < value.size()) {
+                size_t comma = value.find(',', start);
+                options.sizes.push_back(std::stoul(value.substr(start, comma - start)));
+                start = comma == std::string::npos ? value.size() : comma + 1;
+            }
+        }
+        else if (arg == "--traces") options.traces = std::stoul(value);
+        else if (arg == "--iterations") options.iterations = std::stoul(value);
+        else if (arg == "--latency-ms") options.latencyMs = std::stoi(value);
+        else if (arg == "--bandwidth-kbps") options.bandwidthKBps = std::stoi(value);
+        else if (arg == "--stall-every") options.stallEvery = std::stoi(value);
+        else if (arg == "--stall-ms") options.stallMs = std::stoi(value);
+        else if (arg == "--hedge") options.hedge = std::stoi(value) != 0;
+        else if (arg == "--gzip") options.gzip = std::stoi(value) != 0;
+        else if (arg == "--keystroke-ms") options.keystrokeMs = std::stoi(value);
+        else if (arg == "--warmup-ms") options.warmupMs = std::stoi(value);
+        else if (arg == "--fixtures") options.fixtures = value;
+        else if (arg == "--json") options.jsonPath = value;
+        else {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// A fresh VirtualDJ home pointing the plugin at the stand-in
+static fs::path makeHome(const std::string& baseUrl, bool hedge) {
+    fs::path home = fs::temp_directory_path() / ("amp-bench-" + std::to_string(getpid()) + "-" + std::to_string(rand()));
+    fs::path vdj = home / "Library" / "Application Support" / "VirtualDJ";
+    fs::create_directories(vdj);
+    std::ofstream(vdj / ".camp_api_url") << baseUrl;
+    std::ofstream(vdj / ".camp_tracks_url") << baseUrl;
+    std::ofstream(vdj / ".camp_http_hedge") << (hedge ? 1 : 0);
+    setenv("HOME", home.c_str(), 1);
+    return home;
+}
+
+static IVdjPluginOnlineSource* loadPlugin(FakeCallbacks& callbacks) {
+    void* object = nullptr;
+    if (DllGetClassObject(CLSID_VdjPlugin8, IID_IVdjPluginBasic8, &object) != NO_ERROR || !object) {
+        return nullptr;
+    }
+    IVdjPluginOnlineSource* plugin = static_cast<IVdjPluginOnlineSource*>(static_cast<IVdjPlugin8*>(object));
+    plugin->cb = &callbacks;
+    plugin->OnLoad();
+    plugin->IsLogged();
+    return plugin;
+}
+
+static void benchCatalog(const Options& options, BackendStandIn& server, const std::vector<GeneratedTrack>& catalog,
+                         std::vector<Result>& results) {
+    fs::path home = makeHome(server.baseUrl(), options.hedge);
+    FakeCallbacks callbacks;
+    IVdjPluginOnlineSource* plugin = loadPlugin(callbacks);
+    if (!plugin) {
+        fprintf(stderr, "Could not create the plugin\n");
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(options.warmupMs));
+
+    std::mt19937 rng(42);
+    Result onSearch{catalog.size(), "OnSearch"};
+    Result onSearchFinished{catalog.size(), "OnSearch (finished)"};
+    Result getFolder{catalog.size(), "GetFolder"};
+    Result getFolderList{catalog.size(), "GetFolderList"};
+    Result getStreamUrl{catalog.size(), "GetStreamUrl"};
+
+    // Tracks lists must outlive any background search still holding them
+    std::vector<std::unique_ptr<FakeTracksList>> lists;
+
+    for (const std::string& keystroke : generateKeystrokeTrace(catalog, options.traces)) {
+        lists.push_back(std::make_unique<FakeTracksList>());
+        FakeTracksList* list = lists.back().get();
+
+        Clock::time_point start = Clock::now();
+        HRESULT result = plugin->OnSearch(keystroke.c_str(), list);
+        onSearch.samples.push_back(msSince(start));
+
+        if (result != S_FALSE) {
+            onSearchFinished.samples.push_back(onSearch.samples.back());
+        } else if (list->waitFinished(options.keystrokeMs)) {
+            onSearchFinished.samples.push_back(msSince(start, list->finishedAt));
+        } else {
+            // The next keystroke arrives before the server answered
+            plugin->OnSearchCancel();
+            onSearchFinished.cancelled++;
+        }
+    }
+
+    std::vector<std::string> genres;
+    for (const auto& track : catalog) {
+        if (std::find(genres.begin(), genres.end(), track.genre) == genres.end()) genres.push_back(track.genre);
+    }
+    for (size_t i = 0; i < options.iterations; i++) {
+        FakeTracksList list;
+        const std::string& genre = genres[rng() % genres.size()];
+        Clock::time_point start = Clock::now();
+        plugin->GetFolder(genre.c_str(), &list);
+        getFolder.samples.push_back(msSince(start));
+
+        FakeSubfoldersList folders;
+        start = Clock::now();
+        plugin->GetFolderList(&folders);
+        getFolderList.samples.push_back(msSince(start));
+
+        FakeString url, error;
+        const std::string& uniqueId = catalog[rng() % catalog.size()].cleanPath;
+        start = Clock::now();
+        plugin->GetStreamUrl(uniqueId.c_str(), url, error);
+        getStreamUrl.samples.push_back(msSince(start));
+    }
+
+    results.push_back(onSearch);
+    results.push_back(onSearchFinished);
+    results.push_back(getFolder);
+    results.push_back(getFolderList);
+    results.push_back(getStreamUrl);
+
+    // Unloads like VirtualDJ does, joining the plugin's background work while the lists
+    // and callbacks it may still use are alive
+    plugin->Release();
+    std::error_code ignored;
+    fs::remove_all(home, ignored);
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) return 1;
+
+    BackendStandIn server;
+    if (!server.start()) {
+        fprintf(stderr, "Could not start the backend stand-in\n");
+        return 1;
+    }
+    server.latencyMs = options.latencyMs;
+    server.stallEvery = options.stallEvery;
+    server.stallMs = options.stallMs;
+    server.bandwidthKBps = options.bandwidthKBps;
+    server.gzip = options.gzip;
+
+    std::vector<Result> results;
+    if (!options.fixtures.empty()) {
+        if (!server.loadFixtures(options.fixtures)) {
+            fprintf(stderr, "Could not load fixtures from %s\n", options.fixtures.c_str());
+            return 1;
+        }
+        std::vector<GeneratedTrack> recorded = server.getCatalog();
+        fprintf(stderr, "Benchmarking %zu recorded tracks from %s\n", recorded.size(), options.fixtures.c_str());
+        benchCatalog(options, server, recorded, results);
+    } else {
+        for (size_t size : options.sizes) {
+            fprintf(stderr, "Benchmarking %zu tracks against %s\n", size, server.baseUrl().c_str());
+            std::vector<GeneratedTrack> catalog = generateCatalog(size);
+            server.setCatalog(catalog);
+            benchCatalog(options, server, catalog, results);
+        }
+    }
+
+    printf("%-10s %-22s %6s %10s %10s %10s %9s\n", "catalog", "callback", "n", "p50 ms", "p95 ms", "p99 ms", "cancelled");
+    for (const Result& result : results) {
+        printf("%-10zu %-22s %6zu %10.3f %10.3f %10.3f %9zu\n", result.catalogSize, result.callback.c_str(), result.samples.size(),
+               percentile(result.samples, 0.50), percentile(result.samples, 0.95), percentile(result.samples, 0.99), result.cancelled);
+    }
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream json(options.jsonPath);
+        json << "{\"latencyMs\":" << options.latencyMs << ",\"bandwidthKBps\":" << options.bandwidthKBps
+             << ",\"gzip\":" << (options.gzip ? "true" : "false") << ",\"results\":[";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& result = results[i];
+            json << (i ? "," : "") << "{\"catalog\":" << result.catalogSize << ",\"callback\":\"" << result.callback
+                 << "\",\"n\":" << result.samples.size() << ",\"p50\":" << percentile(result.samples, 0.50)
+                 << ",\"p95\":" << percentile(result.samples, 0.95) << ",\"p99\":" << percentile(result.samples, 0.99)
+                 << ",\"cancelled\":" << result.cancelled << "}";
+        }
+        json << "]}\n";
+    }
+
+    fprintf(stderr, "%zu requests, %zu bytes served\n", server.requests.load(), server.bytesSent.load());
+    return 0;
+}
@@ -0,0 +1,284 @@
+// CPU cost of the plugin's per-track helpers on synthetic catalogs.
+// Reports time, heap allocations and throughput per operation.
+//
+//   amp_micro_bench [--sizes 1000,10000,100000,1000000] [--min-time-ms 300]
+//                   [--filter NAME] [--json FILE]
+
+#define FTS_FUZZY_MATCH_IMPLEMENTATION
+#include "fts_fuzzy_match.h"
+#include "AMP.h"
+#include "plugin/utilities.h"
+#include "plugin/searchIndex.h"
+#include "catalogGenerator.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+// Every heap allocation in the process is counted, so a benchmark's allocations
+// are the difference between two snapshots around it
+static std::atomic<size_t> allocationCount{0};
+static std::atomic<size_t> allocationBytes{0};
+
+void* operator new(size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// Reaches the private helpers under test
+class CAMPBenchAccess
+{
+public:
+    static std::vector<TrackInfo> parseTracksFromJson(CAMP& plugin, const std::string& json) { return plugin.parseTracksFromJson(json); }
+    static std::string urlEncode(CAMP& plugin, const std::string& value) { return plugin.urlEncode(value); }
+    static std::string getCachePathForTrack(CAMP& plugin, const char* uniqueId) { return plugin.getCachePathForTrack(uniqueId); }
+    static std::string getEncodedLocalPathForTrack(CAMP& plugin, const char* uniqueId) { return plugin.getEncodedLocalPathForTrack(uniqueId); }
+};
+
+struct Options {
+    std::vector<size_t> sizes = {1000, 10000, 100000};
+    int minTimeMs = 300;
+    std::string filter;
+    std::string jsonPath;
+};
+
+struct Result {
+    std::string name;
+    size_t catalogSize;
+    size_t ops;
+    double nsPerOp;
+    double allocsPerOp;
+    double allocBytesPerOp;
+    double opsPerSecond;
+    double mbPerSecond; // input bytes processed, 0 when not meaningful
+};
+
+static size_t sink = 0; // results feed into this so the work can't be optimized away
+
+// Runs `batch` (which performs opsPerBatch operations over inputBytes of input) until minTimeMs has passed
+static Result measure(const Options& options, const std::string& name, size_t catalogSize, size_t opsPerBatch,
+                      size_t inputBytes, const std::function<void()>& batch) {
+    batch(); // warm caches and lazily initialized state
+
+    using Clock = std::chrono::steady_clock;
+    size_t batches = 0;
+    size_t allocationsBefore = allocationCount.load();
+    size_t bytesBefore = allocationBytes.load();
+    Clock::time_point start = Clock::now();
+    Clock::time_point end;
+    do {
+        batch();
+        batches++;
+        end = Clock::now();
+    } while (end - start < std::chrono::milliseconds(options.minTimeMs));
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    size_t ops = batches * opsPerBatch;
+
+    Result result;
+    result.name = name;
+    result.catalogSize = catalogSize;
+    result.ops = ops;
+    result.nsPerOp = seconds * 1e9 / ops;
+    result.allocsPerOp = (double)(allocationCount.load() - allocationsBefore) / ops;
+    result.allocBytesPerOp = (double)(allocationBytes.load() - bytesBefore) / ops;
+    result.opsPerSecond = ops / seconds;
+    result.mbPerSecond = inputBytes ? inputBytes * batches / seconds / (1024.0 * 1024.0) : 0;
+    return result;
+}
+
+static bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        std::string value = argv[i + 1];
+        if (arg == "--sizes") {
+            options.sizes.clear();
+            size_t start = 0;
+            while (start < value.size()) {
+                size_t comma = value.find(',', start);
+                options.sizes.push_back(std::stoul(value.substr(start, comma - start)));
+                start = comma == std::string::npos ? value.size() : comma + 1;
+            }
+        }
+        else if (arg == "--min-time-ms") options.minTimeMs = std::stoi(value);
+        else if (arg == "--filter") options.filter = value;
+        else if (arg == "--json") options.jsonPath = value;
+        else {
+            fprintf(stderr, "Unknown option %s\n", arg.c_str());
+            return false;
+        }
+    }
+    return argc % 2 == 1;
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        fprintf(stderr, "usage: amp_micro_bench [--sizes 1000,10000] [--min-time-ms 300] [--filter NAME] [--json FILE]\n");
+        return 1;
+    }
+
+    // Keep the plugin's log and cache folder out of the real VirtualDJ folder
+    namespace fs = std::filesystem;
+    fs::path home = fs::temp_directory_path() / ("amp-micro-" + std::to_string(getpid()));
+    fs::create_directories(home / "Library" / "Application Support" / "VirtualDJ");
+    setenv("HOME", home.c_str(), 1);
+
+    CAMP plugin;
+    std::vector<Result> results;
+    auto selected = [&](const std::string& name) {
+        return options.filter.empty() || name.find(options.filter) != std::string::npos;
+    };
+
+    for (size_t size : options.sizes) {
+        fprintf(stderr, "Generating %zu tracks\n", size);
+        std::vector<GeneratedTrack> catalog = generateCatalog(size);
+        std::string json = catalogToJson(catalog, "https://tracks.abelldjcompany.com");
+        size_t nameBytes = 0, pathBytes = 0;
+        for (const auto& track : catalog) {
+            nameBytes += track.fileName.size();
+            pathBytes += track.cleanPath.size();
+        }
+
+        if (selected("parseTracksFromJson")) {
+            results.push_back(measure(options, "parseTracksFromJson", size, size, json.size(), [&] {
+                sink += CAMPBenchAccess::parseTracksFromJson(plugin, json).size();
+            }));
+        }
+        if (selected("parseTrackTitleAndArtist")) {
+            results.push_back(measure(options, "parseTrackTitleAndArtist", size, size, nameBytes, [&] {
+                for (const auto& track : catalog) sink += parseTrackTitleAndArtist(track.fileName).first.size();
+            }));
+        }
+        if (selected("urlEncode")) {
+            results.push_back(measure(options, "urlEncode", size, size, pathBytes, [&] {
+                for (const auto& track : catalog) sink += CAMPBenchAccess::urlEncode(plugin, track.cleanPath).size();
+            }));
+        }
+        if (selected("getCachePathForTrack")) {
+            results.push_back(measure(options, "getCachePathForTrack", size, size, pathBytes, [&] {
+                for (const auto& track : catalog) sink += CAMPBenchAccess::getCachePathForTrack(plugin, track.cleanPath.c_str()).size();
+            }));
+        }
+        if (selected("getEncodedLocalPathForTrack")) {
+            results.push_back(measure(options, "getEncodedLocalPathForTrack", size, size, pathBytes, [&] {
+                for (const auto& track : catalog) sink += CAMPBenchAccess::getEncodedLocalPathForTrack(plugin, track.cleanPath.c_str()).size();
+            }));
+        }
+        if (selected("foldSearchText")) {
+            // Once per track when the catalog is built
+            std::string folded;
+            results.push_back(measure(options, "foldSearchText", size, size, nameBytes, [&] {
+                for (const auto& track : catalog) {
+                    folded.clear();
+                    foldSearchText(track.fileName.data(), track.fileName.size(), folded);
+                    sink += folded.size();
+                }
+            }));
+        }
+        if (selected("normalizeSearchQuery")) {
+            // Once per keystroke
+            std::vector<std::string> keystrokes = generateKeystrokeTrace(catalog, 1000, 11);
+            size_t keystrokeBytes = 0;
+            for (const auto& keystroke : keystrokes) keystrokeBytes += keystroke.size();
+            results.push_back(measure(options, "normalizeSearchQuery", size, keystrokes.size(), keystrokeBytes, [&] {
+                for (const auto& keystroke : keystrokes) sink += normalizeSearchQuery(keystroke).size();
+            }));
+        }
+
+        // One search box entry checked against every file name, as a local search would
+        std::vector<std::string> patterns = generateKeystrokeTrace(catalog, 1, 7);
+        std::string pattern = normalizeSearchQuery(patterns.empty() ? "love" : patterns.back());
+        std::vector<SearchKey> keys;
+        if (selected("fts::fuzzy_match") || selected("search scan")) {
+            keys.reserve(catalog.size());
+            for (const auto& track : catalog) keys.push_back(makeSearchKey(track.fileName));
+        }
+        SearchPattern compiled = compileSearchPattern(pattern);
+
+        if (selected("fts::fuzzy_match")) {
+            results.push_back(measure(options, "fts::fuzzy_match", size, size, nameBytes, [&] {
+                for (const auto& track : catalog) {
+                    int score = 0;
+                    if (fts::fuzzy_match(pattern.c_str(), track.fileName.c_str(), score)) sink += score;
+                }
+            }));
+            fts::fuzzy_scratch scratch;
+            std::vector<const char*> fileNames;
+            fileNames.reserve(catalog.size());
+            for (const auto& track : catalog) fileNames.push_back(track.fileName.c_str());
+            std::vector<int> scores(fileNames.size());
+            results.push_back(measure(options, "fts::fuzzy_match_batch", size, size, nameBytes, [&] {
+                sink += fts::fuzzy_match_batch(pattern.c_str(), fileNames.data(), fileNames.size(), scores.data(), scratch);
+            }));
+
+            // Repeated tags make the recursive scorer branch on every candidate character
+            std::string repetitive = "(Clean) (Extended) (Intro) (Clean) (Extended) (Intro) - Dj Edit Extended Intro.mp3";
+            const char* repetitivePattern = "extended intro";
+            results.push_back(measure(options, "fts::fuzzy_match repetitive", size, size, repetitive.size() * size, [&] {
+                for (size_t i = 0; i < size; i++) {
+                    int score = 0;
+                    if (fts::fuzzy_match(repetitivePattern, repetitive.c_str(), score)) sink += score;
+                }
+            }));
+            results.push_back(measure(options, "fts::fuzzy_match_dp repetitive", size, size, repetitive.size() * size, [&] {
+                for (size_t i = 0; i < size; i++) {
+                    int score = 0;
+                    if (fts::fuzzy_match_dp(repetitivePattern, repetitive.c_str(), score, scratch)) sink += score;
+                }
+            }));
+            results.push_back(measure(options, "fts::fuzzy_match+prefilter", size, size, nameBytes, [&] {
+                for (size_t i = 0; i < catalog.size(); i++) {
+                    int score = 0;
+                    if (fuzzyPrefilter(keys[i], compiled) && fts::fuzzy_match(pattern.c_str(), catalog[i].fileName.c_str(), score)) sink += score;
+                }
+            }));
+        }
+        if (selected("search scan")) {
+            results.push_back(measure(options, "search scan (query)", size, size, nameBytes, [&] {
+                for (const auto& track : catalog) sink += matchesSearchQuery(track.fileName, pattern);
+            }));
+            results.push_back(measure(options, "search scan (SearchKey)", size, size, nameBytes, [&] {
+                SearchPattern perKeystroke = compileSearchPattern(pattern);
+                for (const auto& key : keys) sink += matchesSearchKey(key, perKeystroke);
+            }));
+        }
+    }
+
+    printf("%-32s %9s %12s %10s %12s %14s %10s\n", "benchmark", "catalog", "ns/op", "allocs/op", "alloc B/op", "ops/s", "MB/s");
+    for (const Result& r : results) {
+        printf("%-32s %9zu %12.1f %10.2f %12.1f %14.0f %10.1f\n", r.name.c_str(), r.catalogSize, r.nsPerOp, r.allocsPerOp,
+               r.allocBytesPerOp, r.opsPerSecond, r.mbPerSecond);
+    }
+
+    if (!options.jsonPath.empty()) {
+        std::ofstream out(options.jsonPath);
+        out << "{\"benchmarks\":[";
+        for (size_t i = 0; i < results.size(); i++) {
+            const Result& r = results[i];
+            out << (i ? "," : "") << "{\"name\":\"" << r.name << "\",\"catalog\":" << r.catalogSize << ",\"ops\":" << r.ops
+                << ",\"nsPerOp\":" << r.nsPerOp << ",\"allocsPerOp\":" << r.allocsPerOp << ",\"allocBytesPerOp\":" << r.allocBytesPerOp
+                << ",\"opsPerSecond\":" << r.opsPerSecond << ",\"mbPerSecond\":" << r.mbPerSecond << "}";
+        }
+        out << "]}\n";
+    }
+
+    std::error_code ignored;
+    fs::remove_all(home, ignored);
+    return sink == 42 ? 1 : 0;
+}
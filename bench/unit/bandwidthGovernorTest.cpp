@@ -0,0 +1,103 @@
+#include "unitTest.h"
+#include "plugin/bandwidthGovernor.h"
+#include <chrono>
+
+static int64_t steadyNowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+UNIT_TEST(tokenBucketUnlimitedNeverWaits)
+{
+    TokenBucket bucket;
+    int64_t now = steadyNowUs();
+    bucket.take(100 * 1024 * 1024, now);
+    CHECK(!bucket.isLimited());
+    CHECK_EQ(bucket.msUntilAvailable(now), 0);
+}
+
+UNIT_TEST(tokenBucketBurstPassesThenWaitsOffTheDebt)
+{
+    TokenBucket bucket;
+    bucket.setRate(64 * 1024); // burst is a quarter of that: 16 KB
+    int64_t now = steadyNowUs();
+    bucket.take(16 * 1024 - 1, now);
+    CHECK_EQ(bucket.msUntilAvailable(now), 0);
+
+    // 32 KB in debt at 64 KB/s: half a second
+    bucket.take(32 * 1024 + 1, now);
+    int delay = bucket.msUntilAvailable(now);
+    CHECK(delay >= 500 && delay <= 502);
+    CHECK(bucket.msUntilAvailable(now + 250000) <= 252);
+    CHECK_EQ(bucket.msUntilAvailable(now + 501000), 0);
+}
+
+UNIT_TEST(tokenBucketRefillStopsAtTheBurst)
+{
+    TokenBucket bucket;
+    bucket.setRate(64 * 1024);
+    int64_t now = steadyNowUs();
+    // An idle minute doesn't save up a minute's worth
+    now += 60 * 1000000LL;
+    bucket.take(16 * 1024 + 64 * 1024, now);
+    int delay = bucket.msUntilAvailable(now);
+    CHECK(delay >= 1000 && delay <= 1002);
+}
+
+UNIT_TEST(tokenBucketKeepsFractionalRefills)
+{
+    TokenBucket bucket;
+    bucket.setRate(1000); // a byte per millisecond, below the 16 KB minimum burst
+    int64_t now = steadyNowUs();
+    bucket.take(16384 + 10, now);
+    // Refilled in steps shorter than a byte's worth, the bucket still fills at the full rate
+    for (int i = 0; i < 40; i++) {
+        now += 500;
+        bucket.msUntilAvailable(now);
+    }
+    CHECK_EQ(bucket.msUntilAvailable(now), 0);
+}
+
+UNIT_TEST(governorHoldsBackgroundWhileStreaming)
+{
+    BandwidthGovernor governor(0, 16 * 1024, 600);
+    CHECK(!governor.isRemoteStreamActive());
+    governor.charge(TransferPriority::Background, 1024 * 1024);
+    CHECK_EQ(governor.delayMs(TransferPriority::Background), 0);
+
+    governor.noteRemoteStream();
+    CHECK(governor.isRemoteStreamActive());
+    governor.charge(TransferPriority::Background, 32 * 1024);
+    int delay = governor.delayMs(TransferPriority::Background);
+    CHECK(delay > 900 && delay <= 1002);
+    // Everything else goes ahead
+    CHECK_EQ(governor.delayMs(TransferPriority::Normal), 0);
+    CHECK_EQ(governor.delayMs(TransferPriority::Interactive), 0);
+}
+
+UNIT_TEST(governorHoldsBackgroundForRelayedStreamsOnly)
+{
+    BandwidthGovernor governor(0, 16 * 1024, 0);
+    governor.noteRemoteStream(); // no lease configured
+    CHECK(!governor.isRemoteStreamActive());
+
+    governor.beginRemoteStream();
+    governor.beginRemoteStream();
+    governor.charge(TransferPriority::Background, 32 * 1024);
+    CHECK(governor.delayMs(TransferPriority::Background) > 0);
+    governor.endRemoteStream();
+    CHECK(governor.isRemoteStreamActive());
+    governor.endRemoteStream();
+    CHECK(!governor.isRemoteStreamActive());
+    CHECK_EQ(governor.delayMs(TransferPriority::Background), 0);
+}
+
+UNIT_TEST(governorTotalCapCountsEverythingButHoldsOnlyDownloads)
+{
+    BandwidthGovernor governor(64 * 1024, 0, 600);
+    governor.charge(TransferPriority::Interactive, 80 * 1024);
+    CHECK_EQ(governor.delayMs(TransferPriority::Interactive), 0);
+    int delay = governor.delayMs(TransferPriority::Background);
+    CHECK(delay > 900 && delay <= 1002);
+    CHECK(governor.delayMs(TransferPriority::Normal) > 900);
+}
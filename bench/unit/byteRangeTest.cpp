@@ -0,0 +1,59 @@
+#include "unitTest.h"
+#include "plugin/localServer.h"
+
+UNIT_TEST(byteRangeFromTo)
+{
+    uint64_t first, last;
+    CHECK(parseByteRange("bytes=100-199", 1000, first, last));
+    CHECK_EQ(first, 100u);
+    CHECK_EQ(last, 199u);
+}
+
+UNIT_TEST(byteRangeOpenEndedRunsToTheEnd)
+{
+    uint64_t first, last;
+    CHECK(parseByteRange("bytes=524288-", 1000000, first, last));
+    CHECK_EQ(first, 524288u);
+    CHECK_EQ(last, 999999u);
+}
+
+UNIT_TEST(byteRangeLastIsClampedToTheFile)
+{
+    uint64_t first, last;
+    CHECK(parseByteRange("bytes=0-999999", 1000, first, last));
+    CHECK_EQ(first, 0u);
+    CHECK_EQ(last, 999u);
+}
+
+UNIT_TEST(byteRangeSuffixIsTheLastBytes)
+{
+    uint64_t first, last;
+    CHECK(parseByteRange("bytes=-100", 1000, first, last));
+    CHECK_EQ(first, 900u);
+    CHECK_EQ(last, 999u);
+
+    // Longer than the file: all of it
+    CHECK(parseByteRange("bytes=-5000", 1000, first, last));
+    CHECK_EQ(first, 0u);
+    CHECK_EQ(last, 999u);
+}
+
+UNIT_TEST(byteRangeUnsatisfiable)
+{
+    uint64_t first, last;
+    CHECK(!parseByteRange("bytes=1000-", 1000, first, last));
+    CHECK(!parseByteRange("bytes=500-400", 1000, first, last));
+    CHECK(!parseByteRange("bytes=-0", 1000, first, last));
+    CHECK(!parseByteRange("bytes=0-", 0, first, last));
+}
+
+UNIT_TEST(byteRangeNotUnderstoodMeansTheWholeFile)
+{
+    uint64_t first, last;
+    CHECK(parseByteRange("bytes=0-99,200-299", 1000, first, last));
+    CHECK_EQ(first, 0u);
+    CHECK_EQ(last, 999u);
+    CHECK(parseByteRange("items", 1000, first, last));
+    CHECK_EQ(first, 0u);
+    CHECK_EQ(last, 999u);
+}
@@ -0,0 +1,53 @@
+#include "unitTest.h"
+#include "plugin/endpointHealth.h"
+#include <algorithm>
+
+// Default .camp_circuit_failures
+static const int FAILURES = 5;
+
+static bool listed(const std::string& host)
+{
+    std::vector<std::string> hosts = getOfflineHosts();
+    return std::find(hosts.begin(), hosts.end(), host) != hosts.end();
+}
+
+UNIT_TEST(hostOfUrl)
+{
+    CHECK_EQ(getHostOf("https://api.example.com:8443/api/tracks?page=2"), std::string("https://api.example.com:8443"));
+    CHECK_EQ(getHostOf("http://example.com"), std::string("http://example.com"));
+    CHECK_EQ(getHostOf("http://example.com?x=1"), std::string("http://example.com"));
+}
+
+UNIT_TEST(unansweredRequestsTakeOnlyTheirHostOffline)
+{
+    // Spread over endpoints of one host
+    for (int i = 0; i < FAILURES; i++) {
+        getEndpointHealth("http://unreachable.test/api/" + std::to_string(i) + "/x").recordFailure(false);
+    }
+    CHECK(isHostOffline("http://unreachable.test/api/tracks"));
+    CHECK(listed("http://unreachable.test"));
+    CHECK(!isHostOffline("http://other.test/api/tracks"));
+
+    // A success elsewhere leaves it offline; one from the host itself brings it back
+    getEndpointHealth("http://other.test/api/tracks").recordSuccess(10);
+    CHECK(isHostOffline("http://unreachable.test/api/tracks"));
+    getEndpointHealth("http://unreachable.test/api/fields-db").recordSuccess(10);
+    CHECK(!isHostOffline("http://unreachable.test/api/tracks"));
+    CHECK(!listed("http://unreachable.test"));
+}
+
+UNIT_TEST(serverErrorsDontTakeAHostOffline)
+{
+    for (int i = 0; i < FAILURES * 3; i++) {
+        getEndpointHealth("http://failing.test/api/tracks").recordFailure(true);
+    }
+    CHECK(!isHostOffline("http://failing.test/api/tracks"));
+
+    // An answer, even an error, ends a run of unanswered requests
+    for (int i = 0; i < FAILURES - 1; i++) {
+        getEndpointHealth("http://flaky.test/audio/a").recordFailure(false);
+    }
+    getEndpointHealth("http://flaky.test/audio/a").recordFailure(true);
+    getEndpointHealth("http://flaky.test/audio/a").recordFailure(false);
+    CHECK(!isHostOffline("http://flaky.test/audio/a"));
+}
@@ -0,0 +1,154 @@
+#include "unitTest.h"
+#include "plugin/integrityIndex.h"
+#include "plugin/internet.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+// SHA-256 of "abc"
+static const char* SHA256_ABC = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+static const char* SHA256_ABC_BASE64 = "ungWv48Bz+pBQUDeXa4iI7ADYaOWF3qctBD/YfIAFa0=";
+static const char* SHA256_ABC_BASE64URL = "ungWv48Bz-pBQUDeXa4iI7ADYaOWF3qctBD_YfIAFa0=";
+
+static void writeFile(const std::string& path, const std::string& contents)
+{
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << contents;
+}
+
+static std::vector<std::string> readLines(const std::string& path)
+{
+    std::vector<std::string> lines;
+    std::ifstream file(path);
+    for (std::string line; std::getline(file, line);) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+static std::vector<std::string> splitTabs(const std::string& line)
+{
+    std::vector<std::string> fields;
+    std::stringstream stream(line);
+    for (std::string field; std::getline(stream, field, '\t');) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+UNIT_TEST(digestHeaderHex)
+{
+    CHECK_EQ(parseSha256Header("x-checksum-sha256", " BA7816BF8F01CFEA414140DE5DAE2223B00361A396177A9CB410FF61F20015AD\r\n"), std::string(SHA256_ABC));
+}
+
+UNIT_TEST(digestHeaderAmzBase64)
+{
+    CHECK_EQ(parseSha256Header("x-amz-checksum-sha256", SHA256_ABC_BASE64), std::string(SHA256_ABC));
+}
+
+UNIT_TEST(digestHeaderStructuredFieldsPickSha256)
+{
+    std::string sha512 = "sha-512=:z4PhNX7vuL3xVChQ1m2AB9Yg5AULVxXcg/SpIdNs6c5H0NE8XYXysP+DGNKHfuwvY7kxvUdBeoGlODJ6+SfaPg==:";
+    CHECK_EQ(parseSha256Header("repr-digest", sha512 + ", sha-256=:" + SHA256_ABC_BASE64 + ":"), std::string(SHA256_ABC));
+    CHECK_EQ(parseSha256Header("content-digest", std::string("sha-256=:") + SHA256_ABC_BASE64URL + ":"), std::string(SHA256_ABC));
+}
+
+UNIT_TEST(digestHeaderRfc3230)
+{
+    CHECK_EQ(parseSha256Header("digest", std::string("MD5=kAFQmDzST7DWlj99KOF/cg==, SHA-256=") + SHA256_ABC_BASE64), std::string(SHA256_ABC));
+}
+
+UNIT_TEST(digestHeaderWithoutSha256IsEmpty)
+{
+    CHECK_EQ(parseSha256Header("etag", SHA256_ABC), std::string());
+    CHECK_EQ(parseSha256Header("digest", "MD5=kAFQmDzST7DWlj99KOF/cg=="), std::string());
+    // Too short, and not hex
+    CHECK_EQ(parseSha256Header("x-checksum-sha256", "ba7816bf"), std::string());
+    CHECK_EQ(parseSha256Header("x-checksum-sha256", std::string(64, 'z')), std::string());
+    CHECK_EQ(parseSha256Header("x-amz-checksum-sha256", "not base64!"), std::string());
+}
+
+UNIT_TEST(integrityIndexWritesOneLinePerFile)
+{
+    std::string dir = makeTestDir("integrity-write");
+    writeFile(dir + "/track.mp3", "abc");
+    IntegrityIndex index;
+    index.record(dir, "track.mp3", SHA256_ABC);
+    int64_t now = (int64_t)time(nullptr);
+
+    std::vector<std::string> lines = readLines(dir + "/.integrity_index");
+    CHECK_EQ(lines.size(), (size_t)2);
+    if (lines.size() != 2) return;
+    CHECK_EQ(lines[0], std::string("AMP integrity 1"));
+    // name, size, modification time, sha256, time of the last check
+    std::vector<std::string> fields = splitTabs(lines[1]);
+    CHECK_EQ(fields.size(), (size_t)5);
+    if (fields.size() != 5) return;
+    CHECK_EQ(fields[0], std::string("track.mp3"));
+    CHECK_EQ(fields[1], std::string("3"));
+    CHECK(atoll(fields[2].c_str()) > 0);
+    CHECK_EQ(fields[3], std::string(SHA256_ABC));
+    CHECK(llabs(atoll(fields[4].c_str()) - now) <= 1);
+    CHECK_EQ(index.get("track.mp3"), std::string(SHA256_ABC));
+
+    index.remove("track.mp3");
+    CHECK_EQ(readLines(dir + "/.integrity_index").size(), (size_t)1);
+}
+
+UNIT_TEST(integrityIndexLoadsWellFormedLinesOnly)
+{
+    std::string dir = makeTestDir("integrity-load");
+    writeFile(dir + "/good.mp3", "abc");
+    writeFile(dir + "/short.mp3", "abc");
+    int64_t now = (int64_t)time(nullptr);
+    writeFile(dir + "/.integrity_index", "AMP integrity 1\n"
+              "good.mp3\t3\t1\t" + std::string(SHA256_ABC) + "\t" + std::to_string(now) + "\n"
+              "short.mp3\t3\t1\tba7816bf\t" + std::to_string(now) + "\n"
+              "fields.mp3\t3\t1\n");
+
+    IntegrityIndex index;
+    index.verifyFolder(dir, {"good.mp3", "short.mp3"}, nullptr);
+    // Checked just now, so it is taken as it is without hashing the file
+    CHECK_EQ(index.get("good.mp3"), std::string(SHA256_ABC));
+    CHECK_EQ(index.get("fields.mp3"), std::string());
+    index.stop();
+
+    // Another format version is ignored as a whole
+    std::string other = makeTestDir("integrity-version");
+    writeFile(other + "/.integrity_index", "AMP integrity 2\ngood.mp3\t3\t1\t" + std::string(SHA256_ABC) + "\t" + std::to_string(now) + "\n");
+    IntegrityIndex newer;
+    newer.verifyFolder(other, {}, nullptr);
+    CHECK_EQ(newer.get("good.mp3"), std::string());
+    newer.stop();
+}
+
+UNIT_TEST(integrityIndexFindsADamagedFile)
+{
+    std::string dir = makeTestDir("integrity-damaged");
+    writeFile(dir + "/track.mp3", "hello");
+    {
+        // The right size and modification time, but the digest of other contents, checked long ago
+        IntegrityIndex writer;
+        writer.record(dir, "track.mp3", SHA256_ABC);
+    }
+    std::vector<std::string> lines = readLines(dir + "/.integrity_index");
+    CHECK_EQ(lines.size(), (size_t)2);
+    if (lines.size() != 2) return;
+    std::vector<std::string> fields = splitTabs(lines[1]);
+    writeFile(dir + "/.integrity_index", lines[0] + "\n" + fields[0] + "\t" + fields[1] + "\t" + fields[2] + "\t" + fields[3] + "\t0\n");
+
+    std::atomic<int> damaged{0};
+    IntegrityIndex index;
+    index.verifyFolder(dir, {"track.mp3"}, [&damaged](const std::string& fileName) {
+        if (fileName == "track.mp3") damaged++;
+    });
+    for (int waited = 0; damaged == 0 && waited < 5000; waited += 10) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    index.stop();
+    CHECK_EQ(damaged.load(), 1);
+    CHECK_EQ(index.get("track.mp3"), std::string());
+}
@@ -0,0 +1,47 @@
+#include "unitTest.h"
+#include "plugin/lockFile.h"
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Whether another process can take key in the lock file at path
+static bool lockableElsewhere(const std::string& path, uint64_t key)
+{
+    pid_t child = fork();
+    if (child == 0) {
+        LockFile other;
+        other.open(path);
+        _exit(other.tryLock(key) ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+UNIT_TEST(lockFileExcludesOtherProcesses)
+{
+    std::string path = makeTestDir("lock-exclude") + "/.locks";
+    LockFile locks;
+    CHECK(locks.open(path));
+    CHECK(locks.tryLock(42));
+    CHECK(!lockableElsewhere(path, 42));
+    CHECK(lockableElsewhere(path, 43));
+    locks.unlock(42);
+    CHECK(lockableElsewhere(path, 42));
+}
+
+UNIT_TEST(lockFileCollidingKeysShareOneHold)
+{
+    std::string path = makeTestDir("lock-collide") + "/.locks";
+    LockFile locks;
+    CHECK(locks.open(path));
+    // The same byte of the file
+    uint64_t first = 7;
+    uint64_t second = 7 + (1ULL << 30);
+    CHECK(locks.tryLock(first));
+    CHECK(locks.tryLock(second));
+    // Unlocking one leaves the other held
+    locks.unlock(second);
+    CHECK(!lockableElsewhere(path, first));
+    locks.unlock(first);
+    CHECK(lockableElsewhere(path, first));
+}
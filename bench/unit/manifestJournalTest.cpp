@@ -0,0 +1,121 @@
+#include "unitTest.h"
+#include "plugin/manifestJournal.h"
+#include <fstream>
+#include <sstream>
+
+static std::string readFile(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+static void appendRaw(const std::string& path, const std::string& text)
+{
+    std::ofstream(path, std::ios::binary | std::ios::app) << text;
+}
+
+UNIT_TEST(manifestJournalFormat)
+{
+    std::string dir = makeTestDir("journal-format");
+    LockFile locks;
+    locks.open(dir + "/.locks");
+    ManifestJournal journal;
+    journal.open(dir, &locks);
+
+    std::string header = readFile(dir + "/.manifest_journal");
+    CHECK_EQ(header.compare(0, 12, "AMP journal "), 0);
+    CHECK_EQ(header.back(), '\n');
+    CHECK_EQ(header.find('\n'), header.size() - 1);
+
+    journal.append(true, "a.mp3");
+    journal.append(false, "b.m4a");
+    CHECK_EQ(readFile(dir + "/.manifest_journal"), header + "+a.mp3\n-b.m4a\n");
+
+    // Opening again keeps the generation
+    ManifestJournal other;
+    other.open(dir, &locks);
+    CHECK_EQ(readFile(dir + "/.manifest_journal"), header + "+a.mp3\n-b.m4a\n");
+}
+
+UNIT_TEST(manifestJournalReadsWhatWasAppendedSince)
+{
+    std::string dir = makeTestDir("journal-read");
+    LockFile locks;
+    locks.open(dir + "/.locks");
+    ManifestJournal reader, writer;
+    reader.open(dir, &locks);
+    writer.open(dir, &locks);
+    writer.append(true, "before.mp3");
+
+    // The first call only finds the generation; the caller lists the folder
+    std::vector<ManifestJournal::Change> changes;
+    CHECK(!reader.readChanges(changes));
+    CHECK(changes.empty());
+
+    writer.append(true, "a.mp3");
+    reader.append(false, "before.mp3");
+    CHECK(reader.readChanges(changes));
+    CHECK_EQ(changes.size(), (size_t)2);
+    if (changes.size() != 2) return;
+    CHECK(changes[0].added);
+    CHECK_EQ(changes[0].fileName, std::string("a.mp3"));
+    CHECK(!changes[1].added);
+    CHECK_EQ(changes[1].fileName, std::string("before.mp3"));
+
+    changes.clear();
+    CHECK(reader.readChanges(changes));
+    CHECK(changes.empty());
+}
+
+UNIT_TEST(manifestJournalWaitsForWholeLines)
+{
+    std::string dir = makeTestDir("journal-partial");
+    LockFile locks;
+    locks.open(dir + "/.locks");
+    ManifestJournal journal;
+    journal.open(dir, &locks);
+    std::vector<ManifestJournal::Change> changes;
+    journal.readChanges(changes);
+
+    // An append under way in another process
+    appendRaw(dir + "/.manifest_journal", "+whole.mp3\n+hal");
+    CHECK(journal.readChanges(changes));
+    CHECK_EQ(changes.size(), (size_t)1);
+
+    changes.clear();
+    appendRaw(dir + "/.manifest_journal", "f.mp3\n");
+    CHECK(journal.readChanges(changes));
+    CHECK_EQ(changes.size(), (size_t)1);
+    if (changes.size() != 1) return;
+    CHECK_EQ(changes[0].fileName, std::string("half.mp3"));
+}
+
+UNIT_TEST(manifestJournalStartsOverWhenFull)
+{
+    std::string dir = makeTestDir("journal-full");
+    LockFile locks;
+    locks.open(dir + "/.locks");
+    ManifestJournal journal;
+    journal.open(dir, &locks);
+    std::vector<ManifestJournal::Change> changes;
+    journal.readChanges(changes);
+    std::string header = readFile(dir + "/.manifest_journal");
+
+    std::string fileName(200, 'x');
+    for (int i = 0; i < 2000; i++) {
+        journal.append(true, fileName);
+    }
+    std::string contents = readFile(dir + "/.manifest_journal");
+    CHECK(contents.size() <= 256 * 1024);
+    CHECK(contents.compare(0, header.size(), header) != 0);
+
+    // A new generation: list the folder again, then follow it
+    changes.clear();
+    CHECK(!journal.readChanges(changes));
+    journal.append(false, "gone.mp3");
+    changes.clear();
+    CHECK(journal.readChanges(changes));
+    CHECK_EQ(changes.size(), (size_t)1);
+}
@@ -0,0 +1,192 @@
+#include "unitTest.h"
+#include "plugin/tagReader.h"
+#include <cmath>
+#include <string>
+
+static std::string be32(uint32_t value)
+{
+    return {(char)(value >> 24), (char)(value >> 16), (char)(value >> 8), (char)value};
+}
+
+static std::string syncsafe32(uint32_t value)
+{
+    return {(char)((value >> 21) & 0x7F), (char)((value >> 14) & 0x7F), (char)((value >> 7) & 0x7F), (char)(value & 0x7F)};
+}
+
+// ID3v2.3 or 2.4 frame; frame sizes are plain in 2.3 and syncsafe in 2.4
+static std::string id3Frame(int major, const std::string& id, const std::string& body)
+{
+    return id + (major == 4 ? syncsafe32((uint32_t)body.size()) : be32((uint32_t)body.size())) + std::string(2, '\0') + body;
+}
+
+static std::string id3Tag(int major, const std::string& frames)
+{
+    return std::string("ID3") + (char)major + std::string(2, '\0') + syncsafe32((uint32_t)frames.size()) + frames;
+}
+
+// Latin-1 text frame body
+static std::string latin1(const std::string& text)
+{
+    return std::string(1, '\0') + text;
+}
+
+// UTF-16 text frame body with a little endian byte order mark; ASCII text only
+static std::string utf16(const std::string& text)
+{
+    std::string body = "\x01\xFF\xFE";
+    for (char c : text) {
+        body += c;
+        body += '\0';
+    }
+    return body + std::string(2, '\0');
+}
+
+// count MPEG 1 Layer III frames, 128 kbit/s, 44.1 kHz, stereo: 417 bytes each
+static std::string mpegFrames(int count, const std::string& firstFrameExtra = "")
+{
+    std::string audio;
+    for (int i = 0; i < count; i++) {
+        std::string frame = "\xFF\xFB\x90";
+        frame += '\0';
+        if (i == 0) frame += firstFrameExtra;
+        frame.resize(417, '\0');
+        audio += frame;
+    }
+    return audio;
+}
+
+static std::string atom(const std::string& type, const std::string& body)
+{
+    return be32((uint32_t)(body.size() + 8)) + type + body;
+}
+
+// An ilst item holding one data atom
+static std::string ilstItem(const std::string& type, const std::string& payload)
+{
+    return atom(type, atom("data", std::string(8, '\0') + payload));
+}
+
+static std::string mp4File(uint32_t timescale, uint32_t duration, const std::string& ilst)
+{
+    std::string mvhd = std::string(12, '\0') + be32(timescale) + be32(duration) + std::string(80, '\0');
+    std::string meta = std::string(4, '\0') + atom("hdlr", std::string(25, '\0')) + atom("ilst", ilst);
+    return atom("ftyp", "M4A " + std::string(4, '\0')) + atom("moov", atom("mvhd", mvhd) + atom("udta", atom("meta", meta)));
+}
+
+static bool readMetadata(const std::string& file, TrackMetadata& metadata)
+{
+    return readTrackMetadata((const unsigned char*)file.data(), file.size(), metadata);
+}
+
+UNIT_TEST(musicalKeyNoteNames)
+{
+    CHECK_EQ(parseMusicalKey("Am"), 1);
+    CHECK_EQ(parseMusicalKey("F#m"), 10);
+    CHECK_EQ(parseMusicalKey("G#m"), 12);
+    CHECK_EQ(parseMusicalKey("A"), 13);
+    CHECK_EQ(parseMusicalKey("Ab"), 24);
+    CHECK_EQ(parseMusicalKey("Bb"), 14);
+    CHECK_EQ(parseMusicalKey("Dbmaj"), 17);
+    CHECK_EQ(parseMusicalKey("C minor"), 4);
+    CHECK_EQ(parseMusicalKey("c major"), 16);
+    CHECK_EQ(parseMusicalKey("E\xE2\x99\xAD" "m"), 7);
+    CHECK_EQ(parseMusicalKey("F\xE2\x99\xAF"), 22);
+}
+
+UNIT_TEST(musicalKeyCamelot)
+{
+    CHECK_EQ(parseMusicalKey("8A"), 1);   // Am
+    CHECK_EQ(parseMusicalKey("8B"), 16);  // C
+    CHECK_EQ(parseMusicalKey("1A"), 12);  // G#m
+    CHECK_EQ(parseMusicalKey("5A"), 4);   // Cm
+    CHECK_EQ(parseMusicalKey("12b"), 20); // E
+    CHECK_EQ(parseMusicalKey(" 11 A"), 10); // F#m
+}
+
+UNIT_TEST(musicalKeyRejectsWhatIsNotAKey)
+{
+    CHECK_EQ(parseMusicalKey(""), 0);
+    CHECK_EQ(parseMusicalKey("H"), 0);
+    CHECK_EQ(parseMusicalKey("13A"), 0);
+    CHECK_EQ(parseMusicalKey("0B"), 0);
+    CHECK_EQ(parseMusicalKey("8C"), 0);
+    CHECK_EQ(parseMusicalKey("Cx"), 0);
+}
+
+UNIT_TEST(id3v23TextFramesAndConstantBitrate)
+{
+    std::string frames = id3Frame(3, "TBPM", latin1("128")) + id3Frame(3, "TKEY", latin1("8A")) +
+                         id3Frame(3, "TYER", latin1("2019")) + id3Frame(3, "TCON", latin1("(17)")) +
+                         id3Frame(3, "TIT2", latin1("Ignored"));
+    TrackMetadata metadata;
+    CHECK(readMetadata(id3Tag(3, frames) + mpegFrames(100), metadata));
+    CHECK(std::fabs(metadata.bpm - 128) < 0.001);
+    CHECK_EQ(metadata.key, 1);
+    CHECK_EQ(metadata.year, 2019);
+    CHECK_EQ(metadata.genre, std::string("Rock"));
+    // 100 frames of 417 bytes at 128 kbit/s
+    CHECK(std::fabs(metadata.length - 2.606) < 0.01);
+}
+
+UNIT_TEST(id3v24Utf16TextAndXingFrameCount)
+{
+    std::string frames = id3Frame(4, "TCON", utf16("Deep House")) + id3Frame(4, "TKEY", utf16("F#m")) +
+                         id3Frame(4, "TDRC", latin1("2021-05-01"));
+    // Xing header after the 32 bytes of side information, announcing 1000 frames
+    std::string xing = std::string(32, '\0') + "Xing" + be32(1) + be32(1000);
+    TrackMetadata metadata;
+    CHECK(readMetadata(id3Tag(4, frames) + mpegFrames(3, xing), metadata));
+    CHECK_EQ(metadata.genre, std::string("Deep House"));
+    CHECK_EQ(metadata.key, 10);
+    CHECK_EQ(metadata.year, 2021);
+    CHECK(std::fabs(metadata.length - 1000 * 1152 / 44100.0) < 0.01);
+}
+
+UNIT_TEST(id3GenreRefinementAfterTheNumber)
+{
+    TrackMetadata metadata;
+    CHECK(readMetadata(id3Tag(3, id3Frame(3, "TCON", latin1("(18)Minimal Techno"))), metadata));
+    CHECK_EQ(metadata.genre, std::string("Minimal Techno"));
+
+    TrackMetadata plain;
+    CHECK(readMetadata(id3Tag(3, id3Frame(3, "TCON", latin1("35"))), plain));
+    CHECK_EQ(plain.genre, std::string("House"));
+}
+
+UNIT_TEST(mp4DurationAndIlstItems)
+{
+    std::string name = atom("mean", std::string(4, '\0') + "com.apple.iTunes") + atom("name", std::string(4, '\0') + "initialkey");
+    std::string ilst = ilstItem("\xA9gen", "Techno") + ilstItem("tmpo", std::string("\0\x7C", 2)) + ilstItem("\xA9" "day", "2020") +
+                       atom("----", name + atom("data", std::string(8, '\0') + "5A"));
+    TrackMetadata metadata;
+    CHECK(readMetadata(mp4File(1000, 215500, ilst), metadata));
+    CHECK(std::fabs(metadata.length - 215.5) < 0.001);
+    CHECK_EQ(metadata.genre, std::string("Techno"));
+    CHECK(std::fabs(metadata.bpm - 124) < 0.001);
+    CHECK_EQ(metadata.year, 2020);
+    CHECK_EQ(metadata.key, 4);
+}
+
+UNIT_TEST(unrecognizedFileHasNoMetadata)
+{
+    std::string noise(4096, '\x55');
+    TrackMetadata metadata;
+    CHECK(!readMetadata(noise, metadata));
+    CHECK_EQ(metadata.length, 0.0f);
+    CHECK_EQ(metadata.key, 0);
+}
+
+UNIT_TEST(embeddedCoverPrefersTheFrontCover)
+{
+    std::string back = std::string(1, '\0') + "image/png" + '\0' + '\x04' + "back" + '\0' + "BACK";
+    std::string front = std::string(1, '\0') + "image/jpeg" + '\0' + '\x03' + '\0' + "FRONT";
+    std::string file = id3Tag(3, id3Frame(3, "APIC", back) + id3Frame(3, "APIC", front)) + mpegFrames(2);
+    const unsigned char* image = nullptr;
+    size_t imageSize = 0;
+    CHECK(findEmbeddedCover((const unsigned char*)file.data(), file.size(), image, imageSize));
+    CHECK_EQ(std::string((const char*)image, imageSize), std::string("FRONT"));
+
+    std::string mp4 = mp4File(1000, 1000, ilstItem("covr", "PNGDATA"));
+    CHECK(findEmbeddedCover((const unsigned char*)mp4.data(), mp4.size(), image, imageSize));
+    CHECK_EQ(std::string((const char*)image, imageSize), std::string("PNGDATA"));
+}
@@ -0,0 +1,54 @@
+#ifndef AMP_UNITTEST_H
+#define AMP_UNITTEST_H
+
+// Minimal test registry for the plugin's parsers and policies, run by ctest:
+//
+//   UNIT_TEST(tokenBucketRefills) {
+//       CHECK(bucket.msUntilAvailable(now) == 0);
+//       CHECK_EQ(parsed, expected);
+//   }
+//
+// A failed check reports its file and line and fails the test; the test keeps running.
+
+#include <cstdio>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct UnitTest {
+    const char* name;
+    std::function<void()> run;
+};
+
+std::vector<UnitTest>& unitTests();
+void reportFailure(const char* file, int line, const std::string& message);
+// A new empty folder under the system's temporary folder, for tests of on-disk formats
+std::string makeTestDir(const char* name);
+
+struct UnitTestRegistration {
+    UnitTestRegistration(const char* name, std::function<void()> run) { unitTests().push_back({name, run}); }
+};
+
+#define UNIT_TEST(name)                                                      \
+    static void name();                                                      \
+    static UnitTestRegistration name##Registration(#name, name);             \
+    static void name()
+
+#define CHECK(condition)                                                     \
+    do {                                                                     \
+        if (!(condition)) reportFailure(__FILE__, __LINE__, #condition);     \
+    } while (0)
+
+#define CHECK_EQ(actual, expected)                                           \
+    do {                                                                     \
+        auto actualValue = (actual);                                         \
+        auto expectedValue = (expected);                                     \
+        if (!(actualValue == expectedValue)) {                               \
+            std::ostringstream message;                                      \
+            message << #actual << " is " << actualValue << ", expected " << expectedValue; \
+            reportFailure(__FILE__, __LINE__, message.str());                \
+        }                                                                    \
+    } while (0)
+
+#endif // AMP_UNITTEST_H
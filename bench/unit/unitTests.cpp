@@ -0,0 +1,60 @@
+// Unit tests of the plugin's parsers, file formats and policies.
+//
+//   amp_unit_tests [NAME...]   runs the tests whose names contain one of NAMEs, or all of them
+
+#include "unitTest.h"
+#include <cstring>
+#include <filesystem>
+#include <unistd.h>
+
+static int failures = 0;
+static std::vector<std::string> testDirs; // removed once the tests ran
+
+std::vector<UnitTest>& unitTests()
+{
+    static std::vector<UnitTest> tests;
+    return tests;
+}
+
+void reportFailure(const char* file, int line, const std::string& message)
+{
+    fprintf(stderr, "  %s:%d: %s\n", file, line, message.c_str());
+    failures++;
+}
+
+std::string makeTestDir(const char* name)
+{
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / ("amp-unit-" + std::to_string(getpid()) + "-" + name);
+    std::error_code ignored;
+    std::filesystem::remove_all(dir, ignored);
+    std::filesystem::create_directories(dir);
+    testDirs.push_back(dir.string());
+    return dir.string();
+}
+
+int main(int argc, char** argv)
+{
+    int run = 0;
+    int failed = 0;
+    for (const UnitTest& test : unitTests()) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc; i++) {
+            selected = selected || strstr(test.name, argv[i]) != nullptr;
+        }
+        if (!selected) continue;
+
+        int before = failures;
+        test.run();
+        run++;
+        if (failures != before) {
+            fprintf(stderr, "FAILED %s\n", test.name);
+            failed++;
+        }
+    }
+    for (const std::string& dir : testDirs) {
+        std::error_code ignored;
+        std::filesystem::remove_all(dir, ignored);
+    }
+    printf("%d tests, %d failed\n", run, failed);
+    return failed == 0 && run > 0 ? 0 : 1;
+}
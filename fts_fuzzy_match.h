@@ -5,6 +5,7 @@
 //   publish, and distribute this file as you see fit.
 //
 // VERSION 
+//   0.3.0  (2026-10-19)  Non-recursive dynamic programming scorer with batch entry point, inline functions
 //   0.2.0  (2017-02-18)  Scored matches perform exhaustive search for best score
 //   0.1.0  (2016-03-28)  Initial release
 //
@@ -25,6 +26,16 @@
 //     Recursion is limited internally (default=10) to prevent degenerate cases (pattern="aaaaaa" str="aaaaaaaaaaaaaaaaaaaaaaaaaaaaaa")
 //     Uses uint8_t for match indices. Therefore patterns are limited to 256 characters.
 //     Score system should be tuned for YOUR use case. Words, sentences, file names, or method names all prefer different tuning.
+//
+//   fuzzy_match_dp(...)
+//     Same scoring as fuzzy_match, but finds the best scoring match with dynamic programming instead of recursion.
+//     Every alignment is considered, so the score is never lower than fuzzy_match's (which gives up after its
+//     recursion limit). Takes O(pattern * str) time and O(str) memory kept in a reusable fuzzy_scratch.
+//     Patterns are limited to 256 characters like fuzzy_match; matched indices are not reported.
+//
+//   fuzzy_match_batch(...)
+//     Scores one pattern against many strings with the caller's scratch buffers. Strings that don't match get
+//     fuzzy_no_match. Returns the number that matched.
 
 
 #ifndef FTS_FUZZY_MATCH_H
@@ -36,12 +47,26 @@
 #include <cstring> // memcpy
 
 #include <cstdio>
+#include <climits> // INT_MIN
+#include <cstddef> // size_t
+#include <vector>
 
 // Public interface
 namespace fts {
-    static bool fuzzy_match_simple(char const * pattern, char const * str);
-    static bool fuzzy_match(char const * pattern, char const * str, int & outScore);
-    static bool fuzzy_match(char const * pattern, char const * str, int & outScore, uint8_t * matches, int maxMatches);
+    const int fuzzy_no_match = INT_MIN;
+
+    // Buffers reused across fuzzy_match_dp calls; they grow to the longest string seen
+    struct fuzzy_scratch {
+        std::vector<int> rows;
+        std::vector<int> bonuses;
+        std::vector<char> lowered;
+    };
+
+    inline bool fuzzy_match_simple(char const * pattern, char const * str);
+    inline bool fuzzy_match(char const * pattern, char const * str, int & outScore);
+    inline bool fuzzy_match(char const * pattern, char const * str, int & outScore, uint8_t * matches, int maxMatches);
+    inline bool fuzzy_match_dp(char const * pattern, char const * str, int & outScore, fuzzy_scratch & scratch);
+    inline int fuzzy_match_batch(char const * pattern, char const * const * strs, size_t count, int * outScores, fuzzy_scratch & scratch);
 }
 
 
@@ -50,13 +75,13 @@ namespace fts {
 
     // Forward declarations for "private" implementation
     namespace fuzzy_internal {
-        static bool fuzzy_match_recursive(const char * pattern, const char * str, int & outScore, const char * strBegin,          
+        inline bool fuzzy_match_recursive(const char * pattern, const char * str, int & outScore, const char * strBegin,          
             uint8_t const * srcMatches,  uint8_t * newMatches,  int maxMatches, int nextMatch, 
             int & recursionCount, int recursionLimit);
     }
 
     // Public interface
-    static bool fuzzy_match_simple(char const * pattern, char const * str) {
+    inline bool fuzzy_match_simple(char const * pattern, char const * str) {
         while (*pattern != '\0' && *str != '\0')  {
             if (tolower(*pattern) == tolower(*str))
                 ++pattern;
@@ -66,21 +91,149 @@ namespace fts {
         return *pattern == '\0' ? true : false;
     }
 
-    static bool fuzzy_match(char const * pattern, char const * str, int & outScore) {
+    inline bool fuzzy_match(char const * pattern, char const * str, int & outScore) {
         
         uint8_t matches[256];
         return fuzzy_match(pattern, str, outScore, matches, sizeof(matches));
     }
 
-    static bool fuzzy_match(char const * pattern, char const * str, int & outScore, uint8_t * matches, int maxMatches) {
+    inline bool fuzzy_match(char const * pattern, char const * str, int & outScore, uint8_t * matches, int maxMatches) {
         int recursionCount = 0;
         int recursionLimit = 10;
 
         return fuzzy_internal::fuzzy_match_recursive(pattern, str, outScore, str, nullptr, matches, maxMatches, 0, recursionCount, recursionLimit);
     }
 
+    inline bool fuzzy_match_dp(char const * pattern, char const * str, int & outScore, fuzzy_scratch & scratch) {
+        // Scores must stay in step with fuzzy_match_recursive
+        const int sequential_bonus = 15;
+        const int separator_bonus = 30;
+        const int camel_bonus = 30;
+        const int first_letter_bonus = 15;
+        const int leading_letter_penalty = -5;
+        const int max_leading_letter_penalty = -15;
+        const int unmatched_letter_penalty = -1;
+        const int impossible = INT_MIN / 2; // leaves room to add bonuses without overflowing
+
+        if (*pattern == '\0' || *str == '\0' || !fuzzy_match_simple(pattern, str))
+            return false;
+
+        const int patternLength = (int)strlen(pattern);
+        const int strLength = (int)strlen(str);
+        if (patternLength > 256)
+            return false;
+
+        // Per character of str: its lowercase form and the bonus for matching it, which don't depend on the pattern
+        scratch.lowered.resize((size_t)strLength);
+        scratch.bonuses.resize((size_t)strLength);
+        for (int j = 0; j < strLength; ++j) {
+            const unsigned char curr = (unsigned char)str[j];
+            int bonus = 0;
+            if (j > 0) {
+                const unsigned char neighbor = (unsigned char)str[j - 1];
+                if (::islower(neighbor) && ::isupper(curr))
+                    bonus += camel_bonus;
+                if (neighbor == '_' || neighbor == ' ')
+                    bonus += separator_bonus;
+            }
+            else {
+                bonus += first_letter_bonus;
+            }
+            scratch.lowered[j] = (char)tolower(curr);
+            scratch.bonuses[j] = bonus;
+        }
+        const char * lowered = scratch.lowered.data();
+        const int * bonuses = scratch.bonuses.data();
+
+        // ending[j]: best score of the pattern so far with its last character matched at str[j]
+        // best[j]: best score of the pattern so far matched anywhere within str[0..j]
+        // One row per pattern character; the previous row is overwritten in place.
+        scratch.rows.resize((size_t)strLength * 2);
+        int * ending = scratch.rows.data();
+        int * best = ending + strLength;
+
+        // First pattern character: the leading letter penalty instead of a predecessor
+        {
+            const char p = (char)tolower((unsigned char)pattern[0]);
+            const int last = strLength - patternLength;
+            int runningBest = impossible;
+            for (int j = 0; j < strLength; ++j) {
+                int score = impossible;
+                if (j <= last && lowered[j] == p) {
+                    int penalty = leading_letter_penalty * j;
+                    if (penalty < max_leading_letter_penalty)
+                        penalty = max_leading_letter_penalty;
+                    score = bonuses[j] + penalty;
+                }
+                if (score > runningBest)
+                    runningBest = score;
+                ending[j] = score;
+                best[j] = runningBest;
+            }
+        }
+
+        for (int i = 1; i < patternLength; ++i) {
+            const char p = (char)tolower((unsigned char)pattern[i]);
+            // pattern[i] can only sit where the rest of the pattern still fits after it
+            const int last = strLength - (patternLength - i);
+
+            // Row i-1 values the current column depends on, saved before they are overwritten
+            int previousEnding = ending[i - 1];                       // ending[j-1]
+            int previousBest = i >= 2 ? best[i - 2] : impossible;     // best[j-2]
+            int previousBestNext = best[i - 1];                       // best[j-1]
+            int runningBest = impossible;
+            ending[i - 1] = impossible;
+            best[i - 1] = impossible;
+
+            for (int j = i; j < strLength; ++j) {
+                const int rowEnding = ending[j];
+                const int rowBest = best[j];
+
+                int score = impossible;
+                if (j <= last && lowered[j] == p) {
+                    // Either right after the previous character's match, or after a gap
+                    int from = previousBest;
+                    if (previousEnding > impossible && previousEnding + sequential_bonus > from)
+                        from = previousEnding + sequential_bonus;
+                    if (from > impossible)
+                        score = bonuses[j] + from;
+                }
+                if (score > runningBest)
+                    runningBest = score;
+
+                ending[j] = score;
+                best[j] = runningBest;
+                previousEnding = rowEnding;
+                previousBest = previousBestNext;
+                previousBestNext = rowBest;
+            }
+        }
+
+        const int matched = best[strLength - 1];
+        if (matched <= impossible)
+            return false;
+
+        outScore = 100 + matched + unmatched_letter_penalty * (strLength - patternLength);
+        return true;
+    }
+
+    inline int fuzzy_match_batch(char const * pattern, char const * const * strs, size_t count, int * outScores, fuzzy_scratch & scratch) {
+        int matchCount = 0;
+        for (size_t i = 0; i < count; ++i) {
+            int score;
+            if (fuzzy_match_dp(pattern, strs[i], score, scratch)) {
+                outScores[i] = score;
+                ++matchCount;
+            }
+            else {
+                outScores[i] = fuzzy_no_match;
+            }
+        }
+        return matchCount;
+    }
+
     // Private implementation
-    static bool fuzzy_internal::fuzzy_match_recursive(const char * pattern, const char * str, int & outScore, 
+    inline bool fuzzy_internal::fuzzy_match_recursive(const char * pattern, const char * str, int & outScore, 
         const char * strBegin, uint8_t const * srcMatches, uint8_t * matches, int maxMatches, 
         int nextMatch, int & recursionCount, int recursionLimit)
     {
@@ -0,0 +1,76 @@
+#include "backgroundTasks.h"
+#include <chrono>
+
+BackgroundTasks::~BackgroundTasks()
+{
+    stop();
+}
+
+bool BackgroundTasks::start(std::function<void()> task)
+{
+    std::vector<Task> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (stopRequested) {
+            return false;
+        }
+        // Reap the tasks that are done, so a long-lived owner doesn't collect threads
+        for (size_t i = 0; i < tasks.size();) {
+            if (*tasks[i].finished) {
+                finished.push_back(std::move(tasks[i]));
+                tasks[i] = std::move(tasks.back());
+                tasks.pop_back();
+            } else {
+                i++;
+            }
+        }
+        auto done = std::make_shared<std::atomic<bool>>(false);
+        tasks.push_back({std::thread([task, done]() {
+            task();
+            *done = true;
+        }), done});
+    }
+    for (Task& reaped : finished) {
+        reaped.thread.join();
+    }
+    return true;
+}
+
+bool BackgroundTasks::sleepFor(int ms)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    return !wake.wait_for(lock, std::chrono::milliseconds(ms), [this]() { return stopRequested.load(); });
+}
+
+void BackgroundTasks::requestStop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopRequested = true;
+    }
+    wake.notify_all();
+}
+
+void BackgroundTasks::stop()
+{
+    requestStop();
+    std::vector<Task> stopping;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping.swap(tasks);
+    }
+    for (Task& task : stopping) {
+        // A task stopping its own owner can't wait for itself
+        if (task.thread.get_id() == std::this_thread::get_id()) {
+            task.thread.detach();
+        } else {
+            task.thread.join();
+        }
+    }
+}
+
+void BackgroundTasks::resume()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopRequested = false;
+}
@@ -0,0 +1,49 @@
+#ifndef VDJ_BACKGROUNDTASKS_H
+#define VDJ_BACKGROUNDTASKS_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads an owner runs in the background, so it can stop and join them before it goes away
+// (VirtualDJ may unload the plugin at any time). Long-running tasks check stopping() or wait in
+// sleepFor; tasks waiting on a condition variable of their owner are woken by the owner, after
+// requestStop, with its mutex held in between so the wake-up can't be missed.
+class BackgroundTasks
+{
+public:
+    BackgroundTasks() {}
+    ~BackgroundTasks();
+    BackgroundTasks(const BackgroundTasks&) = delete;
+    BackgroundTasks& operator=(const BackgroundTasks&) = delete;
+
+    // Run task on a thread of its own. False, and task not run, once stopping.
+    bool start(std::function<void()> task);
+
+    bool stopping() const { return stopRequested; }
+    // Sleep for ms, returning early (false) when asked to stop
+    bool sleepFor(int ms);
+
+    void requestStop();
+    // requestStop, then wait for every task to finish. Idempotent.
+    void stop();
+    // Accept tasks again after stop
+    void resume();
+
+private:
+    struct Task {
+        std::thread thread;
+        std::shared_ptr<std::atomic<bool>> finished;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<Task> tasks;
+    std::atomic<bool> stopRequested{false};
+};
+
+#endif // VDJ_BACKGROUNDTASKS_H
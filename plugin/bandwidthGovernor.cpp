@@ -0,0 +1,160 @@
+#include "bandwidthGovernor.h"
+#include "settings.h"
+#include "metrics.h"
+#include "utilities.h"
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+
+// Overridable with .camp_bandwidth_kbps, .camp_stream_background_kbps (KB/s) and .camp_stream_lease (seconds)
+static const int DEFAULT_STREAM_BACKGROUND_KBPS = 256;
+static const int DEFAULT_STREAM_LEASE_SECONDS = 600;
+// A bucket holds this much of a second's worth, so short bursts pass but a stream can't be flooded
+static const int64_t BURST_FRACTION = 4;
+static const int64_t MIN_BURST_BYTES = 16384;
+
+static int64_t nowUs()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TokenBucket::setRate(int64_t bytesPerSecond)
+{
+    rate = bytesPerSecond;
+    burst = std::max(MIN_BURST_BYTES, rate / BURST_FRACTION);
+    tokens = burst;
+    lastUs = nowUs();
+}
+
+void TokenBucket::refill(int64_t now)
+{
+    if (now <= lastUs) return;
+    int64_t earned = (now - lastUs) * rate / 1000000;
+    if (earned == 0) return; // keep the remainder for the next refill
+    tokens = std::min(burst, tokens + earned);
+    lastUs = now;
+}
+
+void TokenBucket::take(int64_t bytes, int64_t now)
+{
+    if (!isLimited()) return;
+    refill(now);
+    tokens -= bytes;
+}
+
+int TokenBucket::msUntilAvailable(int64_t now)
+{
+    if (!isLimited()) return 0;
+    refill(now);
+    if (tokens > 0) return 0;
+    return (int)((-tokens + 1) * 1000 / rate) + 1;
+}
+
+BandwidthGovernor::BandwidthGovernor()
+    : BandwidthGovernor((int64_t)readIntSetting(".camp_bandwidth_kbps", 0, 0, 10000000) * 1024,
+                        (int64_t)readIntSetting(".camp_stream_background_kbps", DEFAULT_STREAM_BACKGROUND_KBPS, 0, 10000000) * 1024,
+                        readIntSetting(".camp_stream_lease", DEFAULT_STREAM_LEASE_SECONDS, 0, 86400))
+{
+    if (total.isLimited() || streamingRate > 0) {
+        logDebug("BandwidthGovernor: Cap " + std::to_string(total.getRate() / 1024) + " KB/s, background while streaming " +
+                 std::to_string(streamingRate / 1024) + " KB/s (0 = unlimited)");
+    }
+}
+
+BandwidthGovernor::BandwidthGovernor(int64_t totalRate, int64_t streamingRate, int leaseSeconds)
+    : streamingRate(streamingRate), leaseSeconds(leaseSeconds)
+{
+    total.setRate(totalRate);
+    streaming.setRate(streamingRate);
+}
+
+void BandwidthGovernor::charge(TransferPriority priority, int64_t bytes)
+{
+    if (bytes <= 0) return;
+    int64_t now = nowUs();
+    std::lock_guard<std::mutex> lock(mutex);
+    total.take(bytes, now);
+    if (priority == TransferPriority::Background && streamingLocked(now)) {
+        streaming.take(bytes, now);
+    }
+}
+
+int BandwidthGovernor::delayMs(TransferPriority priority)
+{
+    if (priority == TransferPriority::Interactive) return 0;
+
+    int64_t now = nowUs();
+    std::lock_guard<std::mutex> lock(mutex);
+    int delay = total.msUntilAvailable(now);
+    if (priority == TransferPriority::Background && streamingLocked(now)) {
+        delay = std::max(delay, streaming.msUntilAvailable(now));
+    }
+    return delay;
+}
+
+void BandwidthGovernor::wait(TransferPriority priority)
+{
+    static MetricCounter& throttled = getCounter("amp_bandwidth_throttled_ms_total", "Time downloads were held back by the bandwidth governor");
+
+    int delay;
+    // Unloading: the transfer is about to be aborted anyway
+    while (!transfersStopped() && (delay = delayMs(priority)) > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        throttled.add(delay);
+    }
+}
+
+bool BandwidthGovernor::streamingLocked(int64_t now)
+{
+    return relayedStreams > 0 || now < streamUntilUs;
+}
+
+void BandwidthGovernor::startStreamingLocked(int64_t now)
+{
+    if (!streamingLocked(now)) {
+        // Start from a full bucket rather than whatever was left from the last stream
+        streaming.setRate(streamingRate);
+        logDebug("BandwidthGovernor: Remote stream started, holding background transfers to " +
+                 std::to_string(streamingRate / 1024) + " KB/s");
+    }
+}
+
+void BandwidthGovernor::noteRemoteStream()
+{
+    static MetricCounter& leases = getCounter("amp_remote_stream_leases_total", "Remote streams that made background transfers yield bandwidth");
+
+    if (streamingRate == 0 || leaseSeconds == 0) return;
+    int64_t now = nowUs();
+    std::lock_guard<std::mutex> lock(mutex);
+    startStreamingLocked(now);
+    streamUntilUs = std::max(streamUntilUs, now + (int64_t)leaseSeconds * 1000000);
+    leases.add();
+}
+
+void BandwidthGovernor::beginRemoteStream()
+{
+    if (streamingRate == 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    startStreamingLocked(nowUs());
+    relayedStreams++;
+}
+
+void BandwidthGovernor::endRemoteStream()
+{
+    if (streamingRate == 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    relayedStreams--;
+}
+
+bool BandwidthGovernor::isRemoteStreamActive()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return streamingLocked(nowUs());
+}
+
+BandwidthGovernor& getBandwidthGovernor()
+{
+    static BandwidthGovernor governor;
+    return governor;
+}
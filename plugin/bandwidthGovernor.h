@@ -0,0 +1,81 @@
+#ifndef VDJ_BANDWIDTHGOVERNOR_H
+#define VDJ_BANDWIDTHGOVERNOR_H
+
+#include "connectionPool.h"
+#include <mutex>
+#include <cstdint>
+
+// Bytes per second refilled into a bucket of `burst` bytes. Receiving may run the bucket
+// into debt (a transfer's bytes are only known after they arrived); it is then held back
+// until the debt is paid off.
+class TokenBucket
+{
+public:
+    // 0 = unlimited
+    void setRate(int64_t bytesPerSecond);
+    bool isLimited() const { return rate > 0; }
+    int64_t getRate() const { return rate; }
+
+    void take(int64_t bytes, int64_t nowUs);
+    // Time until the bucket is out of debt, 0 if it already is
+    int msUntilAvailable(int64_t nowUs);
+
+private:
+    void refill(int64_t nowUs);
+
+    int64_t rate = 0;
+    int64_t burst = 0;
+    int64_t tokens = 0;
+    int64_t lastUs = 0;
+};
+
+// Shares the link between the plugin's transfers. Everything received counts against
+// .camp_bandwidth_kbps (0, the default, is no cap). While a deck streams a remote track,
+// background transfers are also held to .camp_stream_background_kbps (256 by default), so a
+// cache download can't cause dropouts; once the stream is over they get the link back.
+// Only downloads and intro fetches wait for the governor: everything else is small and latency
+// sensitive, and is counted so that downloads make room for it. The governor is what keeps a
+// download from crowding out a stream: downloads run on HTTP/1.1 connections of their own, out
+// of reach of the HTTP/2 stream weights (see performOwnTransfer). bench/unit tests both.
+class BandwidthGovernor
+{
+public:
+    // Rates and lease from the settings
+    BandwidthGovernor();
+    // Bytes per second (0 = unlimited) and lease in seconds, for tests
+    BandwidthGovernor(int64_t totalRate, int64_t streamingRate, int leaseSeconds);
+
+    // Bytes a transfer of this priority received since it was last charged
+    void charge(TransferPriority priority, int64_t bytes);
+    // How long a transfer of this priority should wait before receiving more, 0 = go ahead
+    int delayMs(TransferPriority priority);
+    // Sleep until a transfer of this priority may receive again
+    void wait(TransferPriority priority);
+
+    // A remote stream URL was handed to VirtualDJ, which reads it on its own: the plugin can't
+    // see when that ends, so it counts as streaming for .camp_stream_lease seconds (600 by
+    // default, longer than most tracks take to play, let alone to buffer). Each load renews it.
+    void noteRemoteStream();
+    // A remote stream the plugin relays itself (the rest of a cached intro), from its first
+    // byte to its last; no lease is needed for these
+    void beginRemoteStream();
+    void endRemoteStream();
+    bool isRemoteStreamActive();
+
+private:
+    // Called with the mutex held
+    bool streamingLocked(int64_t nowUs);
+    void startStreamingLocked(int64_t nowUs);
+
+    std::mutex mutex;
+    TokenBucket total;
+    TokenBucket streaming; // background transfers while a stream plays
+    int64_t streamingRate;
+    int leaseSeconds;
+    int64_t streamUntilUs = 0;
+    int relayedStreams = 0;
+};
+
+BandwidthGovernor& getBandwidthGovernor();
+
+#endif // VDJ_BANDWIDTHGOVERNOR_H
@@ -1,5 +1,9 @@
 #include "../AMP.h"
+#include "settings.h"
+#include "tracing.h"
+#include "metrics.h"
 #include "utilities.h"
+#include "mappedFile.h"
 #include <string>
 #include <vector>
 #include <fstream>
@@ -11,6 +15,7 @@
 #include <windows.h>
 #elif defined(VDJ_MAC)
 #include <sys/stat.h>
+#include <dirent.h>
 #endif
 
 void CAMP::downloadTrackToCache(const char* uniqueId)
@@ -23,16 +28,18 @@ void CAMP::downloadTrackToCache(const char* uniqueId)
         return;
     }
 
-    ensureTracksAreCached();
+    std::shared_ptr<const FolderListing> catalog = ensureTracksAreCached();
 
     std::string downloadUrl;
 
     // Try to find the track in the master cache first
     const TrackInfo* trackToDownload = nullptr;
-    for (const auto& track : cachedTracks) {
-        if (track.uniqueId == uniqueId) {
-            trackToDownload = &track;
-            break;
+    if (catalog) {
+        for (const auto& track : catalog->tracks) {
+            if (track.uniqueId == uniqueId) {
+                trackToDownload = &track;
+                break;
+            }
         }
     }
 
@@ -45,7 +52,7 @@ void CAMP::downloadTrackToCache(const char* uniqueId)
         std::string id = uniqueId;
         if (!id.empty() && id != "fallback") {
             std::string encodedPath = urlEncode(id);
-            downloadUrl = "https://tracks.abelldjcompany.com/audio/" + encodedPath;
+            downloadUrl = getTracksBaseUrl() + "/audio/" + encodedPath;
         }
     }
 
@@ -61,15 +68,61 @@ void CAMP::downloadTrackToCache(const char* uniqueId)
         // Copy variables to pass to the thread
         std::string uniqueIdStr = uniqueId;
 
-        std::thread([this, downloadUrl, filePath, uniqueIdStr]() {
-            if (downloadFile(downloadUrl, filePath)) {
-                logDebug("Background download successful for uniqueId: " + uniqueIdStr);
+        backgroundTasks.start([this, downloadUrl, filePath, uniqueIdStr]() {
+            std::string fileName = getCacheFileNameForTrack(uniqueIdStr.c_str());
+            {
+                std::lock_guard<std::mutex> lock(manifestMutex);
+                if (!downloadsInFlight.insert(fileName).second) {
+                    logDebug("Already downloading " + fileName);
+                    return;
+                }
+            }
+
+            // Another VirtualDJ downloading the same track: wait for it and use its file
+            uint64_t lockKey = hashString(fileName);
+            if (!cacheLocks.tryLock(lockKey)) {
+                logDebug("Another VirtualDJ is downloading " + fileName + "; waiting for it");
+                do {
+                    if (!backgroundTasks.sleepFor(100)) {
+                        std::lock_guard<std::mutex> lock(manifestMutex);
+                        downloadsInFlight.erase(fileName);
+                        return;
+                    }
+                } while (!cacheLocks.tryLock(lockKey));
+            }
+            uint64_t existingSize;
+            int64_t existingModifiedAt;
+            if (statFile(filePath, existingSize, existingModifiedAt)) {
+                logDebug("Joined the download of " + fileName + " by another VirtualDJ");
+                addToCacheManifest(fileName);
+                metadataIndex.scanFile(getCacheDir(), fileName);
                 cb->SendCommand("browsed_file_color \"#00FF00\"");
             } else {
-                logDebug("Background download failed for uniqueId: " + uniqueIdStr);
-                remove(filePath.c_str());
+                // Downloaded under a hidden name, so a partial file is never taken for a cached track
+                std::string partPath = joinPath(getCacheDir(), "." + fileName + ".part");
+                std::string sha256;
+                bool downloaded = downloadFile(downloadUrl, partPath, sha256);
+#ifdef VDJ_WIN
+                downloaded = downloaded && MoveFileExA(partPath.c_str(), filePath.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+                downloaded = downloaded && rename(partPath.c_str(), filePath.c_str()) == 0;
+#endif
+                if (downloaded) {
+                    logDebug("Background download successful for uniqueId: " + uniqueIdStr + " (SHA-256 " + sha256 + ")");
+                    addToCacheManifest(fileName);
+                    integrityIndex.record(getCacheDir(), fileName, sha256);
+                    metadataIndex.scanFile(getCacheDir(), fileName);
+                    cb->SendCommand("browsed_file_color \"#00FF00\"");
+                } else {
+                    logDebug("Background download failed for uniqueId: " + uniqueIdStr);
+                    remove(partPath.c_str());
+                }
             }
-        }).detach();
+            cacheLocks.unlock(lockKey);
+
+            std::lock_guard<std::mutex> lock(manifestMutex);
+            downloadsInFlight.erase(fileName);
+        });
 
     } else {
         logDebug("Could not determine a download URL for uniqueId: " + std::string(uniqueId));
@@ -84,6 +137,9 @@ void CAMP::deleteTrackFromCache(const char* uniqueId)
     if (isTrackCached(uniqueId)) {
         std::string filePath = getCachePathForTrack(uniqueId);
         if (!filePath.empty()) {
+            removeFromCacheManifest(getCacheFileNameForTrack(uniqueId));
+            metadataIndex.remove(getCacheFileNameForTrack(uniqueId));
+            integrityIndex.remove(getCacheFileNameForTrack(uniqueId));
             if (remove(filePath.c_str()) == 0) {
                 logDebug("Successfully deleted cached track: " + filePath);
                 cb->SendCommand("browsed_file_color \"#D8D8D8\"");
@@ -96,124 +152,425 @@ void CAMP::deleteTrackFromCache(const char* uniqueId)
     }
 }
 
+static MetricGauge& cachedFilesGauge()
+{
+    static MetricGauge& gauge = getGauge("amp_cache_files", "Tracks in the local AMP cache");
+    return gauge;
+}
+
 bool CAMP::isTrackCached(const char* uniqueId)
 {
+    TRACE_SPAN("cache.check");
+    static MetricCounter& hits = getCounter("amp_cache_checks_total{result=\"hit\"}", "Cache lookups for a track, by outcome");
+    static MetricCounter& misses = getCounter("amp_cache_checks_total{result=\"miss\"}", "Cache lookups for a track, by outcome");
+    if (!uniqueId) return false;
+
+    refreshCacheManifest();
+    {
+        std::lock_guard<std::mutex> lock(manifestMutex);
+        if (manifestReady) {
+            bool cached = cacheManifest.count(cacheFileNameFor(uniqueId)) > 0;
+            (cached ? hits : misses).add();
+            return cached;
+        }
+    }
+
     std::string path = getCachePathForTrack(uniqueId);
     if (path.empty()) {
+        misses.add();
         return false;
     }
 
     std::ifstream f(path.c_str());
     if (f.good()) {
         f.close();
+        hits.add();
         return true;
     }
     
+    misses.add();
     return false;
 }
 
-std::string CAMP::getCacheDir()
+// Percent-encode a path for a file:// URL, leaving '/' alone
+static void appendUrlEncodedPath(std::string& url, const std::string& path)
 {
-    std::string base_path;
-#ifdef VDJ_WIN
-    char* userProfile = getenv("USERPROFILE");
-    if (userProfile) {
-        base_path = std::string(userProfile) + "\\AppData\\Local\\VirtualDJ";
+    static const char digits[] = "0123456789ABCDEF";
+    for (char c : path) {
+        if (isalnum((unsigned char)c) || c == '/' || c == '-' || c == '_' || c == '.' || c == '~') {
+            url += c;
+        } else {
+            url += '%';
+            url += digits[(unsigned char)c >> 4];
+            url += digits[(unsigned char)c & 0x0F];
+        }
     }
+}
+
+// Found (and the folders created) once; the user folder doesn't move while VirtualDJ runs
+const std::string& CAMP::getCacheDir()
+{
+    std::call_once(cacheDirOnce, [this]() {
+        std::string base_path;
+#ifdef VDJ_WIN
+        char* userProfile = getenv("USERPROFILE");
+        if (userProfile) {
+            base_path = std::string(userProfile) + "\\AppData\\Local\\VirtualDJ";
+        }
 #else
-    char* homeDir = getenv("HOME");
-    if (homeDir) {
-        base_path = std::string(homeDir) + "/Library/Application Support/VirtualDJ";
-    }
+        char* homeDir = getenv("HOME");
+        if (homeDir) {
+            base_path = std::string(homeDir) + "/Library/Application Support/VirtualDJ";
+        }
 #endif
-    if(base_path.empty()) return "";
+        if (base_path.empty()) return;
 
 #ifdef VDJ_WIN
-    std::string cache_path = base_path + "\\Cache";
-    CreateDirectoryA(cache_path.c_str(), NULL);
-    std::string amp_cache_path = cache_path + "\\AMP";
-    CreateDirectoryA(amp_cache_path.c_str(), NULL);
-    return amp_cache_path;
+        std::string cache_path = base_path + "\\Cache";
+        CreateDirectoryA(cache_path.c_str(), NULL);
+        cacheDirPath = cache_path + "\\AMP";
+        CreateDirectoryA(cacheDirPath.c_str(), NULL);
+        cacheDirUrl = "file://";
+        appendUrlEncodedPath(cacheDirUrl, cacheDirPath + "\\");
 #else
-    std::string cache_path = base_path + "/Cache";
-    mkdir(cache_path.c_str(), 0777);
-    std::string amp_cache_path = cache_path + "/AMP";
-    mkdir(amp_cache_path.c_str(), 0777);
-    return amp_cache_path;
+        std::string cache_path = base_path + "/Cache";
+        mkdir(cache_path.c_str(), 0777);
+        cacheDirPath = cache_path + "/AMP";
+        mkdir(cacheDirPath.c_str(), 0777);
+        cacheDirUrl = "file://";
+        appendUrlEncodedPath(cacheDirUrl, cacheDirPath + "/");
 #endif
+    });
+    return cacheDirPath;
+}
+
+std::string CAMP::getCacheFileNameForTrack(const char* uniqueId)
+{
+    if (!uniqueId) return "";
+    return cacheFileNameFor(uniqueId);
 }
 
 std::string CAMP::getCachePathForTrack(const char* uniqueId)
 {
     if (!uniqueId || strlen(uniqueId) == 0) return "";
 
-    std::string cacheDir = getCacheDir();
+    const std::string& cacheDir = getCacheDir();
     if (cacheDir.empty()) {
         return "";
     }
+    return joinPath(cacheDir, cacheFileNameFor(uniqueId));
+}
 
-    std::string safeFileName = uniqueId;
-    // Replace problematic characters for a safe file name
-    for (char &c : safeFileName) {
-        if (c == '/' || c == '\\' || c == '$' || c == '?' || c == '*' || c == ':' || 
-            c == '|' || c == '<' || c == '>' || c == '"' || c == '&' || c == '%') {
-            c = '_';
+static bool isPartFileName(const std::string& name)
+{
+    return name.size() > 6 && name[0] == '.' && name.compare(name.size() - 5, 5, ".part") == 0;
+}
+
+// File names (as returned by getCacheFileNameForTrack) of everything in the AMP cache folder
+std::vector<std::string> CAMP::listCachedFiles()
+{
+    refreshCacheManifest();
+    {
+        std::lock_guard<std::mutex> lock(manifestMutex);
+        if (manifestReady) {
+            std::vector<std::string> fileNames;
+            fileNames.reserve(cacheManifest.size());
+            for (const auto& item : cacheManifest) {
+                fileNames.push_back(item.first);
+            }
+            return fileNames;
         }
     }
+    return scanCacheDir();
+}
+
+// partFiles, if given, receives the downloads' hidden ".<file name>.part" files
+std::vector<std::string> CAMP::scanCacheDir(std::vector<std::string>* partFiles)
+{
+    std::vector<std::string> fileNames;
+    std::string cacheDir = getCacheDir();
+    if (cacheDir.empty()) {
+        return fileNames;
+    }
 
 #ifdef VDJ_WIN
-    return cacheDir + "\\" + safeFileName;
+    WIN32_FIND_DATAA findData;
+    HANDLE hFind = FindFirstFileA((cacheDir + "\\*").c_str(), &findData);
+    if (hFind == INVALID_HANDLE_VALUE) {
+        return fileNames;
+    }
+    do {
+        if (!(findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && findData.cFileName[0] != '.') {
+            fileNames.push_back(findData.cFileName);
+        } else if (partFiles && isPartFileName(findData.cFileName)) {
+            partFiles->push_back(findData.cFileName);
+        }
+    } while (FindNextFileA(hFind, &findData));
+    FindClose(hFind);
 #else
-    return cacheDir + "/" + safeFileName;
+    DIR* dir = opendir(cacheDir.c_str());
+    if (!dir) {
+        return fileNames;
+    }
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.' && entry->d_type != DT_DIR) {
+            fileNames.push_back(entry->d_name);
+        } else if (partFiles && entry->d_type != DT_DIR && isPartFileName(entry->d_name)) {
+            partFiles->push_back(entry->d_name);
+        }
+    }
+    closedir(dir);
 #endif
+
+    return fileNames;
+}
+
+// The manifest mirrors the cache folder in memory so isTrackCached needs no file system access.
+// Downloads and deletions made by the plugin keep it up to date, and the manifest journal brings
+// in those of other VirtualDJ processes sharing the folder.
+void CAMP::buildCacheManifest()
+{
+    std::lock_guard<std::mutex> lock(manifestMutex);
+    // Follow the journal from here on; the listing covers everything before
+    std::vector<ManifestJournal::Change> changes;
+    manifestJournal.readChanges(changes);
+    std::vector<std::string> partFiles;
+    std::vector<std::string> fileNames = scanCacheDir(&partFiles);
+    cacheManifest.clear();
+    for (const std::string& fileName : fileNames) {
+        cacheManifest[fileName] = getFileUrlForCacheFile(fileName);
+    }
+    removeOrphanedPartFilesLocked(partFiles);
+    manifestReady = true;
+    manifestCheckedAt = std::chrono::steady_clock::now();
+    cachedFilesGauge().set((int64_t)cacheManifest.size());
+    logDebug("Cache manifest built with " + std::to_string(cacheManifest.size()) + " files");
+}
+
+// Partial downloads left by a crash or a kill. Those of this process are in downloadsInFlight, which
+// can't gain entries while manifestMutex is held; another process downloading holds the file's lock.
+void CAMP::removeOrphanedPartFilesLocked(const std::vector<std::string>& partFiles)
+{
+    for (const std::string& partFile : partFiles) {
+        std::string fileName = partFile.substr(1, partFile.size() - 6);
+        if (downloadsInFlight.count(fileName)) {
+            continue;
+        }
+        uint64_t lockKey = hashString(fileName);
+        if (!cacheLocks.tryLock(lockKey)) {
+            continue;
+        }
+        if (remove(joinPath(getCacheDir(), partFile).c_str()) == 0) {
+            logDebug("Removed the partial download " + partFile);
+        }
+        cacheLocks.unlock(lockKey);
+    }
+}
+
+// Apply what other processes added or deleted, looking at most once a second. The journal is
+// read (and the folder listed, if it started over) without manifestMutex, so the lookups of the
+// host thread don't wait on the file system; the lock is only taken to apply what was found.
+void CAMP::refreshCacheManifest()
+{
+    {
+        std::lock_guard<std::mutex> lock(manifestMutex);
+        auto now = std::chrono::steady_clock::now();
+        if (!manifestReady || manifestRefreshing || now - manifestCheckedAt < std::chrono::seconds(1)) {
+            return;
+        }
+        manifestCheckedAt = now;
+        manifestRefreshing = true;
+    }
+
+    std::vector<ManifestJournal::Change> changes;
+    bool followed = manifestJournal.readChanges(changes);
+    std::vector<std::string> fileNames;
+    if (!followed) {
+        // The journal started over; list the folder instead
+        fileNames = scanCacheDir();
+    }
+
+    std::lock_guard<std::mutex> lock(manifestMutex);
+    if (!followed) {
+        cacheManifest.clear();
+        for (const std::string& fileName : fileNames) {
+            cacheManifest[fileName] = getFileUrlForCacheFile(fileName);
+        }
+        logDebug("Cache manifest rebuilt with " + std::to_string(cacheManifest.size()) + " files");
+    }
+    for (const auto& change : changes) {
+        if (change.added) {
+            cacheManifest.emplace(change.fileName, getFileUrlForCacheFile(change.fileName));
+        } else {
+            cacheManifest.erase(change.fileName);
+        }
+    }
+    manifestRefreshing = false;
+    cachedFilesGauge().set((int64_t)cacheManifest.size());
+}
+
+void CAMP::addToCacheManifest(const std::string& fileName)
+{
+    {
+        std::lock_guard<std::mutex> lock(manifestMutex);
+        cacheManifest[fileName] = getFileUrlForCacheFile(fileName);
+        cachedFilesGauge().set((int64_t)cacheManifest.size());
+    }
+    manifestJournal.append(true, fileName);
+}
+
+void CAMP::removeFromCacheManifest(const std::string& fileName)
+{
+    {
+        std::lock_guard<std::mutex> lock(manifestMutex);
+        cacheManifest.erase(fileName);
+        cachedFilesGauge().set((int64_t)cacheManifest.size());
+    }
+    manifestJournal.append(false, fileName);
+}
+
+// A cached file that no longer matches its digest: better downloaded again than played
+void CAMP::dropDamagedCacheFile(const std::string& fileName)
+{
+    std::string path = joinPath(getCacheDir(), fileName);
+    removeFromCacheManifest(fileName);
+    metadataIndex.remove(fileName);
+    integrityIndex.remove(fileName);
+    if (remove(path.c_str()) == 0) {
+        logDebug("Deleted damaged cached track: " + path);
+    } else {
+        logDebug("Could not delete damaged cached track: " + path);
+    }
 }
 
 std::string CAMP::getEncodedLocalPathForTrack(const char* uniqueId)
 {
-    std::string path = getCachePathForTrack(uniqueId);
-    if (path.empty()) {
+    if (!uniqueId || !*uniqueId) {
         return "";
     }
+    std::string fileName = cacheFileNameFor(uniqueId);
+    {
+        std::lock_guard<std::mutex> lock(manifestMutex);
+        auto it = cacheManifest.find(fileName);
+        if (it != cacheManifest.end()) {
+            return it->second;
+        }
+    }
+    return getFileUrlForCacheFile(fileName);
+}
 
-    // URL encode the path, especially for spaces.
-    std::string encodedPath;
-    encodedPath.reserve(path.size() * 3);
-    for (char c : path) {
-        if (c == ' ') {
-            encodedPath += "%20";
-        } else if (c == '/') {
-            encodedPath += "/";
-        } else if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-            encodedPath += c;
+// file:// URL of a file in the cache folder, URL encoded (especially for spaces)
+std::string CAMP::getFileUrlForCacheFile(const std::string& fileName)
+{
+    if (getCacheDir().empty()) {
+        return "";
+    }
+    std::string url;
+    url.reserve(cacheDirUrl.size() + fileName.size() + 16);
+    url = cacheDirUrl;
+    appendUrlEncodedPath(url, fileName);
+    return url;
+}
+
+// One manifest lookup for a listed track: whether it is cached, and its file:// URL if it is
+bool CAMP::findCachedTrack(const TrackInfo& track, std::string& localUrl)
+{
+    TRACE_SPAN("cache.check");
+    static MetricCounter& hits = getCounter("amp_cache_checks_total{result=\"hit\"}", "Cache lookups for a track, by outcome");
+    static MetricCounter& misses = getCounter("amp_cache_checks_total{result=\"miss\"}", "Cache lookups for a track, by outcome");
+    refreshCacheManifest();
+    {
+        std::lock_guard<std::mutex> lock(manifestMutex);
+        if (manifestReady) {
+            auto it = cacheManifest.find(track.cacheFileName.empty() ? cacheFileNameFor(track.uniqueId) : track.cacheFileName);
+            bool cached = it != cacheManifest.end();
+            if (cached) {
+                localUrl = it->second;
+            }
+            (cached ? hits : misses).add();
+            return cached;
         }
-        else {
-            char buf[4];
-            sprintf(buf, "%%%02X", (unsigned char)c);
-            encodedPath += buf;
+    }
+
+    if (!isTrackCached(track.uniqueId.c_str())) {
+        return false;
+    }
+    localUrl = getEncodedLocalPathForTrack(track.uniqueId.c_str());
+    return true;
+}
+
+// Cover thumbnail URL of a listed track. Until it has one, the thumbnail is made in the
+// background from the cached file's artwork or the backend's cover, for the next listing.
+std::string CAMP::getCoverUrlForTrack(const TrackInfo& track, bool cached)
+{
+    std::string coverUrl = thumbnailCache.getCoverUrl(track.uniqueId);
+    if (coverUrl.empty()) {
+        if (cached) {
+            thumbnailCache.requestFromFile(track.uniqueId, getCachePathForTrack(track.uniqueId.c_str()));
+        } else if (!track.coverUrl.empty()) {
+            thumbnailCache.requestFromUrl(track.uniqueId, track.coverUrl);
         }
     }
-    
-    return "file://" + encodedPath;
+    return coverUrl;
 }
 
-// Caching helper method
-void CAMP::ensureTracksAreCached()
+// Caching helper method. Returns the catalog, loading it (from the disk snapshot or the
+// backend) on first use; later calls pick up background refreshes of the snapshot.
+std::shared_ptr<const FolderListing> CAMP::ensureTracksAreCached()
 {
-    if (tracksCached) {
-        return;
+    // One loader at a time; others wait for it instead of downloading the catalog again
+    std::lock_guard<std::mutex> loadLock(catalogLoadMutex);
+
+    std::shared_ptr<const FolderListing> current = getLoadedCatalog();
+    if (!current) {
+        logDebug("No cached tracks available, fetching from backend");
     }
 
-    logDebug("No cached tracks available, fetching from backend");
+    auto listing = folderCache.get(
+        getApiBaseUrl() + "/api/tracks",
+        [this](const std::string& url, const std::string& etag) { return httpGetAllPages(url, "results", etag); },
+        [this](const std::string& json) {
+            FolderListing parsed;
+            parsed.tracks = parseTracksFromJson(json);
+            parsed.valid = !(parsed.tracks.size() == 1 && parsed.tracks[0].uniqueId.compare(0, 11, "parse_error") == 0);
+            parsed.searchKeys = makeSearchKeys(parsed.tracks);
+            return parsed;
+        });
 
-    // Fetch tracks from backend using new API
-    logDebug("Fetching tracks from backend with authentication");
-    std::string jsonResponse = httpGet("https://music.abelldjcompany.com/api/tracks");
-    if (!jsonResponse.empty()) {
-        logDebug("Received JSON response, parsing tracks");
-        cachedTracks = parseTracksFromJson(jsonResponse);
-        tracksCached = true;
-        logDebug("Tracks cached successfully, count: " + std::to_string(cachedTracks.size()));
-    } else {
+    if (!listing) {
         logDebug("Empty JSON response from backend - authentication may have failed");
+        return current;
+    }
+
+    if (!listing->valid) {
+        logDebug("Catalog response not recognized, keeping the catalog already loaded");
+        return current ? current : listing;
     }
+
+    publishCatalog(listing, current);
+    return getLoadedCatalog();
+}
+
+// Make listing the catalog, unless it is already or the catalog moved on from replacing meanwhile
+// (a newer one published by a background refresh must not be undone by a slower caller)
+void CAMP::publishCatalog(const std::shared_ptr<const FolderListing>& listing, const std::shared_ptr<const FolderListing>& replacing)
+{
+    {
+        std::lock_guard<std::mutex> lock(catalogMutex);
+        if (!listing->valid || listing == catalog || catalog != replacing) {
+            return;
+        }
+        catalog = listing;
+    }
+    updateCatalogMetrics(listing.get());
+    // Search results may reference tracks that changed with this catalog
+    searchCache.clear();
+    logDebug("Tracks cached successfully, count: " + std::to_string(listing->tracks.size()));
+}
+
+// The catalog if it has been loaded, without waiting for the backend
+std::shared_ptr<const FolderListing> CAMP::getLoadedCatalog()
+{
+    std::lock_guard<std::mutex> lock(catalogMutex);
+    return catalog;
 }
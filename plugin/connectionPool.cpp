@@ -0,0 +1,433 @@
+#include "connectionPool.h"
+#include "bandwidthGovernor.h"
+#include "utilities.h"
+#include "endpointHealth.h"
+#include "settings.h"
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include <thread>
+
+// Set by stopTransfers, until resumeTransfers
+static std::atomic<bool> stopping{false};
+
+bool transfersStopped()
+{
+    return stopping;
+}
+
+// .camp_http2 set to 0 keeps every request on HTTP/1.1
+static bool http2Enabled()
+{
+    static bool enabled = readIntSetting(".camp_http2", 1, 0, 1) != 0;
+    return enabled;
+}
+
+#ifdef VDJ_WIN
+#pragma comment(lib, "wininet.lib")
+
+HINTERNET getInternetSession()
+{
+    static HINTERNET hInternet = NULL;
+    static std::once_flag once;
+    std::call_once(once, []() {
+        hInternet = InternetOpenA("VDJ Plugin", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
+        if (!hInternet) {
+            logDebug("getInternetSession: InternetOpenA failed");
+            return;
+        }
+        // WinINet timeouts are per session, so they stay at the default deadline rather than adapting
+        DWORD timeoutMs = (DWORD)getDefaultHttpTimeoutMs();
+        InternetSetOptionA(hInternet, INTERNET_OPTION_CONNECT_TIMEOUT, &timeoutMs, sizeof(timeoutMs));
+        InternetSetOptionA(hInternet, INTERNET_OPTION_RECEIVE_TIMEOUT, &timeoutMs, sizeof(timeoutMs));
+        InternetSetOptionA(hInternet, INTERNET_OPTION_SEND_TIMEOUT, &timeoutMs, sizeof(timeoutMs));
+        // Have WinINet decode gzip/deflate responses while reading; JSON requests ask for them (httpGet, httpGetConditional)
+        BOOL decode = TRUE;
+        InternetSetOptionA(hInternet, INTERNET_OPTION_HTTP_DECODING, &decode, sizeof(decode));
+#ifdef INTERNET_OPTION_ENABLE_HTTP_PROTOCOL
+        // HTTP/2 where the server offers it (Windows 10 and later); requests in this session share its connections
+        if (http2Enabled()) {
+            DWORD protocols = HTTP_PROTOCOL_FLAG_HTTP2;
+            InternetSetOptionA(hInternet, INTERNET_OPTION_ENABLE_HTTP_PROTOCOL, &protocols, sizeof(protocols));
+        }
+#endif
+    });
+    return hInternet;
+}
+
+void prewarmConnections(const std::string& url, int count)
+{
+    HINTERNET hInternet = getInternetSession();
+    if (!hInternet) return;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < count; i++) {
+        threads.emplace_back([hInternet, url]() {
+            HINTERNET hUrl = InternetOpenUrlA(hInternet, url.c_str(), NULL, 0, INTERNET_FLAG_KEEP_CONNECTION, 0);
+            if (hUrl) {
+                InternetCloseHandle(hUrl);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    logDebug("prewarmConnections: Opened " + std::to_string(count) + " connections to " + url);
+}
+
+// WinINet requests run on the threads that made them, which the plugin joins; their read loops check transfersStopped
+void stopTransfers()
+{
+    stopping = true;
+}
+
+void resumeTransfers()
+{
+    stopping = false;
+}
+
+#elif defined(VDJ_MAC)
+
+// Idle handles beyond this are closed instead of pooled
+static const size_t MAX_IDLE_HANDLES = 8;
+// Idle connections the multi handle keeps open
+static const long MAX_IDLE_CONNECTIONS = 16;
+
+static std::mutex poolMutex;
+static std::vector<CURL*> idleHandles;
+static CURLSH* share = nullptr;
+static std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+static void lockShare(CURL*, curl_lock_data data, curl_lock_access, void*)
+{
+    shareLocks[data].lock();
+}
+
+static void unlockShare(CURL*, curl_lock_data data, void*)
+{
+    shareLocks[data].unlock();
+}
+
+static void initCurl()
+{
+    static std::once_flag once;
+    std::call_once(once, []() {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        // Connections aren't shared here: every transfer runs on the one multi handle, which owns them
+        share = curl_share_init();
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    });
+}
+
+// Options every request starts with; callers add URL, callbacks and headers
+static void applyDefaults(CURL* handle)
+{
+    curl_easy_setopt(handle, CURLOPT_SHARE, share);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, "VDJ Plugin");
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, http2Enabled() ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_1_1);
+    // Wait for a connection that is still being set up rather than opening another,
+    // in case it turns out to be HTTP/2 and can carry this request too
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+}
+
+CURL* acquireCurlHandle()
+{
+    initCurl();
+
+    CURL* handle = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(poolMutex);
+        if (!idleHandles.empty()) {
+            handle = idleHandles.back();
+            idleHandles.pop_back();
+        }
+    }
+
+    if (!handle) {
+        handle = curl_easy_init();
+        if (!handle) {
+            logDebug("acquireCurlHandle: curl_easy_init failed");
+            return nullptr;
+        }
+    }
+
+    applyDefaults(handle);
+    return handle;
+}
+
+void releaseCurlHandle(CURL* handle)
+{
+    if (!handle) return;
+
+    // Connections belong to the multi handle, so this only clears the options
+    curl_easy_reset(handle);
+
+    std::lock_guard<std::mutex> lock(poolMutex);
+    if (idleHandles.size() < MAX_IDLE_HANDLES) {
+        idleHandles.push_back(handle);
+    } else {
+        curl_easy_cleanup(handle);
+    }
+}
+
+// A transfer handed to the engine thread; the caller waits until done is set
+struct Transfer {
+    CURL* handle;
+    TransferPriority priority;
+    const std::atomic<bool>* cancel; // may be null
+    CURLcode result;
+    bool done;
+    curl_off_t charged; // bytes received that the bandwidth governor has been told about
+};
+
+static std::mutex engineMutex;
+static std::condition_variable transferDone;
+static std::vector<Transfer*> pendingTransfers;
+static CURLM* multi = nullptr;      // created with the engine thread, both guarded by engineMutex
+static std::thread engineThread;
+
+static void finishTransfer(Transfer* transfer, CURLcode result)
+{
+    std::lock_guard<std::mutex> lock(engineMutex);
+    transfer->result = result;
+    transfer->done = true;
+    transferDone.notify_all();
+}
+
+// Tell the bandwidth governor what the transfer received since the last time, so downloads
+// yield to it. Transfers here are never held back themselves: they are small, and pausing
+// one HTTP/2 stream doesn't slow its connection down anyway.
+static void chargeTransfer(Transfer* transfer)
+{
+    curl_off_t received = 0;
+    curl_easy_getinfo(transfer->handle, CURLINFO_SIZE_DOWNLOAD_T, &received);
+    getBandwidthGovernor().charge(transfer->priority, received - transfer->charged);
+    transfer->charged = received;
+}
+
+// Drives every transfer on one thread, so they can share (and multiplex) connections
+static void runTransfers()
+{
+    std::vector<Transfer*> running;
+    for (;;) {
+        std::vector<Transfer*> starting;
+        bool stopping;
+        {
+            std::lock_guard<std::mutex> lock(engineMutex);
+            starting.swap(pendingTransfers);
+            stopping = ::stopping;
+        }
+        if (stopping) {
+            for (Transfer* transfer : running) {
+                curl_multi_remove_handle(multi, transfer->handle);
+                finishTransfer(transfer, CURLE_ABORTED_BY_CALLBACK);
+            }
+            for (Transfer* transfer : starting) {
+                finishTransfer(transfer, CURLE_ABORTED_BY_CALLBACK);
+            }
+            logDebug("runTransfers: Stopped, aborted " + std::to_string(running.size() + starting.size()) + " transfers");
+            return;
+        }
+
+        // Most urgent first, so they get the first streams and free connections
+        std::stable_sort(starting.begin(), starting.end(), [](const Transfer* a, const Transfer* b) {
+            return a->priority < b->priority;
+        });
+        for (Transfer* transfer : starting) {
+            CURLMcode added = curl_multi_add_handle(multi, transfer->handle);
+            if (added != CURLM_OK) {
+                logDebug(std::string("runTransfers: curl_multi_add_handle failed: ") + curl_multi_strerror(added));
+                finishTransfer(transfer, CURLE_FAILED_INIT);
+            } else {
+                running.push_back(transfer);
+            }
+        }
+
+        for (size_t i = 0; i < running.size();) {
+            Transfer* transfer = running[i];
+            if (transfer->cancel && transfer->cancel->load()) {
+                curl_multi_remove_handle(multi, transfer->handle);
+                running.erase(running.begin() + i);
+                finishTransfer(transfer, CURLE_ABORTED_BY_CALLBACK);
+            } else {
+                i++;
+            }
+        }
+
+        int stillRunning = 0;
+        curl_multi_perform(multi, &stillRunning);
+
+        CURLMsg* message;
+        int queued;
+        while ((message = curl_multi_info_read(multi, &queued))) {
+            if (message->msg != CURLMSG_DONE) continue;
+            CURL* handle = message->easy_handle;
+            CURLcode result = message->data.result;
+            Transfer* transfer = nullptr;
+            curl_easy_getinfo(handle, CURLINFO_PRIVATE, (char**)&transfer);
+            chargeTransfer(transfer);
+            curl_multi_remove_handle(multi, handle);
+            running.erase(std::remove(running.begin(), running.end(), transfer), running.end());
+            finishTransfer(transfer, result);
+        }
+
+        for (Transfer* transfer : running) {
+            chargeTransfer(transfer);
+        }
+
+        // Returns early for socket activity, libcurl's own timers and curl_multi_wakeup
+        curl_multi_poll(multi, nullptr, 0, 1000, nullptr);
+    }
+}
+
+// The multi handle, with the engine thread started if it isn't running. Called with engineMutex held.
+static CURLM* transferEngine()
+{
+    if (!multi) {
+        initCurl();
+        multi = curl_multi_init();
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, MAX_IDLE_CONNECTIONS);
+        engineThread = std::thread(runTransfers);
+        logDebug(std::string("transferEngine: Started, HTTP/2 ") + (http2Enabled() ? "enabled" : "disabled"));
+    }
+    return multi;
+}
+
+void stopTransfers()
+{
+    std::thread stopped;
+    {
+        std::lock_guard<std::mutex> lock(engineMutex);
+        stopping = true;
+        if (!multi) return;
+        curl_multi_wakeup(multi);
+        stopped = std::move(engineThread);
+    }
+    stopped.join();
+
+    // Its connections go with it; the next transfer after resumeTransfers starts a new engine
+    std::lock_guard<std::mutex> lock(engineMutex);
+    curl_multi_cleanup(multi);
+    multi = nullptr;
+    logDebug("stopTransfers: Transfer engine stopped");
+}
+
+void resumeTransfers()
+{
+    std::lock_guard<std::mutex> lock(engineMutex);
+    stopping = false;
+}
+
+static long streamWeight(TransferPriority priority)
+{
+    switch (priority) {
+        case TransferPriority::Interactive: return 256;
+        case TransferPriority::Normal: return 64;
+        default: return 8;
+    }
+}
+
+void wakeTransferEngine()
+{
+    std::lock_guard<std::mutex> lock(engineMutex);
+    if (multi) {
+        curl_multi_wakeup(multi);
+    }
+}
+
+CURLcode performTransfer(CURL* handle, TransferPriority priority, const std::atomic<bool>* cancel)
+{
+    static MetricCounter& http2Transfers = getCounter("amp_http_transfers_total{protocol=\"h2\"}", "HTTP transfers by negotiated protocol");
+    static MetricCounter& http1Transfers = getCounter("amp_http_transfers_total{protocol=\"http/1.1\"}", "HTTP transfers by negotiated protocol");
+    static MetricCounter& newConnections = getCounter("amp_http_new_connections_total", "Connections opened for HTTP transfers");
+
+    Transfer transfer = {handle, priority, cancel, CURLE_OK, false, 0};
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, &transfer);
+    curl_easy_setopt(handle, CURLOPT_STREAM_WEIGHT, streamWeight(priority));
+
+    {
+        std::lock_guard<std::mutex> lock(engineMutex);
+        if (stopping) {
+            return CURLE_ABORTED_BY_CALLBACK;
+        }
+        pendingTransfers.push_back(&transfer);
+        // Under the lock, so stopTransfers can't free the multi handle in between
+        curl_multi_wakeup(transferEngine());
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(engineMutex);
+        transferDone.wait(lock, [&transfer]() { return transfer.done; });
+    }
+
+    long version = 0;
+    long connects = 0;
+    curl_easy_getinfo(handle, CURLINFO_HTTP_VERSION, &version);
+    curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+    if (version == CURL_HTTP_VERSION_2_0) http2Transfers.add();
+    else if (version != 0) http1Transfers.add();
+    newConnections.add((uint64_t)connects);
+    return transfer.result;
+}
+
+static int abortWhenStopped(void*, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+    return stopping ? 1 : 0;
+}
+
+CURLcode performOwnTransfer(CURL* handle)
+{
+    if (stopping) {
+        return CURLE_ABORTED_BY_CALLBACK;
+    }
+    curl_easy_setopt(handle, CURLOPT_XFERINFOFUNCTION, abortWhenStopped);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 0L);
+    return curl_easy_perform(handle);
+}
+
+void prewarmConnections(const std::string& url, int count)
+{
+    // Run them all at once: over HTTP/1.1 each opens its own connection, over HTTP/2 they share one
+    std::vector<CURL*> handles;
+    for (int i = 0; i < count; i++) {
+        CURL* handle = acquireCurlHandle();
+        if (!handle) break;
+        handles.push_back(handle);
+    }
+
+    std::vector<std::thread> threads;
+    std::atomic<long> opened{0};
+    for (CURL* handle : handles) {
+        threads.emplace_back([handle, url, &opened]() {
+            curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+            CURLcode result = performTransfer(handle, TransferPriority::Background);
+            if (result != CURLE_OK) {
+                logDebug("prewarmConnections: " + url + " failed: " + curl_easy_strerror(result));
+            }
+            long connects = 0;
+            curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects);
+            opened += connects;
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (CURL* handle : handles) {
+        releaseCurlHandle(handle);
+    }
+    logDebug("prewarmConnections: Opened " + std::to_string(opened.load()) + " connections to " + url);
+}
+
+#endif
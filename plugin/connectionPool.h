@@ -0,0 +1,57 @@
+#ifndef VDJ_CONNECTIONPOOL_H
+#define VDJ_CONNECTIONPOOL_H
+
+#include "../vdjPlugin8.h"
+#include <atomic>
+#include <string>
+
+// Reusable HTTP handles, so consecutive and concurrent requests to the backend
+// keep their connections (and TLS sessions) alive instead of reconnecting.
+// HTTPS requests negotiate HTTP/2 (ALPN) so concurrent requests to a host share one
+// multiplexed connection; servers without it, and .camp_http2 set to 0, get HTTP/1.1.
+
+// How urgently a transfer is wanted. Sets its HTTP/2 stream weight, the order transfers
+// queued at the same time are started in, and how much the bandwidth governor holds it back.
+enum class TransferPriority {
+    Interactive, // someone is waiting on it: browsing, searching, loading a deck
+    Normal,
+    Background,  // downloads and warm-up, which must never hold up the others
+};
+
+#ifdef VDJ_WIN
+#include <windows.h>
+#include <wininet.h>
+
+// One WinINet session for the whole plugin; WinINet pools keep-alive connections per session
+HINTERNET getInternetSession();
+#elif defined(VDJ_MAC)
+#include <curl/curl.h>
+
+// Take an easy handle from the pool (created on demand), with the common options set.
+// DNS and TLS sessions are shared between all of them.
+CURL* acquireCurlHandle();
+// Reset the handle's options and return it to the pool
+void releaseCurlHandle(CURL* handle);
+
+// Run a transfer on the shared multi handle, whose connections (HTTP/2 ones multiplexed)
+// every transfer draws from, and wait for it. Use instead of curl_easy_perform for everything
+// but downloads, which run on their own connection so the bandwidth governor can slow them.
+// Setting *cancel aborts the transfer; wakeTransferEngine makes that happen at once.
+CURLcode performTransfer(CURL* handle, TransferPriority priority, const std::atomic<bool>* cancel = nullptr);
+void wakeTransferEngine();
+// Run a transfer on the calling thread and a connection of its own, for those whose callbacks
+// block: downloads held back by the bandwidth governor, intros fed to VirtualDJ as it reads
+CURLcode performOwnTransfer(CURL* handle);
+#endif
+
+// Open `count` connections to the host of `url` in parallel and leave them idle in the pool
+void prewarmConnections(const std::string& url, int count);
+
+// For unloading the plugin: abort the transfers in flight, stop the thread driving them and
+// fail new ones until resumeTransfers, so nothing is left running in the unloaded module
+void stopTransfers();
+void resumeTransfers();
+// True between stopTransfers and resumeTransfers; loops reading a response give up on it
+bool transfersStopped();
+
+#endif // VDJ_CONNECTIONPOOL_H
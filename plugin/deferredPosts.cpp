@@ -0,0 +1,196 @@
+#include "deferredPosts.h"
+#include "mappedFile.h"
+#include "metrics.h"
+#include "settings.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <unordered_set>
+#include <vector>
+
+static const char* DEFERRED_FILE = ".deferred_posts";
+static const char* DEFERRED_HEADER = "AMP deferred 1\n";
+// Past this, the oldest half is dropped: weeks of play counts, so only reached if the backend never returns
+static const size_t MAX_DEFERRED_BYTES = 1024 * 1024;
+
+struct DeferredPost {
+    std::string line; // "<unix time>\t<url>\t<body>", without the newline
+    std::string url;
+    std::string body;
+};
+
+static uint64_t deferredLockKey()
+{
+    static const uint64_t key = hashString(DEFERRED_FILE);
+    return key;
+}
+
+// Held while sending, so only one process does
+static uint64_t senderLockKey()
+{
+    static const uint64_t key = hashString(std::string(DEFERRED_FILE) + ".sender");
+    return key;
+}
+
+// The pending requests, oldest first. Called with the lock held.
+static std::vector<DeferredPost> readPending(const std::string& path)
+{
+    std::vector<DeferredPost> posts;
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return posts;
+    }
+    std::string contents;
+    char buffer[16384];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, read);
+    }
+    fclose(file);
+    if (contents.compare(0, strlen(DEFERRED_HEADER), DEFERRED_HEADER) != 0) {
+        logDebug("DeferredPosts: Ignoring " + path + ", not a deferred request file");
+        return posts;
+    }
+
+    size_t position = strlen(DEFERRED_HEADER);
+    while (position < contents.size()) {
+        size_t end = contents.find('\n', position);
+        if (end == std::string::npos) break; // cut short by a crash mid-append
+        DeferredPost post;
+        post.line = contents.substr(position, end - position);
+        size_t urlStart = post.line.find('\t');
+        size_t bodyStart = urlStart == std::string::npos ? std::string::npos : post.line.find('\t', urlStart + 1);
+        if (bodyStart != std::string::npos) {
+            post.url = post.line.substr(urlStart + 1, bodyStart - urlStart - 1);
+            post.body = post.line.substr(bodyStart + 1);
+            posts.push_back(post);
+        }
+        position = end + 1;
+    }
+    return posts;
+}
+
+// Called with the lock held
+static void writePending(const std::string& path, const std::vector<DeferredPost>& posts, size_t first)
+{
+    if (first >= posts.size()) {
+        remove(path.c_str());
+        return;
+    }
+    std::string contents = DEFERRED_HEADER;
+    for (size_t i = first; i < posts.size(); i++) {
+        contents += posts[i].line + "\n";
+    }
+    if (!writeFileAtomically(path, contents)) {
+        logDebug("DeferredPosts: Could not write " + path);
+    }
+}
+
+void DeferredPosts::open(const std::string& cacheDir, LockFile* lockFile)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    path = joinPath(cacheDir, DEFERRED_FILE);
+    locks = lockFile;
+}
+
+void DeferredPosts::add(const std::string& url, const std::string& body)
+{
+    static MetricCounter& queued = getCounter("amp_deferred_posts_total{result=\"queued\"}", "Requests kept for when the backend is reachable again");
+    static MetricCounter& dropped = getCounter("amp_deferred_posts_total{result=\"dropped\"}", "Requests kept for when the backend is reachable again");
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (path.empty() || url.find_first_of("\t\n") != std::string::npos || body.find('\n') != std::string::npos) {
+        logDebug("DeferredPosts: Dropping request to " + url);
+        dropped.add();
+        return;
+    }
+    std::string line = std::to_string((long long)time(nullptr)) + "\t" + url + "\t" + body + "\n";
+
+    locks->lock(deferredLockKey());
+    uint64_t size = 0;
+    int64_t modifiedAt;
+    if (!statFile(path, size, modifiedAt)) {
+        writeFileAtomically(path, DEFERRED_HEADER);
+        size = strlen(DEFERRED_HEADER);
+    }
+    if (size + line.size() > MAX_DEFERRED_BYTES) {
+        std::vector<DeferredPost> posts = readPending(path);
+        logDebug("DeferredPosts: Full, dropping the oldest " + std::to_string(posts.size() / 2) + " requests");
+        dropped.add(posts.size() / 2);
+        writePending(path, posts, posts.size() / 2);
+        if (!statFile(path, size, modifiedAt)) {
+            writeFileAtomically(path, DEFERRED_HEADER);
+        }
+    }
+    FILE* file = fopen(path.c_str(), "ab");
+    if (file) {
+        fwrite(line.data(), 1, line.size(), file);
+        fclose(file);
+        queued.add();
+        logDebug("DeferredPosts: Kept request to " + url + " for later");
+    } else {
+        logDebug("DeferredPosts: Could not append to " + path);
+        dropped.add();
+    }
+    locks->unlock(deferredLockKey());
+}
+
+void DeferredPosts::replay(const Sender& send)
+{
+    static MetricCounter& sent = getCounter("amp_deferred_posts_total{result=\"sent\"}", "Requests kept for when the backend is reachable again");
+
+    std::unique_lock<std::mutex> sending(sendMutex, std::try_to_lock);
+    if (!sending.owns_lock()) {
+        return;
+    }
+    std::vector<DeferredPost> posts;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        uint64_t size;
+        int64_t modifiedAt;
+        if (path.empty() || !statFile(path, size, modifiedAt)) {
+            return;
+        }
+        if (!locks->tryLock(senderLockKey())) {
+            logDebug("DeferredPosts: Another VirtualDJ is sending the deferred requests");
+            return;
+        }
+        locks->lock(deferredLockKey());
+        posts = readPending(path);
+        locks->unlock(deferredLockKey());
+    }
+
+    // Without the file lock, so requests can still be kept meanwhile however long these take
+    size_t done = 0;
+    while (done < posts.size() && send(posts[done].url, posts[done].body)) {
+        done++;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        locks->lock(deferredLockKey());
+        // Requests were appended meanwhile, and the oldest may have been dropped to make room
+        std::unordered_multiset<std::string> sentLines;
+        for (size_t i = 0; i < done; i++) {
+            sentLines.insert(posts[i].line);
+        }
+        std::vector<DeferredPost> remaining;
+        for (DeferredPost& post : readPending(path)) {
+            auto it = sentLines.find(post.line);
+            if (it != sentLines.end()) {
+                sentLines.erase(it);
+            } else {
+                remaining.push_back(post);
+            }
+        }
+        if (done > 0 || remaining.empty()) {
+            writePending(path, remaining, 0);
+        }
+        locks->unlock(deferredLockKey());
+        locks->unlock(senderLockKey());
+    }
+
+    sent.add(done);
+    logDebug("DeferredPosts: Sent " + std::to_string(done) + " of " + std::to_string(posts.size()) + " deferred requests");
+}
@@ -0,0 +1,33 @@
+#ifndef VDJ_DEFERREDPOSTS_H
+#define VDJ_DEFERREDPOSTS_H
+
+#include "lockFile.h"
+#include <string>
+#include <mutex>
+#include <functional>
+
+// POST requests that can wait, such as play counts, kept in .deferred_posts in the cache folder
+// while the backend is out of reach and sent in order once it is back. The file survives restarts
+// and is shared by the VirtualDJ processes using the folder; only one of them sends at a time.
+class DeferredPosts
+{
+public:
+    // False if the request didn't get through and should be kept for later
+    using Sender = std::function<bool(const std::string& url, const std::string& body)>;
+
+    // locks serializes access between processes
+    void open(const std::string& cacheDir, LockFile* locks);
+
+    void add(const std::string& url, const std::string& body);
+    // Sends what is pending, oldest first, until one fails; that one and the rest stay for next time.
+    // Does nothing while another thread or process is sending.
+    void replay(const Sender& send);
+
+private:
+    std::string path;
+    LockFile* locks = nullptr;
+    std::mutex mutex;     // this process's side of the file lock
+    std::mutex sendMutex; // this process's side of the sender lock
+};
+
+#endif // VDJ_DEFERREDPOSTS_H
@@ -0,0 +1,263 @@
+#include "endpointHealth.h"
+#include "settings.h"
+#include "metrics.h"
+#include "utilities.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string>
+
+// Overridable with .camp_http_timeout / .camp_http_min_timeout (ms), .camp_http_hedge (0 or 1)
+// and .camp_circuit_failures
+static const int DEFAULT_TIMEOUT_MS = 15000;    // before there is history, and the upper bound after
+static const int DEFAULT_MIN_TIMEOUT_MS = 1500; // adaptive deadlines never go below this
+static const int DEFAULT_CIRCUIT_FAILURES = 5;  // consecutive failures that open the circuit
+static const int MIN_SAMPLES = 20;              // history needed before deadlines adapt
+static const int MIN_STALL_MS = 2000;           // a body may pause this long whatever the history
+static const int FIRST_COOLDOWN_MS = 5000;
+static const int MAX_COOLDOWN_MS = 300000;
+
+struct HealthSettings {
+    int timeoutMs;
+    int minTimeoutMs;
+    bool hedge;
+    int circuitFailures;
+};
+
+static const HealthSettings& healthSettings()
+{
+    static HealthSettings settings = {
+        readIntSetting(".camp_http_timeout", DEFAULT_TIMEOUT_MS, 100, 600000),
+        readIntSetting(".camp_http_min_timeout", DEFAULT_MIN_TIMEOUT_MS, 10, 600000),
+        readIntSetting(".camp_http_hedge", 1, 0, 1) != 0,
+        readIntSetting(".camp_circuit_failures", DEFAULT_CIRCUIT_FAILURES, 1, 1000),
+    };
+    return settings;
+}
+
+int getDefaultHttpTimeoutMs()
+{
+    return healthSettings().timeoutMs;
+}
+
+static int64_t nowMs()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct HostState {
+    int unreachable = 0; // requests in a row that got no answer
+    bool offline = false;
+};
+
+static std::mutex hostsMutex;
+static std::map<std::string, HostState> hosts;
+static std::atomic<int> offlineHostCount{0};
+static std::mutex listenerMutex;
+static std::function<void(const std::string&, bool)> connectivityListener;
+
+std::string getHostOf(const std::string& url)
+{
+    size_t hostStart = url.find("://");
+    hostStart = hostStart == std::string::npos ? 0 : hostStart + 3;
+    return url.substr(0, url.find_first_of("/?#", hostStart));
+}
+
+// Record whether a request to host got an answer, and tell the listener if that takes it offline
+// or brings it back. A 5xx is an answer but not a success, so it only ends the run of failures.
+static void recordReachability(const std::string& host, bool answered, bool succeeded)
+{
+    static MetricGauge& offlineGauge = getGauge("amp_backend_offline", "Backend hosts unreachable while the plugin works from local state");
+    static MetricCounter& wentOffline = getCounter("amp_offline_transitions_total", "Times a backend host was taken offline");
+
+    bool changed = false;
+    bool offline = false;
+    {
+        std::lock_guard<std::mutex> lock(hostsMutex);
+        HostState& state = hosts[host];
+        if (answered) {
+            state.unreachable = 0;
+        } else {
+            state.unreachable++;
+        }
+        if (state.offline && succeeded) {
+            state.offline = false;
+            changed = true;
+        } else if (!state.offline && state.unreachable >= healthSettings().circuitFailures) {
+            state.offline = true;
+            changed = offline = true;
+        }
+        if (changed) {
+            offlineHostCount += offline ? 1 : -1;
+            offlineGauge.set(offlineHostCount.load());
+        }
+    }
+    if (!changed) {
+        return;
+    }
+    if (offline) {
+        wentOffline.add();
+    }
+    logDebug("EndpointHealth: " + host + (offline ? " unreachable, going offline for it" : " reachable, going online for it"));
+
+    std::function<void(const std::string&, bool)> listener;
+    {
+        std::lock_guard<std::mutex> lock(listenerMutex);
+        listener = connectivityListener;
+    }
+    if (listener) {
+        listener(host, offline);
+    }
+}
+
+bool isHostOffline(const std::string& url)
+{
+    if (offlineHostCount.load(std::memory_order_relaxed) == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(hostsMutex);
+    auto it = hosts.find(getHostOf(url));
+    return it != hosts.end() && it->second.offline;
+}
+
+std::vector<std::string> getOfflineHosts()
+{
+    std::vector<std::string> offline;
+    std::lock_guard<std::mutex> lock(hostsMutex);
+    for (const auto& item : hosts) {
+        if (item.second.offline) {
+            offline.push_back(item.first);
+        }
+    }
+    return offline;
+}
+
+void setConnectivityListener(const std::function<void(const std::string& host, bool offline)>& listener)
+{
+    std::lock_guard<std::mutex> lock(listenerMutex);
+    connectivityListener = listener;
+}
+
+EndpointHealth::EndpointHealth(const std::string& name) : name(name), host(getHostOf(name))
+{
+}
+
+int EndpointHealth::percentileLocked(double fraction) const
+{
+    uint32_t sorted[kSamples];
+    std::copy(samples, samples + sampleCount, sorted);
+    int index = std::min(sampleCount - 1, (int)(fraction * sampleCount));
+    std::nth_element(sorted, sorted + index, sorted + sampleCount);
+    return (int)sorted[index];
+}
+
+bool EndpointHealth::allowRequest()
+{
+    static MetricCounter& rejected = getCounter("amp_http_circuit_rejections_total", "Requests not sent because their endpoint's circuit was open");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (openUntilMs == 0) {
+        return true;
+    }
+    if (nowMs() >= openUntilMs && !probeInFlight) {
+        // Half open: this request finds out whether the endpoint is back
+        probeInFlight = true;
+        logDebug("EndpointHealth: Probing " + name);
+        return true;
+    }
+    rejected.add();
+    return false;
+}
+
+EndpointHealth::Policy EndpointHealth::getPolicy()
+{
+    const HealthSettings& settings = healthSettings();
+    Policy policy = {settings.timeoutMs, settings.timeoutMs, 0};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (sampleCount < MIN_SAMPLES) {
+        return policy;
+    }
+
+    // Generous multiple of the tail, so only requests that are clearly stuck are cut off
+    int p99 = percentileLocked(0.99);
+    policy.firstByteTimeoutMs = std::max(settings.minTimeoutMs, std::min(settings.timeoutMs, p99 * 4));
+    // A body that stops for longer than the server normally takes to start one is as stuck.
+    // Floored higher, as it is checked in whole seconds and a gap mid-body costs a restart.
+    policy.stallTimeoutMs = std::max(MIN_STALL_MS, policy.firstByteTimeoutMs);
+    if (settings.hedge && !probeInFlight && openUntilMs == 0) {
+        // A little past p95, so jitter alone doesn't double the load on a tight distribution
+        int p95 = percentileLocked(0.95);
+        policy.hedgeAfterMs = std::min(policy.firstByteTimeoutMs / 2, p95 + std::max(10, p95 / 4));
+    }
+    return policy;
+}
+
+void EndpointHealth::recordSuccess(uint64_t firstByteMs)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        samples[nextSample] = (uint32_t)std::min<uint64_t>(firstByteMs, UINT32_MAX);
+        nextSample = (nextSample + 1) % kSamples;
+        if (sampleCount < kSamples) sampleCount++;
+
+        if (openUntilMs != 0) {
+            logDebug("EndpointHealth: " + name + " recovered, closing circuit");
+        }
+        consecutiveFailures = 0;
+        openUntilMs = 0;
+        cooldownMs = 0;
+        probeInFlight = false;
+    }
+    recordReachability(host, true, true);
+}
+
+void EndpointHealth::recordFailure(bool responded)
+{
+    static MetricCounter& opened = getCounter("amp_http_circuit_opens_total", "Times an endpoint's circuit breaker opened");
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        consecutiveFailures++;
+        bool probeFailed = probeInFlight;
+        probeInFlight = false;
+        if (probeFailed || (openUntilMs == 0 && consecutiveFailures >= healthSettings().circuitFailures)) {
+            cooldownMs = cooldownMs == 0 ? FIRST_COOLDOWN_MS : std::min(MAX_COOLDOWN_MS, cooldownMs * 2);
+            openUntilMs = nowMs() + cooldownMs;
+            opened.add();
+            logDebug("EndpointHealth: " + std::to_string(consecutiveFailures) + " failures in a row, opening circuit for " + name +
+                     " for " + std::to_string(cooldownMs) + " ms");
+        }
+    }
+    recordReachability(host, responded, false);
+}
+
+// Scheme, host and the first two path segments of url, without the query
+static std::string endpointName(const std::string& url)
+{
+    size_t end = url.find_first_of("?#");
+    if (end == std::string::npos) end = url.size();
+    size_t hostStart = url.find("://");
+    size_t pos = hostStart == std::string::npos ? 0 : hostStart + 3;
+    for (int slashes = 0; slashes < 3; slashes++) {
+        pos = url.find('/', pos + (slashes > 0 ? 1 : 0));
+        if (pos == std::string::npos || pos >= end) return url.substr(0, end);
+    }
+    return url.substr(0, pos);
+}
+
+EndpointHealth& getEndpointHealth(const std::string& url)
+{
+    static std::mutex registryMutex;
+    static std::map<std::string, std::unique_ptr<EndpointHealth>> endpoints;
+
+    std::string name = endpointName(url);
+    std::lock_guard<std::mutex> lock(registryMutex);
+    std::unique_ptr<EndpointHealth>& health = endpoints[name];
+    if (!health) {
+        health.reset(new EndpointHealth(name));
+    }
+    return *health;
+}
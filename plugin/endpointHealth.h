@@ -0,0 +1,73 @@
+#ifndef VDJ_ENDPOINTHEALTH_H
+#define VDJ_ENDPOINTHEALTH_H
+
+#include <string>
+#include <mutex>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Recent behaviour of one backend endpoint (scheme, host and first two path segments, so
+// /api/fields/{name}/tracks pages share one history). Derives the time-to-first-byte
+// deadline and hedging delay from observed latency and trips a circuit breaker after
+// repeated failures, so callers fall back to their caches instead of waiting on a dead backend.
+class EndpointHealth
+{
+public:
+    struct Policy {
+        int firstByteTimeoutMs; // give up if no response headers arrived by then
+        int stallTimeoutMs;     // give up if the body stops flowing for this long
+        int hedgeAfterMs;       // send a duplicate request after this long without headers, 0 = don't
+    };
+
+    explicit EndpointHealth(const std::string& name);
+
+    // False while the circuit is open. When it half-opens, one probe request is let through.
+    bool allowRequest();
+    Policy getPolicy();
+
+    void recordSuccess(uint64_t firstByteMs);
+    // responded: the server answered, with a 5xx; false if it couldn't be reached at all
+    void recordFailure(bool responded);
+
+    const std::string& getName() const { return name; }
+
+private:
+    static const int kSamples = 128;
+
+    int percentileLocked(double fraction) const;
+
+    std::string name;
+    std::string host;
+    std::mutex mutex;
+    uint32_t samples[kSamples];
+    int sampleCount = 0; // valid samples, up to kSamples
+    int nextSample = 0;
+
+    int consecutiveFailures = 0;
+    int64_t openUntilMs = 0; // circuit open until this steady clock time
+    int cooldownMs = 0;      // doubles every time the circuit opens again without recovering
+    bool probeInFlight = false;
+};
+
+// Deadline for requests to endpoints without history (.camp_http_timeout, in ms)
+int getDefaultHttpTimeoutMs();
+
+// Health of the endpoint `url` belongs to, created on first use
+EndpointHealth& getEndpointHealth(const std::string& url);
+
+// Scheme, host and port of url, such as "https://example.com:8443"
+std::string getHostOf(const std::string& url);
+
+// True once requests to the host of url fail without an answer as many times in a row as open a
+// circuit (.camp_circuit_failures), until a request to that host succeeds again. An error status
+// is an answer, so a failing backend alone never takes a host offline. Callers answer from local
+// state alone meanwhile; while every host is online this is one atomic load.
+bool isHostOffline(const std::string& url);
+// The hosts offline now, as getHostOf returns them
+std::vector<std::string> getOfflineHosts();
+// Called with true when a host goes offline and with false when it is back, on the thread whose
+// request found out. It should return quickly.
+void setConnectivityListener(const std::function<void(const std::string& host, bool offline)>& listener);
+
+#endif // VDJ_ENDPOINTHEALTH_H
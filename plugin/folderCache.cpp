@@ -0,0 +1,273 @@
+#include "../vdjPlugin8.h"
+#include "folderCache.h"
+#include "settings.h"
+#include "utilities.h"
+#include "mappedFile.h"
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <ctime>
+#include <cstdio>
+
+#ifdef VDJ_WIN
+#include <windows.h>
+#elif defined(VDJ_MAC)
+#include <sys/stat.h>
+#endif
+
+// Defaults, overridable with .camp_folder_cache_fresh and .camp_folder_cache_stale (seconds)
+static const int DEFAULT_FRESH_SECONDS = 60;
+static const int DEFAULT_MAX_STALE_SECONDS = 7 * 24 * 3600;
+
+FolderCache::FolderCache()
+{
+    freshSeconds = readIntSetting(".camp_folder_cache_fresh", DEFAULT_FRESH_SECONDS, 0, 7 * 24 * 3600);
+    maxStaleSeconds = readIntSetting(".camp_folder_cache_stale", DEFAULT_MAX_STALE_SECONDS, 0, 365 * 24 * 3600);
+}
+
+// Listings live next to the track cache in Cache/AMPListings, one .meta/.json pair per URL.
+// The folders are created once; the user folder doesn't move while VirtualDJ runs.
+std::string FolderCache::getDiskPath(const std::string& url)
+{
+    std::call_once(listingDirOnce, [this]() {
+        std::string cacheDir = getSettingsPath("Cache");
+        if (cacheDir.empty()) return;
+#ifdef VDJ_WIN
+        listingDir = cacheDir + "\\AMPListings";
+        CreateDirectoryA(cacheDir.c_str(), NULL);
+        CreateDirectoryA(listingDir.c_str(), NULL);
+#else
+        listingDir = cacheDir + "/AMPListings";
+        mkdir(cacheDir.c_str(), 0777);
+        mkdir(listingDir.c_str(), 0777);
+#endif
+    });
+    if (listingDir.empty()) return "";
+
+    char hashStr[17];
+    snprintf(hashStr, sizeof(hashStr), "%016llx", (unsigned long long)hashString(url));
+    return joinPath(listingDir, hashStr);
+}
+
+bool FolderCache::loadFromDisk(const std::string& url, const Parser& parse, Entry& entry)
+{
+    std::string path = getDiskPath(url);
+    if (path.empty()) return false;
+
+    std::ifstream metaFile(path + ".meta");
+    if (!metaFile.is_open()) return false;
+
+    std::string storedUrl, etag, fetchedAtStr;
+    getline(metaFile, storedUrl);
+    getline(metaFile, etag);
+    getline(metaFile, fetchedAtStr);
+    if (storedUrl != url) return false; // hash collision
+
+    std::ifstream bodyFile(path + ".json", std::ios::binary);
+    if (!bodyFile.is_open()) return false;
+    std::stringstream body;
+    body << bodyFile.rdbuf();
+
+    auto listing = std::make_shared<const FolderListing>(parse(body.str()));
+    if (!listing->valid) {
+        logDebug("FolderCache: Ignoring unrecognized listing on disk for " + url);
+        return false;
+    }
+    entry.listing = listing;
+    entry.etag = etag;
+    entry.fetchedAt = atoll(fetchedAtStr.c_str());
+    logDebug("FolderCache: Loaded listing from disk for " + url);
+    return true;
+}
+
+void FolderCache::saveToDisk(const std::string& url, const Entry& entry, const std::string& body)
+{
+    std::string path = getDiskPath(url);
+    if (path.empty()) return;
+
+    // Body first and metadata last, each replaced whole, so other processes sharing the folder
+    // never see a torn file or an ETag that belongs to another body
+    if (!writeFileAtomically(path + ".json", body)) {
+        logDebug("FolderCache: Could not write " + path + ".json");
+        return;
+    }
+    touchOnDisk(url, entry);
+}
+
+void FolderCache::touchOnDisk(const std::string& url, const Entry& entry)
+{
+    std::string path = getDiskPath(url);
+    if (path.empty()) return;
+
+    if (!writeFileAtomically(path + ".meta", url + "\n" + entry.etag + "\n" + std::to_string((long long)entry.fetchedAt) + "\n")) {
+        logDebug("FolderCache: Could not write " + path + ".meta");
+    }
+}
+
+std::shared_ptr<const FolderListing> FolderCache::fetchInto(const std::string& url, const Fetcher& fetch, const Parser& parse, const std::string& etag)
+{
+    HttpResponse response = fetch(url, etag);
+    int64_t now = (int64_t)time(nullptr);
+
+    if (response.status == 304) {
+        Entry updated;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.notModified++;
+            auto it = entries.find(url);
+            if (it == entries.end()) return nullptr;
+            it->second.fetchedAt = now;
+            it->second.revalidating = false;
+            updated = it->second;
+        }
+        logDebug("FolderCache: Listing not modified: " + url);
+        touchOnDisk(url, updated);
+        return updated.listing;
+    }
+
+    if (response.status != 200 || response.body.empty()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.fetchFailures++;
+        auto it = entries.find(url);
+        if (it != entries.end()) it->second.revalidating = false;
+        logDebug("FolderCache: Fetch failed (status " + std::to_string(response.status) + ") for " + url);
+        return nullptr;
+    }
+
+    auto listing = std::make_shared<const FolderListing>(parse(response.body));
+    if (!listing->valid) {
+        // Keep whatever was cached before; a good response replaces it later
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.fetchFailures++;
+        auto it = entries.find(url);
+        if (it != entries.end()) it->second.revalidating = false;
+        logDebug("FolderCache: Not caching unrecognized listing for " + url);
+        return listing;
+    }
+
+    Entry fetched;
+    fetched.listing = listing;
+    fetched.etag = response.etag;
+    fetched.fetchedAt = now;
+    UpdateListener listener;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[url] = fetched;
+        listener = updated;
+    }
+    saveToDisk(url, fetched, response.body);
+    if (listener) {
+        listener(url, listing);
+    }
+    return listing;
+}
+
+std::shared_ptr<const FolderListing> FolderCache::get(const std::string& url, const Fetcher& fetch, const Parser& parse)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    auto it = entries.find(url);
+    if (it == entries.end()) {
+        // Reading and parsing a listing can take a while (the catalog especially), so the other
+        // lookups and the revalidations finishing meanwhile don't wait for it
+        lock.unlock();
+        Entry loaded;
+        bool found = loadFromDisk(url, parse, loaded);
+        lock.lock();
+        it = entries.find(url);
+        if (it == entries.end() && found) {
+            stats.diskLoads++;
+            it = entries.emplace(url, loaded).first;
+        }
+    }
+
+    std::string etag;
+    if (it != entries.end()) {
+        Entry& entry = it->second;
+        int64_t age = (int64_t)time(nullptr) - entry.fetchedAt;
+        if (age <= freshSeconds) {
+            stats.freshHits++;
+            logDebug("FolderCache: Fresh hit (" + std::to_string(age) + "s old) for " + url);
+            return entry.listing;
+        }
+        bool servable = age <= maxStaleSeconds;
+        if (!servable && offline && offline(url)) {
+            // Out of date, but all there is until the backend is back
+            servable = true;
+            stats.offlineHits++;
+            logDebug("FolderCache: Offline, serving " + std::to_string(age) + "s old listing for " + url);
+        } else if (servable) {
+            stats.staleHits++;
+            logDebug("FolderCache: Stale hit (" + std::to_string(age) + "s old), revalidating " + url);
+        }
+        if (servable) {
+            if (!entry.revalidating) {
+                entry.revalidating = true;
+                stats.revalidations++;
+                std::string staleEtag = entry.etag;
+                entry.revalidating = revalidations.start([this, url, fetch, parse, staleEtag]() {
+                    fetchInto(url, fetch, parse, staleEtag);
+                });
+            }
+            return entry.listing;
+        }
+        etag = entry.etag;
+    }
+
+    // Nothing usable: fetch now. A listing that's too old is still better than nothing if that fails.
+    stats.misses++;
+    if (offline && offline(url)) {
+        logDebug("FolderCache: Offline and nothing cached for " + url);
+        return nullptr;
+    }
+    lock.unlock();
+    std::shared_ptr<const FolderListing> fetched = fetchInto(url, fetch, parse, etag);
+    if (fetched && fetched->valid) {
+        return fetched;
+    }
+    lock.lock();
+
+    it = entries.find(url);
+    return it != entries.end() ? it->second.listing : fetched;
+}
+
+void FolderCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
+
+FolderCache::Stats FolderCache::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats;
+}
+
+void FolderCache::setFreshSeconds(int seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    freshSeconds = seconds;
+}
+
+void FolderCache::setMaxStaleSeconds(int seconds)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    maxStaleSeconds = seconds;
+}
+
+void FolderCache::setOfflineCheck(const OfflineCheck& check)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    offline = check;
+}
+
+void FolderCache::setUpdateListener(const UpdateListener& listener)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    updated = listener;
+}
+
+void FolderCache::stop()
+{
+    revalidations.stop();
+}
@@ -0,0 +1,97 @@
+#ifndef VDJ_FOLDERCACHE_H
+#define VDJ_FOLDERCACHE_H
+
+#include "trackInfo.h"
+#include "internet.h"
+#include "searchIndex.h"
+#include "backgroundTasks.h"
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+struct FolderInfo {
+    std::string uniqueId;
+    std::string name;
+};
+
+// Parsed response of /api/fields/{id}/tracks (tracks) or /api/fields-db (folders)
+struct FolderListing {
+    std::vector<TrackInfo> tracks;
+    std::vector<FolderInfo> folders;
+    std::vector<SearchKey> searchKeys; // one per track, filled in for the catalog only
+    // False if the response had no array the parser knows (an error page, or the "Please subscribe"
+    // placeholder). Such a listing is shown but never cached, so the next request asks again.
+    bool valid = true;
+};
+
+// Stale-while-revalidate cache of folder listings, kept in memory and on disk.
+// Fresh entries are served as-is; stale ones are served immediately while a
+// background conditional request (If-None-Match) refreshes them. While offline,
+// listings of any age are served that way and nothing is fetched in the foreground.
+class FolderCache
+{
+public:
+    using Fetcher = std::function<HttpResponse(const std::string& url, const std::string& etag)>;
+    using Parser = std::function<FolderListing(const std::string& json)>;
+    using OfflineCheck = std::function<bool(const std::string& url)>;
+    using UpdateListener = std::function<void(const std::string& url, const std::shared_ptr<const FolderListing>& listing)>;
+
+    struct Stats {
+        uint64_t freshHits = 0;
+        uint64_t staleHits = 0;
+        uint64_t offlineHits = 0; // served past their max staleness because the backend is unreachable
+        uint64_t misses = 0;
+        uint64_t diskLoads = 0;
+        uint64_t revalidations = 0;
+        uint64_t notModified = 0;
+        uint64_t fetchFailures = 0;
+    };
+
+    FolderCache();
+
+    // Returns nullptr only if nothing is cached and the backend could not be reached (or is offline)
+    std::shared_ptr<const FolderListing> get(const std::string& url, const Fetcher& fetch, const Parser& parse);
+    void clear();
+    Stats getStats();
+
+    void setFreshSeconds(int seconds);
+    void setMaxStaleSeconds(int seconds);
+    // Whether the host of a URL is offline. Without one, it never is.
+    void setOfflineCheck(const OfflineCheck& check);
+    // Told about every new listing fetched for a URL, including those a background revalidation brings
+    void setUpdateListener(const UpdateListener& listener);
+    // Wait for the revalidations in flight; none start afterwards
+    void stop();
+
+private:
+    struct Entry {
+        std::shared_ptr<const FolderListing> listing;
+        std::string etag;
+        int64_t fetchedAt = 0; // unix time, so it survives on disk
+        bool revalidating = false;
+    };
+
+    bool loadFromDisk(const std::string& url, const Parser& parse, Entry& entry);
+    void saveToDisk(const std::string& url, const Entry& entry, const std::string& body);
+    void touchOnDisk(const std::string& url, const Entry& entry);
+    std::string getDiskPath(const std::string& url);
+    // The listing to show for url after fetching it, or nullptr if the fetch failed
+    std::shared_ptr<const FolderListing> fetchInto(const std::string& url, const Fetcher& fetch, const Parser& parse, const std::string& etag);
+
+    std::once_flag listingDirOnce;
+    std::string listingDir; // empty if there is no user folder
+    std::mutex mutex;
+    std::map<std::string, Entry> entries;
+    int freshSeconds;
+    int maxStaleSeconds;
+    OfflineCheck offline;
+    UpdateListener updated;
+    Stats stats;
+    BackgroundTasks revalidations; // last, so it is joined before the rest goes away
+};
+
+#endif // VDJ_FOLDERCACHE_H
@@ -1,43 +1,38 @@
 #include "getFolder.h"
+#include "endpointHealth.h"
+#include "settings.h"
+#include "tracing.h"
 #include "utilities.h"
 #include "../AMP.h"
 #include <cstring>
 #include <string>
+#include <vector>
 
-HRESULT getFolder(CAMP* plugin, const char* folderUniqueId, IVdjTracksList* tracksList) {
-    std::string folderId = folderUniqueId ? folderUniqueId : "(null)";
-    logDebug("GetFolder called with folderUniqueId: '" + folderId + "'");
-    
-    
-    // Fetch tracks for specific field from new API endpoint
-    std::string encodedFolderId = plugin->urlEncode(folderId);
-    std::string apiUrl = "https://music.abelldjcompany.com/api/fields/" + encodedFolderId + "/tracks";
-    logDebug("Fetching tracks from: " + apiUrl);
-    std::string jsonResponse = plugin->httpGet(apiUrl);
-    if (jsonResponse.empty()) {
-        logDebug("Empty JSON response from field tracks API");
-        return S_OK;
-    }
+// Parse the "tracks" array of /api/fields/{id}/tracks
+static FolderListing parseFolderTracks(const std::string& jsonResponse) {
+    TRACE_SPAN("parse.folderTracks");
+    FolderListing listing;
 
     // Parse tracks from JSON response
     logDebug("Parsing tracks from JSON response");
     size_t tracksPos = jsonResponse.find("\"tracks\"");
     if (tracksPos == std::string::npos) {
         logDebug("'tracks' not found in JSON response");
-        return S_OK;
+        listing.valid = false;
+        return listing;
     }
-    
+
     size_t arrayStart = jsonResponse.find('[', tracksPos);
     if (arrayStart == std::string::npos) {
         logDebug("Tracks array start '[' not found");
-        return S_OK;
+        listing.valid = false;
+        return listing;
     }
-    
+
     // Parse each track object
     size_t pos = arrayStart + 1;
-    int trackCount = 0;
-    
-    while (pos < jsonResponse.length() && trackCount < 1000) {
+
+    while (pos < jsonResponse.length()) {
         size_t objStart = jsonResponse.find('{', pos);
         if (objStart == std::string::npos) break;
 
@@ -55,7 +50,7 @@ HRESULT getFolder(CAMP* plugin, const char* folderUniqueId, IVdjTracksList* trac
 
         std::string trackObj = jsonResponse.substr(objStart, objEnd - objStart + 1);
 
-        std::string fileName, fullUrl, cleanPath;
+        std::string fileName, fullUrl, cleanPath, coverUrl;
 
         // Extract fileName
         size_t fileNameStart = trackObj.find("\"fileName\":");
@@ -87,48 +82,108 @@ HRESULT getFolder(CAMP* plugin, const char* folderUniqueId, IVdjTracksList* trac
             }
         }
 
-        // Only add track if we have essential fields
-        if (!fileName.empty() && !fullUrl.empty() && !cleanPath.empty()) {
-            const char* streamUrl = nullptr;
-            std::string localPath;
-            if (plugin->isTrackCached(cleanPath.c_str())) {
-                localPath = plugin->getEncodedLocalPathForTrack(cleanPath.c_str());
-                streamUrl = localPath.c_str();
-                logDebug("Track is cached. Returning local path");
-                plugin->cb->SendCommand("browsed_file_color \"#00FF00\"");
-            }else {
-                logDebug("Track is not cached. Returning remote path");
+        // Extract coverUrl (optional, may be null)
+        size_t coverStart = trackObj.find("\"coverUrl\":");
+        if (coverStart != std::string::npos) {
+            coverStart = trackObj.find_first_not_of(" \t\r\n", coverStart + 11);
+            size_t coverEnd = coverStart != std::string::npos && trackObj[coverStart] == '"' ? trackObj.find('"', coverStart + 1) : std::string::npos;
+            if (coverEnd != std::string::npos) {
+                coverUrl = trackObj.substr(coverStart + 1, coverEnd - coverStart - 1);
             }
+        }
 
-            // check whether the track is a video (mp3 vs mp4)
-            bool isVideo = false;
-            if (fileName.find(".mp4") != std::string::npos) {
-                isVideo = true;
-            }
-            
-            tracksList->add(
-                cleanPath.c_str(),        // uniqueId (cleanPath)
-                fileName.c_str(),         // title (fileName)
-                "",         // artist (field name)
-                "",                       // remix
-                nullptr,                  // genre
-                "",             // label
-                "",          // comment
-                "",                       // cover URL
-                streamUrl,                // streamUrl
-                0,                        // length (determined when loaded)
-                0,                        // bpm
-                0,                        // key
-                0,                        // year
-                isVideo,                    // isVideo
-                false                     // isKaraoke
-            );
-            trackCount++;
+        // Only keep track if we have essential fields
+        if (!fileName.empty() && !fullUrl.empty() && !cleanPath.empty()) {
+            TrackInfo track;
+            track.uniqueId = cleanPath;
+            track.cacheFileName = cacheFileNameFor(cleanPath);
+            track.name = fileName;
+            track.url = fullUrl;
+            track.coverUrl = coverUrl;
+            track.size = 0;
+            listing.tracks.push_back(track);
         }
 
         pos = objEnd + 1;
     }
-    
-    logDebug("GetFolder completed, added " + std::to_string(trackCount) + " tracks to folder '" + folderId + "'");
+
+    return listing;
+}
+
+HRESULT getFolder(CAMP* plugin, const char* folderUniqueId, IVdjTracksList* tracksList) {
+    std::string folderId = folderUniqueId ? folderUniqueId : "(null)";
+    logDebug("GetFolder called with folderUniqueId: '" + folderId + "'");
+
+
+    // Fetch tracks for specific field from new API endpoint
+    std::string encodedFolderId = plugin->urlEncode(folderId);
+    std::string apiUrl = getApiBaseUrl() + "/api/fields/" + encodedFolderId + "/tracks";
+    logDebug("Fetching tracks from: " + apiUrl);
+    auto listing = plugin->folderCache.get(
+        apiUrl,
+        [plugin](const std::string& url, const std::string& etag) { return plugin->httpGetAllPages(url, "tracks", etag); },
+        parseFolderTracks);
+    if (!listing) {
+        logDebug("No cached listing and empty response from field tracks API");
+        return S_OK;
+    }
+
+    TRACE_SPAN("getFolder.emit");
+    // Offline, only the cached tracks can be played
+    bool offline = isHostOffline(getTracksBaseUrl());
+    int trackCount = 0;
+    std::vector<std::string> uncachedUrls;
+    for (const auto& track : listing->tracks) {
+        const char* streamUrl = nullptr;
+        std::string localPath;
+        TrackMetadata metadata;
+        bool cached = plugin->findCachedTrack(track, localPath);
+        if (!cached && offline) {
+            continue;
+        }
+        std::string coverUrl = plugin->getCoverUrlForTrack(track, cached);
+        if (cached) {
+            streamUrl = localPath.c_str();
+            plugin->metadataIndex.get(track.cacheFileName, metadata);
+            logDebug("Track is cached. Returning local path");
+            plugin->cb->SendCommand("browsed_file_color \"#00FF00\"");
+        }else {
+            logDebug("Track is not cached. Returning remote path");
+            uncachedUrls.push_back(track.url);
+        }
+
+        // check whether the track is a video (mp3 vs mp4)
+        bool isVideo = false;
+        if (track.name.find(".mp4") != std::string::npos) {
+            isVideo = true;
+        }
+
+        tracksList->add(
+            track.uniqueId.c_str(),   // uniqueId (cleanPath)
+            track.name.c_str(),       // title (fileName)
+            "",         // artist (field name)
+            "",                       // remix
+            metadata.genre.empty() ? nullptr : metadata.genre.c_str(), // genre
+            "",             // label
+            "",          // comment
+            coverUrl.empty() ? nullptr : coverUrl.c_str(), // cover URL
+            streamUrl,                // streamUrl
+            metadata.length,          // length (0 = determined when loaded)
+            metadata.bpm,             // bpm
+            metadata.key,             // key
+            metadata.year,            // year
+            isVideo,                    // isVideo
+            false                     // isKaraoke
+        );
+        trackCount++;
+    }
+    // The DJ is likely to load one of the first tracks listed
+    plugin->introCache.prefetch(uncachedUrls);
+
+    FolderCache::Stats stats = plugin->folderCache.getStats();
+    logDebug("Folder cache stats - fresh: " + std::to_string(stats.freshHits) + ", stale: " + std::to_string(stats.staleHits) +
+             ", misses: " + std::to_string(stats.misses) + ", not modified: " + std::to_string(stats.notModified));
+    logDebug("GetFolder completed, added " + std::to_string(trackCount) + " tracks to folder '" + folderId + "'" +
+             (offline ? " (offline, cached tracks only)" : ""));
     return S_OK;
 }
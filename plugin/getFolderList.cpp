@@ -1,38 +1,36 @@
 #include "getFolderList.h"
+#include "settings.h"
+#include "tracing.h"
 #include "utilities.h"
 #include "../AMP.h"
 #include <string>
 #include <cstring>
 
-HRESULT getFolderList(CAMP* plugin, IVdjSubfoldersList* subfoldersList) {
-    logDebug("GetFolderList called");
-
-    logDebug("Fetching fields from API");
-    std::string jsonResponse = plugin->httpGet("https://music.abelldjcompany.com/api/fields-db");
-    if (jsonResponse.empty()) {
-        logDebug("Empty JSON response from fields API");
-        return S_OK;
-    }
+// Parse the "fields" array of /api/fields-db
+FolderListing parseFieldsJson(const std::string& jsonResponse) {
+    TRACE_SPAN("parse.fields");
+    FolderListing listing;
 
     // Parse fields from JSON response
     logDebug("Parsing fields from JSON response");
     size_t fieldsPos = jsonResponse.find("\"fields\"");
     if (fieldsPos == std::string::npos) {
         logDebug("'fields' not found in JSON response");
-        return S_OK;
+        listing.valid = false;
+        return listing;
     }
 
     size_t arrayStart = jsonResponse.find('[', fieldsPos);
     if (arrayStart == std::string::npos) {
         logDebug("Fields array start '[' not found");
-        return S_OK;
+        listing.valid = false;
+        return listing;
     }
     
     // Parse each field object
     size_t pos = arrayStart + 1;
-    int fieldCount = 0;
-    
-    while (pos < jsonResponse.length() && fieldCount < 1000) {
+
+    while (pos < jsonResponse.length() && listing.folders.size() < 1000) {
         size_t objStart = jsonResponse.find('{', pos);
         if (objStart == std::string::npos) break;
 
@@ -70,14 +68,33 @@ HRESULT getFolderList(CAMP* plugin, IVdjSubfoldersList* subfoldersList) {
                     }
                 }
 
-                subfoldersList->add(fieldName.c_str(), displayName.c_str());
-                fieldCount++;
+                listing.folders.push_back({fieldName, displayName});
             }
         }
 
         pos = objEnd + 1;
     }
 
-    logDebug("GetFolderList completed - added " + std::to_string(fieldCount) + " fields");
+    return listing;
+}
+
+HRESULT getFolderList(CAMP* plugin, IVdjSubfoldersList* subfoldersList) {
+    logDebug("GetFolderList called");
+
+    logDebug("Fetching fields from API");
+    auto listing = plugin->folderCache.get(
+        getApiBaseUrl() + "/api/fields-db",
+        [plugin](const std::string& url, const std::string& etag) { return plugin->httpGetConditional(url, etag); },
+        parseFieldsJson);
+    if (!listing) {
+        logDebug("No cached fields and empty response from fields API");
+        return S_OK;
+    }
+
+    for (const auto& folder : listing->folders) {
+        subfoldersList->add(folder.uniqueId.c_str(), folder.name.c_str());
+    }
+
+    logDebug("GetFolderList completed - added " + std::to_string(listing->folders.size()) + " fields");
     return S_OK;
 }
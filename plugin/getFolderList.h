@@ -3,9 +3,14 @@
 
 #include "../vdjPlugin8.h"
 #include "../vdjOnlineSource.h"
+#include "folderCache.h"
+#include <string>
 
 class CAMP;
 
 HRESULT getFolderList(CAMP* plugin, IVdjSubfoldersList* subfoldersList);
 
+// Parse the /api/fields-db response (also used to warm the folder cache)
+FolderListing parseFieldsJson(const std::string& jsonResponse);
+
 #endif
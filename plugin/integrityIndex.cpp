@@ -0,0 +1,247 @@
+#include "integrityIndex.h"
+#include "sha256.h"
+#include "mappedFile.h"
+#include "settings.h"
+#include "tracing.h"
+#include "metrics.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+static const char* INDEX_FILE = ".integrity_index";
+static const char* INDEX_HEADER = "AMP integrity 1";
+// Hashing is bound by the disk, which a few readers already keep busy
+static const int MAX_VERIFIERS = 4;
+
+static MetricGauge& indexedFilesGauge()
+{
+    static MetricGauge& gauge = getGauge("amp_integrity_index_files", "Cached files with a digest in the integrity index");
+    return gauge;
+}
+
+IntegrityIndex::IntegrityIndex()
+{
+}
+
+// One line per file: name, size, modification time, sha256, time of the last check (tab separated)
+void IntegrityIndex::loadLocked(const std::string& cacheDir)
+{
+    directory = cacheDir;
+    std::ifstream file(joinPath(cacheDir, INDEX_FILE));
+    std::string line;
+    if (!file.is_open() || !getline(file, line) || line != INDEX_HEADER) {
+        return;
+    }
+
+    while (getline(file, line)) {
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (getline(stream, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 5 || fields[3].size() != 64) {
+            continue;
+        }
+        Entry entry;
+        entry.size = strtoull(fields[1].c_str(), nullptr, 10);
+        entry.modifiedAt = strtoll(fields[2].c_str(), nullptr, 10);
+        entry.sha256 = fields[3];
+        entry.verifiedAt = strtoll(fields[4].c_str(), nullptr, 10);
+        entries[fields[0]] = entry;
+    }
+    indexedFilesGauge().set((int64_t)entries.size());
+    logDebug("IntegrityIndex: Loaded " + std::to_string(entries.size()) + " entries");
+}
+
+void IntegrityIndex::save()
+{
+    std::string contents = std::string(INDEX_HEADER) + "\n";
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!dirty || directory.empty()) {
+            return;
+        }
+        char numbers[64];
+        for (const auto& item : entries) {
+            snprintf(numbers, sizeof(numbers), "\t%llu\t%lld\t", (unsigned long long)item.second.size, (long long)item.second.modifiedAt);
+            contents += item.first + numbers + item.second.sha256 + "\t" + std::to_string(item.second.verifiedAt) + "\n";
+        }
+        path = joinPath(directory, INDEX_FILE);
+        dirty = false;
+        indexedFilesGauge().set((int64_t)entries.size());
+    }
+    if (!writeFileAtomically(path, contents)) {
+        logDebug("IntegrityIndex: Could not write " + path);
+    }
+}
+
+void IntegrityIndex::record(const std::string& cacheDir, const std::string& fileName, const std::string& sha256)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (directory.empty()) {
+            loadLocked(cacheDir);
+        }
+        Entry entry;
+        if (sha256.empty() || !statFile(joinPath(cacheDir, fileName), entry.size, entry.modifiedAt)) {
+            return;
+        }
+        entry.sha256 = sha256;
+        entry.verifiedAt = (int64_t)time(nullptr);
+        entries[fileName] = entry;
+        dirty = true;
+    }
+    save();
+}
+
+void IntegrityIndex::remove(const std::string& fileName)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!entries.erase(fileName)) {
+            return;
+        }
+        dirty = true;
+    }
+    save();
+}
+
+std::string IntegrityIndex::get(const std::string& fileName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(fileName);
+    return it == entries.end() ? "" : it->second.sha256;
+}
+
+void IntegrityIndex::verifyFolder(const std::string& cacheDir, const std::vector<std::string>& fileNames, CorruptHandler onCorrupt)
+{
+    TRACE_SPAN("integrity.checkFolder");
+    int verifyDays = readIntSetting(".camp_verify_days", 7, 0, 3650);
+    int64_t now = (int64_t)time(nullptr);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (directory.empty()) {
+        loadLocked(cacheDir);
+    }
+    corruptHandler = onCorrupt;
+
+    std::unordered_set<std::string> present(fileNames.begin(), fileNames.end());
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (present.count(it->first)) {
+            ++it;
+        } else {
+            it = entries.erase(it);
+            dirty = true;
+        }
+    }
+
+    size_t queued = 0;
+    for (const std::string& fileName : fileNames) {
+        auto it = entries.find(fileName);
+        if (it != entries.end() && (verifyDays == 0 || now - it->second.verifiedAt < (int64_t)verifyDays * 86400)) {
+            continue;
+        }
+        enqueue(fileName);
+        queued++;
+    }
+    logDebug("IntegrityIndex: " + std::to_string(queued) + " of " + std::to_string(fileNames.size()) + " cached files to verify");
+
+    if (queue.empty() && dirty) {
+        // Nothing to verify, but files were dropped
+        workers.start([this]() { save(); });
+    }
+}
+
+// Called with the mutex held. Starts another verifier while there are more files than verifiers.
+void IntegrityIndex::enqueue(const std::string& fileName)
+{
+    queue.push_back(fileName);
+    int cores = (int)std::thread::hardware_concurrency();
+    int maxVerifiers = std::max(1, std::min(MAX_VERIFIERS, cores - 1));
+    if (runningVerifiers < maxVerifiers && (size_t)runningVerifiers < queue.size() &&
+        workers.start([this]() { verifyLoop(); })) {
+        runningVerifiers++;
+    }
+}
+
+void IntegrityIndex::stop()
+{
+    workers.stop();
+}
+
+void IntegrityIndex::verifyLoop()
+{
+    static MetricCounter& intact = getCounter("amp_integrity_checks_total{result=\"intact\"}", "Cached files hashed by the integrity check, by outcome");
+    static MetricCounter& corrupt = getCounter("amp_integrity_checks_total{result=\"corrupt\"}", "Cached files hashed by the integrity check, by outcome");
+    static MetricCounter& recorded = getCounter("amp_integrity_checks_total{result=\"recorded\"}", "Cached files hashed by the integrity check, by outcome");
+    static MetricCounter& failed = getCounter("amp_integrity_checks_total{result=\"failed\"}", "Cached files hashed by the integrity check, by outcome");
+
+    lowerThreadPriority();
+    CorruptHandler onCorrupt;
+    bool last = false;
+    for (;;) {
+        std::string fileName;
+        std::string dir;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // The rest waits for the next session
+            if (queue.empty() || workers.stopping()) {
+                runningVerifiers--;
+                last = runningVerifiers == 0;
+                break;
+            }
+            fileName = queue.front();
+            queue.pop_front();
+            dir = directory;
+        }
+
+        TRACE_SPAN("integrity.verifyFile");
+        std::string path = joinPath(dir, fileName);
+        Entry entry;
+        std::string sha256;
+        if (!statFile(path, entry.size, entry.modifiedAt) || !sha256File(path, sha256)) {
+            // Deleted, or being played on a system that locks it; a later check will get it
+            failed.add();
+            continue;
+        }
+        entry.sha256 = sha256;
+        entry.verifiedAt = (int64_t)time(nullptr);
+
+        bool damaged = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(fileName);
+            if (it == entries.end() || it->second.size != entry.size || it->second.modifiedAt != entry.modifiedAt) {
+                // First digest of a file cached before digests were kept, or of one rewritten on purpose
+                entries[fileName] = entry;
+                recorded.add();
+            } else if (it->second.sha256 != sha256) {
+                entries.erase(it);
+                damaged = true;
+                corrupt.add();
+            } else {
+                it->second.verifiedAt = entry.verifiedAt;
+                intact.add();
+            }
+            dirty = true;
+            onCorrupt = corruptHandler;
+        }
+        if (damaged) {
+            logDebug("IntegrityIndex: " + fileName + " no longer matches its digest");
+            if (onCorrupt) onCorrupt(fileName);
+        }
+    }
+
+    if (last) {
+        // The last verifier to finish writes the index
+        save();
+        logDebug("IntegrityIndex: Verification finished");
+    }
+}
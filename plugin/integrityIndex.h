@@ -0,0 +1,62 @@
+#ifndef VDJ_INTEGRITYINDEX_H
+#define VDJ_INTEGRITYINDEX_H
+
+#include "backgroundTasks.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <cstdint>
+
+// SHA-256 of the files in the AMP cache folder, taken as they were downloaded, so damaged files
+// are found before VirtualDJ plays them. Kept on disk as .integrity_index in the cache folder.
+// verifyFolder hashes the files again in the background, on threads with low I/O priority.
+class IntegrityIndex
+{
+public:
+    // Gets the name of a cached file whose contents no longer match its digest
+    using CorruptHandler = std::function<void(const std::string& fileName)>;
+
+    IntegrityIndex();
+
+    // Digest of a file just downloaded into cacheDir
+    void record(const std::string& cacheDir, const std::string& fileName, const std::string& sha256);
+    void remove(const std::string& fileName);
+
+    // Check every file in cacheDir (fileNames) not checked for .camp_verify_days (7; 0 = only
+    // files without a digest yet), dropping files that are gone. A file without a digest, or
+    // changed since it was taken (VirtualDJ writing tags), gets a new one.
+    void verifyFolder(const std::string& cacheDir, const std::vector<std::string>& fileNames, CorruptHandler onCorrupt);
+
+    // Empty if the file has no digest (yet)
+    std::string get(const std::string& fileName);
+
+    // Stop verifying and wait for the files being hashed; what was verified so far is saved
+    void stop();
+
+private:
+    struct Entry {
+        uint64_t size = 0;
+        int64_t modifiedAt = 0;
+        std::string sha256;
+        int64_t verifiedAt = 0; // Unix seconds
+    };
+
+    void loadLocked(const std::string& cacheDir);
+    void save();
+    void enqueue(const std::string& fileName);
+    void verifyLoop();
+
+    std::mutex mutex;
+    std::string directory; // cache folder, once loaded
+    std::unordered_map<std::string, Entry> entries;
+    std::deque<std::string> queue;
+    CorruptHandler corruptHandler;
+    int runningVerifiers = 0;
+    bool dirty = false; // entries changed since the last save
+    BackgroundTasks workers; // last, so it is joined before the rest goes away
+};
+
+#endif // VDJ_INTEGRITYINDEX_H
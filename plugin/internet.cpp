@@ -1,22 +1,414 @@
 #include "../AMP.h"
+#include "internet.h"
+#include "connectionPool.h"
+#include "bandwidthGovernor.h"
+#include "streamUrlCache.h"
+#include "endpointHealth.h"
+#include "settings.h"
+#include "tracing.h"
+#include "metrics.h"
 #include "utilities.h"
+#include "sha256.h"
 #include <string>
 #include <vector>
+#include <deque>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <future>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <cctype>
 #include <fstream>
 #include <sstream>
+#include <ctime>
 
 #ifdef VDJ_WIN
 #include <windows.h>
 #include <wininet.h>
 #pragma comment(lib, "wininet.lib")
-#elif defined(VDJ_MAC)
-// For popen
-#include <cstdio>
+
+// INTERNET_OPTION_HTTP_DECODING only decodes; JSON requests have to ask for compression themselves.
+// Not sent with audio requests, whose byte ranges must refer to the file itself.
+static const char* ACCEPT_ENCODING_HEADER = "Accept-Encoding: gzip, deflate\r\n";
 #endif
 
 
+// Counters shared by all GET paths
+struct HttpMetrics {
+    MetricCounter& requests;
+    MetricCounter& errors;
+    MetricCounter& responseBytes;
+    MetricCounter& wireBytes;
+};
+
+static HttpMetrics& httpMetrics()
+{
+    static HttpMetrics metrics = {
+        getCounter("amp_http_requests_total", "HTTP GET requests to the backend"),
+        getCounter("amp_http_errors_total", "HTTP GET requests that failed to complete"),
+        getCounter("amp_http_response_bytes_total", "HTTP GET response body bytes received, after decompression"),
+        getCounter("amp_http_wire_bytes_total", "HTTP GET response body bytes as transferred, before decompression"),
+    };
+    return metrics;
+}
+
+// Hex of base64 text (standard or URL-safe alphabet); empty if it isn't base64
+static std::string base64ToHex(const std::string& text)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    uint32_t bits = 0;
+    int bitCount = 0;
+    for (char c : text) {
+        int value;
+        if (c >= 'A' && c <= 'Z') value = c - 'A';
+        else if (c >= 'a' && c <= 'z') value = c - 'a' + 26;
+        else if (c >= '0' && c <= '9') value = c - '0' + 52;
+        else if (c == '+' || c == '-') value = 62;
+        else if (c == '/' || c == '_') value = 63;
+        else if (c == '=') break;
+        else return "";
+        bits = (bits << 6) | (uint32_t)value;
+        bitCount += 6;
+        if (bitCount >= 8) {
+            bitCount -= 8;
+            unsigned char byte = (unsigned char)(bits >> bitCount);
+            hex += digits[byte >> 4];
+            hex += digits[byte & 0x0F];
+        }
+    }
+    return hex;
+}
+
+std::string parseSha256Header(const std::string& name, const std::string& value)
+{
+    std::string trimmed = value;
+    trimmed.erase(0, trimmed.find_first_not_of(" \t"));
+    trimmed.erase(trimmed.find_last_not_of(" \t\r\n") + 1);
+    std::string hex;
+    if (name == "x-checksum-sha256") {
+        hex = trimmed;
+        for (char& c : hex) c = (char)tolower((unsigned char)c);
+    } else if (name == "x-amz-checksum-sha256") {
+        hex = base64ToHex(trimmed);
+    } else if (name == "repr-digest" || name == "content-digest" || name == "digest") {
+        // A list of algorithm=value pairs
+        std::stringstream list(trimmed);
+        std::string item;
+        while (getline(list, item, ',')) {
+            size_t equals = item.find('=');
+            if (equals == std::string::npos) continue;
+            std::string algorithm = item.substr(0, equals);
+            algorithm.erase(0, algorithm.find_first_not_of(' '));
+            for (char& c : algorithm) c = (char)tolower((unsigned char)c);
+            if (algorithm != "sha-256") continue;
+            std::string encoded = item.substr(equals + 1);
+            encoded.erase(std::remove(encoded.begin(), encoded.end(), ':'), encoded.end());
+            encoded.erase(std::remove(encoded.begin(), encoded.end(), ' '), encoded.end());
+            hex = base64ToHex(encoded);
+            break;
+        }
+    }
+    return hex.size() == 64 && hex.find_first_not_of("0123456789abcdef") == std::string::npos ? hex : "";
+}
+
+#ifdef VDJ_MAC
+static size_t appendToString(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    static_cast<std::string*>(userdata)->append(data, size * nmemb);
+    return size * nmemb;
+}
+
+// Where a download goes: the file, and the hash of what was written to it
+struct DownloadSink {
+    FILE* file;
+    Sha256 hash;
+    std::string expectedSha256; // announced by the final response, if it did
+};
+
+// Write callback for downloads: to the file, as fast as the bandwidth governor lets background transfers go.
+// Waiting here stops libcurl reading the socket, so TCP slows the sender down.
+static size_t writeToFile(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    DownloadSink* sink = static_cast<DownloadSink*>(userdata);
+    BandwidthGovernor& governor = getBandwidthGovernor();
+    governor.charge(TransferPriority::Background, (int64_t)(size * nmemb));
+    governor.wait(TransferPriority::Background);
+    size_t written = fwrite(data, 1, size * nmemb, sink->file);
+    sink->hash.update(data, written);
+    return written;
+}
+
+// Header callback for downloads: the digest of the final response in the redirect chain
+static size_t collectDigestHeader(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    DownloadSink* sink = static_cast<DownloadSink*>(userdata);
+    std::string line(data, size * nmemb);
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        sink->expectedSha256.clear();
+        return size * nmemb;
+    }
+    size_t colon = line.find(':');
+    if (colon != std::string::npos) {
+        std::string name = line.substr(0, colon);
+        for (char& c : name) c = (char)tolower((unsigned char)c);
+        std::string sha256 = parseSha256Header(name, line.substr(colon + 1));
+        if (!sha256.empty()) {
+            sink->expectedSha256 = sha256;
+        }
+    }
+    return size * nmemb;
+}
+
+// Header callback: keep the ETag of the final response in the redirect chain
+static size_t collectHeader(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    HttpResponse* response = static_cast<HttpResponse*>(userdata);
+    std::string line(data, size * nmemb);
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        response->etag.clear();
+    }
+
+    std::string name = line.substr(0, 5);
+    for (char& c : name) c = (char)tolower((unsigned char)c);
+    if (line.size() > 5 && name == "etag:") {
+        size_t valueStart = line.find_first_not_of(' ', 5);
+        size_t valueEnd = line.find_last_not_of(" \r\n");
+        if (valueStart != std::string::npos && valueEnd != std::string::npos && valueEnd >= valueStart) {
+            response->etag = line.substr(valueStart, valueEnd - valueStart + 1);
+        }
+    }
+    return size * nmemb;
+}
+
+// Split a finished transfer into connect, time-to-first-byte and body read spans
+static void recordTransferTimings(CURL* curl, uint64_t startNs)
+{
+    static LatencyHistogram& connectHistogram = getSpanHistogram("http.connect");
+    static LatencyHistogram& firstByteHistogram = getSpanHistogram("http.ttfb");
+    static LatencyHistogram& bodyHistogram = getSpanHistogram("http.body");
+
+    curl_off_t connectUs = 0, tlsUs = 0, firstByteUs = 0, totalUs = 0;
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connectUs);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tlsUs);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &firstByteUs);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &totalUs);
+
+    // Requests on a reused connection report no connect time
+    curl_off_t connectedUs = tlsUs > connectUs ? tlsUs : connectUs;
+    if (connectedUs > 0) {
+        recordSpan(connectHistogram, startNs, (uint64_t)connectedUs * 1000);
+    }
+    recordSpan(firstByteHistogram, startNs, (uint64_t)firstByteUs * 1000);
+    if (totalUs > firstByteUs) {
+        recordSpan(bodyHistogram, startNs + (uint64_t)firstByteUs * 1000, (uint64_t)(totalUs - firstByteUs) * 1000);
+    }
+}
+
+// One try of a GET. Headers and progress callbacks watch the deadline and the hedging race.
+struct GetAttempt {
+    HttpResponse response;
+    EndpointHealth::Policy policy;
+    uint64_t startNs = 0;
+    uint64_t firstByteNs = 0;            // when the response headers started, 0 before
+    std::atomic<bool> headersSeen{false};
+    std::atomic<bool>* cancel = nullptr; // set when a competing attempt already won
+    bool timedOut = false;
+    std::function<void()> onHeaders;     // tells a waiting hedger this attempt is answering
+};
+
+static size_t collectAttemptHeader(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    GetAttempt* attempt = static_cast<GetAttempt*>(userdata);
+    if (!attempt->headersSeen.load(std::memory_order_relaxed)) {
+        attempt->firstByteNs = traceNowNs();
+        attempt->headersSeen = true;
+        if (attempt->onHeaders) attempt->onHeaders();
+    }
+    return collectHeader(data, size, nmemb, &attempt->response);
+}
+
+static int watchAttempt(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+    GetAttempt* attempt = static_cast<GetAttempt*>(userdata);
+    if (attempt->cancel && attempt->cancel->load(std::memory_order_relaxed)) {
+        return 1;
+    }
+    if (!attempt->headersSeen.load(std::memory_order_relaxed) &&
+        traceNowNs() - attempt->startNs > (uint64_t)attempt->policy.firstByteTimeoutMs * 1000000) {
+        attempt->timedOut = true;
+        return 1;
+    }
+    return 0;
+}
+
+static void performAttempt(const std::string& url, const std::string& etag, GetAttempt& attempt)
+{
+    static MetricCounter& timeouts = getCounter("amp_http_timeouts_total", "HTTP GET requests abandoned at their adaptive deadline");
+
+    CURL* curl = acquireCurlHandle();
+    if (!curl) {
+        return;
+    }
+
+    struct curl_slist* headers = nullptr;
+    if (!etag.empty()) {
+        headers = curl_slist_append(headers, ("If-None-Match: " + etag).c_str());
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendToString);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &attempt.response.body);
+    // Offer every encoding this libcurl can decode (gzip, deflate, and br/zstd when built with them).
+    // Decompression happens as the data arrives, so the body is only ever held decoded, once.
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, collectAttemptHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &attempt);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, watchAttempt);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &attempt);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)attempt.policy.firstByteTimeoutMs);
+    // A body that stops flowing (under 1 byte/s) for the stall timeout is given up on as well
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)std::max(1, (attempt.policy.stallTimeoutMs + 999) / 1000));
+
+    attempt.startNs = traceNowNs();
+    CURLcode result = performTransfer(curl, TransferPriority::Interactive, attempt.cancel);
+    httpMetrics().requests.add();
+    if (result == CURLE_OK) {
+        long statusCode = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &statusCode);
+        attempt.response.status = (int)statusCode;
+        recordTransferTimings(curl, attempt.startNs);
+        httpMetrics().responseBytes.add(attempt.response.body.size());
+        curl_off_t wireBytes = 0;
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &wireBytes);
+        httpMetrics().wireBytes.add((uint64_t)wireBytes);
+    } else {
+        bool cancelled = attempt.cancel && attempt.cancel->load();
+        if (!cancelled) {
+            logDebug("performGet: curl error for " + url + ": " + curl_easy_strerror(result) +
+                     (attempt.timedOut ? " (no response within " + std::to_string(attempt.policy.firstByteTimeoutMs) + " ms)" : ""));
+            httpMetrics().errors.add();
+        }
+        if (attempt.timedOut || result == CURLE_OPERATION_TIMEDOUT) {
+            timeouts.add();
+        }
+        attempt.response.status = 0;
+        attempt.response.body.clear();
+    }
+
+    releaseCurlHandle(curl);
+    curl_slist_free_all(headers);
+}
+
+// Two attempts at the same GET; the first real response wins and the other is cancelled
+struct HedgeRace {
+    std::mutex mutex;
+    std::condition_variable changed;
+    GetAttempt attempts[2];
+    bool done[2] = {false, false};
+    std::atomic<bool> cancel{false};
+};
+
+static void runRaceAttempt(HedgeRace* race, int index, const std::string& url, const std::string& etag)
+{
+    GetAttempt& attempt = race->attempts[index];
+    attempt.cancel = &race->cancel;
+    attempt.onHeaders = [race]() {
+        std::lock_guard<std::mutex> lock(race->mutex);
+        race->changed.notify_all();
+    };
+    performAttempt(url, etag, attempt);
+    std::lock_guard<std::mutex> lock(race->mutex);
+    race->done[index] = true;
+    race->changed.notify_all();
+}
+
+// GET on a pooled handle, optionally conditional on an ETag. The endpoint's history decides
+// how long to wait for a response and when to hedge with a second request; while its circuit
+// is open the request fails immediately so callers fall back to what they have cached.
+static HttpResponse performGet(const std::string& url, const std::string& etag)
+{
+    static MetricCounter& hedged = getCounter("amp_http_hedged_requests_total", "HTTP GET requests duplicated after their endpoint's p95 time to first byte");
+    static MetricCounter& hedgeWins = getCounter("amp_http_hedge_wins_total", "Hedged HTTP GET requests answered by the duplicate");
+
+    EndpointHealth& health = getEndpointHealth(url);
+    if (!health.allowRequest()) {
+        logDebug("performGet: Circuit open for " + health.getName() + ", not requesting " + url);
+        return HttpResponse();
+    }
+    EndpointHealth::Policy policy = health.getPolicy();
+
+    GetAttempt single;
+    GetAttempt* winner = &single;
+    HedgeRace race;
+    std::thread racers[2];
+    if (policy.hedgeAfterMs == 0) {
+        single.policy = policy;
+        performAttempt(url, etag, single);
+    } else {
+        race.attempts[0].policy = policy;
+        race.attempts[1].policy = policy;
+        racers[0] = std::thread(runRaceAttempt, &race, 0, url, etag);
+
+        std::unique_lock<std::mutex> lock(race.mutex);
+        bool answering = race.changed.wait_for(lock, std::chrono::milliseconds(policy.hedgeAfterMs), [&race]() {
+            return race.done[0] || race.attempts[0].headersSeen.load();
+        });
+        if (!answering) {
+            logDebug("performGet: No response after " + std::to_string(policy.hedgeAfterMs) + " ms, hedging " + url);
+            hedged.add();
+            racers[1] = std::thread(runRaceAttempt, &race, 1, url, etag);
+        }
+
+        // First finished attempt with a real response, or the last one to finish
+        int attempts = answering ? 1 : 2;
+        int chosen = -1;
+        race.changed.wait(lock, [&]() {
+            bool allDone = true;
+            for (int i = 0; i < attempts; i++) {
+                if (race.done[i] && race.attempts[i].response.status != 0) {
+                    chosen = i;
+                    return true;
+                }
+                allDone = allDone && race.done[i];
+            }
+            if (allDone) chosen = 0;
+            return allDone;
+        });
+        lock.unlock();
+
+        // Abort the loser now rather than at its next progress callback, and wait for it
+        race.cancel = true;
+        wakeTransferEngine();
+        for (std::thread& racer : racers) {
+            if (racer.joinable()) racer.join();
+        }
+        winner = &race.attempts[chosen];
+        if (chosen == 1) {
+            hedgeWins.add();
+        }
+    }
+
+    // 5xx counts against the endpoint too, but the caller still gets the response
+    HttpResponse response = winner->response;
+    if (response.status != 0 && response.status < 500) {
+        health.recordSuccess((winner->firstByteNs - winner->startNs) / 1000000);
+    } else {
+        health.recordFailure(response.status != 0);
+    }
+    return response;
+}
+#endif
+
 // HTTP GET implementation
 std::string CAMP::httpGet(const std::string& url)
 {
@@ -25,53 +417,322 @@ std::string CAMP::httpGet(const std::string& url)
     
 #ifdef VDJ_WIN
     logDebug("httpGet: Using Windows WinINet");
-    HINTERNET hInternet = InternetOpenA("VDJ Plugin", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
+    EndpointHealth& health = getEndpointHealth(url);
+    if (!health.allowRequest()) {
+        logDebug("httpGet: Circuit open for " + health.getName() + ", not requesting " + url);
+        return response;
+    }
+    HINTERNET hInternet = getInternetSession();
     if (hInternet) {
-        logDebug("httpGet: Internet connection opened");
-        HINTERNET hUrl = InternetOpenUrlA(hInternet, url.c_str(), NULL, 0, INTERNET_FLAG_RELOAD, 0);
+        HINTERNET hUrl;
+        uint64_t startNs = traceNowNs();
+        {
+            // WinINet connects and waits for the response headers in this one call
+            TRACE_SPAN("http.ttfb");
+            hUrl = InternetOpenUrlA(hInternet, url.c_str(), ACCEPT_ENCODING_HEADER, (DWORD)strlen(ACCEPT_ENCODING_HEADER),
+                                    INTERNET_FLAG_RELOAD | INTERNET_FLAG_KEEP_CONNECTION, 0);
+        }
         if (hUrl) {
-            logDebug("httpGet: URL opened, reading data");
+            // Like performGet: a 5xx is an answer, but counts against the endpoint
+            DWORD statusCode = 0;
+            DWORD statusSize = sizeof(statusCode);
+            HttpQueryInfoA(hUrl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &statusCode, &statusSize, NULL);
+            if (statusCode == 0 || statusCode >= 500) {
+                health.recordFailure(statusCode != 0);
+            } else {
+                health.recordSuccess((traceNowNs() - startNs) / 1000000);
+            }
+            logDebug("httpGet: URL opened (status " + std::to_string(statusCode) + "), reading data");
             char buffer[4096];
             DWORD bytesRead;
+            TRACE_SPAN("http.body");
             while (InternetReadFile(hUrl, buffer, sizeof(buffer) - 1, &bytesRead) && bytesRead > 0) {
                 buffer[bytesRead] = '\0';
                 response += buffer;
             }
             logDebug("httpGet: Data read, response length: " + std::to_string(response.length()));
+            httpMetrics().requests.add();
+            httpMetrics().responseBytes.add(response.length());
             InternetCloseHandle(hUrl);
         } else {
             logDebug("httpGet: Failed to open URL");
+            httpMetrics().errors.add();
+            health.recordFailure(false);
         }
-        InternetCloseHandle(hInternet);
     } else {
         logDebug("httpGet: Failed to open internet connection");
     }
 #elif defined(VDJ_MAC)
-    // HTTP request using macOS system command
-    logDebug("httpGet: Using macOS curl");
-    std::string command = "curl -s -L \"" + url + "\"";
-    logDebug("httpGet: Executing command: " + command);
-    FILE* pipe = popen(command.c_str(), "r");
-    if (pipe) {
-        logDebug("httpGet: Command executed, reading output");
-        char buffer[4096];
-        while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-            response += buffer;
-        }
-        pclose(pipe);
-        logDebug("httpGet: Command completed, response length: " + std::to_string(response.length()));
-    } else {
-        logDebug("httpGet: Failed to execute curl command");
-    }
+    // Pooled libcurl handle, so back-to-back requests reuse the connection
+    response = performGet(url, "").body;
+    logDebug("httpGet: Response length: " + std::to_string(response.length()));
 #endif
     
     logDebug("httpGet completed, returning response");
     return response;
 }
 
+// HTTP GET that also reports status and ETag, sending If-None-Match when an ETag is given.
+// A 304 response means the caller's copy is still current and the body is empty.
+HttpResponse CAMP::httpGetConditional(const std::string& url, const std::string& etag)
+{
+    logDebug("httpGetConditional called with URL: " + url + (etag.empty() ? "" : ", ETag: " + etag));
+    HttpResponse response;
+
+#ifdef VDJ_WIN
+    std::string headers = ACCEPT_ENCODING_HEADER;
+    if (!etag.empty()) {
+        headers += "If-None-Match: " + etag + "\r\n";
+    }
+    EndpointHealth& health = getEndpointHealth(url);
+    if (!health.allowRequest()) {
+        logDebug("httpGetConditional: Circuit open for " + health.getName() + ", not requesting " + url);
+        return response;
+    }
+    HINTERNET hInternet = getInternetSession();
+    if (hInternet) {
+        HINTERNET hUrl;
+        uint64_t startNs = traceNowNs();
+        {
+            TRACE_SPAN("http.ttfb");
+            hUrl = InternetOpenUrlA(hInternet, url.c_str(), headers.c_str(), (DWORD)headers.length(), INTERNET_FLAG_RELOAD | INTERNET_FLAG_KEEP_CONNECTION, 0);
+        }
+        if (hUrl) {
+            DWORD statusCode = 0;
+            DWORD statusSize = sizeof(statusCode);
+            if (HttpQueryInfoA(hUrl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &statusCode, &statusSize, NULL)) {
+                response.status = (int)statusCode;
+            }
+            if (response.status == 0 || response.status >= 500) {
+                health.recordFailure(response.status != 0);
+            } else {
+                health.recordSuccess((traceNowNs() - startNs) / 1000000);
+            }
+            char etagBuffer[256];
+            DWORD etagSize = sizeof(etagBuffer);
+            if (HttpQueryInfoA(hUrl, HTTP_QUERY_ETAG, etagBuffer, &etagSize, NULL)) {
+                response.etag.assign(etagBuffer, etagSize);
+            }
+
+            char buffer[4096];
+            DWORD bytesRead;
+            TRACE_SPAN("http.body");
+            while (InternetReadFile(hUrl, buffer, sizeof(buffer), &bytesRead) && bytesRead > 0) {
+                response.body.append(buffer, bytesRead);
+            }
+            InternetCloseHandle(hUrl);
+            httpMetrics().requests.add();
+            httpMetrics().responseBytes.add(response.body.length());
+        } else {
+            logDebug("httpGetConditional: Failed to open URL");
+            httpMetrics().errors.add();
+            health.recordFailure(false);
+        }
+    } else {
+        logDebug("httpGetConditional: Failed to open internet connection");
+    }
+#elif defined(VDJ_MAC)
+    response = performGet(url, etag);
+#endif
+
+    logDebug("httpGetConditional completed, status: " + std::to_string(response.status) + ", length: " + std::to_string(response.body.length()));
+    return response;
+}
+
+// Contents of the JSON array following "key" (without the brackets), and how many objects it holds
+static std::string extractJsonArray(const std::string& json, const std::string& key, int& objectCount)
+{
+    objectCount = 0;
+    size_t keyPos = json.find("\"" + key + "\"");
+    if (keyPos == std::string::npos) return "";
+    size_t arrayStart = json.find('[', keyPos);
+    if (arrayStart == std::string::npos) return "";
+
+    int depth = 0;
+    bool inString = false;
+    for (size_t i = arrayStart + 1; i < json.length(); i++) {
+        char c = json[i];
+        if (inString) {
+            if (c == '\\') i++;
+            else if (c == '"') inString = false;
+            continue;
+        }
+        if (c == '"') inString = true;
+        else if (c == '{' || c == '[') {
+            if (depth == 0 && c == '{') objectCount++;
+            depth++;
+        }
+        else if (c == '}') depth--;
+        else if (c == ']') {
+            if (depth == 0) return json.substr(arrayStart + 1, i - arrayStart - 1);
+            depth--;
+        }
+    }
+    return ""; // unterminated array
+}
+
+// Integer value of "key" in the outermost JSON object, skipping nested objects and arrays
+// (an item may have a "total" of its own). False if the object has no such number.
+static bool readTopLevelInt(const std::string& json, const std::string& key, long long& value)
+{
+    int depth = 0;
+    for (size_t i = 0; i < json.length(); i++) {
+        char c = json[i];
+        if (c == '{' || c == '[') depth++;
+        else if (c == '}' || c == ']') depth--;
+        else if (c == '"') {
+            size_t start = i + 1;
+            for (i = start; i < json.length() && json[i] != '"'; i++) {
+                if (json[i] == '\\') i++;
+            }
+            if (depth != 1 || json.compare(start, i - start, key) != 0) continue;
+            size_t colon = json.find_first_not_of(" \t\r\n", i + 1);
+            if (colon == std::string::npos || json[colon] != ':') continue;
+            size_t number = json.find_first_not_of(" \t\r\n", colon + 1);
+            if (number == std::string::npos || !(isdigit((unsigned char)json[number]) || json[number] == '-')) return false;
+            value = atoll(json.c_str() + number);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Fetch every page of a paginated collection (?limit=&offset=), keeping several pages in
+// flight on pooled connections. The result holds all items as {"<arrayKey>":[...]} in page
+// order. Its ETag holds the page stride and the page ETags; passing it back revalidates
+// every page conditionally.
+HttpResponse CAMP::httpGetAllPages(const std::string& url, const std::string& arrayKey, const std::string& etag)
+{
+    static const int pageSize = readIntSetting(".camp_page_size", 500, 50, 10000);
+    static const int parallel = readIntSetting(".camp_fetch_parallel", 4, 1, 16);
+
+    // The server may cap pages below pageSize, so pages are stride items apart: as many as the first one held
+    auto pageUrl = [&url](int page, int stride) {
+        return url + (url.find('?') == std::string::npos ? "?" : "&") +
+               "limit=" + std::to_string(pageSize) + "&offset=" + std::to_string((long long)page * stride);
+    };
+    auto fetchPage = [this, pageUrl](int page, int stride, const std::string& pageEtag) {
+        std::string fullUrl = pageUrl(page, stride);
+        return std::async(std::launch::async, [this, fullUrl, pageEtag]() { return httpGetConditional(fullUrl, pageEtag); });
+    };
+
+    // Revalidate: all known pages unchanged and nothing past the last one means 304
+    if (!etag.empty()) {
+        std::vector<std::string> pageEtags;
+        std::stringstream etagStream(etag);
+        std::string pageEtag;
+        while (getline(etagStream, pageEtag, '\t')) {
+            pageEtags.push_back(pageEtag);
+        }
+        // ETags are quoted, so a bare number in front is the stride; ETags saved without one used pageSize
+        int stride = pageSize;
+        if (!pageEtags.empty() && !pageEtags[0].empty() && pageEtags[0].find_first_not_of("0123456789") == std::string::npos) {
+            stride = std::max(1, atoi(pageEtags[0].c_str()));
+            pageEtags.erase(pageEtags.begin());
+        }
+
+        bool unchanged = !pageEtags.empty();
+        for (size_t batchStart = 0; batchStart < pageEtags.size() && unchanged; batchStart += parallel) {
+            std::vector<std::future<HttpResponse>> checks;
+            for (size_t i = batchStart; i < pageEtags.size() && i < batchStart + parallel; i++) {
+                checks.push_back(fetchPage((int)i, stride, pageEtags[i]));
+            }
+            for (auto& check : checks) {
+                if (check.get().status != 304) unchanged = false;
+            }
+        }
+        if (unchanged) {
+            int extraCount = 0;
+            HttpResponse next = fetchPage((int)pageEtags.size(), stride, "").get();
+            extractJsonArray(next.body, arrayKey, extraCount);
+            if (next.status == 200 && extraCount == 0) {
+                HttpResponse notModified;
+                notModified.status = 304;
+                notModified.etag = etag;
+                return notModified;
+            }
+        }
+        logDebug("httpGetAllPages: Collection changed, refetching all pages of " + url);
+    }
+
+    HttpResponse first = fetchPage(0, pageSize, "").get();
+    if (first.status != 200) {
+        return first;
+    }
+
+    int firstCount = 0;
+    std::vector<std::string> pageItems{extractJsonArray(first.body, arrayKey, firstCount)};
+    std::vector<std::string> pageEtags{first.etag};
+    int stride = firstCount > 0 ? firstCount : pageSize;
+
+    // Only an empty page ends the collection, unless a top-level "total" says exactly where it ends
+    long long total = -1;
+    readTopLevelInt(first.body, "total", total);
+    if (firstCount > 0 && (total < 0 || firstCount < total)) {
+        long long pageCount = total < 0 ? -1 : (total + stride - 1) / stride;
+
+        std::deque<std::future<HttpResponse>> inflight;
+        int nextPage = 1;
+        bool done = false;
+        while (true) {
+            while (!done && (int)inflight.size() < parallel && (pageCount < 0 || nextPage < pageCount)) {
+                inflight.push_back(fetchPage(nextPage++, stride, ""));
+            }
+            if (inflight.empty()) break;
+
+            HttpResponse page = inflight.front().get();
+            inflight.pop_front();
+            if (done) continue; // speculative request past the end
+
+            if (page.status != 200) {
+                logDebug("httpGetAllPages: Page " + std::to_string(pageItems.size()) + " failed with status " + std::to_string(page.status));
+                return page;
+            }
+
+            int count = 0;
+            std::string items = extractJsonArray(page.body, arrayKey, count);
+            if (!items.empty() && items == pageItems[0]) {
+                logDebug("httpGetAllPages: Server ignores offset, stopping after first page");
+                done = true;
+                continue;
+            }
+            if (count == 0) {
+                done = true;
+                continue;
+            }
+            pageItems.push_back(items);
+            pageEtags.push_back(page.etag);
+        }
+    }
+
+    HttpResponse combined;
+    combined.status = 200;
+    combined.body = "{\"" + arrayKey + "\":[";
+    for (size_t i = 0; i < pageItems.size(); i++) {
+        if (pageItems[i].empty()) continue;
+        if (combined.body.back() != '[') combined.body += ',';
+        combined.body += pageItems[i];
+    }
+    combined.body += "]}";
+
+    // Only revalidate page by page if every page had an ETag
+    combined.etag = std::to_string(stride);
+    for (size_t i = 0; i < pageEtags.size(); i++) {
+        if (pageEtags[i].empty()) {
+            combined.etag.clear();
+            break;
+        }
+        combined.etag += "\t" + pageEtags[i];
+    }
+
+    logDebug("httpGetAllPages: Fetched " + std::to_string(pageItems.size()) + " pages of " + url);
+    return combined;
+}
+
 // Simple JSON parsing for our specific response format
 std::vector<TrackInfo> CAMP::parseTracksFromJson(const std::string& jsonString)
 {
+    TRACE_SPAN("parse.tracks");
     logDebug("parseTracksFromJson called with JSON length: " + std::to_string(jsonString.length()));
     std::vector<TrackInfo> tracks;
     
@@ -82,9 +743,10 @@ std::vector<TrackInfo> CAMP::parseTracksFromJson(const std::string& jsonString)
         logDebug("parseTracksFromJson: 'tracks' not found in JSON, creating error track");
         TrackInfo testTrack;
         testTrack.uniqueId = "parse_error";
+        testTrack.cacheFileName = "parse_error";
         testTrack.name = "Please subscribe to AMP";
         testTrack.directory = "Error";
-        testTrack.url = "https://tracks.abelldjcompany.com/audio/test.mp3";
+        testTrack.url = getTracksBaseUrl() + "/audio/test.mp3";
         testTrack.size = 0;
         tracks.push_back(testTrack);
         logDebug("parseTracksFromJson: Returning error track");
@@ -96,9 +758,10 @@ std::vector<TrackInfo> CAMP::parseTracksFromJson(const std::string& jsonString)
         logDebug("parseTracksFromJson: Array start '[' not found, creating error track");
         TrackInfo testTrack;
         testTrack.uniqueId = "parse_error2";
+        testTrack.cacheFileName = "parse_error2";
         testTrack.name = "Please subscribe to AMP";
         testTrack.directory = "Error";
-        testTrack.url = "https://tracks.abelldjcompany.com/audio/test.mp3";
+        testTrack.url = getTracksBaseUrl() + "/audio/test.mp3";
         testTrack.size = 0;
         tracks.push_back(testTrack);
         logDebug("parseTracksFromJson: Returning array error track");
@@ -108,9 +771,8 @@ std::vector<TrackInfo> CAMP::parseTracksFromJson(const std::string& jsonString)
     // Parse the real JSON response - look for each track object
     logDebug("parseTracksFromJson: Found tracks array, starting to parse tracks");
     size_t pos = arrayStart + 1;
-    int trackCount = 0;
     
-    while (pos < jsonString.length() && trackCount < 5000) { // Higher limit for all tracks
+    while (pos < jsonString.length()) {
         size_t objStart = jsonString.find('{', pos);
         if (objStart == std::string::npos) break;
         
@@ -169,10 +831,20 @@ std::vector<TrackInfo> CAMP::parseTracksFromJson(const std::string& jsonString)
             }
         }
         
+        // Extract coverUrl (optional, may be null)
+        size_t coverStart = trackObj.find("\"coverUrl\":");
+        if (coverStart != std::string::npos) {
+            coverStart = trackObj.find_first_not_of(" \t\r\n", coverStart + 11);
+            size_t coverEnd = coverStart != std::string::npos && trackObj[coverStart] == '"' ? trackObj.find('"', coverStart + 1) : std::string::npos;
+            if (coverEnd != std::string::npos) {
+                track.coverUrl = trackObj.substr(coverStart + 1, coverEnd - coverStart - 1);
+            }
+        }
+        
         // Only add track if we have essential fields
         if (!track.name.empty() && !track.uniqueId.empty() && !track.url.empty()) {
+            track.cacheFileName = cacheFileNameFor(track.uniqueId);
             tracks.push_back(track);
-            trackCount++;
         }
         
         pos = objEnd + 1;
@@ -182,34 +854,59 @@ std::vector<TrackInfo> CAMP::parseTracksFromJson(const std::string& jsonString)
     return tracks;
 }
 
-void CAMP::httpPost(const std::string& url, const std::string& postData)
+// POST a JSON body. True if the backend took it (any response below 500); false if it should be
+// sent again later, including while the endpoint's circuit is open.
+bool CAMP::httpPost(const std::string& url, const std::string& postData)
 {
+    TRACE_SPAN("http.post");
     logDebug("httpPost called with URL: " + url + " and data: " + postData);
 
+    EndpointHealth& health = getEndpointHealth(url);
+    if (!health.allowRequest()) {
+        logDebug("httpPost: Circuit open for " + health.getName() + ", not posting to " + url);
+        return false;
+    }
+
 #ifdef VDJ_MAC
-    // Using curl for POST request on macOS
-    std::string command = "curl -s -L -X POST -H \"Content-Type: application/json\" -d '" + postData + "' \"" + url + "\"";
-    
-    FILE* pipe = popen(command.c_str(), "r");
-    if (!pipe) {
-        logDebug("httpPost: failed to execute curl command.");
-        return;
+    CURL* curl = acquireCurlHandle();
+    if (!curl) {
+        return false;
     }
-    
-    char buffer[128];
-    std::string result = "";
-    while (fgets(buffer, sizeof(buffer), pipe) != NULL) {
-        result += buffer;
+
+    std::string result;
+    struct curl_slist* headers = curl_slist_append(nullptr, "Content-Type: application/json");
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, postData.c_str());
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)postData.size());
+    // Stay a POST through redirects
+    curl_easy_setopt(curl, CURLOPT_POSTREDIR, (long)CURL_REDIR_POST_ALL);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, appendToString);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &result);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)getDefaultHttpTimeoutMs());
+
+    CURLcode code = performTransfer(curl, TransferPriority::Normal);
+    long statusCode = 0;
+    double firstByteSeconds = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &statusCode);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &firstByteSeconds);
+    releaseCurlHandle(curl);
+    curl_slist_free_all(headers);
+
+    if (code != CURLE_OK || statusCode == 0 || statusCode >= 500) {
+        logDebug("httpPost: Failed for " + url + ": " + (code != CURLE_OK ? curl_easy_strerror(code) : "status " + std::to_string(statusCode)));
+        health.recordFailure(statusCode != 0);
+        return false;
     }
-    
-    pclose(pipe);
-    logDebug("httpPost response: " + result);
+    health.recordSuccess((uint64_t)(firstByteSeconds * 1000));
+    logDebug("httpPost response (" + std::to_string(statusCode) + "): " + result);
+    return true;
 #elif defined(VDJ_WIN)
     // Using WinINet for POST request on Windows
-    HINTERNET hInternet = InternetOpenA("VDJ Plugin", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
+    HINTERNET hInternet = getInternetSession();
     if (!hInternet) {
-        logDebug("httpPost: InternetOpenA failed.");
-        return;
+        logDebug("httpPost: No internet session.");
+        return false;
     }
 
     URL_COMPONENTS urlComp;
@@ -225,15 +922,14 @@ void CAMP::httpPost(const std::string& url, const std::string& postData)
     
     if (!InternetCrackUrlA(url.c_str(), url.length(), 0, &urlComp)) {
         logDebug("httpPost: InternetCrackUrlA failed.");
-        InternetCloseHandle(hInternet);
-        return;
+        return false;
     }
 
     HINTERNET hConnect = InternetConnectA(hInternet, urlComp.lpszHostName, urlComp.nPort, NULL, NULL, INTERNET_SERVICE_HTTP, 0, 0);
     if (!hConnect) {
         logDebug("httpPost: InternetConnectA failed.");
-        InternetCloseHandle(hInternet);
-        return;
+        health.recordFailure(false);
+        return false;
     }
 
     const char* acceptTypes[] = {"application/json", NULL};
@@ -241,84 +937,503 @@ void CAMP::httpPost(const std::string& url, const std::string& postData)
     if (!hRequest) {
         logDebug("httpPost: HttpOpenRequestA failed.");
         InternetCloseHandle(hConnect);
-        InternetCloseHandle(hInternet);
-        return;
+        return false;
     }
 
     std::string headers = "Content-Type: application/json";
+    uint64_t startNs = traceNowNs();
+    DWORD statusCode = 0;
     if (!HttpSendRequestA(hRequest, headers.c_str(), headers.length(), (LPVOID)postData.c_str(), postData.length())) {
          DWORD dwError = GetLastError();
         logDebug("httpPost: HttpSendRequestA failed. Error: " + std::to_string(dwError));
+    } else {
+        DWORD statusSize = sizeof(statusCode);
+        HttpQueryInfoA(hRequest, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &statusCode, &statusSize, NULL);
     }
     
     InternetCloseHandle(hRequest);
     InternetCloseHandle(hConnect);
-    InternetCloseHandle(hInternet);
+
+    if (statusCode == 0 || statusCode >= 500) {
+        health.recordFailure(statusCode != 0);
+        return false;
+    }
+    health.recordSuccess((traceNowNs() - startNs) / 1000000);
+    logDebug("httpPost response (" + std::to_string(statusCode) + ")");
+    return true;
+#else
+    return false;
 #endif
 }
 
-bool CAMP::downloadFile(const std::string& url, const std::string& filePath)
+bool CAMP::downloadFile(const std::string& url, const std::string& filePath, std::string& sha256)
 {
+    TRACE_SPAN("http.download");
+    static MetricCounter& downloadsOk = getCounter("amp_downloads_total{result=\"ok\"}", "Track downloads to the cache");
+    static MetricCounter& downloadsFailed = getCounter("amp_downloads_total{result=\"failed\"}", "Track downloads to the cache");
+    static MetricCounter& downloadsCorrupt = getCounter("amp_downloads_total{result=\"corrupt\"}", "Track downloads to the cache");
+    static MetricCounter& downloadBytes = getCounter("amp_download_bytes_total", "Bytes of tracks downloaded to the cache");
     logDebug("downloadFile called. URL: " + url + ", Path: " + filePath);
 
 #ifdef VDJ_WIN
     std::ofstream outFile(filePath, std::ios::binary);
     if (!outFile.is_open()) {
         logDebug("downloadFile: Failed to open file for writing: " + filePath);
+        downloadsFailed.add();
         return false;
     }
 
-    HINTERNET hInternet = InternetOpenA("VDJ Plugin", INTERNET_OPEN_TYPE_DIRECT, NULL, NULL, 0);
+    HINTERNET hInternet = getInternetSession();
     if (!hInternet) {
-        logDebug("downloadFile: InternetOpenA failed.");
+        logDebug("downloadFile: No internet session.");
         outFile.close();
+        downloadsFailed.add();
         return false;
     }
     
-    HINTERNET hUrl = InternetOpenUrlA(hInternet, url.c_str(), NULL, 0, INTERNET_FLAG_RELOAD, 0);
+    HINTERNET hUrl = InternetOpenUrlA(hInternet, url.c_str(), NULL, 0, INTERNET_FLAG_RELOAD | INTERNET_FLAG_KEEP_CONNECTION, 0);
     if (!hUrl) {
         logDebug("downloadFile: InternetOpenUrlA failed for url: " + url);
-        InternetCloseHandle(hInternet);
         outFile.close();
+        downloadsFailed.add();
         return false;
     }
+
+    DWORD statusCode = 0;
+    DWORD statusSize = sizeof(statusCode);
+    HttpQueryInfoA(hUrl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &statusCode, &statusSize, NULL);
+    DWORD contentLength = 0;
+    DWORD lengthSize = sizeof(contentLength);
+    bool lengthKnown = HttpQueryInfoA(hUrl, HTTP_QUERY_CONTENT_LENGTH | HTTP_QUERY_FLAG_NUMBER, &contentLength, &lengthSize, NULL) != FALSE;
+    std::string expectedSha256;
+    for (const char* header : {"repr-digest", "content-digest", "digest", "x-amz-checksum-sha256", "x-checksum-sha256"}) {
+        // HTTP_QUERY_CUSTOM takes the header name in the buffer and returns its value there
+        char value[256];
+        DWORD valueSize = sizeof(value);
+        strncpy(value, header, sizeof(value));
+        if (expectedSha256.empty() && HttpQueryInfoA(hUrl, HTTP_QUERY_CUSTOM, value, &valueSize, NULL)) {
+            expectedSha256 = parseSha256Header(header, std::string(value, valueSize));
+        }
+    }
     
     char buffer[4096];
     DWORD bytesRead;
-    while (InternetReadFile(hUrl, buffer, sizeof(buffer), &bytesRead) && bytesRead > 0) {
+    uint64_t received = 0;
+    Sha256 hash;
+    BandwidthGovernor& governor = getBandwidthGovernor();
+    while (!transfersStopped() && InternetReadFile(hUrl, buffer, sizeof(buffer), &bytesRead) && bytesRead > 0) {
         outFile.write(buffer, bytesRead);
+        hash.update(buffer, bytesRead);
+        received += bytesRead;
+        downloadBytes.add(bytesRead);
+        governor.charge(TransferPriority::Background, bytesRead);
+        governor.wait(TransferPriority::Background);
     }
 
     InternetCloseHandle(hUrl);
-    InternetCloseHandle(hInternet);
     outFile.close();
+    sha256 = hash.finish();
 
+    // A connection that drops mid-download just ends the loop
+    if (statusCode >= 400 || outFile.fail() || (lengthKnown && received != contentLength) || transfersStopped()) {
+        logDebug("downloadFile: Download of " + url + " failed (status " + std::to_string(statusCode) + ", " +
+                 std::to_string(received) + " bytes)");
+        downloadsFailed.add();
+        return false;
+    }
+    if (!expectedSha256.empty() && sha256 != expectedSha256) {
+        logDebug("downloadFile: " + url + " arrived damaged: SHA-256 " + sha256 + ", server says " + expectedSha256);
+        downloadsCorrupt.add();
+        return false;
+    }
     logDebug("downloadFile: File downloaded successfully to: " + filePath);
+    downloadsOk.add();
     return true;
 #elif defined(VDJ_MAC)
-    std::string command = "curl --location -s -o \"" + filePath + "\" \"" + url + "\"";
-    
-    int result = system(command.c_str());
-    
-    if (result == 0) {
-        logDebug("downloadFile: File downloaded successfully to: " + filePath);
-        return true;
-    } else {
-        logDebug("downloadFile: curl command failed with exit code: " + std::to_string(result));
+    DownloadSink sink;
+    sink.file = fopen(filePath.c_str(), "wb");
+    if (!sink.file) {
+        logDebug("downloadFile: Failed to open file for writing: " + filePath);
+        downloadsFailed.add();
+        return false;
+    }
+
+    CURL* curl = acquireCurlHandle();
+    if (!curl) {
+        fclose(sink.file);
+        downloadsFailed.add();
         return false;
     }
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeToFile);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &sink);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, collectDigestHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &sink);
+    // An error page is not a track
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    // On an HTTP/1.1 connection of its own, where holding the download back makes TCP slow the
+    // sender down; a held back HTTP/2 stream keeps arriving into libcurl's (32 MB) stream window
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)getDefaultHttpTimeoutMs());
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)std::max(1, getDefaultHttpTimeoutMs() / 1000));
+
+    // Not on the shared multi handle: waiting in writeToFile would hold up every other transfer, and
+    // libcurl 7.x can hand an HTTP/1.1 connection that is busy to a request expecting HTTP/2 there
+    CURLcode result = performOwnTransfer(curl);
+    curl_off_t received = 0;
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &received);
+    releaseCurlHandle(curl);
+    bool written = fclose(sink.file) == 0;
+    sha256 = sink.hash.finish();
+
+    if (result != CURLE_OK || !written) {
+        logDebug("downloadFile: Download of " + url + " failed: " + (written ? curl_easy_strerror(result) : "could not write the file"));
+        downloadsFailed.add();
+        return false;
+    }
+    downloadBytes.add((uint64_t)received);
+    if (!sink.expectedSha256.empty() && sha256 != sink.expectedSha256) {
+        logDebug("downloadFile: " + url + " arrived damaged: SHA-256 " + sha256 + ", server says " + sink.expectedSha256);
+        downloadsCorrupt.add();
+        return false;
+    }
+    logDebug("downloadFile: File downloaded successfully to: " + filePath);
+    downloadsOk.add();
+    return true;
 #else
     return false; 
 #endif
 }
 
+#ifdef VDJ_MAC
+// Header callback for resolveFinalUrl: how long the redirects in the chain may be reused
+struct RedirectHeaders {
+    bool inRedirect = false;
+    bool noCache = false;
+    int64_t expiresAt = 0; // earliest expiry any redirect announced, 0 if none did
+};
+
+static size_t collectRedirectHeader(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    RedirectHeaders* headers = static_cast<RedirectHeaders*>(userdata);
+    std::string line(data, size * nmemb);
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        size_t space = line.find(' ');
+        int status = space == std::string::npos ? 0 : atoi(line.c_str() + space + 1);
+        headers->inRedirect = status >= 300 && status < 400;
+        return size * nmemb;
+    }
+    if (!headers->inRedirect) {
+        return size * nmemb;
+    }
+
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+        return size * nmemb;
+    }
+    std::string name = line.substr(0, colon);
+    std::string value = line.substr(colon + 1);
+    for (char& c : name) c = (char)tolower((unsigned char)c);
+    for (char& c : value) c = (char)tolower((unsigned char)c);
+
+    int64_t expiresAt = 0;
+    if (name == "cache-control") {
+        if (value.find("no-store") != std::string::npos || value.find("no-cache") != std::string::npos) {
+            headers->noCache = true;
+        }
+        size_t maxAge = value.find("max-age=");
+        if (maxAge != std::string::npos) {
+            expiresAt = (int64_t)time(nullptr) + atoll(value.c_str() + maxAge + 8);
+        }
+    } else if (name == "expires") {
+        expiresAt = parseHttpDate(line.substr(colon + 1));
+        if (expiresAt == 0) headers->noCache = true; // "Expires: 0" and other invalid dates mean already expired
+    }
+    if (expiresAt && (headers->expiresAt == 0 || expiresAt < headers->expiresAt)) {
+        headers->expiresAt = expiresAt;
+    }
+    return size * nmemb;
+}
+
+// Body callback for resolveFinalUrl: one byte is proof enough, stop if the server ignores the range
+static size_t discardBody(char*, size_t size, size_t nmemb, void* userdata)
+{
+    size_t* received = static_cast<size_t*>(userdata);
+    *received += size * nmemb;
+    return *received > 1 ? 0 : size * nmemb;
+}
+#endif
+
+// Follow the redirects of a stream URL to the media URL they end at, with a one byte ranged GET
+// (presigned media URLs are often only valid for GET, so no HEAD). expiresAt is the Unix time
+// the final URL should be resolved again by. Returns false if the URL doesn't lead to media.
+bool CAMP::resolveFinalUrl(const std::string& url, std::string& finalUrl, int64_t& expiresAt)
+{
+    TRACE_SPAN("http.resolve");
+    int64_t defaultExpiry = (int64_t)time(nullptr) + streamUrlCache.getDefaultTtlSeconds();
+    int status = 0;
+
+#ifdef VDJ_WIN
+    HINTERNET hInternet = getInternetSession();
+    if (!hInternet) {
+        logDebug("resolveFinalUrl: Failed to open internet connection");
+        return false;
+    }
+    const char* rangeHeader = "Range: bytes=0-0\r\n";
+    HINTERNET hUrl = InternetOpenUrlA(hInternet, url.c_str(), rangeHeader, (DWORD)strlen(rangeHeader), INTERNET_FLAG_RELOAD | INTERNET_FLAG_KEEP_CONNECTION, 0);
+    if (!hUrl) {
+        logDebug("resolveFinalUrl: Failed to open " + url);
+        return false;
+    }
+    DWORD statusCode = 0;
+    DWORD statusSize = sizeof(statusCode);
+    if (HttpQueryInfoA(hUrl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &statusCode, &statusSize, NULL)) {
+        status = (int)statusCode;
+    }
+    // WinINet follows the redirects itself and reports where it ended up
+    char effectiveUrl[4096];
+    DWORD effectiveSize = sizeof(effectiveUrl);
+    if (InternetQueryOptionA(hUrl, INTERNET_OPTION_URL, effectiveUrl, &effectiveSize)) {
+        finalUrl.assign(effectiveUrl, effectiveSize);
+    }
+    InternetCloseHandle(hUrl);
+    expiresAt = defaultExpiry;
+#elif defined(VDJ_MAC)
+    CURL* curl = acquireCurlHandle();
+    if (!curl) {
+        return false;
+    }
+
+    RedirectHeaders headers;
+    size_t received = 0;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 10L);
+    curl_easy_setopt(curl, CURLOPT_RANGE, "0-0");
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discardBody);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &received);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, collectRedirectHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &headers);
+
+    // Deck loads wait on this
+    CURLcode result = performTransfer(curl, TransferPriority::Interactive);
+    long statusCode = 0;
+    long redirects = 0;
+    char* effectiveUrl = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &statusCode);
+    curl_easy_getinfo(curl, CURLINFO_REDIRECT_COUNT, &redirects);
+    curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &effectiveUrl);
+    if (effectiveUrl) {
+        finalUrl = effectiveUrl;
+    }
+    releaseCurlHandle(curl);
+
+    // A server that ignores the range is cut off after the first bytes, which is fine
+    if (result != CURLE_OK && result != CURLE_WRITE_ERROR) {
+        logDebug("resolveFinalUrl: curl error for " + url + ": " + curl_easy_strerror(result));
+        return false;
+    }
+    status = (int)statusCode;
+    expiresAt = headers.noCache ? (int64_t)time(nullptr) : (headers.expiresAt ? headers.expiresAt : defaultExpiry);
+    logDebug("resolveFinalUrl: " + std::to_string(redirects) + " redirects");
+#else
+    return false;
+#endif
+
+    if (status != 200 && status != 206) {
+        logDebug("resolveFinalUrl: " + url + " answered with status " + std::to_string(status));
+        return false;
+    }
+    if (finalUrl.empty()) {
+        finalUrl = url;
+    }
+
+    // A signed media URL stops working at its own expiry, whatever the redirects said
+    int64_t signedExpiry = expiryFromSignedUrl(finalUrl);
+    if (signedExpiry && signedExpiry < expiresAt) {
+        expiresAt = signedExpiry;
+    }
+    logDebug("resolveFinalUrl: " + url + " -> " + finalUrl + ", valid for " + std::to_string(expiresAt - (int64_t)time(nullptr)) + " s");
+    return true;
+}
+
+#ifdef VDJ_MAC
+// State of an httpGetRange transfer, shared by its header and body callbacks
+struct RangeTransfer {
+    const IntroCache::RangeSink* sink;
+    IntroCache::RangeInfo* info;
+    TransferPriority priority;
+    bool stopped = false; // the sink had enough
+};
+
+static size_t collectRangeHeader(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    IntroCache::RangeInfo* info = static_cast<RangeTransfer*>(userdata)->info;
+    std::string line(data, size * nmemb);
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        // Start of another response in the redirect chain
+        size_t space = line.find(' ');
+        info->status = space == std::string::npos ? 0 : atoi(line.c_str() + space + 1);
+        info->totalSize = 0;
+        info->contentType.clear();
+        return size * nmemb;
+    }
+
+    size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+        return size * nmemb;
+    }
+    std::string name = line.substr(0, colon);
+    for (char& c : name) c = (char)tolower((unsigned char)c);
+    size_t valueStart = line.find_first_not_of(' ', colon + 1);
+    size_t valueEnd = line.find_last_not_of(" \r\n");
+    std::string value = valueStart == std::string::npos || valueEnd < valueStart ? "" : line.substr(valueStart, valueEnd - valueStart + 1);
+
+    if (name == "content-range") {
+        // bytes first-last/total
+        size_t slash = value.find('/');
+        if (slash != std::string::npos && value[slash + 1] != '*') {
+            info->totalSize = strtoull(value.c_str() + slash + 1, nullptr, 10);
+        }
+    } else if (name == "content-length" && info->status == 200) {
+        info->totalSize = strtoull(value.c_str(), nullptr, 10);
+    } else if (name == "content-type") {
+        info->contentType = value;
+    }
+    return size * nmemb;
+}
+
+static size_t passRangeBody(char* data, size_t size, size_t nmemb, void* userdata)
+{
+    RangeTransfer* transfer = static_cast<RangeTransfer*>(userdata);
+    if (transfer->info->status != 200 && transfer->info->status != 206) {
+        return 0;
+    }
+    BandwidthGovernor& governor = getBandwidthGovernor();
+    governor.charge(transfer->priority, (int64_t)(size * nmemb));
+    governor.wait(transfer->priority);
+    if (!(*transfer->sink)(data, size * nmemb)) {
+        transfer->stopped = true;
+        return 0;
+    }
+    return size * nmemb;
+}
+#endif
+
+// GET part of a track for the intro cache: `length` bytes from `offset` (0 = to the end), passed
+// to sink as they arrive. Background fetches are held back by the bandwidth governor.
+bool CAMP::httpGetRange(const std::string& url, uint64_t offset, uint64_t length, TransferPriority priority,
+                        const IntroCache::RangeSink& sink, IntroCache::RangeInfo& info)
+{
+    TRACE_SPAN("http.range");
+    std::string range = std::to_string(offset) + "-" + (length ? std::to_string(offset + length - 1) : "");
+    logDebug("httpGetRange: " + url + " bytes " + range);
+
+#ifdef VDJ_WIN
+    HINTERNET hInternet = getInternetSession();
+    if (!hInternet) {
+        logDebug("httpGetRange: Failed to open internet connection");
+        return false;
+    }
+    std::string rangeHeader = "Range: bytes=" + range + "\r\n";
+    HINTERNET hUrl = InternetOpenUrlA(hInternet, url.c_str(), rangeHeader.c_str(), (DWORD)rangeHeader.length(), INTERNET_FLAG_RELOAD | INTERNET_FLAG_KEEP_CONNECTION, 0);
+    if (!hUrl) {
+        logDebug("httpGetRange: Failed to open " + url);
+        return false;
+    }
+
+    DWORD statusCode = 0;
+    DWORD statusSize = sizeof(statusCode);
+    if (HttpQueryInfoA(hUrl, HTTP_QUERY_STATUS_CODE | HTTP_QUERY_FLAG_NUMBER, &statusCode, &statusSize, NULL)) {
+        info.status = (int)statusCode;
+    }
+    char value[256];
+    DWORD valueSize = sizeof(value);
+    if (info.status == 206 && HttpQueryInfoA(hUrl, HTTP_QUERY_CONTENT_RANGE, value, &valueSize, NULL)) {
+        const char* slash = strchr(value, '/');
+        if (slash && slash[1] != '*') info.totalSize = strtoull(slash + 1, nullptr, 10);
+    }
+    valueSize = sizeof(value);
+    if (info.status == 200 && HttpQueryInfoA(hUrl, HTTP_QUERY_CONTENT_LENGTH, value, &valueSize, NULL)) {
+        info.totalSize = strtoull(value, nullptr, 10);
+    }
+    valueSize = sizeof(value);
+    if (HttpQueryInfoA(hUrl, HTTP_QUERY_CONTENT_TYPE, value, &valueSize, NULL)) {
+        info.contentType.assign(value, valueSize);
+    }
+    if (info.status != 200 && info.status != 206) {
+        logDebug("httpGetRange: " + url + " answered with status " + std::to_string(info.status));
+        InternetCloseHandle(hUrl);
+        return false;
+    }
+
+    char buffer[16384];
+    DWORD bytesRead = 0;
+    bool complete = true;
+    BandwidthGovernor& governor = getBandwidthGovernor();
+    for (;;) {
+        if (transfersStopped() || !InternetReadFile(hUrl, buffer, sizeof(buffer), &bytesRead)) {
+            complete = false;
+            break;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        governor.charge(priority, bytesRead);
+        governor.wait(priority);
+        if (!sink(buffer, bytesRead)) {
+            break;
+        }
+    }
+    InternetCloseHandle(hUrl);
+    return complete;
+#elif defined(VDJ_MAC)
+    CURL* curl = acquireCurlHandle();
+    if (!curl) {
+        return false;
+    }
+
+    RangeTransfer transfer;
+    transfer.sink = &sink;
+    transfer.info = &info;
+    transfer.priority = priority;
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, passRangeBody);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, collectRangeHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, &transfer);
+    // Like downloadFile: the sink may block (on the governor, or on VirtualDJ reading the
+    // stream), which on the shared multi handle would hold up every other transfer
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)getDefaultHttpTimeoutMs());
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long)std::max(1, getDefaultHttpTimeoutMs() / 1000));
+
+    CURLcode result = performOwnTransfer(curl);
+    releaseCurlHandle(curl);
+
+    if (result == CURLE_WRITE_ERROR && transfer.stopped) {
+        return true;
+    }
+    if (result != CURLE_OK || (info.status != 200 && info.status != 206)) {
+        logDebug("httpGetRange: " + url + " failed with status " + std::to_string(info.status) + ": " + curl_easy_strerror(result));
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
 std::string CAMP::urlEncode(const std::string& value)
 {
     std::string encoded;
     encoded.reserve(value.size() * 3); // Reserve space for worst case (all chars encoded)
     
     for (unsigned char c : value) {
-        if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
+        // Explicit ASCII ranges: isalnum would let UTF-8 bytes through under a Latin-1 locale
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.' || c == '~') {
             // These characters don't need encoding according to RFC 3986
             encoded += c;
         } else if (c == ' ') {
@@ -0,0 +1,19 @@
+#ifndef VDJ_INTERNET_H
+#define VDJ_INTERNET_H
+
+#include <string>
+
+// Result of an HTTP request where the caller needs more than the body
+struct HttpResponse {
+    int status = 0;    // 0 if the request could not be made at all
+    std::string body;
+    std::string etag;
+};
+
+// SHA-256 of a download's body as announced by the server, in lowercase hex; empty if the header
+// doesn't carry one. name is lowercase. Understands Repr-Digest and Content-Digest (RFC 9530,
+// sha-256=:base64:), Digest (RFC 3230, SHA-256=base64), x-amz-checksum-sha256 (base64) and
+// X-Checksum-Sha256 (hex).
+std::string parseSha256Header(const std::string& name, const std::string& value);
+
+#endif // VDJ_INTERNET_H
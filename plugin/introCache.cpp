@@ -0,0 +1,623 @@
+#include "introCache.h"
+#include "bandwidthGovernor.h"
+#include "settings.h"
+#include "metrics.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+
+#ifdef VDJ_WIN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Defaults, overridable with .camp_intro_cache_mb, .camp_intro_kb and .camp_intro_prefetch
+static const int DEFAULT_CACHE_MB = 64;
+static const int DEFAULT_INTRO_KB = 512;
+static const int DEFAULT_PREFETCH = 8;
+static const size_t MAX_REMOTE_URLS = 4096;
+
+static const char SLAB_MAGIC[8] = {'A', 'M', 'P', 'I', 'N', 'T', 'R', 'O'};
+static const uint32_t SLAB_VERSION = 1;
+static const size_t PAGE_SIZE = 4096;
+
+// Start of the slab file, followed by one SlotHeader per slot and then the slots themselves
+struct SlabHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slotSize;
+    uint32_t slotCount;
+    uint32_t reserved;
+    uint64_t clock; // advances on every use, for least recently used eviction
+};
+
+enum SlotState : uint32_t {
+    SlotEmpty = 0,
+    SlotFilling = 1, // being fetched; neither served nor evicted
+    SlotReady = 2,
+};
+
+struct SlotHeader {
+    uint64_t key;
+    uint64_t totalSize;
+    uint64_t lastUsed;
+    uint32_t length;
+    uint32_t state;
+    char contentType[48];
+};
+
+static MetricGauge& slotsUsedGauge()
+{
+    static MetricGauge& gauge = getGauge("amp_intro_cache_slots_used", "Intros held in the intro cache slab");
+    return gauge;
+}
+
+// The slab file, mapped into memory. Not thread safe; IntroCache locks around it.
+class IntroSlab
+{
+public:
+    ~IntroSlab();
+
+    bool open(const std::string& path, uint32_t slotSize, uint32_t slotCount);
+
+    // Slot holding (or filling) key, -1 if none
+    int find(uint64_t key) const;
+    // Claim a slot for filling key, evicting the least recently used intro if none is free.
+    // -1 if every slot is being filled.
+    int reserve(uint64_t key);
+    void commit(int slot, uint32_t length, uint64_t totalSize, const std::string& contentType);
+    void abandon(int slot);
+    void touch(int slot);
+    // Empty every slot that isn't being filled
+    void clear();
+
+    const SlotHeader& getSlot(int slot) const { return table[slot]; }
+    char* getData(int slot) { return data + (size_t)slot * header->slotSize; }
+    uint32_t getSlotSize() const { return header->slotSize; }
+
+private:
+    void countUsed();
+
+    char* base = nullptr;
+    size_t mappedSize = 0;
+#ifdef VDJ_WIN
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#else
+    int fd = -1;
+#endif
+    SlabHeader* header = nullptr;
+    SlotHeader* table = nullptr;
+    char* data = nullptr;
+    std::unordered_map<uint64_t, int> index; // ready and filling slots by key
+};
+
+IntroSlab::~IntroSlab()
+{
+#ifdef VDJ_WIN
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+    if (base) munmap(base, mappedSize);
+    if (fd >= 0) close(fd);
+#endif
+}
+
+bool IntroSlab::open(const std::string& path, uint32_t slotSize, uint32_t slotCount)
+{
+    size_t tableSize = sizeof(SlabHeader) + (size_t)slotCount * sizeof(SlotHeader);
+    tableSize = (tableSize + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    mappedSize = tableSize + (size_t)slotCount * slotSize;
+
+#ifdef VDJ_WIN
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_HIDDEN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        logDebug("IntroSlab: Could not open " + path);
+        return false;
+    }
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG)mappedSize;
+    if (!SetFilePointerEx(file, size, NULL, FILE_BEGIN) || !SetEndOfFile(file)) {
+        logDebug("IntroSlab: Could not size " + path);
+        return false;
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, (DWORD)((uint64_t)mappedSize >> 32), (DWORD)(mappedSize & 0xFFFFFFFF), NULL);
+    if (mapping) {
+        base = (char*)MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, mappedSize);
+    }
+    if (!base) {
+        logDebug("IntroSlab: Could not map " + path);
+        return false;
+    }
+#else
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        logDebug("IntroSlab: Could not open " + path);
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size != mappedSize) {
+        if (ftruncate(fd, (off_t)mappedSize) != 0) {
+            logDebug("IntroSlab: Could not size " + path);
+            return false;
+        }
+    }
+    void* mapped = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        logDebug("IntroSlab: Could not map " + path);
+        return false;
+    }
+    base = (char*)mapped;
+#endif
+
+    header = (SlabHeader*)base;
+    table = (SlotHeader*)(base + sizeof(SlabHeader));
+    data = base + tableSize;
+
+    if (memcmp(header->magic, SLAB_MAGIC, sizeof(SLAB_MAGIC)) != 0 || header->version != SLAB_VERSION ||
+        header->slotSize != slotSize || header->slotCount != slotCount) {
+        // New file, or the sizes changed: start over
+        memset(base, 0, tableSize);
+        memcpy(header->magic, SLAB_MAGIC, sizeof(SLAB_MAGIC));
+        header->version = SLAB_VERSION;
+        header->slotSize = slotSize;
+        header->slotCount = slotCount;
+        logDebug("IntroSlab: Initialized " + path + " with " + std::to_string(slotCount) + " slots of " +
+                 std::to_string(slotSize / 1024) + " KB");
+    }
+
+    for (uint32_t i = 0; i < slotCount; i++) {
+        if (table[i].state == SlotFilling) {
+            // The plugin stopped in the middle of a fetch
+            table[i].state = SlotEmpty;
+        }
+        if (table[i].state == SlotReady) {
+            index[table[i].key] = (int)i;
+        }
+    }
+    countUsed();
+    logDebug("IntroSlab: " + std::to_string(index.size()) + " intros in " + path);
+    return true;
+}
+
+int IntroSlab::find(uint64_t key) const
+{
+    auto it = index.find(key);
+    return it == index.end() ? -1 : it->second;
+}
+
+int IntroSlab::reserve(uint64_t key)
+{
+    static MetricCounter& evictions = getCounter("amp_intro_cache_evictions_total", "Intros evicted from the intro cache to make room");
+
+    int victim = -1;
+    for (uint32_t i = 0; i < header->slotCount; i++) {
+        const SlotHeader& slot = table[i];
+        if (slot.state == SlotEmpty) {
+            victim = (int)i;
+            break;
+        }
+        if (slot.state == SlotReady && (victim < 0 || slot.lastUsed < table[victim].lastUsed)) {
+            victim = (int)i;
+        }
+    }
+    if (victim < 0) {
+        return -1;
+    }
+
+    SlotHeader& slot = table[victim];
+    if (slot.state == SlotReady) {
+        index.erase(slot.key);
+        evictions.add();
+    }
+    slot.state = SlotFilling;
+    slot.key = key;
+    slot.length = 0;
+    slot.totalSize = 0;
+    index[key] = victim;
+    return victim;
+}
+
+void IntroSlab::commit(int slot, uint32_t length, uint64_t totalSize, const std::string& contentType)
+{
+    SlotHeader& entry = table[slot];
+    entry.length = length;
+    entry.totalSize = totalSize;
+    memset(entry.contentType, 0, sizeof(entry.contentType));
+    memcpy(entry.contentType, contentType.data(), std::min(contentType.size(), sizeof(entry.contentType) - 1));
+    entry.lastUsed = ++header->clock;
+    entry.state = SlotReady;
+    countUsed();
+}
+
+void IntroSlab::abandon(int slot)
+{
+    index.erase(table[slot].key);
+    table[slot].state = SlotEmpty;
+}
+
+void IntroSlab::touch(int slot)
+{
+    table[slot].lastUsed = ++header->clock;
+}
+
+void IntroSlab::clear()
+{
+    for (uint32_t i = 0; i < header->slotCount; i++) {
+        if (table[i].state == SlotReady) {
+            index.erase(table[i].key);
+            table[i].state = SlotEmpty;
+        }
+    }
+    countUsed();
+}
+
+void IntroSlab::countUsed()
+{
+    int64_t used = 0;
+    for (uint32_t i = 0; i < header->slotCount; i++) {
+        if (table[i].state == SlotReady) used++;
+    }
+    slotsUsedGauge().set(used);
+}
+
+uint64_t introKey(const std::string& url)
+{
+    return hashString(url);
+}
+
+// ".mp3" for .../Song.mp3?sig=..., so VirtualDJ sees the format in the loopback URL too
+static std::string urlExtension(const std::string& url)
+{
+    size_t end = url.find_first_of("?#");
+    if (end == std::string::npos) end = url.size();
+    size_t dot = url.rfind('.', end);
+    size_t slash = url.rfind('/', end);
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash) || end - dot > 5) {
+        return "";
+    }
+    return url.substr(dot, end - dot);
+}
+
+IntroCache::IntroCache()
+{
+    prefetchCount = DEFAULT_PREFETCH;
+}
+
+IntroCache::~IntroCache()
+{
+    stop();
+}
+
+void IntroCache::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        filler.requestStop();
+    }
+    queued.notify_all();
+    filler.stop();
+}
+
+void IntroCache::configure(const std::string& slabPath, RangeFetcher rangeFetcher)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (slab) {
+        return;
+    }
+
+    int cacheMb = readIntSetting(".camp_intro_cache_mb", DEFAULT_CACHE_MB, 0, 4096);
+    int introKb = readIntSetting(".camp_intro_kb", DEFAULT_INTRO_KB, 64, 8192);
+    prefetchCount = readIntSetting(".camp_intro_prefetch", DEFAULT_PREFETCH, 0, 100);
+    uint32_t slotCount = (uint32_t)((int64_t)cacheMb * 1024 / introKb);
+    if (slotCount == 0 || prefetchCount == 0 || slabPath.empty()) {
+        logDebug("IntroCache: Disabled");
+        return;
+    }
+
+    std::unique_ptr<IntroSlab> opened(new IntroSlab());
+    if (!opened->open(slabPath, (uint32_t)introKb * 1024, slotCount)) {
+        return;
+    }
+    slab = std::move(opened);
+    fetcher = rangeFetcher;
+    getLocalServer().addRoute("/intro/", [this](const LocalServer::Request& request, LocalServer::Connection& connection) {
+        serve(request, connection);
+    });
+}
+
+void IntroCache::prefetch(const std::vector<std::string>& urls)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!slab) {
+        return;
+    }
+
+    queue.clear();
+    for (const std::string& url : urls) {
+        if ((int)queue.size() >= prefetchCount) break;
+        if (url.empty()) continue;
+        uint64_t key = introKey(url);
+        if (slab->find(key) < 0 && !tried.count(key)) {
+            queue.push_back(url);
+        }
+    }
+    if (queue.empty()) {
+        return;
+    }
+
+    if (!fillerStarted) {
+        fillerStarted = filler.start([this]() { fillLoop(); });
+    }
+    queued.notify_one();
+}
+
+void IntroCache::fillLoop()
+{
+    for (;;) {
+        std::string url;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [this]() { return !queue.empty() || filler.stopping(); });
+            if (filler.stopping()) {
+                return;
+            }
+            url = queue.front();
+            queue.pop_front();
+        }
+        fill(url);
+    }
+}
+
+bool IntroCache::fill(const std::string& url)
+{
+    static MetricCounter& filled = getCounter("amp_intro_cache_fills_total{result=\"ok\"}", "Intros fetched into the intro cache");
+    static MetricCounter& failed = getCounter("amp_intro_cache_fills_total{result=\"failed\"}", "Intros fetched into the intro cache");
+
+    uint64_t key = introKey(url);
+    int slot;
+    char* target;
+    uint32_t capacity;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (slab->find(key) >= 0) {
+            return true;
+        }
+        slot = slab->reserve(key);
+        if (slot < 0) {
+            return false;
+        }
+        // The slot is ours until commit or abandon, so it is written without the lock
+        target = slab->getData(slot);
+        capacity = slab->getSlotSize();
+    }
+
+    uint32_t length = 0;
+    RangeInfo info;
+    bool fetched = fetcher(url, 0, capacity, TransferPriority::Background, [&](const char* data, size_t size) {
+        size_t take = std::min<size_t>(size, capacity - length);
+        memcpy(target + length, data, take);
+        length += (uint32_t)take;
+        return length < capacity;
+    }, info);
+
+    // The rest is streamed with Range requests later, so the server has to support them,
+    // unless the whole track fit
+    bool usable = fetched && length > 0 && info.totalSize > 0 && (info.status == 206 || info.totalSize == length);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!usable) {
+        slab->abandon(slot);
+        // An error page or a server without Range support won't be different on the next listing
+        tried.insert(key);
+        logDebug("IntroCache: Could not cache the intro of " + url + " (status " + std::to_string(info.status) + ")");
+        failed.add();
+        return false;
+    }
+    slab->commit(slot, length, info.totalSize, info.contentType);
+    filled.add();
+    logDebug("IntroCache: Cached " + std::to_string(length / 1024) + " KB of " + url);
+    return true;
+}
+
+std::string IntroCache::getLocalUrl(const std::string& url, const std::string& remoteUrl)
+{
+    static MetricCounter& hits = getCounter("amp_intro_cache_lookups_total{result=\"hit\"}", "Remote tracks loaded, by whether their intro was cached");
+    static MetricCounter& misses = getCounter("amp_intro_cache_lookups_total{result=\"miss\"}", "Remote tracks loaded, by whether their intro was cached");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!slab) {
+        return "";
+    }
+
+    uint64_t key = introKey(url);
+    int slot = slab->find(key);
+    if (slot < 0 || slab->getSlot(slot).state != SlotReady) {
+        misses.add();
+        return "";
+    }
+
+    if (!getLocalServer().start()) {
+        return "";
+    }
+
+    slab->touch(slot);
+    rememberRemoteUrl(key, remoteUrl);
+    hits.add();
+
+    char keyHex[17];
+    snprintf(keyHex, sizeof(keyHex), "%016llx", (unsigned long long)key);
+    return getLocalServer().getBaseUrl() + "/intro/" + keyHex + urlExtension(url);
+}
+
+// Called with the lock held
+void IntroCache::rememberRemoteUrl(uint64_t key, const std::string& remoteUrl)
+{
+    auto found = remoteUrls.find(key);
+    if (found != remoteUrls.end()) {
+        found->second.url = remoteUrl;
+        remoteUrlAges.splice(remoteUrlAges.begin(), remoteUrlAges, found->second.age);
+        return;
+    }
+    remoteUrlAges.push_front(key);
+    RemoteUrl& entry = remoteUrls[key];
+    entry.url = remoteUrl;
+    entry.age = remoteUrlAges.begin();
+
+    // Oldest first, skipping those being streamed; all of them busy, the map grows for a while
+    auto oldest = remoteUrlAges.end();
+    while (remoteUrls.size() > MAX_REMOTE_URLS && oldest != remoteUrlAges.begin()) {
+        --oldest;
+        auto candidate = remoteUrls.find(*oldest);
+        if (candidate->second.streams == 0) {
+            remoteUrls.erase(candidate);
+            oldest = remoteUrlAges.erase(oldest);
+        }
+    }
+}
+
+void IntroCache::releaseRemoteUrl(uint64_t key)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = remoteUrls.find(key);
+    if (found != remoteUrls.end() && found->second.streams > 0) {
+        found->second.streams--;
+    }
+}
+
+bool IntroCache::copyIntro(uint64_t key, Intro& intro)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto remote = remoteUrls.find(key);
+    if (remote != remoteUrls.end()) {
+        intro.remoteUrl = remote->second.url;
+        remote->second.streams++;
+        remoteUrlAges.splice(remoteUrlAges.begin(), remoteUrlAges, remote->second.age);
+    }
+    if (!slab) {
+        return false;
+    }
+
+    int slot = slab->find(key);
+    if (slot < 0 || slab->getSlot(slot).state != SlotReady) {
+        return false;
+    }
+    const SlotHeader& entry = slab->getSlot(slot);
+    intro.data.assign(slab->getData(slot), entry.length);
+    intro.totalSize = entry.totalSize;
+    intro.contentType = entry.contentType;
+    slab->touch(slot);
+    return true;
+}
+
+void IntroCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    queue.clear();
+    tried.clear();
+    // Those being streamed stay, so their connections can finish and release them
+    for (auto it = remoteUrls.begin(); it != remoteUrls.end();) {
+        if (it->second.streams == 0) {
+            remoteUrlAges.erase(it->second.age);
+            it = remoteUrls.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (slab) {
+        slab->clear();
+        logDebug("IntroCache: Cleared");
+    }
+}
+
+void IntroCache::serve(const LocalServer::Request& request, LocalServer::Connection& connection)
+{
+    uint64_t key = strtoull(request.path.substr(7, 16).c_str(), nullptr, 16); // after "/intro/"
+    Intro intro;
+    if (copyIntro(key, intro)) {
+        stream(request, connection, intro);
+    } else if (!intro.remoteUrl.empty()) {
+        // Evicted since the URL was handed out: let VirtualDJ stream it directly
+        logDebug("IntroCache: No intro for " + request.path + ", redirecting to " + intro.remoteUrl);
+        connection.send("HTTP/1.1 302 Found\r\nLocation: " + intro.remoteUrl + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    } else {
+        connection.send("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    }
+    if (!intro.remoteUrl.empty()) {
+        releaseRemoteUrl(key);
+    }
+}
+
+void IntroCache::stream(const LocalServer::Request& request, LocalServer::Connection& connection, const Intro& intro)
+{
+    static MetricCounter& slabBytes = getCounter("amp_intro_served_bytes_total{from=\"slab\"}", "Bytes of tracks served from intro URLs, by where they came from");
+    static MetricCounter& backendBytes = getCounter("amp_intro_served_bytes_total{from=\"backend\"}", "Bytes of tracks served from intro URLs, by where they came from");
+
+    uint64_t first = 0;
+    uint64_t last = intro.totalSize - 1;
+    bool partial = !request.range.empty();
+    if (partial && !parseByteRange(request.range, intro.totalSize, first, last)) {
+        connection.send("HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */" + std::to_string(intro.totalSize) +
+                        "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+
+    std::string headers = partial ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n";
+    if (!intro.contentType.empty()) {
+        headers += "Content-Type: " + intro.contentType + "\r\n";
+    }
+    headers += "Content-Length: " + std::to_string(last - first + 1) + "\r\n";
+    if (partial) {
+        headers += "Content-Range: bytes " + std::to_string(first) + "-" + std::to_string(last) + "/" + std::to_string(intro.totalSize) + "\r\n";
+    }
+    headers += "Accept-Ranges: bytes\r\nConnection: close\r\n\r\n";
+    if (!connection.send(headers) || request.method == "HEAD") {
+        return;
+    }
+
+    // The part that is in the intro
+    uint64_t position = first;
+    if (position < intro.data.size()) {
+        uint64_t end = std::min<uint64_t>(last + 1, intro.data.size());
+        if (!connection.send(intro.data.data() + position, (size_t)(end - position))) {
+            return;
+        }
+        slabBytes.add(end - position);
+        position = end;
+    }
+
+    // The rest of the track, straight from the backend
+    if (position <= last && !intro.remoteUrl.empty()) {
+        uint64_t remaining = last - position + 1;
+        // Background transfers yield to it for exactly as long as it takes
+        BandwidthGovernor& governor = getBandwidthGovernor();
+        governor.beginRemoteStream();
+        RangeInfo info;
+        bool fetched = fetcher(intro.remoteUrl, position, remaining, TransferPriority::Interactive, [&](const char* data, size_t size) {
+            // Anything but the requested range would be spliced into the wrong place
+            if (info.status != 206) {
+                return false;
+            }
+            size_t take = (size_t)std::min<uint64_t>(size, remaining);
+            if (!connection.send(data, take)) {
+                return false;
+            }
+            backendBytes.add(take);
+            remaining -= take;
+            return remaining > 0;
+        }, info);
+        governor.endRemoteStream();
+        if (!fetched || remaining > 0) {
+            // VirtualDJ sees the connection close early and asks again from where it got to
+            logDebug("IntroCache: Streaming the rest of " + intro.remoteUrl + " stopped with " + std::to_string(remaining) +
+                     " bytes to go (status " + std::to_string(info.status) + ")");
+        }
+    }
+}
@@ -0,0 +1,108 @@
+#ifndef VDJ_INTROCACHE_H
+#define VDJ_INTROCACHE_H
+
+#include "connectionPool.h"
+#include "localServer.h"
+#include "backgroundTasks.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <cstdint>
+
+class IntroSlab;
+
+// The first few hundred KB of tracks the DJ browses, so a deck can start and cue an uncached
+// track at once instead of waiting for the stream to buffer. Each intro is fetched with one
+// Range request into a fixed size slot of a memory-mapped slab file (.intro_slab in the cache
+// folder), and slots are reused least recently used first. The local server hands VirtualDJ
+// the intro from the slab and streams the rest of the track from the backend.
+// .camp_intro_cache_mb sets the slab size (64, 0 turns the cache off), .camp_intro_kb the
+// intro length (512) and .camp_intro_prefetch how many tracks of a listing get one (8).
+class IntroCache
+{
+public:
+    struct RangeInfo {
+        int status = 0;         // 200 or 206 once the response headers arrived
+        uint64_t totalSize = 0; // size of the whole file, 0 if the server didn't say
+        std::string contentType;
+    };
+    // Receives the body as it arrives; returning false ends the transfer early
+    using RangeSink = std::function<bool(const char* data, size_t size)>;
+    // GET `length` bytes of url from `offset` (0 = to the end). True if the server answered with
+    // the range (or the whole file from offset 0) and the body arrived, or the sink stopped it.
+    using RangeFetcher = std::function<bool(const std::string& url, uint64_t offset, uint64_t length, TransferPriority priority,
+                                            const RangeSink& sink, RangeInfo& info)>;
+
+    struct Intro {
+        std::string data;
+        uint64_t totalSize = 0;
+        std::string contentType;
+        std::string remoteUrl; // where the rest of the track comes from
+    };
+
+    IntroCache();
+    ~IntroCache();
+
+    // Slab location and how to reach the backend. Nothing is cached before this is called.
+    void configure(const std::string& slabPath, RangeFetcher fetcher);
+
+    // Fetch the intros of these stream URLs in the background, first ones first. Replaces the
+    // intros still waiting from an earlier listing, as the DJ has moved on from it.
+    void prefetch(const std::vector<std::string>& urls);
+
+    // Loopback URL that serves url's intro and then streams the rest from remoteUrl,
+    // or empty if the intro isn't cached. Intros that couldn't be fetched aren't tried again
+    // this session.
+    std::string getLocalUrl(const std::string& url, const std::string& remoteUrl);
+
+    // Forget every intro, e.g. on logout
+    void clear();
+    // Stop fetching intros and wait for the one in flight. Its route on the local server
+    // must be gone first (LocalServer::stop), as serving reads the slab.
+    void stop();
+
+private:
+    void fillLoop();
+    bool fill(const std::string& url);
+    // A copy of an intro by the key in its loopback URL. Its remote URL, if known, is kept
+    // from eviction until releaseRemoteUrl, even when the intro itself is gone.
+    bool copyIntro(uint64_t key, Intro& intro);
+    void rememberRemoteUrl(uint64_t key, const std::string& remoteUrl);
+    void releaseRemoteUrl(uint64_t key);
+    // GET /intro/<key>: the intro, then the rest of the track from the backend. Supports Range so
+    // VirtualDJ can seek; an intro evicted since its URL was handed out redirects to the remote URL.
+    void serve(const LocalServer::Request& request, LocalServer::Connection& connection);
+    // The requested range of a cached intro and the rest of its track
+    void stream(const LocalServer::Request& request, LocalServer::Connection& connection, const Intro& intro);
+
+    std::mutex mutex;
+    std::unique_ptr<IntroSlab> slab;
+    RangeFetcher fetcher;
+    int prefetchCount;
+
+    // Remote URLs of the intros handed out, by key, dropped least recently used first
+    struct RemoteUrl {
+        std::string url;
+        std::list<uint64_t>::iterator age; // in remoteUrlAges
+        int streams = 0;                   // serve calls using it right now; never dropped meanwhile
+    };
+    std::unordered_map<uint64_t, RemoteUrl> remoteUrls;
+    std::list<uint64_t> remoteUrlAges; // most recently used first
+    std::unordered_set<uint64_t> tried; // intros whose fetch failed this session
+    std::deque<std::string> queue;
+    std::condition_variable queued;
+    bool fillerStarted = false;
+    BackgroundTasks filler; // last, so it is joined before the rest goes away
+};
+
+// Key of a stream URL in the slab and in loopback URLs
+uint64_t introKey(const std::string& url);
+
+#endif // VDJ_INTROCACHE_H
@@ -0,0 +1,277 @@
+// Winsock has to come before the windows.h that vdjPlugin8.h includes
+#if defined(WIN32) || defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#endif
+
+#include "localServer.h"
+#include "../vdjPlugin8.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#ifndef VDJ_WIN
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+#ifdef VDJ_WIN
+typedef SOCKET Socket;
+static const Socket NO_SOCKET = INVALID_SOCKET;
+static void closeSocket(Socket s) { closesocket(s); }
+static void shutdownSocket(Socket s) { shutdown(s, SD_BOTH); }
+#else
+typedef int Socket;
+static const Socket NO_SOCKET = -1;
+static void closeSocket(Socket s) { close(s); }
+static void shutdownSocket(Socket s) { shutdown(s, SHUT_RDWR); }
+#endif
+
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0; // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+static const size_t MAX_REQUEST_BYTES = 16384;
+static const int RECEIVE_TIMEOUT_MS = 10000;
+// How often the accept loop looks whether it should stop
+static const int ACCEPT_POLL_MS = 200;
+
+bool LocalServer::Connection::send(const char* data, size_t size)
+{
+    while (size > 0) {
+        int chunk = (int)std::min<size_t>(size, 1 << 20);
+        int sent = (int)::send((Socket)socket, data, chunk, SEND_FLAGS);
+        if (sent <= 0) {
+            return false;
+        }
+        data += sent;
+        size -= (size_t)sent;
+    }
+    return true;
+}
+
+bool parseByteRange(const std::string& value, uint64_t totalSize, uint64_t& first, uint64_t& last)
+{
+    first = 0;
+    last = totalSize - 1;
+    size_t equals = value.find('=');
+    size_t dash = value.find('-');
+    if (equals == std::string::npos || dash == std::string::npos || dash < equals || value.find(',') != std::string::npos) {
+        return true;
+    }
+    std::string from = value.substr(equals + 1, dash - equals - 1);
+    std::string to = value.substr(dash + 1);
+    from.erase(0, from.find_first_not_of(' '));
+    to.erase(to.find_last_not_of(" \r\n") + 1);
+
+    if (from.empty()) {
+        // Suffix range: the last n bytes
+        uint64_t suffix = strtoull(to.c_str(), nullptr, 10);
+        if (suffix == 0) {
+            return false;
+        }
+        first = suffix >= totalSize ? 0 : totalSize - suffix;
+        return true;
+    }
+    first = strtoull(from.c_str(), nullptr, 10);
+    if (!to.empty()) {
+        last = std::min(last, (uint64_t)strtoull(to.c_str(), nullptr, 10));
+    }
+    return first < totalSize && first <= last;
+}
+
+LocalServer& getLocalServer()
+{
+    static LocalServer server;
+    return server;
+}
+
+void LocalServer::addRoute(const std::string& prefix, Handler handler)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    routes.emplace_back(prefix, handler);
+}
+
+bool LocalServer::start()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (port != 0) {
+        return true;
+    }
+
+#ifdef VDJ_WIN
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        logDebug("LocalServer: WSAStartup failed");
+        return false;
+    }
+#endif
+
+    Socket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == NO_SOCKET) {
+        logDebug("LocalServer: Could not create a socket");
+        return false;
+    }
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (bind(s, (sockaddr*)&address, sizeof(address)) != 0 || listen(s, 16) != 0 ||
+        getsockname(s, (sockaddr*)&address, &length) != 0) {
+        logDebug("LocalServer: Could not listen on the loopback interface");
+        closeSocket(s);
+        return false;
+    }
+
+    listener = (intptr_t)s;
+    port = ntohs(address.sin_port);
+    logDebug("LocalServer: Listening on 127.0.0.1:" + std::to_string(port));
+    threads.resume();
+    threads.start([this]() { acceptLoop(); });
+    return true;
+}
+
+std::string LocalServer::getBaseUrl()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return port ? "http://127.0.0.1:" + std::to_string(port) : "";
+}
+
+void LocalServer::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (port == 0) {
+            return;
+        }
+        threads.requestStop();
+        // Handlers blocked sending to VirtualDJ or waiting for its request give up on their own
+        for (intptr_t client : clients) {
+            shutdownSocket((Socket)client);
+        }
+    }
+    threads.stop();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    closeSocket((Socket)listener);
+    listener = -1;
+    port = 0;
+    routes.clear();
+    logDebug("LocalServer: Stopped");
+}
+
+void LocalServer::acceptLoop()
+{
+    Socket s = (Socket)listener;
+    while (!threads.stopping()) {
+        fd_set ready;
+        FD_ZERO(&ready);
+        FD_SET(s, &ready);
+        timeval wait = {0, ACCEPT_POLL_MS * 1000};
+        if (select((int)s + 1, &ready, nullptr, nullptr, &wait) <= 0) {
+            continue;
+        }
+        Socket client = accept(s, nullptr, nullptr);
+        if (client == NO_SOCKET) {
+            continue;
+        }
+        // VirtualDJ opens a new connection for every seek
+        std::lock_guard<std::mutex> lock(mutex);
+        clients.insert((intptr_t)client);
+        if (!threads.start([this, client]() { handleConnection((intptr_t)client); })) {
+            clients.erase((intptr_t)client);
+            closeSocket(client);
+        }
+    }
+}
+
+void LocalServer::handleConnection(intptr_t clientHandle)
+{
+    Socket client = (Socket)clientHandle;
+    // Closed once it is out of the set, so stop() can't shut down a reused descriptor
+    auto closeClient = [this, client]() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            clients.erase((intptr_t)client);
+        }
+        closeSocket(client);
+    };
+    Connection connection(clientHandle);
+    int noDelay = 1;
+    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+#ifdef VDJ_WIN
+    DWORD timeout = RECEIVE_TIMEOUT_MS;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+#else
+    timeval timeout = {RECEIVE_TIMEOUT_MS / 1000, 0};
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+    int noSigPipe = 1;
+    setsockopt(client, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+#endif
+
+    std::string request;
+    char buffer[4096];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_BYTES) {
+        int received = (int)recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            closeClient();
+            return;
+        }
+        request.append(buffer, (size_t)received);
+    }
+
+    // Request line
+    size_t lineEnd = request.find("\r\n");
+    size_t methodEnd = request.find(' ');
+    size_t pathEnd = methodEnd == std::string::npos ? std::string::npos : request.find(' ', methodEnd + 1);
+    if (lineEnd == std::string::npos || pathEnd == std::string::npos || pathEnd > lineEnd) {
+        connection.send("HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        closeClient();
+        return;
+    }
+    Request parsed;
+    parsed.method = request.substr(0, methodEnd);
+    parsed.path = request.substr(methodEnd + 1, pathEnd - methodEnd - 1);
+
+    // Range header, if any
+    std::string lower = request;
+    for (char& c : lower) c = (char)tolower((unsigned char)c);
+    size_t rangeStart = lower.find("\r\nrange:");
+    if (rangeStart != std::string::npos) {
+        size_t valueStart = rangeStart + 8;
+        parsed.range = request.substr(valueStart, request.find("\r\n", valueStart) - valueStart);
+    }
+
+    Handler handler;
+    if (parsed.method == "GET" || parsed.method == "HEAD") {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (const auto& route : routes) {
+            if (parsed.path.compare(0, route.first.size(), route.first) == 0) {
+                handler = route.second;
+                break;
+            }
+        }
+    }
+    if (handler) {
+        handler(parsed, connection);
+    } else {
+        connection.send("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+    }
+    closeClient();
+}
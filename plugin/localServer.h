@@ -0,0 +1,70 @@
+#ifndef VDJ_LOCALSERVER_H
+#define VDJ_LOCALSERVER_H
+
+#include "backgroundTasks.h"
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Loopback HTTP server for the URLs the plugin hands VirtualDJ and answers itself (cached
+// intros, cover thumbnails). Each part of the plugin registers the path prefix it serves.
+// One response per connection, each connection on a thread of its own, since a response
+// that streams the rest of a track stays busy for as long as the track plays.
+class LocalServer
+{
+public:
+    struct Request {
+        std::string method; // GET or HEAD
+        std::string path;
+        std::string range;  // value of the Range header, empty if none
+    };
+
+    // The client side of a connection
+    class Connection
+    {
+    public:
+        explicit Connection(intptr_t socket) : socket(socket) {}
+        bool send(const char* data, size_t size);
+        bool send(const std::string& data) { return send(data.data(), data.size()); }
+
+    private:
+        intptr_t socket; // kept out of the header for the sake of windows.h
+    };
+
+    using Handler = std::function<void(const Request& request, Connection& connection)>;
+
+    // Requests for paths starting with prefix go to handler
+    void addRoute(const std::string& prefix, Handler handler);
+
+    // Listen on an ephemeral port of 127.0.0.1, if not listening yet
+    bool start();
+    // "http://127.0.0.1:<port>", empty until started
+    std::string getBaseUrl();
+    // Close the connections, wait for their handlers and stop listening. The routes are
+    // dropped with them, as their owners are going away; start() listens again.
+    void stop();
+
+private:
+    void acceptLoop();
+    void handleConnection(intptr_t client);
+
+    std::mutex mutex;
+    std::vector<std::pair<std::string, Handler>> routes;
+    std::set<intptr_t> clients; // connections being handled
+    intptr_t listener = -1;
+    int port = 0;
+    BackgroundTasks threads; // the accept loop and one per connection
+};
+
+// The plugin's one local server
+LocalServer& getLocalServer();
+
+// Bytes first..last of a "bytes=..." Range value against a file of totalSize bytes. False if the
+// range can't be satisfied; a value this doesn't understand means the whole file.
+bool parseByteRange(const std::string& value, uint64_t totalSize, uint64_t& first, uint64_t& last);
+
+#endif // VDJ_LOCALSERVER_H
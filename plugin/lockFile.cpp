@@ -0,0 +1,158 @@
+#include "lockFile.h"
+#include "utilities.h"
+
+#ifndef VDJ_WIN
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+// Keys are hashed onto the first GB of the file; a collision only makes two keys wait for each other
+// in other processes, and share one hold in this one
+static const uint64_t KEY_MASK = (1ULL << 30) - 1;
+
+LockFile::~LockFile()
+{
+#ifdef VDJ_WIN
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+    if (fd >= 0) close(fd);
+#endif
+}
+
+bool LockFile::open(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+#ifdef VDJ_WIN
+    if (file != INVALID_HANDLE_VALUE) {
+        return true;
+    }
+    file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_HIDDEN, NULL);
+    bool opened = file != INVALID_HANDLE_VALUE;
+#else
+    // The process must keep this one descriptor: closing any descriptor of the file drops its locks
+    if (fd >= 0) {
+        return true;
+    }
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    bool opened = fd >= 0;
+#endif
+    if (!opened) {
+        logDebug("LockFile: Could not open " + path + "; not coordinating with other VirtualDJ processes");
+    }
+    return opened;
+}
+
+bool LockFile::lockSystem(uint64_t offset, bool wait)
+{
+#ifdef VDJ_WIN
+    if (file == INVALID_HANDLE_VALUE) {
+        return true;
+    }
+    OVERLAPPED region = {};
+    region.Offset = (DWORD)offset;
+    DWORD flags = LOCKFILE_EXCLUSIVE_LOCK | (wait ? 0 : LOCKFILE_FAIL_IMMEDIATELY);
+    return LockFileEx(file, flags, 0, 1, 0, &region) != FALSE;
+#else
+    if (fd < 0) {
+        return true;
+    }
+    struct flock region = {};
+    region.l_type = F_WRLCK;
+    region.l_whence = SEEK_SET;
+    region.l_start = (off_t)offset;
+    region.l_len = 1;
+    while (fcntl(fd, wait ? F_SETLKW : F_SETLK, &region) == -1) {
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+void LockFile::unlockSystem(uint64_t offset)
+{
+#ifdef VDJ_WIN
+    if (file != INVALID_HANDLE_VALUE) {
+        OVERLAPPED region = {};
+        region.Offset = (DWORD)offset;
+        UnlockFileEx(file, 0, 1, 0, &region);
+    }
+#else
+    if (fd >= 0) {
+        struct flock region = {};
+        region.l_type = F_UNLCK;
+        region.l_whence = SEEK_SET;
+        region.l_start = (off_t)offset;
+        region.l_len = 1;
+        fcntl(fd, F_SETLK, &region);
+    }
+#endif
+}
+
+bool LockFile::lockRange(uint64_t key, bool wait)
+{
+    uint64_t offset = key & KEY_MASK;
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        Slot& slot = slots[offset];
+        if (slot.holders > 0) {
+            if (slot.key != key) {
+                logDebug("LockFile: Keys " + std::to_string(slot.key) + " and " + std::to_string(key) + " share a lock; sharing it");
+            }
+            slot.holders++;
+            return true;
+        }
+        if (!slot.acquiring) {
+            slot.acquiring = true;
+            slot.key = key;
+            break;
+        }
+        // Another thread is asking the other processes for this byte; its answer is ours
+        if (!wait) {
+            return false;
+        }
+        acquired.wait(lock);
+    }
+
+    // Without the mutex, as this may wait for another process
+    lock.unlock();
+    bool locked = lockSystem(offset, wait);
+    lock.lock();
+    Slot& slot = slots[offset];
+    slot.acquiring = false;
+    if (locked) {
+        slot.holders = 1;
+    } else {
+        slots.erase(offset);
+    }
+    acquired.notify_all();
+    return locked;
+}
+
+bool LockFile::tryLock(uint64_t key)
+{
+    return lockRange(key, false);
+}
+
+void LockFile::lock(uint64_t key)
+{
+    lockRange(key, true);
+}
+
+void LockFile::unlock(uint64_t key)
+{
+    uint64_t offset = key & KEY_MASK;
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = slots.find(offset);
+    if (it != slots.end()) {
+        // Not held (only being acquired) means an unlock without a lock; leave it to the acquirer
+        if (it->second.holders == 0 || --it->second.holders > 0) {
+            return;
+        }
+        slots.erase(it);
+    }
+    unlockSystem(offset);
+}
@@ -0,0 +1,55 @@
+#ifndef VDJ_LOCKFILE_H
+#define VDJ_LOCKFILE_H
+
+#include "../vdjPlugin8.h"
+#include <string>
+#include <mutex>
+#include <condition_variable>
+#include <unordered_map>
+#include <cstdint>
+
+// Advisory locks shared by the VirtualDJ processes of one machine, so their plugins can share the
+// cache folder: one lock file, with a byte of it locked per key (fcntl record locks on macOS,
+// LockFileEx on Windows). The locks belong to the process: a byte this process already holds (for
+// the same key, or another key hashed onto it) is granted again at once and counted, and only the
+// last unlock releases it, so threads of one process don't exclude each other and callers
+// serialize their own threads first. Without the file (open failed), every lock succeeds.
+class LockFile
+{
+public:
+    LockFile() {}
+    ~LockFile();
+    LockFile(const LockFile&) = delete;
+    LockFile& operator=(const LockFile&) = delete;
+
+    bool open(const std::string& path);
+
+    // False if another process holds key
+    bool tryLock(uint64_t key);
+    // Wait until no other process holds key
+    void lock(uint64_t key);
+    void unlock(uint64_t key);
+
+private:
+    // This process's hold on one byte of the file
+    struct Slot {
+        uint64_t key = 0;       // the key that took it, to spot collisions
+        int holders = 0;
+        bool acquiring = false; // a thread is waiting for the other processes
+    };
+
+    bool lockRange(uint64_t key, bool wait);
+    bool lockSystem(uint64_t offset, bool wait);
+    void unlockSystem(uint64_t offset);
+
+    std::mutex mutex;
+    std::condition_variable acquired;
+    std::unordered_map<uint64_t, Slot> slots; // by offset, guarded by mutex
+#ifdef VDJ_WIN
+    HANDLE file = INVALID_HANDLE_VALUE;
+#else
+    int fd = -1;
+#endif
+};
+
+#endif // VDJ_LOCKFILE_H
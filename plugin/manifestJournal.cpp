@@ -0,0 +1,126 @@
+#include "manifestJournal.h"
+#include "mappedFile.h"
+#include "settings.h"
+#include "utilities.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <random>
+
+static const char* JOURNAL_FILE = ".manifest_journal";
+static const uint64_t MAX_JOURNAL_BYTES = 256 * 1024;
+
+// Appends and restarts, between processes
+static uint64_t journalLockKey()
+{
+    static const uint64_t key = hashString(JOURNAL_FILE);
+    return key;
+}
+
+void ManifestJournal::open(const std::string& cacheDir, LockFile* lockFile)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    path = joinPath(cacheDir, JOURNAL_FILE);
+    locks = lockFile;
+    uint64_t size;
+    int64_t modifiedAt;
+    if (!statFile(path, size, modifiedAt)) {
+        locks->lock(journalLockKey());
+        if (!statFile(path, size, modifiedAt)) {
+            startOver();
+        }
+        locks->unlock(journalLockKey());
+    }
+}
+
+// Called with mutex and the journal lock held
+void ManifestJournal::startOver()
+{
+    std::random_device random;
+    std::string generation = "AMP journal " + std::to_string((long long)time(nullptr)) + "-" + std::to_string(random()) + "\n";
+    if (!writeFileAtomically(path, generation)) {
+        logDebug("ManifestJournal: Could not write " + path);
+    }
+}
+
+void ManifestJournal::append(bool added, const std::string& fileName)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    if (path.empty()) {
+        return;
+    }
+    std::string line = (added ? "+" : "-") + fileName + "\n";
+    locks->lock(journalLockKey());
+    uint64_t size;
+    int64_t modifiedAt;
+    if (!statFile(path, size, modifiedAt)) {
+        startOver();
+    }
+    FILE* file = fopen(path.c_str(), "ab");
+    long written = -1;
+    if (file) {
+        fwrite(line.data(), 1, line.size(), file);
+        written = ftell(file);
+        fclose(file);
+    }
+    if (written < 0 || (uint64_t)written > MAX_JOURNAL_BYTES) {
+        startOver();
+    }
+    locks->unlock(journalLockKey());
+}
+
+bool ManifestJournal::readChanges(std::vector<Change>& changes)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    uint64_t size = 0;
+    int64_t modifiedAt = 0;
+    if (path.empty() || !statFile(path, size, modifiedAt)) {
+        return false;
+    }
+    if (!header.empty() && size == seenSize && modifiedAt == seenModifiedAt) {
+        return true;
+    }
+
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    char line[256];
+    if (!fgets(line, sizeof(line), file) || strncmp(line, "AMP journal ", 12) != 0) {
+        fclose(file);
+        return false;
+    }
+    bool sameGeneration = header == line;
+    if (!sameGeneration) {
+        // New generation: the folder listing the caller makes now covers what it holds so far
+        header = line;
+    } else {
+        fseek(file, (long)offset, SEEK_SET);
+    }
+    std::string contents;
+    char buffer[16384];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        contents.append(buffer, read);
+    }
+    fclose(file);
+    seenSize = size;
+    seenModifiedAt = modifiedAt;
+
+    // Only whole lines; an append may be under way
+    size_t complete = contents.rfind('\n') + 1; // 0 if there is none
+    if (!sameGeneration) {
+        offset = header.size() + complete;
+        return false;
+    }
+    size_t position = 0;
+    while (position < complete) {
+        size_t end = contents.find('\n', position);
+        if (end > position + 1 && (contents[position] == '+' || contents[position] == '-')) {
+            changes.push_back({contents[position] == '+', contents.substr(position + 1, end - position - 1)});
+        }
+        position = end + 1;
+    }
+    offset += complete;
+    return true;
+}
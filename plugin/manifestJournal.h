@@ -0,0 +1,42 @@
+#ifndef VDJ_MANIFESTJOURNAL_H
+#define VDJ_MANIFESTJOURNAL_H
+
+#include "lockFile.h"
+#include <string>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+
+// Files added to and removed from the cache folder, appended to .manifest_journal there by every
+// VirtualDJ process using it, so each keeps its in-memory manifest in step with the others without
+// listing the folder. Once the journal grows past 256 KB it is started over under a new
+// generation, and every reader lists the folder once instead.
+class ManifestJournal
+{
+public:
+    struct Change {
+        bool added;
+        std::string fileName;
+    };
+
+    // locks serializes appends between processes
+    void open(const std::string& cacheDir, LockFile* locks);
+
+    void append(bool added, const std::string& fileName);
+    // What was appended since the last call (by any process, this one included). False if the
+    // journal started over since, or this is the first call: the caller should list the folder.
+    bool readChanges(std::vector<Change>& changes);
+
+private:
+    void startOver();
+
+    std::mutex mutex; // this process's side of the journal lock, and the reading position
+    std::string path;
+    LockFile* locks = nullptr;
+    std::string header;  // first line of the journal generation being followed
+    uint64_t offset = 0; // read up to here
+    uint64_t seenSize = 0;
+    int64_t seenModifiedAt = 0;
+};
+
+#endif // VDJ_MANIFESTJOURNAL_H
@@ -0,0 +1,115 @@
+#include "mappedFile.h"
+#include "utilities.h"
+
+#ifndef VDJ_WIN
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+#ifdef VDJ_WIN
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+    if (base) munmap((void*)base, length);
+#endif
+}
+
+bool MappedFile::open(const std::string& path)
+{
+#ifdef VDJ_WIN
+    file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    FILETIME written;
+    if (!GetFileSizeEx(file, &size) || !GetFileTime(file, NULL, NULL, &written) || size.QuadPart == 0) {
+        return false;
+    }
+    // FILETIME counts 100 ns intervals since 1601
+    ULARGE_INTEGER ticks;
+    ticks.LowPart = written.dwLowDateTime;
+    ticks.HighPart = written.dwHighDateTime;
+    mtime = (int64_t)(ticks.QuadPart / 10000000ULL) - 11644473600LL;
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        return false;
+    }
+    base = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!base) {
+        return false;
+    }
+    length = (size_t)size.QuadPart;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping keeps the file open
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        logDebug("MappedFile: Could not map " + path);
+        return false;
+    }
+    // Parsers jump straight to the parts they need, so don't read ahead
+    madvise(mapped, (size_t)info.st_size, MADV_RANDOM);
+    base = (const unsigned char*)mapped;
+    length = (size_t)info.st_size;
+    mtime = (int64_t)info.st_mtime;
+#endif
+    return true;
+}
+
+std::string joinPath(const std::string& dir, const std::string& fileName)
+{
+#ifdef VDJ_WIN
+    return dir + "\\" + fileName;
+#else
+    return dir + "/" + fileName;
+#endif
+}
+
+bool statFile(const std::string& path, uint64_t& size, int64_t& modifiedAt)
+{
+#ifdef VDJ_WIN
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data)) {
+        return false;
+    }
+    size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    ULARGE_INTEGER ticks;
+    ticks.LowPart = data.ftLastWriteTime.dwLowDateTime;
+    ticks.HighPart = data.ftLastWriteTime.dwHighDateTime;
+    modifiedAt = (int64_t)(ticks.QuadPart / 10000000ULL) - 11644473600LL;
+#else
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    size = (uint64_t)info.st_size;
+    modifiedAt = (int64_t)info.st_mtime;
+#endif
+    return true;
+}
+
+void lowerThreadPriority()
+{
+#ifdef VDJ_WIN
+    // Low CPU and I/O priority
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(IOPOL_TYPE_DISK)
+    setiopolicy_np(IOPOL_TYPE_DISK, IOPOL_SCOPE_THREAD, IOPOL_THROTTLE);
+#endif
+}
@@ -0,0 +1,46 @@
+#ifndef VDJ_MAPPEDFILE_H
+#define VDJ_MAPPEDFILE_H
+
+#include "../vdjPlugin8.h"
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+// A whole file mapped read-only, for parsers that only look at a few parts of it
+// (tags at the start, an MP4 index at the end) and would otherwise read it all.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+
+    const unsigned char* data() const { return base; }
+    size_t size() const { return length; }
+    // Modification time in Unix seconds
+    int64_t modifiedAt() const { return mtime; }
+
+private:
+    const unsigned char* base = nullptr;
+    size_t length = 0;
+    int64_t mtime = 0;
+#ifdef VDJ_WIN
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = NULL;
+#endif
+};
+
+// Path of fileName in dir
+std::string joinPath(const std::string& dir, const std::string& fileName);
+
+// Size and modification time (Unix seconds) of a file; false if it doesn't exist
+bool statFile(const std::string& path, uint64_t& size, int64_t& modifiedAt);
+
+// For threads reading the cache in the background: competing with VirtualDJ reading the
+// tracks it plays, they should let the disk serve it first
+void lowerThreadPriority();
+
+#endif // VDJ_MAPPEDFILE_H
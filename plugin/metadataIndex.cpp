@@ -0,0 +1,222 @@
+#include "metadataIndex.h"
+#include "mappedFile.h"
+#include "settings.h"
+#include "tracing.h"
+#include "metrics.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+
+static const char* INDEX_FILE = ".metadata_index";
+static const char* INDEX_HEADER = "AMP metadata 1";
+static const int MAX_SCANNERS = 8;
+
+static MetricGauge& indexedFilesGauge()
+{
+    static MetricGauge& gauge = getGauge("amp_metadata_index_files", "Cached files with their tags in the metadata index");
+    return gauge;
+}
+
+MetadataIndex::MetadataIndex()
+{
+}
+
+// One line per file: name, size, modification time, length, bpm, key, year, genre (tab separated)
+void MetadataIndex::loadLocked(const std::string& cacheDir)
+{
+    directory = cacheDir;
+    std::ifstream file(joinPath(cacheDir, INDEX_FILE));
+    std::string line;
+    if (!file.is_open() || !getline(file, line) || line != INDEX_HEADER) {
+        return;
+    }
+
+    while (getline(file, line)) {
+        std::vector<std::string> fields;
+        std::stringstream stream(line);
+        std::string field;
+        while (getline(stream, field, '\t')) {
+            fields.push_back(field);
+        }
+        if (fields.size() < 7) {
+            continue;
+        }
+        Entry entry;
+        entry.size = strtoull(fields[1].c_str(), nullptr, 10);
+        entry.modifiedAt = strtoll(fields[2].c_str(), nullptr, 10);
+        entry.metadata.length = (float)atof(fields[3].c_str());
+        entry.metadata.bpm = (float)atof(fields[4].c_str());
+        entry.metadata.key = atoi(fields[5].c_str());
+        entry.metadata.year = atoi(fields[6].c_str());
+        entry.metadata.genre = fields.size() > 7 ? fields[7] : "";
+        entries[fields[0]] = entry;
+    }
+    indexedFilesGauge().set((int64_t)entries.size());
+    logDebug("MetadataIndex: Loaded " + std::to_string(entries.size()) + " entries");
+}
+
+void MetadataIndex::save()
+{
+    std::string contents = std::string(INDEX_HEADER) + "\n";
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!dirty || directory.empty()) {
+            return;
+        }
+        char numbers[128];
+        for (const auto& item : entries) {
+            const TrackMetadata& metadata = item.second.metadata;
+            snprintf(numbers, sizeof(numbers), "\t%llu\t%lld\t%.3f\t%.2f\t%d\t%d\t", (unsigned long long)item.second.size,
+                     (long long)item.second.modifiedAt, metadata.length, metadata.bpm, metadata.key, metadata.year);
+            contents += item.first + numbers + metadata.genre + "\n";
+        }
+        path = joinPath(directory, INDEX_FILE);
+        dirty = false;
+        indexedFilesGauge().set((int64_t)entries.size());
+    }
+    if (!writeFileAtomically(path, contents)) {
+        logDebug("MetadataIndex: Could not write " + path);
+    }
+}
+
+void MetadataIndex::scanFolder(const std::string& cacheDir, const std::vector<std::string>& fileNames)
+{
+    TRACE_SPAN("metadata.checkFolder");
+    std::lock_guard<std::mutex> lock(mutex);
+    if (directory.empty()) {
+        loadLocked(cacheDir);
+    }
+
+    std::unordered_set<std::string> present(fileNames.begin(), fileNames.end());
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (present.count(it->first)) {
+            ++it;
+        } else {
+            it = entries.erase(it);
+            dirty = true;
+        }
+    }
+
+    size_t queued = 0;
+    for (const std::string& fileName : fileNames) {
+        auto it = entries.find(fileName);
+        uint64_t size = 0;
+        int64_t modifiedAt = 0;
+        if (it != entries.end() && statFile(joinPath(cacheDir, fileName), size, modifiedAt) &&
+            it->second.size == size && it->second.modifiedAt == modifiedAt) {
+            continue;
+        }
+        enqueue(fileName);
+        queued++;
+    }
+    logDebug("MetadataIndex: " + std::to_string(queued) + " of " + std::to_string(fileNames.size()) + " cached files to scan");
+
+    if (queue.empty() && dirty) {
+        // Nothing to scan, but files were dropped
+        workers.start([this]() { save(); });
+    }
+}
+
+void MetadataIndex::scanFile(const std::string& cacheDir, const std::string& fileName)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (directory.empty()) {
+        loadLocked(cacheDir);
+    }
+    enqueue(fileName);
+}
+
+void MetadataIndex::remove(const std::string& fileName)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!entries.erase(fileName)) {
+            return;
+        }
+        dirty = true;
+    }
+    save();
+}
+
+bool MetadataIndex::get(const std::string& fileName, TrackMetadata& metadata)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(fileName);
+    if (it == entries.end()) {
+        return false;
+    }
+    metadata = it->second.metadata;
+    return true;
+}
+
+// Called with the mutex held. Starts another scanner while there are more files than scanners,
+// up to one per core (leaving one for VirtualDJ).
+void MetadataIndex::enqueue(const std::string& fileName)
+{
+    queue.push_back(fileName);
+    int cores = (int)std::thread::hardware_concurrency();
+    int maxScanners = std::max(1, std::min(MAX_SCANNERS, cores - 1));
+    if (runningScanners < maxScanners && (size_t)runningScanners < queue.size() &&
+        workers.start([this]() { scanLoop(); })) {
+        runningScanners++;
+    }
+}
+
+void MetadataIndex::stop()
+{
+    workers.stop();
+}
+
+void MetadataIndex::scanLoop()
+{
+    static MetricCounter& tagged = getCounter("amp_metadata_scans_total{result=\"tagged\"}", "Cached files read for the metadata index, by outcome");
+    static MetricCounter& untagged = getCounter("amp_metadata_scans_total{result=\"untagged\"}", "Cached files read for the metadata index, by outcome");
+    static MetricCounter& failed = getCounter("amp_metadata_scans_total{result=\"failed\"}", "Cached files read for the metadata index, by outcome");
+
+    lowerThreadPriority();
+    for (;;) {
+        std::string fileName;
+        std::string dir;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            // The rest waits for the next session
+            if (queue.empty() || workers.stopping()) {
+                runningScanners--;
+                if (runningScanners > 0) {
+                    return;
+                }
+                break;
+            }
+            fileName = queue.front();
+            queue.pop_front();
+            dir = directory;
+        }
+
+        TRACE_SPAN("metadata.scanFile");
+        MappedFile file;
+        Entry entry;
+        if (!file.open(joinPath(dir, fileName))) {
+            // Deleted or still being written; a later scan will get it
+            failed.add();
+            continue;
+        }
+        entry.size = file.size();
+        entry.modifiedAt = file.modifiedAt();
+        bool recognized = readTrackMetadata(file.data(), file.size(), entry.metadata);
+        (recognized ? tagged : untagged).add();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[fileName] = entry;
+        dirty = true;
+    }
+
+    // The last scanner to finish writes the index
+    save();
+    logDebug("MetadataIndex: Scan finished");
+}
@@ -0,0 +1,55 @@
+#ifndef VDJ_METADATAINDEX_H
+#define VDJ_METADATAINDEX_H
+
+#include "tagReader.h"
+#include "backgroundTasks.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+// Duration, BPM, key, year and genre of the files in the AMP cache folder, read from their tags in
+// the background so listings can fill those columns without VirtualDJ analyzing the track first.
+// Kept on disk as .metadata_index in the cache folder; a file is read again when its size or
+// modification time changes. Files are scanned in parallel, on threads with low I/O priority.
+class MetadataIndex
+{
+public:
+    MetadataIndex();
+
+    // Bring the index up to date with every file in cacheDir (fileNames), dropping files that are gone
+    void scanFolder(const std::string& cacheDir, const std::vector<std::string>& fileNames);
+    // Read one file that was just added to cacheDir
+    void scanFile(const std::string& cacheDir, const std::string& fileName);
+    void remove(const std::string& fileName);
+
+    // False if the file hasn't been read yet
+    bool get(const std::string& fileName, TrackMetadata& metadata);
+
+    // Stop scanning and wait for the files being read; what was read so far is saved
+    void stop();
+
+private:
+    struct Entry {
+        uint64_t size = 0;
+        int64_t modifiedAt = 0;
+        TrackMetadata metadata;
+    };
+
+    void loadLocked(const std::string& cacheDir);
+    void save();
+    void enqueue(const std::string& fileName);
+    void scanLoop();
+
+    std::mutex mutex;
+    std::string directory; // cache folder, once loaded
+    std::unordered_map<std::string, Entry> entries;
+    std::deque<std::string> queue;
+    int runningScanners = 0;
+    bool dirty = false; // entries changed since the last save
+    BackgroundTasks workers; // last, so it is joined before the rest goes away
+};
+
+#endif // VDJ_METADATAINDEX_H
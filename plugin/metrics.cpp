@@ -0,0 +1,178 @@
+#include "../vdjPlugin8.h"
+#include "metrics.h"
+#include "tracing.h"
+#include "folderCache.h"
+#include "settings.h"
+#include "utilities.h"
+#include "backgroundTasks.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct MetricEntry {
+    const char* name;
+    const char* help;
+    MetricCounter* counter; // exactly one of counter and gauge is set
+    MetricGauge* gauge;
+};
+
+const int kMaxMetrics = 128;
+MetricEntry metricEntries[kMaxMetrics];
+std::atomic<int> metricCount{0};
+std::mutex registryMutex;
+
+// Existing entry for the name, or a new one; past the limit metrics work but are not dumped
+MetricEntry* findOrAddMetric(const char* name, const char* help, bool isGauge)
+{
+    int count = metricCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (strcmp(metricEntries[i].name, name) == 0) {
+            return &metricEntries[i];
+        }
+    }
+
+    static MetricEntry overflow;
+    MetricEntry* entry = count < kMaxMetrics ? &metricEntries[count] : &overflow;
+    entry->name = name;
+    entry->help = help;
+    entry->counter = isGauge ? nullptr : new MetricCounter();
+    entry->gauge = isGauge ? new MetricGauge() : nullptr;
+    if (count < kMaxMetrics) {
+        metricCount.store(count + 1, std::memory_order_release);
+    }
+    return entry;
+}
+
+// Series name without labels: amp_x_total{a="b"} -> amp_x_total
+std::string familyName(const char* name)
+{
+    const char* brace = strchr(name, '{');
+    return brace ? std::string(name, brace - name) : std::string(name);
+}
+
+} // namespace
+
+MetricCounter& getCounter(const char* name, const char* help)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    MetricEntry* entry = findOrAddMetric(name, help, false);
+    if (!entry->counter) {
+        logDebug(std::string("getCounter: ") + name + " is already a gauge");
+        static MetricCounter unused;
+        return unused;
+    }
+    return *entry->counter;
+}
+
+MetricGauge& getGauge(const char* name, const char* help)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    MetricEntry* entry = findOrAddMetric(name, help, true);
+    if (!entry->gauge) {
+        logDebug(std::string("getGauge: ") + name + " is already a counter");
+        static MetricGauge unused;
+        return unused;
+    }
+    return *entry->gauge;
+}
+
+// Catalog size and approximate memory (strings included), or zero when there is none
+void updateCatalogMetrics(const FolderListing* listing)
+{
+    static MetricGauge& trackCount = getGauge("amp_catalog_tracks", "Tracks in the loaded catalog");
+    static MetricGauge& memoryBytes = getGauge("amp_catalog_bytes", "Approximate memory held by the loaded catalog");
+
+    size_t bytes = 0;
+    if (listing) {
+        bytes = sizeof(FolderListing) + listing->tracks.capacity() * sizeof(TrackInfo);
+        for (const auto& track : listing->tracks) {
+            bytes += track.uniqueId.capacity() + track.name.capacity() + track.directory.capacity() + track.url.capacity();
+        }
+        bytes += listing->searchKeys.capacity() * sizeof(SearchKey);
+        for (const auto& key : listing->searchKeys) {
+            bytes += key.lowered.capacity();
+        }
+    }
+    trackCount.set(listing ? (int64_t)listing->tracks.size() : 0);
+    memoryBytes.set((int64_t)bytes);
+}
+
+std::string formatMetrics()
+{
+    std::vector<MetricEntry> entries;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        entries.assign(metricEntries, metricEntries + metricCount.load(std::memory_order_acquire));
+    }
+
+    // The text format wants all series of a family together, under one HELP/TYPE header
+    std::string text;
+    std::vector<bool> written(entries.size(), false);
+    char line[256];
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (written[i]) continue;
+        std::string family = familyName(entries[i].name);
+        text += "# HELP " + family + " " + entries[i].help + "\n";
+        text += "# TYPE " + family + (entries[i].gauge ? " gauge\n" : " counter\n");
+        for (size_t j = i; j < entries.size(); j++) {
+            if (written[j] || familyName(entries[j].name) != family) continue;
+            if (entries[j].gauge) {
+                snprintf(line, sizeof(line), "%s %lld\n", entries[j].name, (long long)entries[j].gauge->get());
+            } else {
+                snprintf(line, sizeof(line), "%s %llu\n", entries[j].name, (unsigned long long)entries[j].counter->get());
+            }
+            text += line;
+            written[j] = true;
+        }
+    }
+    return text;
+}
+
+void dumpMetrics()
+{
+    std::string metricsPath = getSettingsPath("amp_metrics.prom");
+    if (!metricsPath.empty() && !writeFileAtomically(metricsPath, formatMetrics() + formatSpanHistograms())) {
+        logDebug("dumpMetrics: failed to write " + metricsPath);
+    }
+}
+
+// The dumper thread, started by the plugin's OnLoad and stopped when it unloads
+static std::mutex dumperMutex;
+static bool dumperStarted = false;
+static BackgroundTasks dumper;
+
+void startMetricsDumper()
+{
+    std::lock_guard<std::mutex> lock(dumperMutex);
+    if (dumperStarted) {
+        return;
+    }
+    dumperStarted = true;
+
+    int intervalSeconds = readIntSetting(".camp_metrics_interval", 0, 0, 3600);
+    if (intervalSeconds == 0) {
+        return;
+    }
+
+    logDebug("Dumping metrics every " + std::to_string(intervalSeconds) + " s");
+
+    dumper.resume();
+    dumper.start([intervalSeconds]() {
+        while (dumper.sleepFor(intervalSeconds * 1000)) {
+            dumpMetrics();
+        }
+    });
+}
+
+void stopMetricsDumper()
+{
+    std::lock_guard<std::mutex> lock(dumperMutex);
+    dumper.stop();
+    dumperStarted = false;
+}
@@ -0,0 +1,52 @@
+#ifndef VDJ_METRICS_H
+#define VDJ_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Monotonic count of events or bytes
+class MetricCounter
+{
+public:
+    void add(uint64_t amount = 1) { value.fetch_add(amount, std::memory_order_relaxed); }
+    uint64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+// Current level of something (sizes, counts of items held)
+class MetricGauge
+{
+public:
+    void set(int64_t newValue) { value.store(newValue, std::memory_order_relaxed); }
+    void add(int64_t amount) { value.fetch_add(amount, std::memory_order_relaxed); }
+    int64_t get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value{0};
+};
+
+// Metrics by Prometheus series name, labels included (e.g. amp_stream_urls_total{source="local"}),
+// created on first use. Names and help texts must be string literals. Keep the returned
+// reference in a function-local static so hot paths only pay for the atomic update.
+MetricCounter& getCounter(const char* name, const char* help);
+MetricGauge& getGauge(const char* name, const char* help);
+
+struct FolderListing;
+// Set the catalog gauges from the loaded catalog (nullptr when there is none)
+void updateCatalogMetrics(const FolderListing* listing);
+
+// All counters and gauges in Prometheus text format
+std::string formatMetrics();
+
+// Every .camp_metrics_interval seconds (0, the default, turns it off) write the metrics and the
+// span histograms to amp_metrics.prom in the VirtualDJ folder. Does nothing if already running.
+void startMetricsDumper();
+void stopMetricsDumper();
+
+// Write amp_metrics.prom now
+void dumpMetrics();
+
+#endif // VDJ_METRICS_H
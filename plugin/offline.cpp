@@ -0,0 +1,69 @@
+#include "../AMP.h"
+#include "endpointHealth.h"
+#include "settings.h"
+#include "metrics.h"
+#include "utilities.h"
+#include <string>
+
+// Seconds between attempts to reach the backend while offline, overridable with .camp_offline_probe.
+// A probe only goes out once the circuit of its endpoint half-opens.
+static const int DEFAULT_PROBE_SECONDS = 10;
+
+// Offline mode, per backend host: while the API host is unreachable, search, folders and play
+// counts answer from the catalog and listings on disk and requests that can wait are kept; while
+// the tracks host is, only cached tracks are played. Entered and left through EndpointHealth, so
+// nothing here is on the path of a callback.
+void CAMP::onConnectivityChanged(const std::string& host, bool offline)
+{
+    if (offline) {
+        logDebug("Offline mode for " + host + ": working from the cache until it is back");
+        startReconnectProbe();
+        return;
+    }
+    if (host != getHostOf(getApiBaseUrl())) {
+        return;
+    }
+    logDebug("Offline mode over for " + host + ", sending the requests kept meanwhile");
+    backgroundTasks.start([this]() {
+        deferredPosts.replay([this](const std::string& url, const std::string& body) { return httpPost(url, body); });
+    });
+}
+
+// Nothing else may talk to an offline host while the DJ works offline, so keep asking each one
+// until it answers. Any response counts, so other hosts are asked for their root.
+void CAMP::startReconnectProbe()
+{
+    if (reconnectProbeRunning.exchange(true)) {
+        return;
+    }
+    bool started = backgroundTasks.start([this]() {
+        static const int probeSeconds = readIntSetting(".camp_offline_probe", DEFAULT_PROBE_SECONDS, 1, 3600);
+        while (!getOfflineHosts().empty()) {
+            if (!backgroundTasks.sleepFor(probeSeconds * 1000)) {
+                return;
+            }
+            std::string apiHost = getHostOf(getApiBaseUrl());
+            for (const std::string& host : getOfflineHosts()) {
+                httpGetConditional(host == apiHost ? getApiBaseUrl() + "/api/fields-db" : host + "/", "");
+            }
+        }
+        reconnectProbeRunning = false;
+        // A host offline again between the last check and clearing the flag: that transition's start was a no-op
+        if (!getOfflineHosts().empty()) {
+            startReconnectProbe();
+        }
+    });
+    if (!started) {
+        reconnectProbeRunning = false;
+    }
+}
+
+// Count a play of uniqueId, now or once the backend is reachable again
+void CAMP::sendPlayCount(const std::string& uniqueId)
+{
+    std::string url = getApiBaseUrl() + "/api/fields/most-played/tracks";
+    std::string body = "{\"cleanPath\": \"" + uniqueId + "\"}";
+    if (isHostOffline(url) || !httpPost(url, body)) {
+        deferredPosts.add(url, body);
+    }
+}
@@ -1,8 +1,77 @@
 #include "search.h"
+#include "settings.h"
+#include "tracing.h"
+#include "metrics.h"
 #include "utilities.h"
+#include "searchIndex.h"
+#include "endpointHealth.h"
 #include "../AMP.h"
 #include <string>
 #include <cstring>
+#include <set>
+
+SearchWorker::~SearchWorker()
+{
+    stop();
+}
+
+bool SearchWorker::submit(const Job& run, const Job& drop)
+{
+    Job superseded;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (worker.stopping()) {
+            return false;
+        }
+        if (!workerStarted) {
+            workerStarted = worker.start([this]() { loop(); });
+            if (!workerStarted) {
+                return false;
+            }
+        }
+        superseded = pendingDrop;
+        pendingRun = run;
+        pendingDrop = drop;
+    }
+    queued.notify_one();
+    if (superseded) {
+        superseded();
+    }
+    return true;
+}
+
+void SearchWorker::loop()
+{
+    for (;;) {
+        Job run;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [this]() { return pendingRun || worker.stopping(); });
+            if (worker.stopping()) {
+                return;
+            }
+            run.swap(pendingRun);
+            pendingDrop = nullptr;
+        }
+        run();
+    }
+}
+
+void SearchWorker::stop()
+{
+    Job drop;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        worker.requestStop();
+        drop.swap(pendingDrop);
+        pendingRun = nullptr;
+    }
+    queued.notify_all();
+    if (drop) {
+        drop();
+    }
+    worker.stop();
+}
 
 HRESULT search(CAMP* plugin, const char* searchTerm, IVdjTracksList* tracks) {
     logDebug("OnSearch called with search term: " + std::string(searchTerm ? searchTerm : "(null)"));
@@ -12,17 +81,16 @@ HRESULT search(CAMP* plugin, const char* searchTerm, IVdjTracksList* tracks) {
         return S_OK;
     }
 
-    std::string encodedSearch = plugin->urlEncode(searchTerm);
-    std::string searchUrl = "https://music.abelldjcompany.com/api/tracks?search=" + encodedSearch + "&limit=" + std::to_string(plugin->getSearchResultLimit());
-    logDebug("Performing HTTP GET search with URL: " + searchUrl);
+    static MetricCounter& cacheSearches = getCounter("amp_searches_total{answered_by=\"cache\"}", "Searches, by what answered them");
+    static MetricCounter& refinedSearches = getCounter("amp_searches_total{answered_by=\"refine\"}", "Searches, by what answered them");
+    static MetricCounter& serverSearches = getCounter("amp_searches_total{answered_by=\"server\"}", "Searches, by what answered them");
+    static MetricCounter& localOnlySearches = getCounter("amp_searches_total{answered_by=\"local\"}", "Searches, by what answered them");
+    static MetricCounter& offlineSearches = getCounter("amp_searches_total{answered_by=\"offline\"}", "Searches, by what answered them");
+    static MetricCounter& supersededSearches = getCounter("amp_searches_superseded_total", "Server searches dropped because a newer search or a cancel came first");
+    static MetricCounter& searchResults = getCounter("amp_search_results_total", "Tracks listed in search results");
+    static MetricGauge& lastResultCount = getGauge("amp_search_last_result_count", "Tracks listed by the most recent search");
 
-    std::string jsonResponse = plugin->httpGet(searchUrl);
-    logDebug("Received HTTP response length: " + std::to_string(jsonResponse.length()));
-
-    std::vector<TrackInfo> tracksFound = plugin->parseTracksFromJson(jsonResponse);
-    logDebug("Parsed " + std::to_string(tracksFound.size()) + " tracks from JSON response.");
-
-    for (const auto& track : tracksFound) {
+    auto addTrackToList = [plugin, tracks](const TrackInfo& track) {
         // Parse title and artist from track name
         auto titleArtistPair = parseTrackTitleAndArtist(track.name);
         std::string title = titleArtistPair.first;
@@ -30,32 +98,244 @@ HRESULT search(CAMP* plugin, const char* searchTerm, IVdjTracksList* tracks) {
 
         const char* streamUrl = nullptr;
         std::string localPath;
-        if (plugin->isTrackCached(track.uniqueId.c_str())) {
-            localPath = plugin->getEncodedLocalPathForTrack(track.uniqueId.c_str());
+        TrackMetadata metadata;
+        bool cached = plugin->findCachedTrack(track, localPath);
+        std::string coverUrl = plugin->getCoverUrlForTrack(track, cached);
+        if (cached) {
             streamUrl = localPath.c_str();
+            plugin->metadataIndex.get(track.cacheFileName, metadata);
         }
 
         bool isVideo = track.name.find(".mp4") != std::string::npos;
 
         tracks->add(
-            track.uniqueId.c_str(), 
+            track.uniqueId.c_str(),
             title.c_str(), // title
             artist.c_str(), // artist
             "amp", // remix
-            nullptr, // genre
+            metadata.genre.empty() ? nullptr : metadata.genre.c_str(), // genre
             "AMP", // label
             "AbellDj Music Pool", // comment
-            "", // coverUrl
+            coverUrl.empty() ? nullptr : coverUrl.c_str(), // coverUrl
             streamUrl, // sream url
-            0, // length
-            0, // bpm
-            0, // key
-            0, // year
-            isVideo, 
+            metadata.length, // length
+            metadata.bpm, // bpm
+            metadata.key, // key
+            metadata.year, // year
+            isVideo,
             false
         );
         logDebug("Added track: " + track.name + " -> Title: " + title + ", Artist: " + artist);
+    };
+
+    // Intros of the uncached results, top results first
+    auto prefetchIntros = [plugin](const std::vector<TrackInfo>& results) {
+        std::vector<std::string> urls;
+        for (const auto& track : results) {
+            std::string localUrl;
+            if (!plugin->findCachedTrack(track, localUrl)) {
+                urls.push_back(track.url);
+            }
+        }
+        plugin->introCache.prefetch(urls);
+    };
+
+    std::string query = normalizeSearchQuery(searchTerm);
+    int limit = plugin->getSearchResultLimit();
+    // Offline, the backend isn't asked, and only cached tracks are listed if they can't be streamed
+    bool offline = isHostOffline(getApiBaseUrl());
+    bool streamable = !isHostOffline(getTracksBaseUrl());
+
+    std::unique_lock<std::mutex> lock(plugin->searchMutex);
+    unsigned int generation = ++plugin->searchGeneration;
+
+    std::vector<TrackInfo> cachedResults;
+    if (!offline && plugin->searchCache.get(query, limit, cachedResults)) {
+        SearchResultCache::Stats stats = plugin->searchCache.getStats();
+        logDebug("Search cache hit for '" + query + "' (hits: " + std::to_string(stats.hits) +
+                 ", misses: " + std::to_string(stats.misses) + ")");
+
+        for (const auto& track : cachedResults) {
+            addTrackToList(track);
+        }
+        plugin->lastSearchQuery = query;
+        plugin->lastSearchLimit = limit;
+        plugin->lastSearchComplete = (int)cachedResults.size() < limit;
+        plugin->lastSearchResults.swap(cachedResults);
+        prefetchIntros(plugin->lastSearchResults);
+        cacheSearches.add();
+        searchResults.add(plugin->lastSearchResults.size());
+        lastResultCount.set((int64_t)plugin->lastSearchResults.size());
+        logDebug("OnSearch completed with " + std::to_string(plugin->lastSearchResults.size()) + " results.");
+        return S_OK;
     }
-    logDebug("OnSearch completed with " + std::to_string(tracksFound.size()) + " results.");
-    return S_OK;
+
+    // The previous result set can answer this query if it was complete and the user only added characters
+    const std::string& lastQuery = plugin->lastSearchQuery;
+    bool canRefine = !offline && plugin->lastSearchComplete && plugin->lastSearchLimit == limit &&
+                     !lastQuery.empty() && query.size() > lastQuery.size() &&
+                     query.compare(0, lastQuery.size(), lastQuery) == 0;
+
+    if (canRefine) {
+        // Narrow the previous candidates instead of going back to the backend
+        std::vector<TrackInfo> refined;
+        for (const auto& track : plugin->lastSearchResults) {
+            if (matchesSearchQuery(track.name, query) || matchesSearchQuery(track.uniqueId, query)) {
+                refined.push_back(track);
+            }
+        }
+        logDebug("Refined previous search '" + plugin->lastSearchQuery + "' to " + std::to_string(refined.size()) + " results");
+
+        for (const auto& track : refined) {
+            addTrackToList(track);
+        }
+        plugin->searchCache.put(query, limit, refined);
+        plugin->lastSearchQuery = query;
+        plugin->lastSearchResults.swap(refined);
+        prefetchIntros(plugin->lastSearchResults);
+        refinedSearches.add();
+        searchResults.add(plugin->lastSearchResults.size());
+        lastResultCount.set((int64_t)plugin->lastSearchResults.size());
+        logDebug("OnSearch completed with " + std::to_string(plugin->lastSearchResults.size()) + " results.");
+        return S_OK;
+    }
+
+    // Phase 1: answer immediately from what we already have locally.
+    // Cached tracks go first, then other matches from the in-memory catalog.
+    static LatencyHistogram& localHistogram = getSpanHistogram("search.local");
+    uint64_t localStartNs = traceNowNs();
+    std::vector<std::string> cachedFiles = plugin->listCachedFiles();
+    std::set<std::string> cachedFileNames(cachedFiles.begin(), cachedFiles.end());
+    std::set<std::string> emitted; // cache file names of everything added so far
+
+    std::vector<const TrackInfo*> cachedMatches;
+    std::vector<const TrackInfo*> catalogMatches;
+    std::shared_ptr<const FolderListing> catalog = plugin->getLoadedCatalog();
+    if (catalog) {
+        // The precomputed keys let most tracks be rejected on their character mask alone
+        SearchPattern pattern = compileSearchPattern(query);
+        bool haveKeys = catalog->searchKeys.size() == catalog->tracks.size();
+        for (size_t i = 0; i < catalog->tracks.size(); i++) {
+            const TrackInfo& track = catalog->tracks[i];
+            if (haveKeys ? !matchesSearchKey(catalog->searchKeys[i], pattern) : !matchesSearchQuery(track.name, query)) continue;
+            if (cachedFileNames.count(track.cacheFileName)) {
+                cachedMatches.push_back(&track);
+            } else if (streamable && (int)catalogMatches.size() < limit) {
+                catalogMatches.push_back(&track);
+            }
+        }
+    }
+
+    for (const TrackInfo* track : cachedMatches) {
+        addTrackToList(*track);
+        emitted.insert(track->cacheFileName);
+    }
+
+    // Cached files the catalog doesn't know about (or catalog not loaded yet).
+    // The cache file name doubles as uniqueId: it maps back onto itself in getCachePathForTrack.
+    for (const auto& fileName : cachedFiles) {
+        if (emitted.count(fileName) || !matchesSearchQuery(fileName, query)) continue;
+        TrackInfo track;
+        track.uniqueId = fileName;
+        track.cacheFileName = fileName;
+        track.name = fileName;
+        track.size = 0;
+        addTrackToList(track);
+        emitted.insert(fileName);
+    }
+
+    for (const TrackInfo* track : catalogMatches) {
+        if ((int)emitted.size() >= limit) break;
+        addTrackToList(*track);
+        emitted.insert(track->cacheFileName);
+    }
+    lock.unlock();
+    recordSpan(localHistogram, localStartNs, traceNowNs() - localStartNs);
+
+    if (offline) {
+        logDebug("Backend offline, OnSearch completed with " + std::to_string(emitted.size()) + " cached results");
+        offlineSearches.add();
+        searchResults.add(emitted.size());
+        lastResultCount.set((int64_t)emitted.size());
+        return S_OK;
+    }
+    logDebug("Added " + std::to_string(emitted.size()) + " local results, fetching server results in background");
+
+    // Phase 2: fetch server results and append whatever the local pass didn't already show
+    std::string searchTermStr = searchTerm;
+    // OnSearch returns S_FALSE for this list, so VirtualDJ waits for finish() even when it is never searched
+    auto drop = [plugin, tracks, searchTermStr]() {
+        std::lock_guard<std::mutex> lock(plugin->searchMutex);
+        logDebug("Search for '" + searchTermStr + "' was superseded before it reached the server");
+        tracks->finish();
+        supersededSearches.add();
+    };
+    bool started = plugin->searchWorker.submit([plugin, tracks, addTrackToList, prefetchIntros, searchTermStr, query, limit, generation, emitted]() {
+        TRACE_SPAN("search.server");
+        std::string encodedSearch = plugin->urlEncode(searchTermStr);
+        std::string searchUrl = getApiBaseUrl() + "/api/tracks?search=" + encodedSearch + "&limit=" + std::to_string(limit);
+        logDebug("Performing HTTP GET search with URL: " + searchUrl);
+
+        std::string jsonResponse = plugin->httpGet(searchUrl);
+        logDebug("Received HTTP response length: " + std::to_string(jsonResponse.length()));
+
+        if (jsonResponse.empty()) {
+            // Backend unreachable, timed out or its circuit is open: the local results are all there is
+            std::lock_guard<std::mutex> lock(plugin->searchMutex);
+            if (plugin->searchGeneration == generation) {
+                logDebug("Server search failed, keeping the " + std::to_string(emitted.size()) + " local results");
+                tracks->finish();
+                localOnlySearches.add();
+                searchResults.add(emitted.size());
+                lastResultCount.set((int64_t)emitted.size());
+            }
+            return;
+        }
+
+        std::vector<TrackInfo> tracksFound = plugin->parseTracksFromJson(jsonResponse);
+        logDebug("Parsed " + std::to_string(tracksFound.size()) + " tracks from JSON response.");
+
+        std::lock_guard<std::mutex> lock(plugin->searchMutex);
+        if (plugin->searchGeneration != generation) {
+            // OnSearch returned S_FALSE for this list, so VirtualDJ waits for finish() even now
+            logDebug("Search for '" + searchTermStr + "' was cancelled or superseded, dropping server results");
+            tracks->finish();
+            supersededSearches.add();
+            return;
+        }
+
+        TRACE_SPAN("search.emit");
+        size_t appended = 0;
+        for (const auto& track : tracksFound) {
+            if (emitted.count(track.cacheFileName)) continue;
+            addTrackToList(track);
+            appended++;
+        }
+        tracks->finish();
+
+        // Remember this result set so the next keystroke can refine it locally.
+        // A parse error means we don't know the real candidates, so don't reuse it.
+        bool parseFailed = !tracksFound.empty() && tracksFound[0].uniqueId.compare(0, 11, "parse_error") == 0;
+        if (!parseFailed) {
+            plugin->searchCache.put(query, limit, tracksFound);
+        }
+        plugin->lastSearchQuery = query;
+        plugin->lastSearchLimit = limit;
+        plugin->lastSearchComplete = !parseFailed && (int)tracksFound.size() < limit;
+        plugin->lastSearchResults.swap(tracksFound);
+        if (parseFailed) plugin->lastSearchResults.clear();
+        prefetchIntros(plugin->lastSearchResults);
+
+        serverSearches.add();
+        searchResults.add(emitted.size() + appended);
+        lastResultCount.set((int64_t)(emitted.size() + appended));
+        logDebug("OnSearch completed with " + std::to_string(emitted.size() + appended) + " results.");
+    }, drop);
+    if (!started) {
+        // Unloading: the local results are all there is
+        return S_OK;
+    }
+
+    // Tell VirtualDJ the list is finished asynchronously with tracks->finish()
+    return S_FALSE;
 }
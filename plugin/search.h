@@ -3,12 +3,43 @@
 
 #include "../vdjPlugin8.h"
 #include "../vdjOnlineSource.h"  // This defines IVdjTracksList
+#include "backgroundTasks.h"
 #include <string>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
 
 class CAMP; // Forward declaration for the main plugin class
 struct TrackInfo; // Forward declaration for the track info struct
 
+// Runs the server half of searches one at a time on a thread of its own. Only the newest search
+// waiting for it is kept, so typing quickly costs one backend request in flight and one waiting,
+// not a thread and a request per keystroke.
+class SearchWorker
+{
+public:
+    using Job = std::function<void()>;
+
+    ~SearchWorker();
+
+    // run is called on the worker thread, or drop instead if a newer search replaces this one
+    // before it starts or the worker stops first. False, and neither called, once stopping.
+    bool submit(const Job& run, const Job& drop);
+    // Drop what is waiting and wait for the search in progress
+    void stop();
+
+private:
+    void loop();
+
+    std::mutex mutex;
+    std::condition_variable queued;
+    Job pendingRun;
+    Job pendingDrop;
+    bool workerStarted = false;
+    BackgroundTasks worker; // last, so it is joined before the rest goes away
+};
+
 // Search function declaration
 HRESULT search(CAMP* plugin, const char* searchTerm, IVdjTracksList* tracks);
 
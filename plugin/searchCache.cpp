@@ -0,0 +1,110 @@
+#include "searchCache.h"
+#include "settings.h"
+#include "utilities.h"
+#include <string>
+#include <vector>
+
+// Defaults, overridable with .camp_search_cache_ttl (seconds) and .camp_search_cache_mb
+static const int DEFAULT_TTL_SECONDS = 300;
+static const int DEFAULT_MAX_MB = 16;
+
+SearchResultCache::SearchResultCache()
+{
+    ttl = std::chrono::seconds(readIntSetting(".camp_search_cache_ttl", DEFAULT_TTL_SECONDS, 0, 86400));
+    maxBytes = (size_t)readIntSetting(".camp_search_cache_mb", DEFAULT_MAX_MB, 0, 1024) * 1024 * 1024;
+}
+
+std::string SearchResultCache::makeKey(const std::string& query, int limit)
+{
+    return std::to_string(limit) + "|" + query;
+}
+
+size_t SearchResultCache::estimateBytes(const std::vector<TrackInfo>& results)
+{
+    size_t bytes = sizeof(Entry);
+    for (const auto& track : results) {
+        bytes += sizeof(TrackInfo) + track.uniqueId.capacity() + track.cacheFileName.capacity() + track.name.capacity() +
+                 track.directory.capacity() + track.url.capacity() + track.coverUrl.capacity();
+    }
+    return bytes;
+}
+
+bool SearchResultCache::get(const std::string& query, int limit, std::vector<TrackInfo>& results)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = index.find(makeKey(query, limit));
+    if (it == index.end()) {
+        stats.misses++;
+        return false;
+    }
+
+    auto entry = it->second;
+    if (std::chrono::steady_clock::now() - entry->storedAt > ttl) {
+        totalBytes -= entry->bytes;
+        entries.erase(entry);
+        index.erase(it);
+        stats.expirations++;
+        stats.misses++;
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, entry);
+    results = entry->results;
+    stats.hits++;
+    return true;
+}
+
+void SearchResultCache::put(const std::string& query, int limit, const std::vector<TrackInfo>& results)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (ttl.count() == 0 || maxBytes == 0) return;
+
+    std::string key = makeKey(query, limit);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        totalBytes -= it->second->bytes;
+        entries.erase(it->second);
+        index.erase(it);
+    }
+
+    size_t bytes = estimateBytes(results);
+    if (bytes > maxBytes) return; // would evict everything else
+
+    entries.push_front(Entry{key, results, std::chrono::steady_clock::now(), bytes});
+    index[key] = entries.begin();
+    totalBytes += bytes;
+    evictToFit();
+}
+
+void SearchResultCache::evictToFit()
+{
+    while (totalBytes > maxBytes && !entries.empty()) {
+        Entry& oldest = entries.back();
+        totalBytes -= oldest.bytes;
+        index.erase(oldest.key);
+        entries.pop_back();
+        stats.evictions++;
+    }
+}
+
+void SearchResultCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!entries.empty()) {
+        logDebug("SearchResultCache: Clearing " + std::to_string(entries.size()) + " cached searches");
+    }
+    entries.clear();
+    index.clear();
+    totalBytes = 0;
+}
+
+SearchResultCache::Stats SearchResultCache::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats current = stats;
+    current.entries = entries.size();
+    current.bytes = totalBytes;
+    return current;
+}
@@ -0,0 +1,55 @@
+#ifndef VDJ_SEARCHCACHE_H
+#define VDJ_SEARCHCACHE_H
+
+#include "trackInfo.h"
+#include <string>
+#include <vector>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+
+// LRU of parsed search results keyed by normalized query and result limit.
+// Entries expire after a TTL and the total size is kept under a memory cap.
+class SearchResultCache
+{
+public:
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t expirations = 0;
+        uint64_t evictions = 0;
+        size_t entries = 0;
+        size_t bytes = 0;
+    };
+
+    SearchResultCache();
+
+    bool get(const std::string& query, int limit, std::vector<TrackInfo>& results);
+    void put(const std::string& query, int limit, const std::vector<TrackInfo>& results);
+    void clear();
+    Stats getStats();
+
+private:
+    struct Entry {
+        std::string key;
+        std::vector<TrackInfo> results;
+        std::chrono::steady_clock::time_point storedAt;
+        size_t bytes;
+    };
+
+    static std::string makeKey(const std::string& query, int limit);
+    static size_t estimateBytes(const std::vector<TrackInfo>& results);
+    void evictToFit();
+
+    std::mutex mutex;
+    std::list<Entry> entries; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::chrono::seconds ttl;
+    size_t maxBytes;
+    size_t totalBytes = 0;
+    Stats stats;
+};
+
+#endif // VDJ_SEARCHCACHE_H
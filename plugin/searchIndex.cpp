@@ -0,0 +1,344 @@
+#include "searchIndex.h"
+#include <cctype>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SEARCH_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define SEARCH_SIMD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define SEARCH_SIMD_NEON
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static inline int countTrailingZeros(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (int)index;
+#else
+    return __builtin_ctzll(value);
+#endif
+}
+
+// ---- Text folding ----
+
+namespace {
+
+// What an ASCII byte becomes in folded text
+enum : char { kSeparator = 0, kDrop = 1 };
+
+struct AsciiFoldTable {
+    char map[128];
+    AsciiFoldTable()
+    {
+        for (int c = 0; c < 128; c++) {
+            if (c >= 'A' && c <= 'Z') map[c] = (char)(c - 'A' + 'a');
+            else if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9')) map[c] = (char)c;
+            else if (c == '\'' || c == '`') map[c] = kDrop; // "don't" matches "dont"
+            else map[c] = kSeparator;
+        }
+    }
+};
+const AsciiFoldTable asciiFold;
+
+// U+0080 to U+017F (Latin-1 Supplement and Latin Extended-A): the ASCII letters each folds to,
+// nullptr for symbols and punctuation, which act as separators
+const char* const latinFold[256] = {
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // U+0080
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // U+0088
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // U+0090
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // U+0098
+    nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, // U+00A0
+    nullptr, nullptr, "a", nullptr, nullptr, nullptr, nullptr, nullptr, // U+00A8
+    nullptr, nullptr, "2", "3", nullptr, "u", nullptr, nullptr, // U+00B0
+    nullptr, "1", "o", nullptr, nullptr, nullptr, nullptr, nullptr, // U+00B8
+    "a", "a", "a", "a", "a", "a", "ae", "c", // U+00C0
+    "e", "e", "e", "e", "i", "i", "i", "i", // U+00C8
+    "d", "n", "o", "o", "o", "o", "o", nullptr, // U+00D0
+    "o", "u", "u", "u", "u", "y", "th", "ss", // U+00D8
+    "a", "a", "a", "a", "a", "a", "ae", "c", // U+00E0
+    "e", "e", "e", "e", "i", "i", "i", "i", // U+00E8
+    "d", "n", "o", "o", "o", "o", "o", nullptr, // U+00F0
+    "o", "u", "u", "u", "u", "y", "th", "y", // U+00F8
+    "a", "a", "a", "a", "a", "a", "c", "c", // U+0100
+    "c", "c", "c", "c", "c", "c", "d", "d", // U+0108
+    "d", "d", "e", "e", "e", "e", "e", "e", // U+0110
+    "e", "e", "e", "e", "g", "g", "g", "g", // U+0118
+    "g", "g", "g", "g", "h", "h", "h", "h", // U+0120
+    "i", "i", "i", "i", "i", "i", "i", "i", // U+0128
+    "i", "i", "ij", "ij", "j", "j", "k", "k", // U+0130
+    "k", "l", "l", "l", "l", "l", "l", "l", // U+0138
+    "l", "l", "l", "n", "n", "n", "n", "n", // U+0140
+    "n", "n", "n", "n", "o", "o", "o", "o", // U+0148
+    "o", "o", "oe", "oe", "r", "r", "r", "r", // U+0150
+    "r", "r", "s", "s", "s", "s", "s", "s", // U+0158
+    "s", "s", "t", "t", "t", "t", "t", "t", // U+0160
+    "u", "u", "u", "u", "u", "u", "u", "u", // U+0168
+    "u", "u", "u", "u", "w", "w", "y", "y", // U+0170
+    "y", "z", "z", "z", "z", "z", "z", "s", // U+0178
+};
+
+// Folded text is never longer than its input (every replacement, separator included, takes
+// the place of at least as many input bytes), so it is written straight into a sized buffer
+struct FoldWriter {
+    char* out;
+    char* begin;
+    bool pendingSeparator = false;
+
+    void separate()
+    {
+        if (pendingSeparator && out != begin) *out++ = ' ';
+        pendingSeparator = false;
+    }
+    void put(const char* folded)
+    {
+        separate();
+        while (*folded) *out++ = *folded++;
+    }
+    void putCodePoint(uint32_t codePoint)
+    {
+        separate();
+        if (codePoint < 0x800) {
+            *out++ = (char)(0xC0 | (codePoint >> 6));
+            *out++ = (char)(0x80 | (codePoint & 0x3F));
+        } else {
+            *out++ = (char)(0xE0 | (codePoint >> 12));
+            *out++ = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+            *out++ = (char)(0x80 | (codePoint & 0x3F));
+        }
+    }
+};
+
+} // namespace
+
+void foldSearchText(const char* text, size_t length, std::string& out)
+{
+    size_t start = out.size();
+    out.resize(start + length);
+    FoldWriter writer;
+    writer.out = writer.begin = &out[0] + start;
+
+    const unsigned char* bytes = (const unsigned char*)text;
+    size_t i = 0;
+    while (i < length) {
+        unsigned char c = bytes[i];
+        if (c < 0x80) {
+            // ASCII runs stay in this loop, with the writer's state in registers
+            char* dst = writer.out;
+            bool pendingSeparator = writer.pendingSeparator;
+            do {
+                char folded = asciiFold.map[c];
+                if (folded > kDrop) {
+                    if (pendingSeparator && dst != writer.begin) *dst++ = ' ';
+                    pendingSeparator = false;
+                    *dst++ = folded;
+                } else if (folded == kSeparator) {
+                    pendingSeparator = true;
+                }
+                i++;
+            } while (i < length && (c = bytes[i]) < 0x80);
+            writer.out = dst;
+            writer.pendingSeparator = pendingSeparator;
+            continue;
+        }
+
+        // Decode one UTF-8 sequence of up to three bytes; anything else is copied through untouched
+        uint32_t codePoint = 0;
+        size_t sequenceLength = 0;
+        if ((c & 0xE0) == 0xC0 && i + 1 < length && (bytes[i + 1] & 0xC0) == 0x80) {
+            codePoint = ((c & 0x1Fu) << 6) | (bytes[i + 1] & 0x3Fu);
+            sequenceLength = 2;
+        } else if ((c & 0xF0) == 0xE0 && i + 2 < length && (bytes[i + 1] & 0xC0) == 0x80 && (bytes[i + 2] & 0xC0) == 0x80) {
+            codePoint = ((c & 0x0Fu) << 12) | ((bytes[i + 1] & 0x3Fu) << 6) | (bytes[i + 2] & 0x3Fu);
+            sequenceLength = 3;
+        }
+
+        if (sequenceLength == 0) {
+            writer.separate();
+            do {
+                *writer.out++ = text[i++];
+            } while (i < length && (bytes[i] & 0xC0) == 0x80);
+            continue;
+        }
+        i += sequenceLength;
+
+        if (codePoint >= 0x80 && codePoint < 0x180) {
+            const char* folded = latinFold[codePoint - 0x80];
+            if (folded) writer.put(folded);
+            else writer.pendingSeparator = true;
+        } else if (codePoint >= 0x300 && codePoint < 0x370) {
+            // Combining accents, as in decomposed (NFD) file names on macOS
+        } else if (codePoint == 0x2018 || codePoint == 0x2019 || codePoint == 0x201B || codePoint == 0x2032) {
+            // Typographic apostrophes, dropped like '
+        } else if (codePoint >= 0x2000 && codePoint < 0x2070) {
+            writer.pendingSeparator = true; // dashes, quotes, spaces, ellipsis
+        } else if (codePoint >= 0x391 && codePoint <= 0x3A9 && codePoint != 0x3A2) {
+            writer.putCodePoint(codePoint + 0x20); // Greek capitals
+        } else if (codePoint >= 0x410 && codePoint <= 0x42F) {
+            writer.putCodePoint(codePoint + 0x20); // Cyrillic capitals
+        } else if (codePoint >= 0x400 && codePoint <= 0x40F) {
+            writer.putCodePoint(codePoint + 0x50); // Cyrillic capitals with marks
+        } else {
+            writer.putCodePoint(codePoint);
+        }
+    }
+    out.resize(writer.out - &out[0]);
+}
+
+std::string foldSearchText(const std::string& text)
+{
+    std::string folded;
+    folded.reserve(text.size());
+    foldSearchText(text.data(), text.size(), folded);
+    return folded;
+}
+
+uint64_t computeCharMask(const char* lowered, size_t length)
+{
+    uint64_t mask = 0;
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)lowered[i];
+        if (c >= 'a' && c <= 'z') mask |= 1ull << (c - 'a');
+        else if (c >= '0' && c <= '9') mask |= 1ull << (26 + c - '0');
+        else if (c != ' ') mask |= 1ull << (36 + c % 28);
+    }
+    return mask;
+}
+
+SearchKey makeSearchKey(const std::string& text)
+{
+    SearchKey key;
+    key.lowered.reserve(text.size());
+    foldSearchText(text.data(), text.size(), key.lowered);
+    key.charMask = computeCharMask(key.lowered.data(), key.lowered.size());
+    return key;
+}
+
+std::vector<SearchKey> makeSearchKeys(const std::vector<TrackInfo>& tracks)
+{
+    std::vector<SearchKey> keys;
+    keys.reserve(tracks.size());
+    for (const auto& track : tracks) {
+        keys.push_back(makeSearchKey(track.name));
+    }
+    return keys;
+}
+
+SearchPattern compileSearchPattern(const std::string& normalizedQuery)
+{
+    SearchPattern pattern;
+    pattern.lowered = normalizedQuery;
+    size_t start = 0;
+    while (start < normalizedQuery.size()) {
+        size_t end = normalizedQuery.find(' ', start);
+        if (end == std::string::npos) end = normalizedQuery.size();
+        if (end > start) {
+            pattern.words.push_back(normalizedQuery.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    pattern.charMask = computeCharMask(normalizedQuery.data(), normalizedQuery.size());
+    return pattern;
+}
+
+// Candidate positions are where both the first and the last needle byte line up; only those
+// get a full compare. Each SIMD step tests 16 (32 with AVX2) positions at once.
+bool containsLowered(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength)
+{
+    if (needleLength == 0) return true;
+    if (needleLength > haystackLength) return false;
+
+    const size_t lastOffset = needleLength - 1;
+    const size_t positions = haystackLength - needleLength + 1; // valid start positions
+    size_t i = 0;
+
+#if defined(SEARCH_SIMD_AVX2)
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[lastOffset]);
+    for (; i + 32 <= positions; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256((const __m256i*)(haystack + i));
+        __m256i blockLast = _mm256_loadu_si256((const __m256i*)(haystack + i + lastOffset));
+        uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast)));
+        while (mask) {
+            size_t position = i + countTrailingZeros(mask);
+            if (needleLength < 3 || memcmp(haystack + position + 1, needle + 1, needleLength - 2) == 0) return true;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(SEARCH_SIMD_SSE2)
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[lastOffset]);
+    for (; i + 16 <= positions; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128((const __m128i*)(haystack + i));
+        __m128i blockLast = _mm_loadu_si128((const __m128i*)(haystack + i + lastOffset));
+        uint64_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast)));
+        while (mask) {
+            size_t position = i + countTrailingZeros(mask);
+            if (needleLength < 3 || memcmp(haystack + position + 1, needle + 1, needleLength - 2) == 0) return true;
+            mask &= mask - 1;
+        }
+    }
+#elif defined(SEARCH_SIMD_NEON)
+    const uint8x16_t first = vdupq_n_u8((uint8_t)needle[0]);
+    const uint8x16_t last = vdupq_n_u8((uint8_t)needle[lastOffset]);
+    for (; i + 16 <= positions; i += 16) {
+        uint8x16_t blockFirst = vld1q_u8((const uint8_t*)(haystack + i));
+        uint8x16_t blockLast = vld1q_u8((const uint8_t*)(haystack + i + lastOffset));
+        uint8x16_t equal = vandq_u8(vceqq_u8(first, blockFirst), vceqq_u8(last, blockLast));
+        // NEON has no movemask: narrow to 4 bits per byte
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+        while (mask) {
+            size_t position = i + countTrailingZeros(mask) / 4;
+            if (needleLength < 3 || memcmp(haystack + position + 1, needle + 1, needleLength - 2) == 0) return true;
+            mask &= ~(0xFull << (countTrailingZeros(mask) & ~3));
+        }
+    }
+#endif
+
+    for (; i < positions; i++) {
+        if (haystack[i] == needle[0] && haystack[i + lastOffset] == needle[lastOffset] &&
+            (needleLength < 3 || memcmp(haystack + i + 1, needle + 1, needleLength - 2) == 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool matchesSearchKey(const SearchKey& key, const SearchPattern& pattern)
+{
+    if ((pattern.charMask & ~key.charMask) != 0) {
+        return false;
+    }
+    for (const auto& word : pattern.words) {
+        if (!containsLowered(key.lowered.data(), key.lowered.size(), word.data(), word.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool fuzzyPrefilter(const SearchKey& key, const SearchPattern& pattern)
+{
+    if ((pattern.charMask & ~key.charMask) != 0) {
+        return false;
+    }
+    // memchr is vectorized by the C library, so each step skips ahead in wide chunks
+    const char* position = key.lowered.data();
+    const char* end = position + key.lowered.size();
+    for (char c : pattern.lowered) {
+        const void* found = memchr(position, c, end - position);
+        if (!found) {
+            return false;
+        }
+        position = static_cast<const char*>(found) + 1;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef VDJ_SEARCHINDEX_H
+#define VDJ_SEARCHINDEX_H
+
+#include "trackInfo.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Search form of one track name, computed once when the catalog is built
+struct SearchKey {
+    std::string lowered; // folded name, see foldSearchText
+    uint64_t charMask = 0; // characters present, see computeCharMask
+};
+
+// A normalized query, compiled once per keystroke
+struct SearchPattern {
+    std::string lowered;            // the whole folded query, for subsequence (fuzzy) matching
+    std::vector<std::string> words; // space separated words, each must appear as a substring
+    uint64_t charMask = 0;          // characters every match has to contain
+};
+
+// Search form of text: lowercase, accents stripped (é -> e, ß -> ss, also combining accents),
+// apostrophes dropped and runs of spaces and punctuation collapsed into one space, trimmed.
+// Greek and Cyrillic are lowercased; other characters are kept as they are. Appends to out.
+void foldSearchText(const char* text, size_t length, std::string& out);
+std::string foldSearchText(const std::string& text);
+
+// One bit per letter and digit, the remaining bits shared by all other bytes. Spaces are ignored.
+// A text can only match a pattern whose mask bits are all present in the text's mask.
+uint64_t computeCharMask(const char* lowered, size_t length);
+
+SearchKey makeSearchKey(const std::string& text);
+// Keys for the track names, in the same order
+std::vector<SearchKey> makeSearchKeys(const std::vector<TrackInfo>& tracks);
+// normalizedQuery must already be folded (normalizeSearchQuery does that)
+SearchPattern compileSearchPattern(const std::string& normalizedQuery);
+
+// Every word of the pattern occurs in the key (what matchesSearchQuery checks)
+bool matchesSearchKey(const SearchKey& key, const SearchPattern& pattern);
+
+// Every character of the pattern occurs in order in the folded key. Fuzzy matching the folded
+// name can only succeed when this does, so failing candidates can skip the scorer.
+bool fuzzyPrefilter(const SearchKey& key, const SearchPattern& pattern);
+
+// Substring search over already folded text, vectorized with SSE2/AVX2/NEON where available
+bool containsLowered(const char* haystack, size_t haystackLength, const char* needle, size_t needleLength);
+
+#endif // VDJ_SEARCHINDEX_H
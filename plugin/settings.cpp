@@ -0,0 +1,106 @@
+#include "../vdjPlugin8.h"
+#include "settings.h"
+#include "utilities.h"
+#include <string>
+#include <fstream>
+#include <cstdlib>
+#include <cstdio>
+
+std::string getSettingsPath(const std::string& fileName)
+{
+#ifdef VDJ_WIN
+    char* userProfile = getenv("USERPROFILE");
+    if (userProfile) {
+        return std::string(userProfile) + "\\AppData\\Local\\VirtualDJ\\" + fileName;
+    }
+#else
+    char* homeDir = getenv("HOME");
+    if (homeDir) {
+        return std::string(homeDir) + "/Library/Application Support/VirtualDJ/" + fileName;
+    }
+#endif
+    return "";
+}
+
+int readIntSetting(const std::string& fileName, int defaultValue, int minValue, int maxValue)
+{
+    std::string settingsPath = getSettingsPath(fileName);
+    if (settingsPath.empty()) {
+        return defaultValue;
+    }
+
+    std::ifstream settingsFile(settingsPath);
+    if (!settingsFile.is_open()) {
+        return defaultValue;
+    }
+
+    std::string valueStr;
+    getline(settingsFile, valueStr);
+    char* end = nullptr;
+    long value = strtol(valueStr.c_str(), &end, 10);
+    if (end == valueStr.c_str() || value < minValue || value > maxValue) {
+        logDebug("readIntSetting: Ignoring invalid value '" + valueStr + "' in " + fileName);
+        return defaultValue;
+    }
+
+    logDebug("readIntSetting: " + fileName + " = " + std::to_string(value));
+    return (int)value;
+}
+
+std::string readStringSetting(const std::string& fileName, const std::string& defaultValue)
+{
+    std::string settingsPath = getSettingsPath(fileName);
+    if (settingsPath.empty()) {
+        return defaultValue;
+    }
+
+    std::ifstream settingsFile(settingsPath);
+    std::string value;
+    if (!settingsFile.is_open() || !getline(settingsFile, value)) {
+        return defaultValue;
+    }
+    value.erase(value.find_last_not_of(" \t\r\n") + 1);
+    if (value.empty()) {
+        return defaultValue;
+    }
+
+    logDebug("readStringSetting: " + fileName + " = " + value);
+    return value;
+}
+
+static std::string trimTrailingSlash(std::string url)
+{
+    while (!url.empty() && url.back() == '/') {
+        url.pop_back();
+    }
+    return url;
+}
+
+const std::string& getApiBaseUrl()
+{
+    static const std::string apiBaseUrl = trimTrailingSlash(readStringSetting(".camp_api_url", "https://music.abelldjcompany.com"));
+    return apiBaseUrl;
+}
+
+const std::string& getTracksBaseUrl()
+{
+    static const std::string tracksBaseUrl = trimTrailingSlash(readStringSetting(".camp_tracks_url", "https://tracks.abelldjcompany.com"));
+    return tracksBaseUrl;
+}
+
+// Write next to the final name and rename, so readers never see a half-written file
+bool writeFileAtomically(const std::string& path, const std::string& contents)
+{
+    std::string tempPath = path + ".tmp";
+    {
+        std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+        if (!file.is_open()) {
+            return false;
+        }
+        file << contents;
+    }
+#ifdef VDJ_WIN
+    remove(path.c_str());
+#endif
+    return rename(tempPath.c_str(), path.c_str()) == 0;
+}
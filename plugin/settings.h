@@ -0,0 +1,23 @@
+#ifndef VDJ_SETTINGS_H
+#define VDJ_SETTINGS_H
+
+#include <string>
+
+// Path of a plugin setting file in the VirtualDJ user folder (e.g. ".camp_search_limit")
+std::string getSettingsPath(const std::string& fileName);
+
+// Read an integer setting, falling back to defaultValue if missing or out of range
+int readIntSetting(const std::string& fileName, int defaultValue, int minValue, int maxValue);
+
+// Read the first line of a string setting, or defaultValue if the file is missing or empty
+std::string readStringSetting(const std::string& fileName, const std::string& defaultValue);
+
+// Write a file so that readers never see it half-written (temporary file, then rename)
+bool writeFileAtomically(const std::string& path, const std::string& contents);
+
+// Backend base URLs (no trailing slash). .camp_api_url and .camp_tracks_url override them,
+// e.g. to point the plugin at a local stand-in backend.
+const std::string& getApiBaseUrl();
+const std::string& getTracksBaseUrl();
+
+#endif // VDJ_SETTINGS_H
@@ -0,0 +1,129 @@
+#include "sha256.h"
+#include "../vdjPlugin8.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#ifdef VDJ_WIN
+#include <bcrypt.h>
+#pragma comment(lib, "bcrypt.lib")
+#else
+#include <openssl/evp.h>
+#endif
+
+static std::string toHex(const unsigned char* bytes, size_t size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(size * 2);
+    for (size_t i = 0; i < size; i++) {
+        hex += digits[bytes[i] >> 4];
+        hex += digits[bytes[i] & 0x0F];
+    }
+    return hex;
+}
+
+#ifdef VDJ_WIN
+struct Sha256::State {
+    BCRYPT_ALG_HANDLE algorithm = NULL;
+    BCRYPT_HASH_HANDLE hash = NULL;
+};
+
+Sha256::Sha256() : state(new State())
+{
+    if (BCryptOpenAlgorithmProvider(&state->algorithm, BCRYPT_SHA256_ALGORITHM, NULL, 0) != 0 ||
+        BCryptCreateHash(state->algorithm, &state->hash, NULL, 0, NULL, 0, 0) != 0) {
+        logDebug("Sha256: Could not create a CNG hash");
+    }
+}
+
+Sha256::~Sha256()
+{
+    if (state->hash) BCryptDestroyHash(state->hash);
+    if (state->algorithm) BCryptCloseAlgorithmProvider(state->algorithm, 0);
+    delete state;
+}
+
+void Sha256::update(const void* data, size_t size)
+{
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    while (state->hash && size > 0) {
+        ULONG chunk = (ULONG)std::min<size_t>(size, 1u << 30);
+        BCryptHashData(state->hash, (PUCHAR)bytes, chunk, 0);
+        bytes += chunk;
+        size -= chunk;
+    }
+}
+
+std::string Sha256::finish()
+{
+    unsigned char digest[32];
+    if (!state->hash || BCryptFinishHash(state->hash, digest, sizeof(digest), 0) != 0) {
+        return "";
+    }
+    BCryptDestroyHash(state->hash);
+    state->hash = NULL;
+    return toHex(digest, sizeof(digest));
+}
+#else
+struct Sha256::State {
+    EVP_MD_CTX* context = nullptr;
+};
+
+Sha256::Sha256() : state(new State())
+{
+    state->context = EVP_MD_CTX_new();
+    if (state->context && EVP_DigestInit_ex(state->context, EVP_sha256(), nullptr) != 1) {
+        EVP_MD_CTX_free(state->context);
+        state->context = nullptr;
+    }
+    if (!state->context) {
+        logDebug("Sha256: Could not create an EVP context");
+    }
+}
+
+Sha256::~Sha256()
+{
+    if (state->context) EVP_MD_CTX_free(state->context);
+    delete state;
+}
+
+void Sha256::update(const void* data, size_t size)
+{
+    if (state->context) {
+        EVP_DigestUpdate(state->context, data, size);
+    }
+}
+
+std::string Sha256::finish()
+{
+    unsigned char digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (!state->context || EVP_DigestFinal_ex(state->context, digest, &length) != 1) {
+        return "";
+    }
+    EVP_MD_CTX_free(state->context);
+    state->context = nullptr;
+    return toHex(digest, length);
+}
+#endif
+
+bool sha256File(const std::string& path, std::string& digest)
+{
+    // Read front to back, so the OS reads ahead
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    Sha256 hash;
+    std::vector<char> buffer(1024 * 1024);
+    size_t read;
+    while ((read = fread(buffer.data(), 1, buffer.size(), file)) > 0) {
+        hash.update(buffer.data(), read);
+    }
+    bool complete = !ferror(file);
+    fclose(file);
+    digest = complete ? hash.finish() : "";
+    return !digest.empty();
+}
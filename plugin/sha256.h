@@ -0,0 +1,28 @@
+#ifndef VDJ_SHA256_H
+#define VDJ_SHA256_H
+
+#include <string>
+#include <cstddef>
+
+// SHA-256 computed incrementally, as a download arrives (OpenSSL on macOS, CNG on Windows)
+class Sha256
+{
+public:
+    Sha256();
+    ~Sha256();
+    Sha256(const Sha256&) = delete;
+    Sha256& operator=(const Sha256&) = delete;
+
+    void update(const void* data, size_t size);
+    // Lowercase hex digest of everything passed to update; empty if hashing failed
+    std::string finish();
+
+private:
+    struct State;
+    State* state;
+};
+
+// SHA-256 of a whole file; false if it couldn't be read
+bool sha256File(const std::string& path, std::string& digest);
+
+#endif // VDJ_SHA256_H
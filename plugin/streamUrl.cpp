@@ -1,20 +1,44 @@
 #include "streamUrl.h"
+#include "bandwidthGovernor.h"
+#include "endpointHealth.h"
+#include "settings.h"
+#include "metrics.h"
 #include "utilities.h"
 #include "../AMP.h"
 #include <string>
 #include <cstring>
-#include <thread>
 
 
 HRESULT getStreamUrl(CAMP* plugin, const char* uniqueId, IVdjString& url, IVdjString& errorMessage) {
+    static MetricCounter& localUrls = getCounter("amp_stream_urls_total{source=\"local\"}", "Stream URLs returned, by where they came from");
+    static MetricCounter& remoteUrls = getCounter("amp_stream_urls_total{source=\"remote\"}", "Stream URLs returned, by where they came from");
+    static MetricCounter& fallbackUrls = getCounter("amp_stream_urls_total{source=\"fallback\"}", "Stream URLs returned, by where they came from");
+    static MetricCounter& notFound = getCounter("amp_stream_urls_total{source=\"not_found\"}", "Stream URLs returned, by where they came from");
+    static MetricCounter& offlineMisses = getCounter("amp_stream_urls_total{source=\"offline\"}", "Stream URLs returned, by where they came from");
+
+    static MetricCounter& resolvedHits = getCounter("amp_resolved_stream_urls_total{result=\"hit\"}", "Remote stream URLs looked up in the resolved URL cache");
+    static MetricCounter& resolvedMisses = getCounter("amp_resolved_stream_urls_total{result=\"miss\"}", "Remote stream URLs looked up in the resolved URL cache");
+
     std::string id = uniqueId ? uniqueId : "(null)";
+
+    // The direct media URL behind a backend stream URL when it is known and still valid for
+    // long enough, or can be resolved within a short wait; otherwise the stream URL itself
+    auto directUrl = [plugin](const std::string& streamUrl) {
+        std::string finalUrl;
+        StreamUrlCache::Lookup lookup = plugin->streamUrlCache.resolve(streamUrl, finalUrl);
+        if (lookup == StreamUrlCache::Lookup::Miss) {
+            resolvedMisses.add();
+            return streamUrl;
+        }
+        logDebug("Using resolved stream URL: " + finalUrl);
+        resolvedHits.add();
+        return finalUrl;
+    };
     
-    // Call onstream endpoint in a separate thread to avoid blocking
-    std::thread([plugin, id]() {
-        std::string onstreamUrl = "https://music.abelldjcompany.com/api/fields/most-played/tracks";
-        std::string postData = "{\"cleanPath\": \"" + id + "\"}";
-        plugin->httpPost(onstreamUrl, postData);
-    }).detach();
+    // Call onstream endpoint in a separate thread to avoid blocking; kept for later while offline
+    plugin->backgroundTasks.start([plugin, id]() {
+        plugin->sendPlayCount(id);
+    });
 
     logDebug("GetStreamUrl called with uniqueId: '" + id + "'");
     
@@ -23,30 +47,55 @@ HRESULT getStreamUrl(CAMP* plugin, const char* uniqueId, IVdjString& url, IVdjSt
         std::string localPath = plugin->getEncodedLocalPathForTrack(uniqueId);
         logDebug("Track is cached. Returning local path: " + localPath);
         url = localPath.c_str();
+        localUrls.add();
         return S_OK;
     }
     
+    // Offline, a remote URL would only leave the deck loading forever
+    if (isHostOffline(getTracksBaseUrl())) {
+        logDebug("Track not cached and the backend is offline, not streaming it");
+        errorMessage = "Not available offline";
+        offlineMisses.add();
+        return S_FALSE;
+    }
+
     // If not cached, look for the track in our full track list to get the remote URL
     logDebug("Track not cached. Searching in memory...");
-    plugin->ensureTracksAreCached();
-    for (const auto& track : plugin->cachedTracks) {
-        if (track.uniqueId == id) {
-            logDebug("Found track in memory: " + track.url);
-            url = track.url.c_str();
-            return S_OK;
+    std::shared_ptr<const FolderListing> catalog = plugin->ensureTracksAreCached();
+    if (catalog) {
+        for (const auto& track : catalog->tracks) {
+            if (track.uniqueId == id) {
+                logDebug("Found track in memory: " + track.url);
+                std::string remoteUrl = directUrl(track.url);
+                // Start from the cached intro if there is one, the rest streams through the plugin
+                std::string introUrl = plugin->introCache.getLocalUrl(track.url, remoteUrl);
+                if (!introUrl.empty()) {
+                    logDebug("Intro is cached. Returning loopback URL: " + introUrl);
+                }
+                url = (introUrl.empty() ? remoteUrl : introUrl).c_str();
+                if (introUrl.empty()) {
+                    // A relayed intro holds background transfers back itself, while it streams
+                    getBandwidthGovernor().noteRemoteStream();
+                }
+                remoteUrls.add();
+                return S_OK;
+            }
         }
     }
     
     // If not found in cache or memory, construct URL directly as a fallback with proper URL encoding
     if (!id.empty() && id != "fallback") {
         std::string encodedPath = plugin->urlEncode(id);
-        std::string streamUrl = "https://tracks.abelldjcompany.com/audio/" + encodedPath;
+        std::string streamUrl = getTracksBaseUrl() + "/audio/" + encodedPath;
         logDebug("Constructed fallback stream URL: " + streamUrl);
-        url = streamUrl.c_str();
+        url = directUrl(streamUrl).c_str();
+        getBandwidthGovernor().noteRemoteStream();
+        fallbackUrls.add();
         return S_OK;
     }
     
     logDebug("Track not found, returning error");
     errorMessage = "Track not found";
+    notFound.add();
     return S_FALSE;
 }
@@ -0,0 +1,266 @@
+#include "streamUrlCache.h"
+#include "settings.h"
+#include "utilities.h"
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+// Defaults, overridable with .camp_stream_url_ttl and .camp_stream_url_margin (seconds)
+static const int DEFAULT_TTL_SECONDS = 1800;
+static const int DEFAULT_MARGIN_SECONDS = 600;
+// How long a deck load waits for a resolution, overridable with .camp_stream_url_wait (ms)
+static const int DEFAULT_WAIT_MS = 500;
+static const size_t MAX_ENTRIES = 2048;
+// URLs waiting for the resolver; past this the oldest are dropped, their decks long loaded
+static const size_t MAX_QUEUE = 32;
+
+static int64_t nowSeconds()
+{
+    return (int64_t)time(nullptr);
+}
+
+// Days since 1970-01-01 of a proleptic Gregorian date (month 1-12), without timegm
+static int64_t daysFromCivil(int64_t year, int month, int day)
+{
+    year -= month <= 2;
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    int64_t yearOfEra = year - era * 400;
+    int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+static int64_t toUnixSeconds(int year, int month, int day, int hour, int minute, int second)
+{
+    return daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+}
+
+// Value of query parameter `name` (not decoded), empty if absent
+static std::string queryParameter(const std::string& url, const std::string& name)
+{
+    size_t query = url.find('?');
+    if (query == std::string::npos) return "";
+
+    size_t pos = query + 1;
+    while (pos < url.size()) {
+        size_t end = url.find('&', pos);
+        if (end == std::string::npos) end = url.size();
+        size_t equals = url.find('=', pos);
+        if (equals != std::string::npos && equals < end && url.compare(pos, equals - pos, name) == 0 &&
+            equals - pos == name.size()) {
+            return url.substr(equals + 1, end - equals - 1);
+        }
+        pos = end + 1;
+    }
+    return "";
+}
+
+int64_t expiryFromSignedUrl(const std::string& url)
+{
+    // S3 style: signed at X-Amz-Date (20261019T120000Z) for X-Amz-Expires seconds
+    std::string amzDate = queryParameter(url, "X-Amz-Date");
+    std::string amzExpires = queryParameter(url, "X-Amz-Expires");
+    if (!amzDate.empty() && !amzExpires.empty()) {
+        int year, month, day, hour, minute, second;
+        if (sscanf(amzDate.c_str(), "%4d%2d%2dT%2d%2d%2dZ", &year, &month, &day, &hour, &minute, &second) == 6) {
+            return toUnixSeconds(year, month, day, hour, minute, second) + atoll(amzExpires.c_str());
+        }
+    }
+
+    // CloudFront, Google Cloud Storage (v2) and most CDNs: Expires=<unix seconds>
+    std::string expires = queryParameter(url, "Expires");
+    if (expires.empty()) expires = queryParameter(url, "expires");
+    if (!expires.empty() && expires.find_first_not_of("0123456789") == std::string::npos) {
+        return atoll(expires.c_str());
+    }
+    return 0;
+}
+
+int64_t parseHttpDate(const std::string& date)
+{
+    static const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+    char monthName[4] = {0};
+    int day, year, hour, minute, second;
+    size_t comma = date.find(',');
+    const char* text = date.c_str() + (comma == std::string::npos ? 0 : comma + 1);
+    if (sscanf(text, " %d %3s %d %d:%d:%d", &day, monthName, &year, &hour, &minute, &second) != 6) {
+        return 0;
+    }
+    for (int month = 0; month < 12; month++) {
+        if (strcmp(monthName, months[month]) == 0) {
+            return toUnixSeconds(year, month + 1, day, hour, minute, second);
+        }
+    }
+    return 0;
+}
+
+StreamUrlCache::StreamUrlCache()
+{
+    defaultTtlSeconds = readIntSetting(".camp_stream_url_ttl", DEFAULT_TTL_SECONDS, 0, 86400);
+    marginSeconds = readIntSetting(".camp_stream_url_margin", DEFAULT_MARGIN_SECONDS, 0, 86400);
+    waitMs = readIntSetting(".camp_stream_url_wait", DEFAULT_WAIT_MS, 0, 10000);
+    maxEntries = MAX_ENTRIES;
+}
+
+StreamUrlCache::~StreamUrlCache()
+{
+    stop();
+}
+
+void StreamUrlCache::configure(Resolver urlResolver)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    resolver = urlResolver;
+}
+
+StreamUrlCache::Lookup StreamUrlCache::resolve(const std::string& url, std::string& finalUrl)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    Lookup lookup = getLocked(url, finalUrl);
+    if (lookup == Lookup::Fresh || !resolver || worker.stopping()) {
+        return lookup;
+    }
+
+    if (resolving.insert(url).second) {
+        queue.push_back(url);
+        if (queue.size() > MAX_QUEUE) {
+            resolving.erase(queue.front());
+            queue.pop_front();
+        }
+        if (!workerStarted) {
+            workerStarted = worker.start([this]() { resolveLoop(); });
+        }
+        queued.notify_one();
+    }
+    if (lookup != Lookup::Miss || waitMs <= 0) {
+        return lookup;
+    }
+
+    resolved.wait_for(lock, std::chrono::milliseconds(waitMs), [this, &url]() { return !resolving.count(url) || worker.stopping(); });
+    return getLocked(url, finalUrl);
+}
+
+void StreamUrlCache::resolveLoop()
+{
+    for (;;) {
+        std::string url;
+        Resolver resolveUrl;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [this]() { return !queue.empty() || worker.stopping(); });
+            if (worker.stopping()) {
+                return;
+            }
+            url = queue.front();
+            queue.pop_front();
+            resolveUrl = resolver;
+        }
+
+        std::string finalUrl;
+        int64_t expiresAt = 0;
+        bool ok = resolveUrl(url, finalUrl, expiresAt);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) {
+                putLocked(url, finalUrl, expiresAt);
+            } else {
+                entries.erase(url);
+            }
+            resolving.erase(url);
+        }
+        resolved.notify_all();
+    }
+}
+
+void StreamUrlCache::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        worker.requestStop();
+    }
+    queued.notify_all();
+    resolved.notify_all();
+    worker.stop();
+}
+
+StreamUrlCache::Lookup StreamUrlCache::get(const std::string& url, std::string& finalUrl)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return getLocked(url, finalUrl);
+}
+
+StreamUrlCache::Lookup StreamUrlCache::getLocked(const std::string& url, std::string& finalUrl)
+{
+    auto it = entries.find(url);
+    if (it == entries.end()) {
+        return Lookup::Miss;
+    }
+
+    const Entry& entry = it->second;
+    int64_t now = nowSeconds();
+    if (entry.expiresAt - now < marginSeconds) {
+        // It could run out while VirtualDJ is still streaming from it
+        entries.erase(it);
+        return Lookup::Miss;
+    }
+
+    finalUrl = entry.finalUrl;
+    int64_t halfLife = (entry.expiresAt - entry.resolvedAt) / 2;
+    return now - entry.resolvedAt >= halfLife ? Lookup::Refresh : Lookup::Fresh;
+}
+
+void StreamUrlCache::put(const std::string& url, const std::string& finalUrl, int64_t expiresAt)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    putLocked(url, finalUrl, expiresAt);
+}
+
+void StreamUrlCache::putLocked(const std::string& url, const std::string& finalUrl, int64_t expiresAt)
+{
+    int64_t now = nowSeconds();
+    if (expiresAt - now < marginSeconds) {
+        // Too short-lived to ever be handed out
+        logDebug("StreamUrlCache: Not caching " + finalUrl + ", it expires in " + std::to_string(expiresAt - now) + " s");
+        entries.erase(url);
+        return;
+    }
+
+    entries[url] = Entry{finalUrl, now, expiresAt};
+    evictToFit(now);
+}
+
+void StreamUrlCache::evictToFit(int64_t now)
+{
+    if (entries.size() <= maxEntries) return;
+
+    // Expired entries first, then whatever expires soonest
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (it->second.expiresAt - now < marginSeconds) it = entries.erase(it);
+        else ++it;
+    }
+    while (entries.size() > maxEntries) {
+        auto soonest = entries.begin();
+        for (auto it = entries.begin(); it != entries.end(); ++it) {
+            if (it->second.expiresAt < soonest->second.expiresAt) soonest = it;
+        }
+        entries.erase(soonest);
+    }
+}
+
+void StreamUrlCache::invalidate(const std::string& url)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.erase(url);
+}
+
+void StreamUrlCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!entries.empty()) {
+        logDebug("StreamUrlCache: Clearing " + std::to_string(entries.size()) + " resolved stream URLs");
+    }
+    entries.clear();
+}
@@ -0,0 +1,85 @@
+#ifndef VDJ_STREAMURLCACHE_H
+#define VDJ_STREAMURLCACHE_H
+
+#include "backgroundTasks.h"
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+
+// Final media URLs behind the backend's stream URL redirects, so VirtualDJ can be handed
+// a direct URL instead of following the redirects again on every deck load.
+// Entries are only served while they stay valid for the refresh margin (long enough
+// to stream a whole track), and are re-resolved in the background after half their lifetime.
+// One worker thread does the resolving, so a burst of deck loads can't pile up threads.
+class StreamUrlCache
+{
+public:
+    // Follow the redirects of url; expiresAt is in Unix seconds. False if they couldn't be followed.
+    using Resolver = std::function<bool(const std::string& url, std::string& finalUrl, int64_t& expiresAt)>;
+
+    enum class Lookup {
+        Miss,    // not cached, or too close to expiry to hand out
+        Fresh,   // finalUrl is good
+        Refresh, // finalUrl is good, but it is time to resolve it again
+    };
+
+    StreamUrlCache();
+    ~StreamUrlCache();
+
+    void configure(Resolver resolver);
+
+    // Like get, but queues url for the resolver unless the entry is Fresh, and on a Miss waits
+    // for it up to .camp_stream_url_wait ms. Still a Miss then, the result is there next time.
+    Lookup resolve(const std::string& url, std::string& finalUrl);
+    Lookup get(const std::string& url, std::string& finalUrl);
+    // expiresAt is in Unix seconds
+    void put(const std::string& url, const std::string& finalUrl, int64_t expiresAt);
+    void invalidate(const std::string& url);
+    void clear();
+
+    // Stop resolving and wait for the resolution in progress
+    void stop();
+
+    // Lifetime given to a resolution when neither the redirects nor the final URL say
+    int getDefaultTtlSeconds() const { return defaultTtlSeconds; }
+
+private:
+    struct Entry {
+        std::string finalUrl;
+        int64_t resolvedAt;
+        int64_t expiresAt;
+    };
+
+    Lookup getLocked(const std::string& url, std::string& finalUrl);
+    void putLocked(const std::string& url, const std::string& finalUrl, int64_t expiresAt);
+    void evictToFit(int64_t now);
+    void resolveLoop();
+
+    std::mutex mutex;
+    std::unordered_map<std::string, Entry> entries;
+    int defaultTtlSeconds;
+    int marginSeconds;
+    int waitMs;
+    size_t maxEntries;
+    Resolver resolver;
+    std::unordered_set<std::string> resolving; // queued or being resolved
+    std::deque<std::string> queue;
+    std::condition_variable queued;
+    std::condition_variable resolved;
+    bool workerStarted = false;
+    BackgroundTasks worker; // last, so it is joined before the rest goes away
+};
+
+// Unix time a signed URL stops working, from its query parameters (X-Amz-Date + X-Amz-Expires,
+// or an Expires timestamp as CloudFront and others use). 0 when the URL carries none.
+int64_t expiryFromSignedUrl(const std::string& url);
+
+// Unix time of an HTTP date ("Sun, 06 Nov 1994 08:49:37 GMT"), 0 if it doesn't parse
+int64_t parseHttpDate(const std::string& date);
+
+#endif // VDJ_STREAMURLCACHE_H
@@ -0,0 +1,531 @@
+#include "tagReader.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+static uint32_t readBe16(const unsigned char* p) { return ((uint32_t)p[0] << 8) | p[1]; }
+static uint32_t readBe24(const unsigned char* p) { return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]; }
+static uint32_t readBe32(const unsigned char* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+static uint64_t readBe64(const unsigned char* p) { return ((uint64_t)readBe32(p) << 32) | readBe32(p + 4); }
+static uint32_t readSyncsafe32(const unsigned char* p) { return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) | ((uint32_t)(p[2] & 0x7F) << 7) | (p[3] & 0x7F); }
+
+// ID3v1 genres and the Winamp extensions, which ID3v2 "(17)" style genres and MP4 gnre atoms refer to
+static const char* const GENRES[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge", "Hip-Hop", "Jazz", "Metal",
+    "New Age", "Oldies", "Other", "Pop", "R&B", "Rap", "Reggae", "Rock", "Techno", "Industrial",
+    "Alternative", "Ska", "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient", "Trip-Hop", "Vocal", "Jazz+Funk",
+    "Fusion", "Trance", "Classical", "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "AlternRock", "Bass", "Soul", "Punk", "Space", "Meditative", "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic",
+    "Darkwave", "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream", "Southern Rock", "Comedy", "Cult", "Gangsta",
+    "Top 40", "Christian Rap", "Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave", "Psychadelic", "Rave", "Showtunes",
+    "Trailer", "Lo-Fi", "Tribal", "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll", "Hard Rock",
+    "Folk", "Folk-Rock", "National Folk", "Swing", "Fast Fusion", "Bebob", "Latin", "Revival", "Celtic", "Bluegrass",
+    "Avantgarde", "Gothic Rock", "Progressive Rock", "Psychedelic Rock", "Symphonic Rock", "Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic",
+    "Humour", "Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony", "Booty Bass", "Primus", "Porn Groove",
+    "Satire", "Slow Jam", "Club", "Tango", "Samba", "Folklore", "Ballad", "Power Ballad", "Rhythmic Soul", "Freestyle",
+    "Duet", "Punk Rock", "Drum Solo", "A capella", "Euro-House", "Dance Hall",
+};
+static const int GENRE_COUNT = (int)(sizeof(GENRES) / sizeof(GENRES[0]));
+
+// "(17)", "17" and "(17)Rock" as ID3v2.3 writes them; anything else is already a name
+static std::string genreName(const std::string& text)
+{
+    size_t start = text.size() > 2 && text[0] == '(' ? 1 : 0;
+    size_t end = start;
+    while (end < text.size() && isdigit((unsigned char)text[end])) end++;
+    if (end == start || (start == 1 && (end >= text.size() || text[end] != ')'))) {
+        return text;
+    }
+    if (start == 0 && end != text.size()) {
+        return text;
+    }
+    if (start == 1 && end + 1 < text.size()) {
+        return text.substr(end + 1); // refinement after the number
+    }
+    int index = atoi(text.c_str() + start);
+    return index < GENRE_COUNT ? GENRES[index] : "";
+}
+
+static void appendUtf8(std::string& out, uint32_t codePoint)
+{
+    if (codePoint < 0x80) {
+        out += (char)codePoint;
+    } else if (codePoint < 0x800) {
+        out += (char)(0xC0 | (codePoint >> 6));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    } else if (codePoint < 0x10000) {
+        out += (char)(0xE0 | (codePoint >> 12));
+        out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    } else {
+        out += (char)(0xF0 | (codePoint >> 18));
+        out += (char)(0x80 | ((codePoint >> 12) & 0x3F));
+        out += (char)(0x80 | ((codePoint >> 6) & 0x3F));
+        out += (char)(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// First value of an ID3v2 text frame, as UTF-8
+static std::string decodeId3Text(const unsigned char* body, size_t size)
+{
+    std::string text;
+    if (size < 2) {
+        return text;
+    }
+    unsigned char encoding = body[0];
+    const unsigned char* p = body + 1;
+    const unsigned char* end = body + size;
+
+    if (encoding == 1 || encoding == 2) {
+        // UTF-16, with a byte order mark (1) or big endian (2)
+        bool bigEndian = encoding == 2;
+        if (encoding == 1 && end - p >= 2) {
+            if (p[0] == 0xFE && p[1] == 0xFF) { bigEndian = true; p += 2; }
+            else if (p[0] == 0xFF && p[1] == 0xFE) { bigEndian = false; p += 2; }
+        }
+        while (end - p >= 2) {
+            uint32_t unit = bigEndian ? ((uint32_t)p[0] << 8 | p[1]) : ((uint32_t)p[1] << 8 | p[0]);
+            p += 2;
+            if (unit == 0) break;
+            if (unit >= 0xD800 && unit < 0xDC00 && end - p >= 2) {
+                uint32_t low = bigEndian ? ((uint32_t)p[0] << 8 | p[1]) : ((uint32_t)p[1] << 8 | p[0]);
+                if (low >= 0xDC00 && low < 0xE000) {
+                    unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                    p += 2;
+                }
+            }
+            appendUtf8(text, unit);
+        }
+    } else {
+        // ISO-8859-1 (0) or UTF-8 (3)
+        for (; p < end && *p; p++) {
+            if (encoding == 0) appendUtf8(text, *p);
+            else text += (char)*p;
+        }
+    }
+
+    size_t last = text.find_last_not_of(" \t\r\n");
+    text.erase(last == std::string::npos ? 0 : last + 1);
+    return text;
+}
+
+// Calls frame(id, body, size) for each frame of the ID3v2 tag at the start of data.
+// Returns the size of the tag, 0 if there is none.
+static size_t forEachId3Frame(const unsigned char* data, size_t size,
+                              const std::function<void(const std::string&, const unsigned char*, size_t)>& frame)
+{
+    if (size < 10 || memcmp(data, "ID3", 3) != 0) {
+        return 0;
+    }
+    int major = data[3];
+    unsigned char flags = data[5];
+    size_t tagSize = 10 + readSyncsafe32(data + 6) + ((flags & 0x10) ? 10 : 0);
+    size_t end = std::min(size, (size_t)(10 + readSyncsafe32(data + 6)));
+    size_t pos = 10;
+    if ((flags & 0x40) && end >= 14) {
+        // Extended header
+        pos += major == 4 ? readSyncsafe32(data + 10) : 4 + readBe32(data + 10);
+    }
+
+    size_t headerSize = major == 2 ? 6 : 10;
+    while (pos + headerSize <= end && data[pos] != 0) {
+        std::string id((const char*)data + pos, major == 2 ? 3 : 4);
+        size_t frameSize;
+        unsigned frameFlags = 0;
+        if (major == 2) {
+            frameSize = readBe24(data + pos + 3);
+        } else {
+            frameSize = major == 4 ? readSyncsafe32(data + pos + 4) : readBe32(data + pos + 4);
+            frameFlags = readBe16(data + pos + 8);
+        }
+        pos += headerSize;
+        if (frameSize > end - pos) {
+            break;
+        }
+
+        const unsigned char* body = data + pos;
+        size_t bodySize = frameSize;
+        bool compressedOrEncrypted = major == 4 ? (frameFlags & 0x000C) != 0 : (frameFlags & 0x00C0) != 0;
+        if (major == 4 && (frameFlags & 0x0001) && bodySize >= 4) {
+            // Data length indicator
+            body += 4;
+            bodySize -= 4;
+        }
+        if (!compressedOrEncrypted) {
+            frame(id, body, bodySize);
+        }
+        pos += frameSize;
+    }
+    return tagSize;
+}
+
+struct MpegHeader {
+    int bitrate;    // kbit/s
+    int sampleRate;
+    int samplesPerFrame;
+    int frameLength;
+    int sideInfoSize; // Layer III only, where a Xing header follows it
+};
+
+static bool parseMpegHeader(const unsigned char* p, MpegHeader& header)
+{
+    static const int BITRATES[2][3][15] = {
+        { // MPEG 1, Layer I, II, III
+            {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+            {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+        },
+        { // MPEG 2 and 2.5
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+        },
+    };
+    static const int SAMPLE_RATES[3] = {44100, 48000, 32000};
+
+    if (p[0] != 0xFF || (p[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+    int versionBits = (p[1] >> 3) & 3; // 0 = 2.5, 2 = 2, 3 = 1
+    int layerBits = (p[1] >> 1) & 3;   // 1 = III, 2 = II, 3 = I
+    int bitrateIndex = p[2] >> 4;
+    int rateIndex = (p[2] >> 2) & 3;
+    if (versionBits == 1 || layerBits == 0 || bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3) {
+        return false;
+    }
+    bool mpeg1 = versionBits == 3;
+    int layer = 4 - layerBits;
+    int padding = (p[2] >> 1) & 1;
+    bool mono = (p[3] >> 6) == 3;
+
+    header.bitrate = BITRATES[mpeg1 ? 0 : 1][layer - 1][bitrateIndex];
+    header.sampleRate = SAMPLE_RATES[rateIndex] >> (mpeg1 ? 0 : versionBits == 2 ? 1 : 2);
+    if (layer == 1) {
+        header.samplesPerFrame = 384;
+        header.frameLength = (12 * header.bitrate * 1000 / header.sampleRate + padding) * 4;
+    } else {
+        header.samplesPerFrame = layer == 3 && !mpeg1 ? 576 : 1152;
+        header.frameLength = header.samplesPerFrame / 8 * header.bitrate * 1000 / header.sampleRate + padding;
+    }
+    header.sideInfoSize = layer != 3 ? 0 : mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+    return header.frameLength > 4;
+}
+
+// Duration from the first MPEG audio frame: its Xing/Info or VBRI frame count if it has one,
+// otherwise the bitrate (constant bitrate files)
+static float mpegDuration(const unsigned char* data, size_t size, size_t audioStart)
+{
+    // Skip padding and junk between the tag and the first frame, but not too far
+    size_t limit = std::min(size, audioStart + 65536);
+    for (size_t pos = audioStart; pos + 4 <= limit; pos++) {
+        MpegHeader header;
+        if (data[pos] != 0xFF || !parseMpegHeader(data + pos, header)) {
+            continue;
+        }
+        // A second frame right after it tells a real header from a chance 0xFF
+        size_t next = pos + header.frameLength;
+        MpegHeader nextHeader;
+        if (next + 4 <= size && !parseMpegHeader(data + next, nextHeader)) {
+            continue;
+        }
+
+        uint32_t frames = 0;
+        size_t xing = pos + 4 + header.sideInfoSize;
+        if (header.sideInfoSize && xing + 12 <= size && (memcmp(data + xing, "Xing", 4) == 0 || memcmp(data + xing, "Info", 4) == 0)) {
+            if (readBe32(data + xing + 4) & 1) {
+                frames = readBe32(data + xing + 8);
+            }
+        } else if (pos + 36 + 18 <= size && memcmp(data + pos + 36, "VBRI", 4) == 0) {
+            frames = readBe32(data + pos + 36 + 14);
+        }
+        if (frames) {
+            return (float)((double)frames * header.samplesPerFrame / header.sampleRate);
+        }
+
+        size_t audioEnd = size;
+        if (size >= 128 && memcmp(data + size - 128, "TAG", 3) == 0) {
+            audioEnd -= 128;
+        }
+        return (float)((double)(audioEnd - pos) * 8 / (header.bitrate * 1000.0));
+    }
+    return 0;
+}
+
+static bool readMp3Metadata(const unsigned char* data, size_t size, TrackMetadata& metadata)
+{
+    float taggedLength = 0;
+    size_t tagSize = forEachId3Frame(data, size, [&](const std::string& id, const unsigned char* body, size_t bodySize) {
+        if (id[0] != 'T') {
+            return;
+        }
+        std::string text = decodeId3Text(body, bodySize);
+        if (text.empty()) {
+            return;
+        }
+        if (id == "TBPM" || id == "TBP") {
+            metadata.bpm = (float)atof(text.c_str());
+        } else if (id == "TKEY" || id == "TKE") {
+            metadata.key = parseMusicalKey(text);
+        } else if (id == "TYER" || id == "TYE" || id == "TDRC") {
+            metadata.year = atoi(text.c_str());
+        } else if (id == "TCON" || id == "TCO") {
+            metadata.genre = genreName(text);
+        } else if (id == "TLEN" || id == "TLE") {
+            taggedLength = (float)(atof(text.c_str()) / 1000.0);
+        }
+    });
+
+    metadata.length = mpegDuration(data, size, tagSize);
+    if (metadata.length <= 0) {
+        metadata.length = taggedLength;
+    }
+    return tagSize > 0 || metadata.length > 0;
+}
+
+// Calls atom(type, body, size) for each atom in data
+static void forEachAtom(const unsigned char* data, size_t size,
+                        const std::function<void(const std::string&, const unsigned char*, size_t)>& atom)
+{
+    size_t pos = 0;
+    while (pos + 8 <= size) {
+        uint64_t atomSize = readBe32(data + pos);
+        size_t headerSize = 8;
+        if (atomSize == 1 && pos + 16 <= size) {
+            atomSize = readBe64(data + pos + 8);
+            headerSize = 16;
+        } else if (atomSize == 0) {
+            atomSize = size - pos; // to the end of the file
+        }
+        if (atomSize < headerSize || atomSize > size - pos) {
+            return;
+        }
+        atom(std::string((const char*)data + pos + 4, 4), data + pos + headerSize, (size_t)atomSize - headerSize);
+        pos += (size_t)atomSize;
+    }
+}
+
+// Payload of the data atom inside an ilst item
+static bool itemData(const unsigned char* item, size_t size, const unsigned char*& payload, size_t& payloadSize)
+{
+    bool found = false;
+    forEachAtom(item, size, [&](const std::string& type, const unsigned char* body, size_t bodySize) {
+        if (!found && type == "data" && bodySize >= 8) {
+            payload = body + 8; // type indicator and locale
+            payloadSize = bodySize - 8;
+            found = true;
+        }
+    });
+    return found;
+}
+
+static void readIlst(const unsigned char* ilst, size_t size, TrackMetadata& metadata)
+{
+    forEachAtom(ilst, size, [&](const std::string& type, const unsigned char* item, size_t itemSize) {
+        const unsigned char* payload;
+        size_t payloadSize;
+        if (!itemData(item, itemSize, payload, payloadSize)) {
+            return;
+        }
+        std::string text((const char*)payload, payloadSize);
+        if (type == "\xA9gen") {
+            metadata.genre = text;
+        } else if (type == "gnre" && payloadSize >= 2 && metadata.genre.empty()) {
+            int index = (int)readBe16(payload) - 1;
+            if (index >= 0 && index < GENRE_COUNT) metadata.genre = GENRES[index];
+        } else if (type == "tmpo" && payloadSize >= 1) {
+            metadata.bpm = (float)(payloadSize >= 2 ? readBe16(payload) : payload[0]);
+        } else if (type == "\xA9" "day") {
+            metadata.year = atoi(text.c_str());
+        } else if (type == "----") {
+            // Freeform item: the name says what it is
+            std::string name;
+            forEachAtom(item, itemSize, [&](const std::string& childType, const unsigned char* body, size_t bodySize) {
+                if (childType == "name" && bodySize > 4) name.assign((const char*)body + 4, bodySize - 4);
+            });
+            for (char& c : name) c = (char)tolower((unsigned char)c);
+            if (name == "initialkey" || name == "key") {
+                metadata.key = parseMusicalKey(text);
+            } else if (name == "bpm" && metadata.bpm == 0) {
+                metadata.bpm = (float)atof(text.c_str());
+            }
+        }
+    });
+}
+
+static bool readMp4Metadata(const unsigned char* data, size_t size, TrackMetadata& metadata)
+{
+    bool sawMoov = false;
+    forEachAtom(data, size, [&](const std::string& type, const unsigned char* moov, size_t moovSize) {
+        if (type != "moov") {
+            return;
+        }
+        sawMoov = true;
+        forEachAtom(moov, moovSize, [&](const std::string& childType, const unsigned char* body, size_t bodySize) {
+            if (childType == "mvhd" && bodySize >= 20) {
+                bool version1 = body[0] == 1;
+                uint32_t timescale = version1 ? (bodySize >= 32 ? readBe32(body + 20) : 0) : readBe32(body + 12);
+                uint64_t duration = version1 ? (bodySize >= 32 ? readBe64(body + 24) : 0) : readBe32(body + 16);
+                if (timescale) metadata.length = (float)((double)duration / timescale);
+            } else if (childType == "udta") {
+                forEachAtom(body, bodySize, [&](const std::string& udtaType, const unsigned char* meta, size_t metaSize) {
+                    if (udtaType != "meta" || metaSize < 12) {
+                        return;
+                    }
+                    // A full box (version and flags first), except in some QuickTime files
+                    if (memcmp(meta + 4, "hdlr", 4) != 0) {
+                        meta += 4;
+                        metaSize -= 4;
+                    }
+                    forEachAtom(meta, metaSize, [&](const std::string& metaType, const unsigned char* ilst, size_t ilstSize) {
+                        if (metaType == "ilst") readIlst(ilst, ilstSize, metadata);
+                    });
+                });
+            }
+        });
+    });
+    return sawMoov;
+}
+
+bool readTrackMetadata(const unsigned char* data, size_t size, TrackMetadata& metadata)
+{
+    if (size >= 12 && memcmp(data + 4, "ftyp", 4) == 0) {
+        return readMp4Metadata(data, size, metadata);
+    }
+    return readMp3Metadata(data, size, metadata);
+}
+
+// Picture data of an ID3v2 APIC (or v2.2 PIC) frame, and its picture type (3 = front cover)
+static bool apicPicture(const std::string& id, const unsigned char* body, size_t size, const unsigned char*& image, size_t& imageSize, int& pictureType)
+{
+    if (size < 4) {
+        return false;
+    }
+    unsigned char encoding = body[0];
+    size_t pos = 1;
+    if (id == "PIC") {
+        pos += 3; // image format, e.g. "JPG"
+    } else {
+        while (pos < size && body[pos]) pos++; // MIME type
+        pos++;
+    }
+    if (pos >= size) {
+        return false;
+    }
+    pictureType = body[pos++];
+
+    // Description, terminated by one zero byte, or two for UTF-16
+    if (encoding == 1 || encoding == 2) {
+        while (pos + 1 < size && (body[pos] || body[pos + 1])) pos += 2;
+        pos += 2;
+    } else {
+        while (pos < size && body[pos]) pos++;
+        pos++;
+    }
+    if (pos >= size) {
+        return false;
+    }
+    image = body + pos;
+    imageSize = size - pos;
+    return true;
+}
+
+bool findEmbeddedCover(const unsigned char* data, size_t size, const unsigned char*& image, size_t& imageSize)
+{
+    bool found = false;
+    if (size >= 12 && memcmp(data + 4, "ftyp", 4) == 0) {
+        // moov/udta/meta/ilst/covr/data
+        forEachAtom(data, size, [&](const std::string& type, const unsigned char* moov, size_t moovSize) {
+            if (type != "moov") return;
+            forEachAtom(moov, moovSize, [&](const std::string& childType, const unsigned char* udta, size_t udtaSize) {
+                if (childType != "udta") return;
+                forEachAtom(udta, udtaSize, [&](const std::string& udtaType, const unsigned char* meta, size_t metaSize) {
+                    if (udtaType != "meta" || metaSize < 12) return;
+                    if (memcmp(meta + 4, "hdlr", 4) != 0) {
+                        meta += 4;
+                        metaSize -= 4;
+                    }
+                    forEachAtom(meta, metaSize, [&](const std::string& metaType, const unsigned char* ilst, size_t ilstSize) {
+                        if (metaType != "ilst") return;
+                        forEachAtom(ilst, ilstSize, [&](const std::string& itemType, const unsigned char* item, size_t itemSize) {
+                            if (!found && itemType == "covr" && itemData(item, itemSize, image, imageSize) && imageSize > 0) {
+                                found = true;
+                            }
+                        });
+                    });
+                });
+            });
+        });
+        return found;
+    }
+
+    forEachId3Frame(data, size, [&](const std::string& id, const unsigned char* body, size_t bodySize) {
+        const unsigned char* picture;
+        size_t pictureSize;
+        int pictureType;
+        if ((id != "APIC" && id != "PIC") || !apicPicture(id, body, bodySize, picture, pictureSize, pictureType)) {
+            return;
+        }
+        // The first picture, unless a front cover comes later
+        if (!found || pictureType == 3) {
+            image = picture;
+            imageSize = pictureSize;
+            found = true;
+        }
+    });
+    return found;
+}
+
+int parseMusicalKey(const std::string& text)
+{
+    // Semitones above A of the minor keys 1A..12A; the major key of the same number is 3 above
+    static const int CAMELOT_MINOR[12] = {11, 6, 1, 8, 3, 10, 5, 0, 7, 2, 9, 4};
+    static const int NOTES[7] = {0, 2, 3, 5, 7, 8, 10}; // A B C D E F G
+
+    std::string key;
+    for (char c : text) {
+        if (c != ' ') key += (char)tolower((unsigned char)c);
+    }
+    if (key.empty()) {
+        return 0;
+    }
+
+    if (isdigit((unsigned char)key[0])) {
+        int number = atoi(key.c_str());
+        char letter = key.back();
+        if (number < 1 || number > 12 || (letter != 'a' && letter != 'b')) {
+            return 0;
+        }
+        int semitone = CAMELOT_MINOR[number - 1];
+        return letter == 'a' ? 1 + semitone : 13 + (semitone + 3) % 12;
+    }
+
+    if (key[0] < 'a' || key[0] > 'g') {
+        return 0;
+    }
+    int semitone = NOTES[key[0] - 'a'];
+    size_t pos = 1;
+    if (key.compare(pos, 1, "#") == 0) {
+        semitone++;
+        pos += 1;
+    } else if (key.compare(pos, 3, "\xE2\x99\xAF") == 0) { // sharp sign
+        semitone++;
+        pos += 3;
+    } else if (key.compare(pos, 3, "\xE2\x99\xAD") == 0) { // flat sign
+        semitone--;
+        pos += 3;
+    } else if (key.compare(pos, 1, "b") == 0) {
+        semitone--;
+        pos += 1;
+    }
+    semitone = (semitone + 12) % 12;
+
+    std::string mode = key.substr(pos);
+    bool minor = !mode.empty() && mode[0] == 'm' && mode.compare(0, 3, "maj") != 0;
+    if (!minor && !mode.empty() && mode.compare(0, 3, "maj") != 0) {
+        return 0;
+    }
+    return minor ? 1 + semitone : 13 + semitone;
+}
@@ -0,0 +1,28 @@
+#ifndef VDJ_TAGREADER_H
+#define VDJ_TAGREADER_H
+
+#include <string>
+#include <cstddef>
+
+// What VirtualDJ's browser shows for a track, as far as the file itself says
+struct TrackMetadata {
+    float length = 0; // seconds
+    float bpm = 0;
+    int key = 0;      // as IVdjTracksList::add takes it: 1=Am ... 12=G#m, 13=A ... 24=G#
+    int year = 0;
+    std::string genre;
+};
+
+// Read duration, BPM, key, year and genre from an MP3 (ID3v2 tag and MPEG frame headers) or
+// MP4/M4A (moov atoms) file without decoding any audio. False if the format isn't recognized;
+// fields the file doesn't carry stay 0.
+bool readTrackMetadata(const unsigned char* data, size_t size, TrackMetadata& metadata);
+
+// Where the embedded cover art (ID3v2 APIC or MP4 covr, the front cover if there are several)
+// is inside data. False if the file has none.
+bool findEmbeddedCover(const unsigned char* data, size_t size, const unsigned char*& image, size_t& imageSize);
+
+// Key number of "Am", "F#m", "Dbmaj", "C minor" or Camelot "8A"; 0 if it doesn't parse
+int parseMusicalKey(const std::string& text);
+
+#endif // VDJ_TAGREADER_H
@@ -0,0 +1,393 @@
+#include "thumbnailCache.h"
+#include "thumbnailer.h"
+#include "tagReader.h"
+#include "mappedFile.h"
+#include "settings.h"
+#include "tracing.h"
+#include "metrics.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Defaults, the pack size overridable with .camp_thumbnail_cache_mb
+static const int DEFAULT_PACK_MB = 32;
+static const int THUMBNAIL_PIXELS = 200;             // longer side, a little over the browser's largest cover
+static const size_t MAX_MEMORY_BYTES = 4 * 1024 * 1024; // thumbnails kept in memory for serving
+static const size_t MAX_QUEUE = 256;
+
+static const char PACK_MAGIC[8] = {'A', 'M', 'P', 'T', 'H', 'M', 'B', '1'};
+static const size_t RECORD_HEADER_SIZE = 13; // key (8), type (1), length (4), little endian
+
+enum ThumbnailType : uint8_t {
+    NoArtwork = 0,
+    Jpeg = 1,
+    Png = 2,
+};
+
+static const char* contentTypeOf(uint8_t type)
+{
+    return type == Png ? "image/png" : "image/jpeg";
+}
+
+static void writeRecordHeader(unsigned char* header, uint64_t key, uint8_t type, uint32_t length)
+{
+    for (int i = 0; i < 8; i++) header[i] = (unsigned char)(key >> (8 * i));
+    header[8] = type;
+    for (int i = 0; i < 4; i++) header[9 + i] = (unsigned char)(length >> (8 * i));
+}
+
+static MetricGauge& packBytesGauge()
+{
+    static MetricGauge& gauge = getGauge("amp_thumbnail_pack_bytes", "Size of the cover thumbnail pack file");
+    return gauge;
+}
+
+ThumbnailCache::ThumbnailCache()
+{
+}
+
+ThumbnailCache::~ThumbnailCache()
+{
+    stop();
+    if (pack) {
+        fclose(pack);
+    }
+}
+
+void ThumbnailCache::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        worker.requestStop();
+    }
+    queued.notify_all();
+    worker.stop();
+}
+
+void ThumbnailCache::configure(const std::string& path, ImageFetcher imageFetcher)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (pack) {
+        return;
+    }
+    int packMb = readIntSetting(".camp_thumbnail_cache_mb", DEFAULT_PACK_MB, 0, 1024);
+    if (packMb == 0 || path.empty()) {
+        logDebug("ThumbnailCache: Disabled");
+        return;
+    }
+
+    packPath = path;
+    maxPackBytes = (uint64_t)packMb * 1024 * 1024;
+    fetcher = imageFetcher;
+    if (!loadPackLocked()) {
+        return;
+    }
+    getLocalServer().addRoute("/cover/", [this](const LocalServer::Request& request, LocalServer::Connection& connection) {
+        serve(request, connection);
+    });
+}
+
+// Index the records of the pack, creating it if needed
+bool ThumbnailCache::loadPackLocked()
+{
+    pack = fopen(packPath.c_str(), "r+b");
+    char magic[sizeof(PACK_MAGIC)];
+    if (!pack || fread(magic, 1, sizeof(magic), pack) != sizeof(magic) || memcmp(magic, PACK_MAGIC, sizeof(magic)) != 0) {
+        if (pack) fclose(pack);
+        pack = fopen(packPath.c_str(), "w+b");
+        if (!pack || fwrite(PACK_MAGIC, 1, sizeof(PACK_MAGIC), pack) != sizeof(PACK_MAGIC)) {
+            logDebug("ThumbnailCache: Could not create " + packPath);
+            if (pack) fclose(pack);
+            pack = nullptr;
+            return false;
+        }
+        fflush(pack);
+        packSize = sizeof(PACK_MAGIC);
+        packBytesGauge().set((int64_t)packSize);
+        return true;
+    }
+
+    fseek(pack, 0, SEEK_END);
+    uint64_t fileSize = (uint64_t)ftell(pack);
+    uint64_t offset = sizeof(PACK_MAGIC);
+    fseek(pack, (long)offset, SEEK_SET);
+    unsigned char header[RECORD_HEADER_SIZE];
+    while (offset + RECORD_HEADER_SIZE <= fileSize && fread(header, 1, sizeof(header), pack) == sizeof(header)) {
+        uint64_t key = 0;
+        uint32_t length = 0;
+        for (int i = 0; i < 8; i++) key |= (uint64_t)header[i] << (8 * i);
+        for (int i = 0; i < 4; i++) length |= (uint32_t)header[9 + i] << (8 * i);
+        if (offset + RECORD_HEADER_SIZE + length > fileSize) {
+            break;
+        }
+        // Later records replace earlier ones, and count as more recently used
+        records[key] = {offset + RECORD_HEADER_SIZE, length, header[8], ++clock};
+        offset += RECORD_HEADER_SIZE + length;
+        fseek(pack, (long)offset, SEEK_SET);
+    }
+    packSize = offset;
+    logDebug("ThumbnailCache: " + std::to_string(records.size()) + " thumbnails in " + packPath);
+    if (packSize < fileSize) {
+        // Cut short while appending; rewrite without the partial record
+        compactLocked();
+    }
+    packBytesGauge().set((int64_t)packSize);
+    return pack != nullptr;
+}
+
+void ThumbnailCache::appendLocked(uint64_t key, const std::string& data, uint8_t type)
+{
+    if (!pack) {
+        return;
+    }
+    if (packSize + RECORD_HEADER_SIZE + data.size() > maxPackBytes) {
+        compactLocked();
+        if (!pack) return;
+    }
+
+    unsigned char header[RECORD_HEADER_SIZE];
+    writeRecordHeader(header, key, type, (uint32_t)data.size());
+    fseek(pack, (long)packSize, SEEK_SET);
+    if (fwrite(header, 1, sizeof(header), pack) != sizeof(header) ||
+        fwrite(data.data(), 1, data.size(), pack) != data.size() || fflush(pack) != 0) {
+        logDebug("ThumbnailCache: Could not append to " + packPath);
+        return;
+    }
+    records[key] = {packSize + RECORD_HEADER_SIZE, (uint32_t)data.size(), type, ++clock};
+    packSize += RECORD_HEADER_SIZE + data.size();
+    packBytesGauge().set((int64_t)packSize);
+}
+
+// Rewrite the pack with the most recently used half of its budget, dropping replaced records
+void ThumbnailCache::compactLocked()
+{
+    TRACE_SPAN("thumbnails.compact");
+    std::vector<std::pair<uint64_t, Record>> byUse(records.begin(), records.end());
+    std::sort(byUse.begin(), byUse.end(), [](const std::pair<uint64_t, Record>& a, const std::pair<uint64_t, Record>& b) {
+        return a.second.lastUsed > b.second.lastUsed;
+    });
+
+    std::string tempPath = packPath + ".tmp";
+    FILE* compacted = fopen(tempPath.c_str(), "wb");
+    if (!compacted) {
+        logDebug("ThumbnailCache: Could not create " + tempPath);
+        return;
+    }
+    fwrite(PACK_MAGIC, 1, sizeof(PACK_MAGIC), compacted);
+
+    std::unordered_map<uint64_t, Record> kept;
+    uint64_t size = sizeof(PACK_MAGIC);
+    std::string data;
+    for (const auto& item : byUse) {
+        const Record& record = item.second;
+        if (size + RECORD_HEADER_SIZE + record.length > maxPackBytes / 2) {
+            break;
+        }
+        data.resize(record.length);
+        fseek(pack, (long)record.offset, SEEK_SET);
+        if (record.length && fread(&data[0], 1, record.length, pack) != record.length) {
+            continue;
+        }
+        unsigned char header[RECORD_HEADER_SIZE];
+        writeRecordHeader(header, item.first, record.type, record.length);
+        fwrite(header, 1, sizeof(header), compacted);
+        fwrite(data.data(), 1, data.size(), compacted);
+        kept[item.first] = {size + RECORD_HEADER_SIZE, record.length, record.type, record.lastUsed};
+        size += RECORD_HEADER_SIZE + record.length;
+    }
+
+    bool written = fclose(compacted) == 0;
+    fclose(pack);
+    pack = nullptr;
+#ifdef VDJ_WIN
+    if (written) remove(packPath.c_str());
+#endif
+    if (written && rename(tempPath.c_str(), packPath.c_str()) == 0) {
+        logDebug("ThumbnailCache: Compacted " + std::to_string(records.size()) + " thumbnails to " + std::to_string(kept.size()));
+        records.swap(kept);
+        packSize = size;
+    } else {
+        logDebug("ThumbnailCache: Could not replace " + packPath);
+        remove(tempPath.c_str());
+    }
+    pack = fopen(packPath.c_str(), "r+b");
+    if (!pack) {
+        records.clear();
+    }
+    packBytesGauge().set((int64_t)packSize);
+}
+
+bool ThumbnailCache::readLocked(uint64_t key, std::string& data, std::string& contentType)
+{
+    auto it = records.find(key);
+    if (!pack || it == records.end() || it->second.length == 0) {
+        return false;
+    }
+    data.resize(it->second.length);
+    fseek(pack, (long)it->second.offset, SEEK_SET);
+    if (fread(&data[0], 1, data.size(), pack) != data.size()) {
+        return false;
+    }
+    contentType = contentTypeOf(it->second.type);
+    return true;
+}
+
+void ThumbnailCache::rememberLocked(uint64_t key, const std::string& data, const std::string& contentType)
+{
+    memoryOrder.push_back(key);
+    Thumbnail& thumbnail = memory[key];
+    thumbnail.data = data;
+    thumbnail.contentType = contentType;
+    thumbnail.position = std::prev(memoryOrder.end());
+    memoryBytes += data.size();
+
+    while (memoryBytes > MAX_MEMORY_BYTES && memoryOrder.size() > 1) {
+        auto oldest = memory.find(memoryOrder.front());
+        memoryBytes -= oldest->second.data.size();
+        memory.erase(oldest);
+        memoryOrder.pop_front();
+    }
+}
+
+std::string ThumbnailCache::getCoverUrl(const std::string& trackId)
+{
+    uint64_t key = hashString(trackId);
+    uint8_t type;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = records.find(key);
+        if (it == records.end() || it->second.length == 0) {
+            return "";
+        }
+        it->second.lastUsed = ++clock;
+        type = it->second.type;
+    }
+    if (!getLocalServer().start()) {
+        return "";
+    }
+
+    char keyHex[17];
+    snprintf(keyHex, sizeof(keyHex), "%016llx", (unsigned long long)key);
+    return getLocalServer().getBaseUrl() + "/cover/" + keyHex + (type == Png ? ".png" : ".jpg");
+}
+
+void ThumbnailCache::requestFromFile(const std::string& trackId, const std::string& filePath)
+{
+    request({hashString(trackId), filePath, ""});
+}
+
+void ThumbnailCache::requestFromUrl(const std::string& trackId, const std::string& imageUrl)
+{
+    request({hashString(trackId), "", imageUrl});
+}
+
+void ThumbnailCache::request(const Job& job)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!pack || records.count(job.key) || !tried.insert(job.key).second) {
+        return;
+    }
+    queue.push_back(job);
+    if (queue.size() > MAX_QUEUE) {
+        // Scrolled past long ago; it can be asked for again
+        tried.erase(queue.front().key);
+        queue.pop_front();
+    }
+    if (!workerStarted) {
+        workerStarted = worker.start([this]() { workLoop(); });
+    }
+    queued.notify_one();
+}
+
+void ThumbnailCache::workLoop()
+{
+    static MetricCounter& embedded = getCounter("amp_thumbnails_made_total{source=\"embedded\"}", "Cover thumbnails made, by where the artwork came from");
+    static MetricCounter& server = getCounter("amp_thumbnails_made_total{source=\"server\"}", "Cover thumbnails made, by where the artwork came from");
+    static MetricCounter& missing = getCounter("amp_thumbnails_missing_total", "Tracks whose artwork was missing or couldn't be read");
+
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            queued.wait(lock, [this]() { return !queue.empty() || worker.stopping(); });
+            if (worker.stopping()) {
+                return;
+            }
+            job = queue.front();
+            queue.pop_front();
+        }
+
+        TRACE_SPAN("thumbnails.make");
+        std::string thumbnail;
+        std::string contentType;
+        bool made = false;
+        bool noArtwork = false;
+        if (!job.filePath.empty()) {
+            MappedFile file;
+            const unsigned char* image;
+            size_t imageSize;
+            if (file.open(job.filePath)) {
+                if (findEmbeddedCover(file.data(), file.size(), image, imageSize)) {
+                    made = makeThumbnail(image, imageSize, THUMBNAIL_PIXELS, thumbnail, contentType);
+                }
+                // Remembered in the pack, so the file isn't read again in later sessions
+                noArtwork = !made;
+            }
+        } else {
+            std::string image;
+            if (fetcher && fetcher(job.imageUrl, image)) {
+                made = makeThumbnail((const unsigned char*)image.data(), image.size(), THUMBNAIL_PIXELS, thumbnail, contentType);
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (made) {
+            appendLocked(job.key, thumbnail, contentType == "image/png" ? Png : Jpeg);
+            (job.filePath.empty() ? server : embedded).add();
+        } else {
+            if (noArtwork) {
+                appendLocked(job.key, "", NoArtwork);
+            }
+            missing.add();
+        }
+    }
+}
+
+void ThumbnailCache::serve(const LocalServer::Request& request, LocalServer::Connection& connection)
+{
+    static MetricCounter& fromMemory = getCounter("amp_thumbnail_requests_total{from=\"memory\"}", "Cover thumbnails served, by where they were read from");
+    static MetricCounter& fromPack = getCounter("amp_thumbnail_requests_total{from=\"pack\"}", "Cover thumbnails served, by where they were read from");
+
+    uint64_t key = strtoull(request.path.substr(7, 16).c_str(), nullptr, 16); // after "/cover/"
+    std::string data;
+    std::string contentType;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = memory.find(key);
+        if (it != memory.end()) {
+            memoryOrder.splice(memoryOrder.end(), memoryOrder, it->second.position);
+            data = it->second.data;
+            contentType = it->second.contentType;
+            found = true;
+            fromMemory.add();
+        } else if (readLocked(key, data, contentType)) {
+            rememberLocked(key, data, contentType);
+            found = true;
+            fromPack.add();
+        }
+    }
+
+    if (!found) {
+        connection.send("HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+        return;
+    }
+    connection.send("HTTP/1.1 200 OK\r\nContent-Type: " + contentType + "\r\nContent-Length: " + std::to_string(data.size()) +
+                    "\r\nCache-Control: max-age=86400\r\nConnection: close\r\n\r\n");
+    if (request.method != "HEAD") {
+        connection.send(data);
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef VDJ_THUMBNAILCACHE_H
+#define VDJ_THUMBNAILCACHE_H
+
+#include "localServer.h"
+#include "backgroundTasks.h"
+#include <string>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <cstdio>
+#include <cstdint>
+
+// Cover art for the browser, downscaled once to thumbnails: from the artwork embedded in cached
+// files, or from the backend's cover URL for tracks that aren't cached. Thumbnails are appended
+// to one pack file (.thumbnails in the cache folder, .camp_thumbnail_cache_mb, 32 by default,
+// 0 turns covers off), and the ones being shown are kept in memory. The local server serves
+// them, so listings can hand VirtualDJ a cover URL that costs no decoding or network fetch.
+class ThumbnailCache
+{
+public:
+    // GET an image; false if it couldn't be fetched
+    using ImageFetcher = std::function<bool(const std::string& url, std::string& image)>;
+
+    ThumbnailCache();
+    ~ThumbnailCache();
+
+    void configure(const std::string& packPath, ImageFetcher fetcher);
+
+    // Cover URL of a track (by uniqueId), or empty if it has no thumbnail (yet)
+    std::string getCoverUrl(const std::string& trackId);
+    // Make a track's thumbnail in the background, from the cover embedded in its cached file
+    // or from an image URL. Tracks tried before are skipped.
+    void requestFromFile(const std::string& trackId, const std::string& filePath);
+    void requestFromUrl(const std::string& trackId, const std::string& imageUrl);
+    // Stop making thumbnails and wait for the one in progress. Its route on the local server
+    // must be gone first (LocalServer::stop), as serving reads the pack.
+    void stop();
+
+private:
+    struct Job {
+        uint64_t key;
+        std::string filePath;
+        std::string imageUrl;
+    };
+    // A thumbnail in the pack; length 0 records a cached file without artwork
+    struct Record {
+        uint64_t offset;
+        uint32_t length;
+        uint8_t type;
+        uint64_t lastUsed;
+    };
+    struct Thumbnail {
+        std::string data;
+        std::string contentType;
+        std::list<uint64_t>::iterator position; // in memoryOrder
+    };
+
+    void request(const Job& job);
+    void workLoop();
+    bool loadPackLocked();
+    void appendLocked(uint64_t key, const std::string& data, uint8_t type);
+    void compactLocked();
+    bool readLocked(uint64_t key, std::string& data, std::string& contentType);
+    void rememberLocked(uint64_t key, const std::string& data, const std::string& contentType);
+    // GET /cover/<key>
+    void serve(const LocalServer::Request& request, LocalServer::Connection& connection);
+
+    std::mutex mutex;
+    std::string packPath;
+    FILE* pack = nullptr;
+    uint64_t packSize = 0;
+    uint64_t maxPackBytes = 0;
+    ImageFetcher fetcher;
+    std::unordered_map<uint64_t, Record> records;
+    uint64_t clock = 0;
+
+    // Thumbnails recently served, least recently used first
+    std::unordered_map<uint64_t, Thumbnail> memory;
+    std::list<uint64_t> memoryOrder;
+    size_t memoryBytes = 0;
+
+    std::unordered_set<uint64_t> tried; // queued or attempted this session
+    std::deque<Job> queue;
+    std::condition_variable queued;
+    bool workerStarted = false;
+    BackgroundTasks worker; // last, so it is joined before the rest goes away
+};
+
+#endif // VDJ_THUMBNAILCACHE_H
@@ -0,0 +1,201 @@
+#include "thumbnailer.h"
+#include "../vdjPlugin8.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(VDJ_MAC) && defined(__has_include)
+#if __has_include(<ImageIO/ImageIO.h>)
+#include <ImageIO/ImageIO.h>
+#define AMP_THUMBNAILS_IMAGEIO
+#endif
+#elif defined(VDJ_WIN)
+#include <windows.h>
+#include <wincodec.h>
+#pragma comment(lib, "windowscodecs.lib")
+#pragma comment(lib, "ole32.lib")
+#endif
+
+#if defined(AMP_THUMBNAILS_IMAGEIO) || defined(VDJ_WIN)
+static const float JPEG_QUALITY = 0.8f;
+#else
+static const size_t MAX_UNSCALED_BYTES = 256 * 1024;
+#endif
+
+static const char* sniffImageType(const unsigned char* image, size_t size)
+{
+    if (size >= 3 && image[0] == 0xFF && image[1] == 0xD8 && image[2] == 0xFF) {
+        return "image/jpeg";
+    }
+    if (size >= 8 && memcmp(image, "\x89PNG\r\n\x1A\n", 8) == 0) {
+        return "image/png";
+    }
+    return nullptr;
+}
+
+#ifdef AMP_THUMBNAILS_IMAGEIO
+static bool scaleImage(const unsigned char* image, size_t size, int maxPixels, std::string& jpeg)
+{
+    CFDataRef input = CFDataCreate(kCFAllocatorDefault, image, (CFIndex)size);
+    if (!input) {
+        return false;
+    }
+    CGImageSourceRef source = CGImageSourceCreateWithData(input, NULL);
+    CFRelease(input);
+    if (!source) {
+        return false;
+    }
+
+    CFNumberRef maxSize = CFNumberCreate(kCFAllocatorDefault, kCFNumberIntType, &maxPixels);
+    const void* keys[] = {kCGImageSourceCreateThumbnailFromImageAlways, kCGImageSourceThumbnailMaxPixelSize, kCGImageSourceCreateThumbnailWithTransform};
+    const void* values[] = {kCFBooleanTrue, maxSize, kCFBooleanTrue};
+    CFDictionaryRef options = CFDictionaryCreate(kCFAllocatorDefault, keys, values, 3, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+    CGImageRef scaled = CGImageSourceCreateThumbnailAtIndex(source, 0, options);
+    CFRelease(options);
+    CFRelease(maxSize);
+    CFRelease(source);
+    if (!scaled) {
+        return false;
+    }
+
+    bool written = false;
+    CFMutableDataRef output = CFDataCreateMutable(kCFAllocatorDefault, 0);
+    CGImageDestinationRef destination = output ? CGImageDestinationCreateWithData(output, CFSTR("public.jpeg"), 1, NULL) : NULL;
+    if (destination) {
+        float quality = JPEG_QUALITY;
+        CFNumberRef qualityNumber = CFNumberCreate(kCFAllocatorDefault, kCFNumberFloatType, &quality);
+        const void* propertyKeys[] = {kCGImageDestinationLossyCompressionQuality};
+        const void* propertyValues[] = {qualityNumber};
+        CFDictionaryRef properties = CFDictionaryCreate(kCFAllocatorDefault, propertyKeys, propertyValues, 1, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        CGImageDestinationAddImage(destination, scaled, properties);
+        written = CGImageDestinationFinalize(destination);
+        CFRelease(properties);
+        CFRelease(qualityNumber);
+        CFRelease(destination);
+    }
+    if (written) {
+        jpeg.assign((const char*)CFDataGetBytePtr(output), (size_t)CFDataGetLength(output));
+    }
+    if (output) CFRelease(output);
+    CGImageRelease(scaled);
+    return written;
+}
+#elif defined(VDJ_WIN)
+template <typename T>
+static void releaseCom(T*& object)
+{
+    if (object) {
+        object->Release();
+        object = NULL;
+    }
+}
+
+static bool scaleImage(const unsigned char* image, size_t size, int maxPixels, std::string& jpeg)
+{
+    HRESULT init = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+
+    IWICImagingFactory* factory = NULL;
+    IWICStream* input = NULL;
+    IWICBitmapDecoder* decoder = NULL;
+    IWICBitmapFrameDecode* frame = NULL;
+    IWICBitmapScaler* scaler = NULL;
+    IWICFormatConverter* converter = NULL;
+    IStream* output = NULL;
+    IWICBitmapEncoder* encoder = NULL;
+    IWICBitmapFrameEncode* target = NULL;
+    IPropertyBag2* frameOptions = NULL;
+    UINT width = 0;
+    UINT height = 0;
+
+    bool ok = SUCCEEDED(CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER, IID_PPV_ARGS(&factory))) &&
+              SUCCEEDED(factory->CreateStream(&input)) &&
+              SUCCEEDED(input->InitializeFromMemory((BYTE*)image, (DWORD)size)) &&
+              SUCCEEDED(factory->CreateDecoderFromStream(input, NULL, WICDecodeMetadataCacheOnDemand, &decoder)) &&
+              SUCCEEDED(decoder->GetFrame(0, &frame)) &&
+              SUCCEEDED(frame->GetSize(&width, &height)) && width > 0 && height > 0;
+
+    if (ok) {
+        double scale = std::min(1.0, (double)maxPixels / std::max(width, height));
+        UINT scaledWidth = std::max<UINT>(1, (UINT)(width * scale + 0.5));
+        UINT scaledHeight = std::max<UINT>(1, (UINT)(height * scale + 0.5));
+        WICPixelFormatGUID pixelFormat = GUID_WICPixelFormat24bppBGR;
+        ok = SUCCEEDED(factory->CreateBitmapScaler(&scaler)) &&
+             SUCCEEDED(scaler->Initialize(frame, scaledWidth, scaledHeight, WICBitmapInterpolationModeFant)) &&
+             // The JPEG encoder takes 24 bit BGR; PNG covers often come with alpha
+             SUCCEEDED(factory->CreateFormatConverter(&converter)) &&
+             SUCCEEDED(converter->Initialize(scaler, GUID_WICPixelFormat24bppBGR, WICBitmapDitherTypeNone, NULL, 0.0, WICBitmapPaletteTypeCustom)) &&
+             SUCCEEDED(CreateStreamOnHGlobal(NULL, TRUE, &output)) &&
+             SUCCEEDED(factory->CreateEncoder(GUID_ContainerFormatJpeg, NULL, &encoder)) &&
+             SUCCEEDED(encoder->Initialize(output, WICBitmapEncoderNoCache)) &&
+             SUCCEEDED(encoder->CreateNewFrame(&target, &frameOptions));
+        if (ok && frameOptions) {
+            PROPBAG2 option = {};
+            option.pstrName = (LPOLESTR)L"ImageQuality";
+            VARIANT value;
+            VariantInit(&value);
+            value.vt = VT_R4;
+            value.fltVal = JPEG_QUALITY;
+            frameOptions->Write(1, &option, &value);
+        }
+        ok = ok && SUCCEEDED(target->Initialize(frameOptions)) &&
+             SUCCEEDED(target->SetSize(scaledWidth, scaledHeight)) &&
+             SUCCEEDED(target->SetPixelFormat(&pixelFormat)) &&
+             SUCCEEDED(target->WriteSource(converter, NULL)) &&
+             SUCCEEDED(target->Commit()) &&
+             SUCCEEDED(encoder->Commit());
+    }
+
+    if (ok) {
+        STATSTG stat;
+        HGLOBAL global = NULL;
+        ok = SUCCEEDED(output->Stat(&stat, STATFLAG_NONAME)) && SUCCEEDED(GetHGlobalFromStream(output, &global));
+        const char* bytes = ok ? (const char*)GlobalLock(global) : NULL;
+        if (bytes) {
+            jpeg.assign(bytes, (size_t)stat.cbSize.QuadPart);
+            GlobalUnlock(global);
+        } else {
+            ok = false;
+        }
+    }
+
+    releaseCom(frameOptions);
+    releaseCom(target);
+    releaseCom(encoder);
+    releaseCom(output);
+    releaseCom(converter);
+    releaseCom(scaler);
+    releaseCom(frame);
+    releaseCom(decoder);
+    releaseCom(input);
+    releaseCom(factory);
+    if (SUCCEEDED(init)) {
+        CoUninitialize();
+    }
+    return ok;
+}
+#endif
+
+bool makeThumbnail(const unsigned char* image, size_t size, int maxPixels, std::string& thumbnail, std::string& contentType)
+{
+    const char* type = sniffImageType(image, size);
+    if (!type) {
+        return false;
+    }
+
+#if defined(AMP_THUMBNAILS_IMAGEIO) || defined(VDJ_WIN)
+    if (scaleImage(image, size, maxPixels, thumbnail)) {
+        contentType = "image/jpeg";
+        return true;
+    }
+    logDebug("makeThumbnail: Could not scale a " + std::string(type) + " of " + std::to_string(size) + " bytes");
+    return false;
+#else
+    (void)maxPixels;
+    if (size > MAX_UNSCALED_BYTES) {
+        return false;
+    }
+    thumbnail.assign((const char*)image, size);
+    contentType = type;
+    return true;
+#endif
+}
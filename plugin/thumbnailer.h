@@ -0,0 +1,12 @@
+#ifndef VDJ_THUMBNAILER_H
+#define VDJ_THUMBNAILER_H
+
+#include <string>
+#include <cstddef>
+
+// Downscale a JPEG or PNG image so its longer side is at most maxPixels, re-encoded as JPEG
+// (ImageIO on macOS, WIC on Windows). Where neither is available, an image that is small
+// enough already is kept as it is. contentType is the MIME type of thumbnail.
+bool makeThumbnail(const unsigned char* image, size_t size, int maxPixels, std::string& thumbnail, std::string& contentType);
+
+#endif // VDJ_THUMBNAILER_H
@@ -0,0 +1,189 @@
+#include "../vdjPlugin8.h"
+#include "tracing.h"
+#include "settings.h"
+#include "utilities.h"
+#include "backgroundTasks.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace {
+
+const int kMaxHistograms = 128;
+std::atomic<LatencyHistogram*> histograms[kMaxHistograms];
+std::atomic<int> histogramCount{0};
+std::mutex registryMutex;
+
+// Ring of the most recent spans for the Chrome trace. Slots are overwritten in place;
+// a slot read while it is being rewritten just shows a mix of two spans.
+struct TraceEvent {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> startNs{0};
+    std::atomic<uint64_t> durationNs{0};
+    std::atomic<uint32_t> threadId{0};
+};
+const uint64_t kTraceEvents = 16384;
+TraceEvent traceEvents[kTraceEvents];
+std::atomic<uint64_t> nextTraceEvent{0};
+std::atomic<bool> traceEventsEnabled{false};
+
+uint32_t currentThreadId()
+{
+    thread_local uint32_t threadId = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+    return threadId;
+}
+
+std::string formatChromeTrace()
+{
+    std::string json = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    uint64_t end = nextTraceEvent.load(std::memory_order_acquire);
+    uint64_t begin = end > kTraceEvents ? end - kTraceEvents : 0;
+    bool first = true;
+    char line[256];
+    for (uint64_t i = begin; i < end; i++) {
+        const TraceEvent& event = traceEvents[i % kTraceEvents];
+        const char* name = event.name.load(std::memory_order_relaxed);
+        if (!name) continue;
+        snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                 first ? "" : ",\n", name, event.threadId.load(std::memory_order_relaxed),
+                 event.startNs.load(std::memory_order_relaxed) / 1000.0, event.durationNs.load(std::memory_order_relaxed) / 1000.0);
+        json += line;
+        first = false;
+    }
+    json += "]}\n";
+    return json;
+}
+
+} // namespace
+
+std::string formatSpanHistograms()
+{
+    std::string text = "# HELP amp_span_duration_seconds Duration of plugin callbacks and their stages\n"
+                       "# TYPE amp_span_duration_seconds histogram\n";
+    char line[256];
+    int count = histogramCount.load(std::memory_order_acquire);
+    for (int i = 0; i < count; i++) {
+        const LatencyHistogram* histogram = histograms[i].load(std::memory_order_acquire);
+        uint64_t cumulative = 0;
+        for (int bucket = 0; bucket < LatencyHistogram::kBuckets - 1; bucket++) {
+            cumulative += histogram->getBucket(bucket);
+            snprintf(line, sizeof(line), "amp_span_duration_seconds_bucket{span=\"%s\",le=\"%g\"} %llu\n",
+                     histogram->getName(), (double)(1ull << bucket) * 1e-6, (unsigned long long)cumulative);
+            text += line;
+        }
+        cumulative += histogram->getBucket(LatencyHistogram::kBuckets - 1);
+        snprintf(line, sizeof(line), "amp_span_duration_seconds_bucket{span=\"%s\",le=\"+Inf\"} %llu\n"
+                                     "amp_span_duration_seconds_sum{span=\"%s\"} %.9f\n"
+                                     "amp_span_duration_seconds_count{span=\"%s\"} %llu\n",
+                 histogram->getName(), (unsigned long long)cumulative, histogram->getName(), histogram->getSumNs() * 1e-9,
+                 histogram->getName(), (unsigned long long)histogram->getCount());
+        text += line;
+    }
+    return text;
+}
+
+uint64_t traceNowNs()
+{
+    return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+LatencyHistogram::LatencyHistogram(const char* name) : name(name)
+{
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::record(uint64_t durationNs)
+{
+    uint64_t micros = durationNs / 1000;
+    int bucket = 0;
+    while (micros && bucket < kBuckets - 1) {
+        micros >>= 1;
+        bucket++;
+    }
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sumNs.fetch_add(durationNs, std::memory_order_relaxed);
+}
+
+LatencyHistogram& getSpanHistogram(const char* name)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    int count = histogramCount.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        LatencyHistogram* histogram = histograms[i].load(std::memory_order_relaxed);
+        if (strcmp(histogram->getName(), name) == 0) {
+            return *histogram;
+        }
+    }
+
+    // Histograms live as long as the process; past the limit they are recorded but not dumped
+    LatencyHistogram* histogram = new LatencyHistogram(name);
+    if (count < kMaxHistograms) {
+        histograms[count].store(histogram, std::memory_order_release);
+        histogramCount.store(count + 1, std::memory_order_release);
+    }
+    return *histogram;
+}
+
+void recordSpan(LatencyHistogram& histogram, uint64_t startNs, uint64_t durationNs)
+{
+    histogram.record(durationNs);
+
+    if (traceEventsEnabled.load(std::memory_order_relaxed)) {
+        TraceEvent& event = traceEvents[nextTraceEvent.fetch_add(1, std::memory_order_acq_rel) % kTraceEvents];
+        event.startNs.store(startNs, std::memory_order_relaxed);
+        event.durationNs.store(durationNs, std::memory_order_relaxed);
+        event.threadId.store(currentThreadId(), std::memory_order_relaxed);
+        event.name.store(histogram.getName(), std::memory_order_release);
+    }
+}
+
+void dumpTraces()
+{
+    std::string tracePath = getSettingsPath("amp_trace.json");
+    if (!tracePath.empty() && !writeFileAtomically(tracePath, formatChromeTrace())) {
+        logDebug("dumpTraces: failed to write " + tracePath);
+    }
+}
+
+// The dumper thread, started by the plugin's OnLoad and stopped when it unloads
+static std::mutex dumperMutex;
+static bool dumperStarted = false;
+static BackgroundTasks dumper;
+
+void startTraceDumper()
+{
+    std::lock_guard<std::mutex> lock(dumperMutex);
+    if (dumperStarted) {
+        return;
+    }
+    dumperStarted = true;
+
+    int intervalSeconds = readIntSetting(".camp_trace_interval", 0, 0, 3600);
+    if (intervalSeconds == 0) {
+        return;
+    }
+
+    logDebug("Dumping traces every " + std::to_string(intervalSeconds) + " s");
+    traceEventsEnabled = true;
+    dumper.resume();
+    dumper.start([intervalSeconds]() {
+        while (dumper.sleepFor(intervalSeconds * 1000)) {
+            dumpTraces();
+        }
+    });
+}
+
+void stopTraceDumper()
+{
+    std::lock_guard<std::mutex> lock(dumperMutex);
+    dumper.stop();
+    dumperStarted = false;
+}
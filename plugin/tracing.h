@@ -0,0 +1,74 @@
+#ifndef VDJ_TRACING_H
+#define VDJ_TRACING_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Monotonic clock in nanoseconds
+uint64_t traceNowNs();
+
+// Durations in fixed power-of-two buckets: bucket i counts spans shorter than 2^i microseconds,
+// the last one everything longer. Recording only touches atomics.
+class LatencyHistogram
+{
+public:
+    static const int kBuckets = 32;
+
+    explicit LatencyHistogram(const char* name);
+
+    void record(uint64_t durationNs);
+
+    const char* getName() const { return name; }
+    uint64_t getBucket(int index) const { return buckets[index].load(std::memory_order_relaxed); }
+    uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+    uint64_t getSumNs() const { return sumNs.load(std::memory_order_relaxed); }
+
+private:
+    const char* name;
+    std::atomic<uint64_t> buckets[kBuckets];
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sumNs{0};
+};
+
+// Histogram for a span name (a string literal), created on first use
+LatencyHistogram& getSpanHistogram(const char* name);
+
+// Add a finished span to its histogram and, while trace dumping is on, to the trace buffer
+void recordSpan(LatencyHistogram& histogram, uint64_t startNs, uint64_t durationNs);
+
+// Times the scope it lives in
+class TraceSpan
+{
+public:
+    explicit TraceSpan(LatencyHistogram& histogram) : histogram(histogram), startNs(traceNowNs()) {}
+    ~TraceSpan() { recordSpan(histogram, startNs, traceNowNs() - startNs); }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    LatencyHistogram& histogram;
+    uint64_t startNs;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+
+// Time the rest of the enclosing scope as span `name`. The histogram lookup happens once per call site.
+#define TRACE_SPAN(name) \
+    static LatencyHistogram& TRACE_CONCAT(traceHistogram, __LINE__) = getSpanHistogram(name); \
+    TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(TRACE_CONCAT(traceHistogram, __LINE__))
+
+// All span histograms in Prometheus text format
+std::string formatSpanHistograms();
+
+// Every .camp_trace_interval seconds (0, the default, turns it off) write amp_trace.json,
+// a Chrome trace of the most recent spans, to the VirtualDJ folder. Does nothing if already running.
+void startTraceDumper();
+void stopTraceDumper();
+
+// Write amp_trace.json now
+void dumpTraces();
+
+#endif // VDJ_TRACING_H
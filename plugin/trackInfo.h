@@ -0,0 +1,17 @@
+#ifndef VDJ_TRACKINFO_H
+#define VDJ_TRACKINFO_H
+
+#include <string>
+
+// Simple structure to hold track information
+struct TrackInfo {
+    std::string uniqueId;
+    std::string cacheFileName; // cacheFileNameFor(uniqueId), worked out once when parsed
+    std::string name;
+    std::string directory;
+    std::string url;
+    std::string coverUrl; // artwork on the backend, if it has any
+    int size;
+};
+
+#endif // VDJ_TRACKINFO_H
@@ -1,5 +1,6 @@
 #include "../AMP.h"
 #include "utilities.h"
+#include "metrics.h"
 
 HRESULT VDJ_API CAMP::OnLogin()
 {
@@ -11,8 +12,19 @@ HRESULT VDJ_API CAMP::OnLogin()
 HRESULT VDJ_API CAMP::OnLogout()
 {
     logDebug("OnLogout called");
-    tracksCached = false;
-    cachedTracks.clear();
+    {
+        std::lock_guard<std::mutex> lock(catalogMutex);
+        catalog.reset();
+    }
+    updateCatalogMetrics(nullptr);
+    folderCache.clear();
+    lastSearchQuery.clear();
+    lastSearchResults.clear();
+    lastSearchComplete = false;
+    searchCache.clear();
+    streamUrlCache.clear();
+    introCache.clear();
+    warmUpStarted = false; // warm up again on the next login check
     logDebug("Logout completed");
     return S_OK;
 }
@@ -21,6 +33,7 @@ HRESULT VDJ_API CAMP::OnLogout()
 HRESULT VDJ_API CAMP::IsLogged()
 {
     logDebug("IsLogged called");
+    startWarmUp();
     return  S_OK;
 }
 
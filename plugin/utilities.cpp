@@ -1,9 +1,11 @@
 #include "utilities.h"
+#include "searchIndex.h"
 #include <string>
 #include <fstream>
 #include <ctime>
 #include <cstring>
 #include <regex>
+#include <algorithm>
 
 using namespace std;
 
@@ -47,6 +49,30 @@ std::string truncateString(const std::string& str, size_t maxLength) {
     return str.substr(0, maxLength - 3) + "...";
 }
 
+// Fold case, accents and punctuation so "  Beyoncé - Halo" and "beyonce halo" compare equal
+std::string normalizeSearchQuery(const std::string& query) {
+    return foldSearchText(query);
+}
+
+// True if every word of the (normalized) query appears somewhere in text, ignoring case and accents
+bool matchesSearchQuery(const std::string& text, const std::string& normalizedQuery) {
+    // Reuse one buffer per thread instead of allocating a folded copy per candidate
+    thread_local std::string folded;
+    folded.clear();
+    foldSearchText(text.data(), text.size(), folded);
+
+    size_t start = 0;
+    while (start < normalizedQuery.size()) {
+        size_t end = normalizedQuery.find(' ', start);
+        if (end == string::npos) end = normalizedQuery.size();
+        if (!containsLowered(folded.data(), folded.size(), normalizedQuery.c_str() + start, end - start)) {
+            return false;
+        }
+        start = end + 1;
+    }
+    return true;
+}
+
 // Parse track title and artist from filename
 std::pair<std::string, std::string> parseTrackTitleAndArtist(const std::string& trackName) {
     string filename = trackName;
@@ -118,3 +144,22 @@ std::pair<std::string, std::string> parseTrackTitleAndArtist(const std::string&
     
     return make_pair(title, artist);
 }
+
+std::string cacheFileNameFor(const std::string& uniqueId) {
+    std::string fileName = uniqueId;
+    for (char& c : fileName) {
+        if (c == '/' || c == '\\' || c == '$' || c == '?' || c == '*' || c == ':' ||
+            c == '|' || c == '<' || c == '>' || c == '"' || c == '&' || c == '%') {
+            c = '_';
+        }
+    }
+    return fileName;
+}
+
+uint64_t hashString(const std::string& text) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
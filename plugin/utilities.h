@@ -2,6 +2,7 @@
 #define VDJ_UTILITIES_H
 
 #include <string>
+#include <cstdint>
 
 // Debug logging function declaration
 void logDebug(const std::string& message);
@@ -10,4 +11,15 @@ void logDebug(const std::string& message);
 std::pair<std::string, std::string> parseTrackTitleAndArtist(const std::string& trackName);
 std::string truncateString(const std::string& str, size_t maxLength);
 
+// Name of a track's file in the AMP cache folder: its uniqueId with characters that aren't safe
+// in file names replaced
+std::string cacheFileNameFor(const std::string& uniqueId);
+
+// 64-bit FNV-1a hash, for keys of on-disk caches (stable across runs and platforms)
+uint64_t hashString(const std::string& text);
+
+// Search query helpers
+std::string normalizeSearchQuery(const std::string& query);
+bool matchesSearchQuery(const std::string& text, const std::string& normalizedQuery);
+
 #endif // VDJ_UTILITIES_H 
@@ -0,0 +1,55 @@
+#include "../AMP.h"
+#include "connectionPool.h"
+#include "getFolderList.h"
+#include "settings.h"
+#include "utilities.h"
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+
+// Load everything the first callbacks need in the background, so the first search,
+// folder or deck load doesn't pay for the catalog download and connection setup.
+// Runs once per login; callers never wait for it.
+void CAMP::startWarmUp()
+{
+    if (warmUpStarted.exchange(true)) {
+        return;
+    }
+
+    logDebug("Starting background warm-up");
+    backgroundTasks.start([this]() {
+        auto start = std::chrono::steady_clock::now();
+
+        std::vector<std::thread> stages;
+        stages.emplace_back([this]() {
+            prewarmConnections(getApiBaseUrl() + "/", 4);
+            prewarmConnections(getTracksBaseUrl() + "/", 2);
+            // Play counts a previous session couldn't send
+            deferredPosts.replay([this](const std::string& url, const std::string& body) { return httpPost(url, body); });
+        });
+        stages.emplace_back([this]() {
+            buildCacheManifest();
+            metadataIndex.scanFolder(getCacheDir(), listCachedFiles());
+            integrityIndex.verifyFolder(getCacheDir(), listCachedFiles(), [this](const std::string& fileName) {
+                dropDamagedCacheFile(fileName);
+            });
+        });
+        stages.emplace_back([this]() {
+            ensureTracksAreCached();
+        });
+        stages.emplace_back([this]() {
+            folderCache.get(
+                getApiBaseUrl() + "/api/fields-db",
+                [this](const std::string& url, const std::string& etag) { return httpGetConditional(url, etag); },
+                parseFieldsJson);
+        });
+
+        for (auto& stage : stages) {
+            stage.join();
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        logDebug("Warm-up completed in " + std::to_string(elapsed.count()) + " ms");
+    });
+}